@@ -0,0 +1,648 @@
+// Microbenchmarks for the data structures, without the network in the way.
+// `make bench` builds and runs it. For each operation it reports ns/op, the
+// hardware cache misses per op (if perf counters are available) and the
+// malloc() calls per op.
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <vector>
+#include <string>
+#include "common.h"
+#include "hashtable.h"
+#include "avl.h"
+#include "heap.h"
+#include "zset.h"
+#include "hash.h"
+#include "qlist.h"
+#include "set.h"
+#include "bitops.h"
+#include "stream.h"
+
+
+/*Count the allocations by interposing the malloc family. operator new ends up in
+malloc() too, so this covers both. The __libc_* entry points are the real glibc
+allocator.*/
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+}
+static uint64_t g_allocs = 0;
+
+extern "C" void *malloc(size_t size) {
+    g_allocs++;
+    return __libc_malloc(size);
+}
+extern "C" void *calloc(size_t n, size_t size) {
+    g_allocs++;
+    return __libc_calloc(n, size);
+}
+extern "C" void *realloc(void *ptr, size_t size) {
+    g_allocs++;
+    return __libc_realloc(ptr, size);
+}
+extern "C" void free(void *ptr) {
+    __libc_free(ptr);
+}
+
+static uint64_t get_monotonic_nsec() {
+    struct timespec tv = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return uint64_t(tv.tv_sec) * 1000000000 + tv.tv_nsec;
+}
+
+// the cache miss counter of this thread, -1 if perf_event_open() is not allowed
+static int g_perf_fd = -1;
+
+static void perf_init() {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    g_perf_fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t perf_read() {
+    uint64_t val = 0;
+    if (g_perf_fd >= 0 && read(g_perf_fd, &val, sizeof(val)) != sizeof(val)) {
+        val = 0;
+    }
+    return val;
+}
+
+// one measurement: bench_begin(), run `ops` operations, bench_end()
+static struct {
+    uint64_t t0 = 0;
+    uint64_t misses0 = 0;
+    uint64_t allocs0 = 0;
+} g_bench;
+
+static void bench_begin() {
+    if (g_perf_fd >= 0) {
+        ioctl(g_perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    g_bench.misses0 = perf_read();
+    g_bench.allocs0 = g_allocs;
+    g_bench.t0 = get_monotonic_nsec();
+}
+
+// returns the nanoseconds it took
+static uint64_t bench_end(const char *name, size_t n, uint64_t ops) {
+    uint64_t t1 = get_monotonic_nsec();
+    uint64_t allocs = g_allocs - g_bench.allocs0;
+    uint64_t misses = perf_read() - g_bench.misses0;
+    if (g_perf_fd >= 0) {
+        ioctl(g_perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+    char miss_str[32] = "-";
+    if (g_perf_fd >= 0) {
+        snprintf(miss_str, sizeof(miss_str), "%.2f", (double)misses / (double)ops);
+    }
+    printf("%-26s %10zu %10.1f %12s %10.3f\n", name, n,
+        (double)(t1 - g_bench.t0) / (double)ops, miss_str, (double)allocs / (double)ops);
+    return t1 - g_bench.t0;
+}
+
+// deterministic pseudo-random numbers
+static uint64_t g_rng = 0x9E3779B97F4A7C15ull;
+static uint64_t rng_next() {
+    g_rng ^= g_rng >> 12;
+    g_rng ^= g_rng << 25;
+    g_rng ^= g_rng >> 27;
+    return g_rng * 0x2545F4914F6CDD1Dull;
+}
+
+// a shuffled permutation of [0, n)
+static std::vector<uint32_t> shuffled(size_t n) {
+    std::vector<uint32_t> v(n);
+    for (size_t i = 0; i < n; i++) {
+        v[i] = (uint32_t)i;
+    }
+    for (size_t i = n; i > 1; i--) {
+        std::swap(v[i - 1], v[rng_next() % i]);
+    }
+    return v;
+}
+
+// ---------------------------------------------------------
+// hashtable
+// ---------------------------------------------------------
+struct HEntry {
+    HNode node;
+    uint64_t key = 0;
+};
+
+static void hentry_init(HEntry *ent, uint64_t key) {
+    ent->key = key;
+    ent->node.hcode = str_hash((const uint8_t *)&key, sizeof(key));
+}
+
+static bool hentry_eq(HNode *lhs, HNode *rhs) {
+    return container_of(lhs, HEntry, node)->key == container_of(rhs, HEntry, node)->key;
+}
+
+static void bench_hmap(size_t n) {
+    std::vector<HEntry> ents(n);
+    std::vector<uint32_t> order = shuffled(n);
+    for (size_t i = 0; i < n; i++) {
+        hentry_init(&ents[i], i);
+    }
+    HMap hmap;
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        hm_insert(&hmap, &ents[order[i]].node);
+    }
+    bench_end("hm_insert", n, n);
+
+    // lookups that also move the rest of an unfinished rehash
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        HEntry key;
+        hentry_init(&key, order[i]);
+        HNode *node = hm_lookup(&hmap, &key.node, &hentry_eq);
+        assert(node);
+        (void)node;
+    }
+    bench_end("hm_lookup (hit)", n, n);
+
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        HEntry key;
+        hentry_init(&key, n + order[i]);
+        HNode *node = hm_lookup(&hmap, &key.node, &hentry_eq);
+        assert(!node);
+        (void)node;
+    }
+    bench_end("hm_lookup (miss)", n, n);
+
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        HEntry key;
+        hentry_init(&key, order[i]);
+        HNode *node = hm_delete(&hmap, &key.node, &hentry_eq);
+        assert(node);
+        (void)node;
+    }
+    bench_end("hm_delete", n, n);
+    hm_clear(&hmap);
+
+    // Lookups while a resize is in progress: fill the table up to the point where the
+    // next insert triggers the rehash, then look up until the old table is gone.
+    std::vector<HEntry> more(n * 2 + 64);
+    size_t count = 0;
+    bool triggered = false;
+    while (!triggered && count < more.size()) {
+        bool rehashing = hmap.older.tab != NULL;
+        hentry_init(&more[count], count);
+        hm_insert(&hmap, &more[count].node);
+        count++;
+        triggered = count >= n && !rehashing && hmap.older.tab;
+    }
+    if (triggered) {
+        uint64_t ops = 0;
+        bench_begin();
+        while (hmap.older.size > 0) {
+            HEntry key;
+            hentry_init(&key, rng_next() % count);
+            HNode *node = hm_lookup(&hmap, &key.node, &hentry_eq);
+            assert(node);
+            (void)node;
+            ops++;
+        }
+        bench_end("hm_lookup (rehashing)", count, ops);
+    }
+    hm_clear(&hmap);
+}
+
+// ---------------------------------------------------------
+// AVL tree
+// ---------------------------------------------------------
+struct TNode {
+    AVLNode node;
+    uint32_t val = 0;
+};
+
+static void avl_add(AVLNode **root, TNode *data) {
+    avl_init(&data->node);
+    AVLNode *cur = NULL;
+    AVLNode **from = root;
+    while (*from) {
+        cur = *from;
+        uint32_t node_val = container_of(cur, TNode, node)->val;
+        from = (data->val < node_val) ? &cur->left : &cur->right;
+    }
+    *from = &data->node;
+    data->node.parent = cur;
+    *root = avl_fix(&data->node);
+}
+
+static void bench_avl(size_t n) {
+    std::vector<TNode> nodes(n);
+    std::vector<uint32_t> order = shuffled(n);
+    AVLNode *root = NULL;
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        nodes[i].val = order[i];
+        avl_add(&root, &nodes[i]);  // search + avl_fix()
+    }
+    bench_end("avl insert + avl_fix", n, n);
+
+    // walk from the leftmost node by random offsets
+    AVLNode *first = root;
+    while (first->left) {
+        first = first->left;
+    }
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        AVLNode *node = avl_offset(first, (int64_t)order[i]);
+        assert(node);
+        (void)node;
+    }
+    bench_end("avl_offset", n, n);
+
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        root = avl_del(&nodes[i].node);
+    }
+    bench_end("avl_del", n, n);
+    assert(!root);
+}
+
+// ---------------------------------------------------------
+// heap
+// ---------------------------------------------------------
+static void bench_heap(size_t n) {
+    std::vector<size_t> refs(n);
+    std::vector<HeapItem> heap;
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        HeapItem item;
+        item.val = rng_next();
+        item.ref = &refs[i];
+        heap.push_back(item);
+        heap_update(heap.data(), heap.size() - 1, heap.size());
+    }
+    bench_end("heap push + heap_update", n, n);
+
+    // change the value of random items, like resetting a TTL
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        size_t pos = refs[rng_next() % n];
+        heap[pos].val = rng_next();
+        heap_update(heap.data(), pos, heap.size());
+    }
+    bench_end("heap_update (random)", n, n);
+}
+
+// ---------------------------------------------------------
+// zset
+// ---------------------------------------------------------
+static void bench_zset(size_t n) {
+    std::vector<uint32_t> order = shuffled(n);
+    std::vector<std::string> names(n);
+    for (size_t i = 0; i < n; i++) {
+        names[i] = "member:" + std::to_string(order[i]);
+    }
+    ZSet zset;
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        zset_insert(&zset, names[i].data(), names[i].size(), (double)order[i]);
+    }
+    bench_end("zset_insert", n, n);
+
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        ZNode *node = zset_seekge(&zset, (double)order[i], "", 0);
+        assert(node);
+        (void)node;
+    }
+    bench_end("zset_seekge", n, n);
+
+    ZNode *first = zset_seekge(&zset, -1, "", 0);
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        ZNode *node = znode_offset(first, (int64_t)order[i]);
+        assert(node);
+        (void)node;
+    }
+    bench_end("znode_offset", n, n);
+
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        ZNode *node = zset_lookup(&zset, names[i].data(), names[i].size());
+        assert(node);
+        (void)node;
+    }
+    bench_end("zset_lookup", n, n);
+    zset_clear(&zset);
+}
+
+// ---------------------------------------------------------
+// hash
+// ---------------------------------------------------------
+// `n` fields, as n / 8 small hashes in the compact encoding or as one table
+static void bench_hash(size_t n) {
+    const size_t k_small = 8;
+    std::vector<std::string> fields(n);
+    for (size_t i = 0; i < n; i++) {
+        fields[i] = "field:" + std::to_string(i);
+    }
+    std::vector<Hash> small((n + k_small - 1) / k_small);
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        hash_set(&small[i / k_small], fields[i].data(), fields[i].size(), "value", 5);
+    }
+    bench_end("hash_set (compact, 8)", n, n);
+
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        HashPair pair;
+        bool found = hash_get(&small[i / k_small], fields[i].data(), fields[i].size(), &pair);
+        assert(found);
+        (void)found;
+    }
+    bench_end("hash_get (compact, 8)", n, n);
+    for (Hash &hash : small) {
+        hash_clear(&hash);
+    }
+
+    std::vector<uint32_t> order = shuffled(n);
+    Hash table;
+    hash_to_table(&table);
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        const std::string &field = fields[order[i]];
+        hash_set(&table, field.data(), field.size(), "value", 5);
+    }
+    bench_end("hash_set (table)", n, n);
+
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        HashPair pair;
+        bool found = hash_get(&table, fields[i].data(), fields[i].size(), &pair);
+        assert(found);
+        (void)found;
+    }
+    bench_end("hash_get (table)", n, n);
+    hash_clear(&table);
+}
+
+// ---------------------------------------------------------
+// list
+// ---------------------------------------------------------
+// `n` small elements pushed at both ends, read in LRANGE-sized windows, popped
+static void bench_list(size_t n) {
+    const size_t k_window = 10;
+    QList list;
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        qlist_push(&list, i % 2 == 0, "element", 7);
+    }
+    bench_end("qlist_push", n, n);
+
+    // a window at a random offset, the seek skips whole chunks
+    std::vector<uint32_t> order = shuffled(n);
+    size_t nwin = n / k_window;
+    bench_begin();
+    for (size_t i = 0; i < nwin; i++) {
+        QIter it;
+        qlist_seek(&list, order[i] % (n - k_window + 1), &it);
+        for (size_t j = 0; j < k_window; j++) {
+            QElem elem;
+            bool found = qlist_next(&list, &it, &elem);
+            assert(found);
+            (void)found;
+        }
+    }
+    bench_end("qlist_seek + 10 next", n, nwin);
+
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        qlist_pop(&list, i % 2 == 0);
+    }
+    bench_end("qlist_pop", n, n);
+    assert(list.count == 0);
+}
+
+// ---------------------------------------------------------
+// stream
+// ---------------------------------------------------------
+static bool cb_count(const SEntry &, void *arg) {
+    return --*(size_t *)arg > 0;
+}
+
+// entries of 2 small fields at increasing IDs, with the bytes per entry next to a zset's
+static void bench_stream(size_t n) {
+    const size_t k_window = 10;
+    const std::string_view fields[4] = {"field", "value", "other", "12345"};
+    Stream stream;
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        stream_append(&stream, StreamID{1000 + i / 4, i % 4}, fields, 4, 4096, 100);
+    }
+    bench_end("stream_append", n, n);
+    ZSet zset;
+    for (size_t i = 0; i < n; i++) {
+        std::string name = std::to_string(1000 + i / 4) + "-" + std::to_string(i % 4);
+        zset_insert(&zset, name.data(), name.size(), (double)i);
+    }
+    printf("%-26s %10s %10.1f B/entry (zset %.1f)\n", "", "",
+        (double)stream_mem(&stream) / (double)n, (double)zset_mem(&zset) / (double)n);
+    zset_clear(&zset);
+
+    // a window from a random ID: one tree seek, then a scan of the block
+    std::vector<uint32_t> order = shuffled(n);
+    size_t nwin = n / k_window;
+    bench_begin();
+    for (size_t i = 0; i < nwin; i++) {
+        size_t at = order[i] % (n - k_window + 1);
+        size_t left = k_window;
+        stream_range(&stream, StreamID{1000 + at / 4, at % 4}, StreamID{UINT64_MAX, UINT64_MAX},
+            false, &cb_count, &left);
+        assert(left == 0);
+    }
+    bench_end("stream_range 10 entries", n, nwin);
+
+    bench_begin();
+    size_t all = n + 1;
+    stream_range(&stream, StreamID{}, StreamID{UINT64_MAX, UINT64_MAX}, false, &cb_count, &all);
+    assert(all == 1);
+    bench_end("stream_range (all)", n, n);
+
+    bench_begin();
+    for (size_t i = 0; i < n; i += 100) {
+        stream_trim(&stream, n - std::min(n, i + 100), StreamID{}, false);
+    }
+    bench_end("stream_trim (100)", n, n);
+    assert(stream.count == 0);
+    stream_clear(&stream);
+}
+
+// ---------------------------------------------------------
+// set
+// ---------------------------------------------------------
+/*Two sets of about `n` members each from 0..2n, half of them in common. The intersection as
+intset merges (scalar and SIMD) against the tag-as-zset workaround, which walks one zset and
+looks each name up in the other. Ops are members of both inputs.*/
+static void bench_set(size_t n) {
+    std::vector<int64_t> a, b;
+    for (size_t i = 0; i < 2 * n; i++) {
+        if (rng_next() % 2) {
+            a.push_back((int64_t)i);
+        }
+        if (rng_next() % 2) {
+            b.push_back((int64_t)i);
+        }
+    }
+    size_t ops = a.size() + b.size();
+    std::vector<int64_t> out(std::min(a.size(), b.size()));
+    size_t rounds = std::max((size_t)1, (size_t)(1 << 20) / ops);    // enough work to time
+
+    bench_begin();
+    size_t expect = 0;
+    for (size_t r = 0; r < rounds; r++) {
+        expect = intset_intersect_scalar(a.data(), a.size(), b.data(), b.size(), out.data());
+    }
+    bench_end("sinter (intset, scalar)", n, ops * rounds);
+
+    bench_begin();
+    for (size_t r = 0; r < rounds; r++) {
+        size_t got = intset_intersect(a.data(), a.size(), b.data(), b.size(), out.data());
+        assert(got == expect);
+        (void)got;
+    }
+    bench_end("sinter (intset, dispatch)", n, ops * rounds);
+
+    ZSet za, zb;
+    for (int64_t val : a) {
+        std::string name = std::to_string(val);
+        zset_insert(&za, name.data(), name.size(), 0);
+    }
+    for (int64_t val : b) {
+        std::string name = std::to_string(val);
+        zset_insert(&zb, name.data(), name.size(), 0);
+    }
+    bench_begin();
+    for (size_t r = 0; r < rounds; r++) {
+        size_t got = 0;
+        for (ZNode *node = zset_seekge(&za, 0, "", 0); node; node = znode_offset(node, +1)) {
+            got += zset_lookup(&zb, node->name, node->len) != NULL;
+        }
+        assert(got == expect);
+        (void)got;
+    }
+    bench_end("sinter (zset workaround)", n, ops * rounds);
+    zset_clear(&za);
+    zset_clear(&zb);
+
+    // the table encoding, for members that are not integers
+    std::vector<std::string> names(n);
+    for (size_t i = 0; i < n; i++) {
+        names[i] = "tag:" + std::to_string(i);
+    }
+    Set table;
+    set_to_table(&table);
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        set_add(&table, names[i].data(), names[i].size());
+    }
+    bench_end("set_add (table)", n, n);
+
+    bench_begin();
+    for (size_t i = 0; i < n; i++) {
+        bool found = set_has(&table, names[i].data(), names[i].size());
+        assert(found);
+        (void)found;
+    }
+    bench_end("set_has (table)", n, n);
+    set_clear(&table);
+}
+
+// ---------------------------------------------------------
+// bitmaps
+// ---------------------------------------------------------
+/*A bitmap of 16 bytes per n, so 1M is 16MB and doesn't fit in the cache. An op is a byte, and the
+throughput is printed under each line as well, since that's how BITCOUNT is usually quoted.*/
+static void bench_bits(size_t n) {
+    static const char *const names[] = {"scalar", "popcnt", "avx2"};
+    size_t len = n * 16;
+    std::vector<uint8_t> a(len), b(len);
+    for (size_t i = 0; i < len; i++) {
+        a[i] = (uint8_t)rng_next();
+        b[i] = (uint8_t)rng_next();
+    }
+    size_t rounds = std::max((size_t)1, (size_t)(64 << 20) / len);
+    uint64_t expect = bit_count_with(BIT_KERNEL_SCALAR, a.data(), len);
+    for (uint32_t kernel = BIT_KERNEL_SCALAR; kernel <= BIT_KERNEL_AVX2; kernel++) {
+        if (!bit_kernel_supported(kernel)) {
+            continue;
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "bitcount (%s)", names[kernel]);
+        bench_begin();
+        for (size_t r = 0; r < rounds; r++) {
+            uint64_t got = bit_count_with(kernel, a.data(), len);
+            assert(got == expect);
+            (void)got;
+        }
+        uint64_t ns = bench_end(name, n, len * rounds);
+        printf("%-26s %10s %10.2f GB/s\n", "", "", (double)(len * rounds) / (double)ns);
+    }
+    for (uint32_t kernel : {(uint32_t)BIT_KERNEL_SCALAR, (uint32_t)BIT_KERNEL_AVX2}) {
+        if (!bit_kernel_supported(kernel)) {
+            continue;
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "bitop xor (%s)", names[kernel]);
+        bench_begin();
+        for (size_t r = 0; r < rounds; r++) {
+            bit_combine_with(kernel, BITOP_XOR, a.data(), b.data(), len);
+        }
+        uint64_t ns = bench_end(name, n, len * rounds);
+        printf("%-26s %10s %10.2f GB/s\n", "", "", (double)(len * rounds) / (double)ns);
+    }
+}
+
+int main(int argc, char **argv) {
+    // optional: the sizes to run, default 1K 64K 1M
+    std::vector<size_t> sizes;
+    for (int i = 1; i < argc; i++) {
+        sizes.push_back((size_t)strtoull(argv[i], NULL, 10));
+    }
+    if (sizes.empty()) {
+        sizes = {1 << 10, 1 << 16, 1 << 20};
+    }
+    perf_init();
+    if (g_perf_fd < 0) {
+        printf("(perf counters are not available, no cache misses)\n");
+    }
+    printf("%-26s %10s %10s %12s %10s\n", "op", "n", "ns/op", "misses/op", "allocs/op");
+    for (size_t n : sizes) {
+        if (n == 0) {
+            continue;
+        }
+        bench_hmap(n);
+        bench_avl(n);
+        bench_heap(n);
+        bench_zset(n);
+        bench_hash(n);
+        bench_list(n);
+        bench_stream(n);
+        bench_set(n);
+        bench_bits(n);
+        printf("\n");
+    }
+    return 0;
+}
@@ -2,16 +2,34 @@
 #include <vector>
 #include <string>
 #include <chrono>
+#include <thread>
+#include <map>
+#include <algorithm>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <string.h>
+#include <stdlib.h>
 
 static void buf_append(std::vector<uint8_t> &buf, const uint8_t *data, size_t len) {
     buf.insert(buf.end(), data, data + len);
 }
 
-static void pack_command(std::vector<uint8_t> &buf, const std::vector<std::string> &args) {
+// --resp 1: talk RESP instead of the TLV protocol, to compare the two
+static bool g_resp = false;
+
+static void pack_resp_command(std::vector<uint8_t> &buf, const std::vector<std::string> &args) {
+    std::string head = "*" + std::to_string(args.size()) + "\r\n";
+    buf_append(buf, (const uint8_t *)head.data(), head.size());
+    for (const std::string &s : args) {
+        head = "$" + std::to_string(s.size()) + "\r\n";
+        buf_append(buf, (const uint8_t *)head.data(), head.size());
+        buf_append(buf, (const uint8_t *)s.data(), s.size());
+        buf_append(buf, (const uint8_t *)"\r\n", 2);
+    }
+}
+
+static void pack_tlv_command(std::vector<uint8_t> &buf, const std::vector<std::string> &args) {
     uint32_t body_len = 4;
     for (const std::string &s : args) {
         body_len += 4 + s.size(); 
@@ -26,6 +44,13 @@ static void pack_command(std::vector<uint8_t> &buf, const std::vector<std::strin
     }
 }
 
+static void pack_command(std::vector<uint8_t> &buf, const std::vector<std::string> &args) {
+    if (g_resp) {
+        return pack_resp_command(buf, args);
+    }
+    pack_tlv_command(buf, args);
+}
+
 void run_benchmark(int fd, const std::string& test_name, const std::vector<uint8_t>& write_buf, size_t expected_response_bytes, int num_requests) {
     std::cout << "Starting " << test_name << " Benchmark...\n";
     auto start_time = std::chrono::high_resolution_clock::now();
@@ -61,7 +86,63 @@ void run_benchmark(int fd, const std::string& test_name, const std::vector<uint8
     std::cout << "  -> Throughput: " << rps << " RPS\n\n";
 }
 
-int main() {
+// GET throughput by value size. Requests go out in batches of `depth` so that
+// neither side blocks on a full socket buffer with big values.
+void run_value_size_benchmark(int fd, size_t value_size, int num_requests, int depth) {
+    std::vector<uint8_t> set_buf;
+    pack_command(set_buf, {"set", "big_key", std::string(value_size, 'v')});
+    size_t written = 0;
+    while (written < set_buf.size()) {
+        ssize_t rv = write(fd, set_buf.data() + written, set_buf.size() - written);
+        if (rv <= 0) {
+            std::cerr << "Write error\n";
+            return;
+        }
+        written += rv;
+    }
+    char nil_resp[5];   // the same size in RESP: $-1\r\n
+    if (read(fd, nil_resp, sizeof(nil_resp)) != (ssize_t)sizeof(nil_resp)) {
+        std::cerr << "Read error\n";
+        return;
+    }
+
+    std::vector<uint8_t> batch;
+    for (int i = 0; i < depth; i++) {
+        pack_command(batch, {"get", "big_key"});
+    }
+    // 4 byte header + 1 byte tag + 4 byte str_len + the value,
+    // or $<len>\r\n<value>\r\n in RESP
+    size_t resp_size = g_resp
+        ? 1 + std::to_string(value_size).size() + 2 + value_size + 2
+        : 4 + 1 + 4 + value_size;
+    std::vector<char> read_buf(1 << 20);
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (int done = 0; done < num_requests; done += depth) {
+        if (write(fd, batch.data(), batch.size()) != (ssize_t)batch.size()) {
+            std::cerr << "Write error\n";
+            return;
+        }
+        size_t total_read = 0;
+        while (total_read < resp_size * depth) {
+            ssize_t rv = read(fd, read_buf.data(), read_buf.size());
+            if (rv <= 0) {
+                std::cerr << "Read error\n";
+                return;
+            }
+            total_read += rv;
+        }
+    }
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = end_time - start_time;
+    int total = (num_requests + depth - 1) / depth * depth;
+    double rps = total / elapsed.count();
+    double mbps = rps * value_size / (1 << 20);
+    std::cout << "  -> GET " << value_size / 1024 << "KB: " << rps << " RPS, "
+        << mbps << " MB/s\n";
+}
+
+static int connect_server() {
     int fd = socket(AF_INET, SOCK_STREAM, 0);
     struct sockaddr_in addr = {};
     addr.sin_family = AF_INET;
@@ -69,6 +150,265 @@ int main() {
     addr.sin_addr.s_addr = ntohl(INADDR_LOOPBACK); 
     
     if (connect(fd, (const struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool read_full(int fd, uint8_t *buf, size_t n) {
+    while (n > 0) {
+        ssize_t rv = read(fd, buf, n);
+        if (rv <= 0) {
+            return false;
+        }
+        buf += rv;
+        n -= rv;
+    }
+    return true;
+}
+
+// the integer fields of `info stats`, `fd` is a TLV connection
+static std::map<std::string, int64_t> read_stats(int fd) {
+    std::map<std::string, int64_t> stats;
+    std::vector<uint8_t> req;
+    pack_tlv_command(req, {"info", "stats"});
+    if (write(fd, req.data(), req.size()) != (ssize_t)req.size()) {
+        return stats;
+    }
+    uint32_t len = 0;
+    if (!read_full(fd, (uint8_t *)&len, 4)) {
+        return stats;
+    }
+    std::vector<uint8_t> resp(len);
+    if (!read_full(fd, resp.data(), len) || len < 5 || resp[0] != 5) {
+        return stats;
+    }
+    // (arr) of (str) name, (int) value pairs
+    size_t pos = 5;
+    std::string name;
+    while (pos < len) {
+        uint8_t tag = resp[pos++];
+        if (tag == 2) {
+            uint32_t n = 0;
+            memcpy(&n, &resp[pos], 4);
+            name.assign((const char *)&resp[pos + 4], n);
+            pos += 4 + n;
+        } else if (tag == 3 || tag == 4) {
+            int64_t val = 0;
+            memcpy(&val, &resp[pos], 8);
+            pos += 8;
+            if (tag == 3) {
+                stats[name] = val;
+            }
+        } else {
+            break;
+        }
+    }
+    return stats;
+}
+
+// Many connections, each one pipelining `depth` small GETs at a time, either in one
+// write() or (`split`) one write() per request. Reports the throughput and the
+// server's read/write syscalls per request from INFO.
+static int run_multi_client(int num_clients, int depth, bool split, int num_requests) {
+    int ctl = connect_server();
+    if (ctl < 0) {
+        std::cerr << "Failed to connect to server!\n";
+        return 1;
+    }
+    std::vector<uint8_t> set_buf;
+    pack_tlv_command(set_buf, {"set", "mc_key", "bench_value"});
+    uint8_t nil_resp[5];
+    if (write(ctl, set_buf.data(), set_buf.size()) != (ssize_t)set_buf.size()
+        || !read_full(ctl, nil_resp, sizeof(nil_resp)))
+    {
+        std::cerr << "SET error\n";
+        return 1;
+    }
+
+    std::vector<int> fds;
+    for (int i = 0; i < num_clients; i++) {
+        int fd = connect_server();
+        if (fd < 0) {
+            std::cerr << "Failed to connect to server!\n";
+            return 1;
+        }
+        fds.push_back(fd);
+    }
+    std::vector<uint8_t> batch;
+    for (int i = 0; i < depth; i++) {
+        pack_command(batch, {"get", "mc_key"});
+    }
+    size_t req_bytes = batch.size() / depth;
+    size_t write_size = split ? req_bytes : batch.size();
+    size_t resp_bytes = (size_t)depth * (g_resp ? 18 : 20);     // see the GET benchmark above
+    int rounds = num_requests / num_clients / depth;
+
+    std::cout << "Starting GET (" << num_clients << " clients, depth " << depth
+        << (split ? ", split writes" : "") << ") Benchmark...\n";
+    std::map<std::string, int64_t> before = read_stats(ctl);
+    auto start_time = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> threads;
+    for (int fd : fds) {
+        threads.emplace_back([&, fd]() {
+            std::vector<uint8_t> resp(resp_bytes);
+            for (int r = 0; r < rounds; r++) {
+                for (size_t off = 0; off < batch.size(); off += write_size) {
+                    if (write(fd, &batch[off], write_size) != (ssize_t)write_size) {
+                        std::cerr << "Write error\n";
+                        return;
+                    }
+                }
+                if (!read_full(fd, resp.data(), resp.size())) {
+                    std::cerr << "Read error\n";
+                    return;
+                }
+            }
+        });
+    }
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::map<std::string, int64_t> after = read_stats(ctl);
+
+    std::chrono::duration<double> elapsed = end_time - start_time;
+    double total = (double)rounds * depth * num_clients;
+    double reads = (double)(after["read_calls"] - before["read_calls"]);
+    double writes = (double)(after["write_calls"] - before["write_calls"]);
+    std::cout << "  -> " << (int64_t)total << " requests in " << elapsed.count() << " seconds.\n";
+    std::cout << "  -> Throughput: " << total / elapsed.count() << " RPS\n";
+    std::cout << "  -> Server syscalls per request: read " << reads / total
+        << ", write " << writes / total << "\n\n";
+    for (int fd : fds) {
+        close(fd);
+    }
+    close(ctl);
+    return 0;
+}
+
+static bool write_full(int fd, const uint8_t *buf, size_t n) {
+    while (n > 0) {
+        ssize_t rv = write(fd, buf, n);
+        if (rv <= 0) {
+            return false;
+        }
+        buf += rv;
+        n -= rv;
+    }
+    return true;
+}
+
+// Reading 100 random keys out of `num_keys`: one MGET against 100 pipelined GETs.
+// Both are one write and one round trip, the difference is the per-request framing
+// and dispatch, and MGET overlapping the cache misses of its lookups.
+static int run_mget_benchmark(int64_t num_keys, int num_rounds) {
+    const int k_batch = 100;
+    const std::string value = "val_" + std::string(4, 'x');    // 8 bytes
+    int fd = connect_server();
+    if (fd < 0) {
+        std::cerr << "Failed to connect to server!\n";
+        return 1;
+    }
+    auto key_name = [](int64_t i) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "mkey:%012lld", (long long)i);
+        return std::string(buf);
+    };
+
+    std::cout << "Loading " << num_keys << " keys...\n";
+    const int64_t k_mset_keys = 1000;
+    const int k_mset_depth = 16;
+    std::vector<uint8_t> nil_resp(k_mset_depth * 5);   // $-1\r\n in RESP, also 5 bytes
+    for (int64_t i = 0; i < num_keys; ) {
+        std::vector<uint8_t> buf;
+        int reqs = 0;
+        for (; reqs < k_mset_depth && i < num_keys; reqs++) {
+            std::vector<std::string> args = {"mset"};
+            for (int64_t end = std::min(num_keys, i + k_mset_keys); i < end; i++) {
+                args.push_back(key_name(i));
+                args.push_back(value);
+            }
+            pack_command(buf, args);
+        }
+        if (!write_full(fd, buf.data(), buf.size()) || !read_full(fd, nil_resp.data(), reqs * 5)) {
+            std::cerr << "MSET error\n";
+            return 1;
+        }
+    }
+
+    // fixed size responses: TLV str = 4 + 1 + 4 + 8, RESP $8\r\n<8 bytes>\r\n = 14
+    size_t get_resp = g_resp ? 14 : 17;
+    size_t mget_resp = g_resp
+        ? std::string("*" + std::to_string(k_batch) + "\r\n").size() + k_batch * 14
+        : 4 + 1 + 4 + k_batch * (1 + 4 + 8);
+    uint64_t rng = 88172645463325252ull;
+    std::vector<uint8_t> resp(std::max(mget_resp, get_resp * k_batch));
+    for (int mode = 0; mode < 2; mode++) {
+        auto start_time = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < num_rounds; r++) {
+            std::vector<std::string> keys;
+            for (int i = 0; i < k_batch; i++) {
+                rng ^= rng << 13;
+                rng ^= rng >> 7;
+                rng ^= rng << 17;
+                keys.push_back(key_name((int64_t)(rng % (uint64_t)num_keys)));
+            }
+            std::vector<uint8_t> buf;
+            if (mode == 0) {
+                keys.insert(keys.begin(), "mget");
+                pack_command(buf, keys);
+            } else {
+                for (const std::string &key : keys) {
+                    pack_command(buf, {"get", key});
+                }
+            }
+            size_t want = mode == 0 ? mget_resp : get_resp * k_batch;
+            if (!write_full(fd, buf.data(), buf.size()) || !read_full(fd, resp.data(), want)) {
+                std::cerr << "Read error\n";
+                return 1;
+            }
+        }
+        auto end_time = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> elapsed = end_time - start_time;
+        std::cout << "  -> " << (mode == 0 ? "MGET of 100 keys:   " : "100 pipelined GETs: ")
+            << elapsed.count() / num_rounds * 1e6 << " us per batch, "
+            << num_rounds * k_batch / elapsed.count() << " keys/s\n";
+    }
+    close(fd);
+    return 0;
+}
+
+// usage: benchmark [--clients N [--depth D] [--split 1]] [--mget-keys N] [--resp 1]
+int main(int argc, char **argv) {
+    int num_clients = 0;
+    int depth = 16;
+    bool split = false;
+    int64_t mget_keys = 0;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--clients") {
+            num_clients = atoi(argv[i + 1]);
+        } else if (arg == "--depth") {
+            depth = atoi(argv[i + 1]);
+        } else if (arg == "--split") {
+            split = atoi(argv[i + 1]) != 0;
+        } else if (arg == "--mget-keys") {
+            mget_keys = atoll(argv[i + 1]);     // 50000000 for the full size run
+        } else if (arg == "--resp") {
+            g_resp = atoi(argv[i + 1]) != 0;
+        }
+    }
+    if (num_clients > 0 && depth > 0) {
+        return run_multi_client(num_clients, depth, split, 2000000);
+    }
+    if (mget_keys > 0) {
+        return run_mget_benchmark(mget_keys, 20000);
+    }
+
+    int fd = connect_server();
+    if (fd < 0) {
         std::cerr << "Failed to connect to server!\n";
         return 1;
     }
@@ -81,6 +421,7 @@ int main() {
         pack_command(set_buf, {"set", "key_" + std::to_string(i), "bench_value"});
     }
     // SET returns NIL (TAG_NIL). 4 byte header + 1 byte tag = 5 bytes per response.
+    // RESP: $-1\r\n, also 5 bytes.
     run_benchmark(fd, "SET (Write)", set_buf, num_requests * 5, num_requests);
 
 
@@ -90,7 +431,8 @@ int main() {
         pack_command(get_buf, {"get", "key_" + std::to_string(i)});
     }
     // GET returns STR. 4 byte header + 1 byte tag + 4 byte str_len + 11 byte string ("bench_value") = 20 bytes.
-    run_benchmark(fd, "GET (Read)", get_buf, num_requests * 20, num_requests);
+    // RESP: $11\r\nbench_value\r\n = 18 bytes.
+    run_benchmark(fd, "GET (Read)", get_buf, num_requests * (g_resp ? 18 : 20), num_requests);
 
 
     // --- 3. ZADD BENCHMARK ---
@@ -99,8 +441,17 @@ int main() {
         // zadd scores 1.0 player_1, 2.0 player_2, etc.
         pack_command(zadd_buf, {"zadd", "leaderboard", std::to_string(i) + ".0", "player_" + std::to_string(i)});
     }
-    // ZADD returns INT. 4 byte header + 1 byte tag + 8 byte int = 13 bytes.
-    run_benchmark(fd, "ZADD (Sorted Set)", zadd_buf, num_requests * 13, num_requests);
+    // ZADD returns INT. 4 byte header + 1 byte tag + 8 byte int = 13 bytes. RESP: :1\r\n = 4 bytes.
+    run_benchmark(fd, "ZADD (Sorted Set)", zadd_buf, num_requests * (g_resp ? 4 : 13), num_requests);
+
+    // --- 4. GET BY VALUE SIZE ---
+    std::cout << "Starting GET (Value Size) Benchmark...\n";
+    for (size_t size = 1024; size <= (1 << 20); size *= 4) {
+        // move about 1GB per size
+        int n = (int)std::min<size_t>(num_requests, (1 << 30) / size);
+        run_value_size_benchmark(fd, size, n, 16);
+    }
+    std::cout << "\n";
 
     close(fd);
     return 0;
@@ -0,0 +1,188 @@
+#include <string.h>
+#include <immintrin.h>
+// proj
+#include "bitops.h"
+
+
+// ---------------------------------------------------------
+// counting
+// ---------------------------------------------------------
+static uint64_t popcount_swar(uint64_t x) {
+    x = x - ((x >> 1) & 0x5555555555555555ull);
+    x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return (x * 0x0101010101010101ull) >> 56;
+}
+
+static uint64_t load_u64(const uint8_t *p) {
+    uint64_t w = 0;
+    memcpy(&w, p, 8);
+    return w;
+}
+
+// the last partial word, zero-padded
+static uint64_t load_tail(const uint8_t *p, size_t n) {
+    uint64_t w = 0;
+    memcpy(&w, p, n);
+    return w;
+}
+
+static uint64_t count_scalar(const uint8_t *data, size_t len) {
+    uint64_t n = 0;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        n += popcount_swar(load_u64(data + i));
+    }
+    return n + popcount_swar(load_tail(data + i, len - i));
+}
+
+// 4 independent sums, so the popcnt latencies overlap
+__attribute__((target("popcnt")))
+static uint64_t count_popcnt(const uint8_t *data, size_t len) {
+    uint64_t n0 = 0, n1 = 0, n2 = 0, n3 = 0;
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        n0 += (uint64_t)__builtin_popcountll(load_u64(data + i));
+        n1 += (uint64_t)__builtin_popcountll(load_u64(data + i + 8));
+        n2 += (uint64_t)__builtin_popcountll(load_u64(data + i + 16));
+        n3 += (uint64_t)__builtin_popcountll(load_u64(data + i + 24));
+    }
+    for (; i + 8 <= len; i += 8) {
+        n0 += (uint64_t)__builtin_popcountll(load_u64(data + i));
+    }
+    n0 += (uint64_t)__builtin_popcountll(load_tail(data + i, len - i));
+    return n0 + n1 + n2 + n3;
+}
+
+/*Mula's method: the count of each nibble is looked up with a byte shuffle, the byte counts add up
+in 8-bit lanes for a few blocks (at most 8 per byte per block, so 31 blocks can't overflow),
+then _mm256_sad_epu8 widens them into four 64-bit sums.*/
+__attribute__((target("avx2,popcnt")))
+static uint64_t count_avx2(const uint8_t *data, size_t len) {
+    const __m256i lookup = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low4 = _mm256_set1_epi8(0x0f);
+    const size_t k_blocks = 31;
+    __m256i total = _mm256_setzero_si256();
+    size_t i = 0;
+    while (i + 32 <= len) {
+        __m256i bytes = _mm256_setzero_si256();
+        for (size_t b = 0; b < k_blocks && i + 32 <= len; b++, i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+            __m256i lo = _mm256_and_si256(v, low4);
+            __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low4);
+            bytes = _mm256_add_epi8(bytes, _mm256_shuffle_epi8(lookup, lo));
+            bytes = _mm256_add_epi8(bytes, _mm256_shuffle_epi8(lookup, hi));
+        }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+    }
+    uint64_t n = (uint64_t)_mm256_extract_epi64(total, 0) + (uint64_t)_mm256_extract_epi64(total, 1)
+        + (uint64_t)_mm256_extract_epi64(total, 2) + (uint64_t)_mm256_extract_epi64(total, 3);
+    return n + count_popcnt(data + i, len - i);
+}
+
+// ---------------------------------------------------------
+// combining
+// ---------------------------------------------------------
+template <uint32_t op>
+static void combine_scalar(uint8_t *dst, const uint8_t *src, size_t len) {
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t a = load_u64(dst + i);
+        uint64_t b = op == BITOP_NOT ? 0 : load_u64(src + i);
+        a = op == BITOP_AND ? a & b : op == BITOP_OR ? a | b : op == BITOP_XOR ? a ^ b : ~a;
+        memcpy(dst + i, &a, 8);
+    }
+    for (; i < len; i++) {
+        uint8_t a = dst[i];
+        uint8_t b = op == BITOP_NOT ? 0 : src[i];
+        dst[i] = (uint8_t)(op == BITOP_AND ? a & b : op == BITOP_OR ? a | b : op == BITOP_XOR ? a ^ b : ~a);
+    }
+}
+
+template <uint32_t op>
+__attribute__((target("avx2")))
+static void combine_avx2(uint8_t *dst, const uint8_t *src, size_t len) {
+    const __m256i ones = _mm256_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i b = op == BITOP_NOT ? ones : _mm256_loadu_si256((const __m256i *)(src + i));
+        a = op == BITOP_AND ? _mm256_and_si256(a, b) : op == BITOP_OR ? _mm256_or_si256(a, b)
+            : _mm256_xor_si256(a, b);   // NOT is a XOR with ones
+        _mm256_storeu_si256((__m256i *)(dst + i), a);
+    }
+    combine_scalar<op>(dst + i, op == BITOP_NOT ? src : src + i, len - i);
+}
+
+template <uint32_t op>
+static void combine_with(uint32_t kernel, uint8_t *dst, const uint8_t *src, size_t len) {
+    if (kernel == BIT_KERNEL_AVX2) {
+        combine_avx2<op>(dst, src, len);
+    } else {
+        combine_scalar<op>(dst, src, len);  // POPCNT has nothing to add here
+    }
+}
+
+// ---------------------------------------------------------
+// dispatch
+// ---------------------------------------------------------
+bool bit_kernel_supported(uint32_t kernel) {
+    switch (kernel) {
+    case BIT_KERNEL_SCALAR: return true;
+    case BIT_KERNEL_POPCNT: return __builtin_cpu_supports("popcnt");
+    case BIT_KERNEL_AVX2:   return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+    }
+    return false;
+}
+
+static uint32_t best_kernel() {
+    static const uint32_t kernel = bit_kernel_supported(BIT_KERNEL_AVX2) ? BIT_KERNEL_AVX2
+        : bit_kernel_supported(BIT_KERNEL_POPCNT) ? BIT_KERNEL_POPCNT : BIT_KERNEL_SCALAR;
+    return kernel;
+}
+
+uint64_t bit_count_with(uint32_t kernel, const uint8_t *data, size_t len) {
+    switch (kernel) {
+    case BIT_KERNEL_AVX2:   return count_avx2(data, len);
+    case BIT_KERNEL_POPCNT: return count_popcnt(data, len);
+    default:                return count_scalar(data, len);
+    }
+}
+
+uint64_t bit_count(const uint8_t *data, size_t len) {
+    return bit_count_with(best_kernel(), data, len);
+}
+
+void bit_combine_with(uint32_t kernel, uint32_t op, uint8_t *dst, const uint8_t *src, size_t len) {
+    switch (op) {
+    case BITOP_AND: return combine_with<BITOP_AND>(kernel, dst, src, len);
+    case BITOP_OR:  return combine_with<BITOP_OR>(kernel, dst, src, len);
+    case BITOP_XOR: return combine_with<BITOP_XOR>(kernel, dst, src, len);
+    case BITOP_NOT: return combine_with<BITOP_NOT>(kernel, dst, src, len);
+    }
+}
+
+void bit_combine(uint32_t op, uint8_t *dst, const uint8_t *src, size_t len) {
+    bit_combine_with(best_kernel(), op, dst, src, len);
+}
+
+// ---------------------------------------------------------
+// searching
+// ---------------------------------------------------------
+int64_t bit_pos(const uint8_t *data, size_t len, bool bit) {
+    // skip the bytes that have none of it, a word at a time
+    uint64_t skip = bit ? 0 : ~0ull;
+    size_t i = 0;
+    while (i + 8 <= len && load_u64(data + i) == skip) {
+        i += 8;
+    }
+    for (; i < len; i++) {
+        uint8_t byte = bit ? data[i] : (uint8_t)~data[i];
+        if (byte) {
+            return (int64_t)(i * 8 + (size_t)__builtin_clz(byte) - 24);
+        }
+    }
+    return -1;
+}
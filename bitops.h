@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*Bitmap kernels for the bit commands on strings. Bit 0 is the most significant bit of byte 0,
+like Redis. Counting and combining have AVX2 and POPCNT versions, picked once at runtime from
+what the CPU supports, and portable versions to fall back on.*/
+enum {
+    BITOP_AND = 0,
+    BITOP_OR  = 1,
+    BITOP_XOR = 2,
+    BITOP_NOT = 3,
+};
+enum {
+    BIT_KERNEL_SCALAR = 0,
+    BIT_KERNEL_POPCNT = 1,
+    BIT_KERNEL_AVX2   = 2,
+};
+
+uint64_t bit_count(const uint8_t *data, size_t len);
+// dst = dst op src, byte by byte; BITOP_NOT ignores `src`
+void     bit_combine(uint32_t op, uint8_t *dst, const uint8_t *src, size_t len);
+// the offset of the first bit equal to `bit`, -1 if there is none
+int64_t  bit_pos(const uint8_t *data, size_t len, bool bit);
+
+// a specific kernel, for tests and benchmarks
+bool     bit_kernel_supported(uint32_t kernel);
+uint64_t bit_count_with(uint32_t kernel, const uint8_t *data, size_t len);
+void     bit_combine_with(uint32_t kernel, uint32_t op, uint8_t *dst, const uint8_t *src, size_t len);
@@ -0,0 +1,337 @@
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include "client_lib.h"
+
+
+int64_t reply_parse(const uint8_t *data, size_t size, Reply *out) {
+    if (size < 1) {
+        return -1;
+    }
+    *out = Reply{};
+    out->tag = data[0];
+    uint32_t len = 0;
+    switch (data[0]) {
+    case TAG_NIL:
+        return 1;
+    case TAG_ERR:
+        if (size < 1 + 8) {
+            return -1;
+        }
+        memcpy(&out->code, &data[1], 4);
+        memcpy(&len, &data[1 + 4], 4);
+        if (size < 1 + 8 + (size_t)len) {
+            return -1;
+        }
+        out->str = std::string_view((const char *)&data[1 + 8], len);
+        return 1 + 8 + (int64_t)len;
+    case TAG_STR:
+        if (size < 1 + 4) {
+            return -1;
+        }
+        memcpy(&len, &data[1], 4);
+        if (size < 1 + 4 + (size_t)len) {
+            return -1;
+        }
+        out->str = std::string_view((const char *)&data[1 + 4], len);
+        return 1 + 4 + (int64_t)len;
+    case TAG_INT:
+        if (size < 1 + 8) {
+            return -1;
+        }
+        memcpy(&out->num, &data[1], 8);
+        return 1 + 8;
+    case TAG_DBL:
+        if (size < 1 + 8) {
+            return -1;
+        }
+        memcpy(&out->dbl, &data[1], 8);
+        return 1 + 8;
+    case TAG_ARR: {
+        if (size < 1 + 4) {
+            return -1;
+        }
+        memcpy(&out->len, &data[1], 4);
+        // find the end of the elements
+        size_t pos = 1 + 4;
+        for (uint32_t i = 0; i < out->len; i++) {
+            Reply elem;
+            int64_t rv = reply_parse(&data[pos], size - pos, &elem);
+            if (rv < 0) {
+                return -1;
+            }
+            pos += (size_t)rv;
+        }
+        out->elems = std::string_view((const char *)&data[1 + 4], pos - (1 + 4));
+        return (int64_t)pos;
+    }
+    default:
+        return -1;
+    }
+}
+
+bool reply_next(const Reply &arr, size_t *pos, Reply *elem) {
+    if (arr.tag != TAG_ARR || *pos >= arr.elems.size()) {
+        return false;
+    }
+    // already validated by reply_parse()
+    int64_t rv = reply_parse(
+        (const uint8_t *)arr.elems.data() + *pos, arr.elems.size() - *pos, elem);
+    assert(rv > 0);
+    *pos += (size_t)rv;
+    return true;
+}
+
+static uint64_t get_monotonic_msec() {
+    struct timespec tv = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return uint64_t(tv.tv_sec) * 1000 + tv.tv_nsec / 1000 / 1000;
+}
+
+Client *client_connect(const char *host, uint16_t port) {
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        errno = EINVAL;
+        return NULL;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (connect(fd, (const struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return NULL;
+    }
+    // requests are batched by the library, don't let Nagle delay them further
+    int val = 1;
+    (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val));
+    int flags = fcntl(fd, F_GETFL, 0);
+    (void)fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+    Client *c = new Client();
+    c->fd = fd;
+    return c;
+}
+
+void client_close(Client *c) {
+    if (c) {
+        close(c->fd);
+        delete c;
+    }
+}
+
+static void buf_append(std::vector<uint8_t> &buf, const void *data, size_t len) {
+    buf.insert(buf.end(), (const uint8_t *)data, (const uint8_t *)data + len);
+}
+
+void client_send(Client *c, const std::vector<std::string_view> &args, ReplyCb cb, void *arg) {
+    uint32_t len = 4;
+    for (std::string_view s : args) {
+        len += 4 + (uint32_t)s.size();
+    }
+    uint32_t nstr = (uint32_t)args.size();
+    buf_append(c->outgoing, &len, 4);   // assume little endian
+    buf_append(c->outgoing, &nstr, 4);
+    for (std::string_view s : args) {
+        uint32_t slen = (uint32_t)s.size();
+        buf_append(c->outgoing, &slen, 4);
+        buf_append(c->outgoing, s.data(), s.size());
+    }
+    c->pending.push_back(Client::Pending{cb, arg});
+}
+
+size_t client_pending(const Client *c) {
+    return c->pending.size();
+}
+
+// write as much of the queued requests as the socket takes
+static void client_flush(Client *c) {
+    while (c->out_off < c->outgoing.size()) {
+        ssize_t rv = write(c->fd, &c->outgoing[c->out_off], c->outgoing.size() - c->out_off);
+        if (rv < 0 && errno == EAGAIN) {
+            break;
+        }
+        if (rv <= 0) {
+            c->failed = true;
+            return;
+        }
+        c->out_off += (size_t)rv;
+    }
+    if (c->out_off == c->outgoing.size()) {
+        c->outgoing.clear();
+        c->out_off = 0;
+    }
+}
+
+// dispatch the complete replies in `incoming`
+static void client_dispatch(Client *c) {
+    while (!c->failed && c->incoming.size() - c->in_off >= 4) {
+        const uint8_t *msg = &c->incoming[c->in_off];
+        uint32_t len = 0;
+        memcpy(&len, msg, 4);
+        if (c->incoming.size() - c->in_off < 4 + (size_t)len) {
+            break;  // want more
+        }
+        Reply reply;
+        if ((c->pending.empty() && !c->on_push) || reply_parse(msg + 4, len, &reply) != (int64_t)len) {
+            c->failed = true;   // a reply to nothing, or a malformed one
+            return;
+        }
+        if (c->pending.empty()) {
+            c->on_push(reply, c->push_arg);
+        } else {
+            Client::Pending req = c->pending.front();
+            c->pending.pop_front();
+            if (req.cb) {
+                req.cb(reply, req.arg);
+            }
+        }
+        c->in_off += 4 + len;
+    }
+    if (c->in_off == c->incoming.size()) {
+        c->incoming.clear();
+        c->in_off = 0;
+    } else if (c->in_off > c->incoming.size() / 2) {
+        c->incoming.erase(c->incoming.begin(), c->incoming.begin() + c->in_off);
+        c->in_off = 0;
+    }
+}
+
+static void client_read(Client *c) {
+    uint8_t buf[64 * 1024];
+    ssize_t rv = read(c->fd, buf, sizeof(buf));
+    if (rv < 0 && errno == EAGAIN) {
+        return;
+    }
+    if (rv <= 0) {
+        c->failed = true;   // error or EOF
+        return;
+    }
+    buf_append(c->incoming, buf, (size_t)rv);
+    client_dispatch(c);
+}
+
+bool client_run(Client *const *cs, size_t n, int64_t timeout_us) {
+    std::vector<struct pollfd> pfds;
+    std::vector<Client *> active;
+    for (size_t i = 0; i < n; i++) {
+        Client *c = cs[i];
+        if (c->failed) {
+            continue;
+        }
+        client_flush(c);    // all the requests queued so far in one write
+        struct pollfd pfd = {c->fd, POLLIN, 0};
+        if (c->out_off < c->outgoing.size()) {
+            pfd.events |= POLLOUT;
+        }
+        pfds.push_back(pfd);
+        active.push_back(c);
+    }
+    if (pfds.empty()) {
+        return true;
+    }
+    // ppoll() for a finer timeout, open-loop load generation needs it
+    struct timespec ts = {timeout_us / 1000000, (timeout_us % 1000000) * 1000};
+    int rv = ppoll(pfds.data(), (nfds_t)pfds.size(), timeout_us < 0 ? NULL : &ts, NULL);
+    if (rv < 0 && errno != EINTR) {
+        return false;
+    }
+    for (size_t i = 0; rv > 0 && i < pfds.size(); i++) {
+        Client *c = active[i];
+        if (pfds[i].revents & POLLOUT) {
+            client_flush(c);
+        }
+        if (pfds[i].revents & (POLLIN | POLLERR | POLLHUP)) {
+            client_read(c);
+        }
+    }
+    return true;
+}
+
+bool client_wait(Client *c, int timeout_ms) {
+    uint64_t deadline = get_monotonic_msec() + (uint64_t)timeout_ms;
+    while (!c->pending.empty() && !c->failed) {
+        int wait_ms = -1;
+        if (timeout_ms >= 0) {
+            uint64_t now = get_monotonic_msec();
+            if (now >= deadline) {
+                return false;
+            }
+            wait_ms = (int)(deadline - now);
+        }
+        if (!client_run(&c, 1, wait_ms < 0 ? -1 : (int64_t)wait_ms * 1000)) {
+            return false;
+        }
+    }
+    return !c->failed;
+}
+
+bool pool_init(ClientPool *pool, const char *host, uint16_t port, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        Client *c = client_connect(host, port);
+        if (!c) {
+            pool_close(pool);
+            return false;
+        }
+        pool->conns.push_back(c);
+    }
+    return true;
+}
+
+void pool_close(ClientPool *pool) {
+    for (Client *c : pool->conns) {
+        client_close(c);
+    }
+    pool->conns.clear();
+}
+
+Client *pool_pick(ClientPool *pool) {
+    Client *best = NULL;
+    for (Client *c : pool->conns) {
+        if (!c->failed && (!best || c->pending.size() < best->pending.size())) {
+            best = c;
+        }
+    }
+    return best;
+}
+
+bool pool_wait(ClientPool *pool, int timeout_ms) {
+    uint64_t deadline = get_monotonic_msec() + (uint64_t)timeout_ms;
+    while (true) {
+        bool busy = false;
+        for (Client *c : pool->conns) {
+            if (c->failed) {
+                return false;
+            }
+            busy = busy || !c->pending.empty();
+        }
+        if (!busy) {
+            return true;
+        }
+        int wait_ms = -1;
+        if (timeout_ms >= 0) {
+            uint64_t now = get_monotonic_msec();
+            if (now >= deadline) {
+                return false;
+            }
+            wait_ms = (int)(deadline - now);
+        }
+        if (!client_run(pool->conns.data(), pool->conns.size(),
+            wait_ms < 0 ? -1 : (int64_t)wait_ms * 1000))
+        {
+            return false;
+        }
+    }
+}
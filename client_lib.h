@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+#include <vector>
+#include <deque>
+
+
+/*A client library for the server. Requests are queued with client_send() and go out
+together on the next flush, so everything queued between two event loop steps becomes
+one write. Replies are parsed in place: a Reply only points into the receive buffer,
+it's valid for the duration of the callback.*/
+
+// data types of serialized data
+enum {
+    TAG_NIL = 0,    // nil
+    TAG_ERR = 1,    // error code + msg
+    TAG_STR = 2,    // string
+    TAG_INT = 3,    // int64
+    TAG_DBL = 4,    // double
+    TAG_ARR = 5,    // array
+};
+
+struct Reply {
+    uint8_t tag = TAG_NIL;
+    uint32_t code = 0;          // TAG_ERR
+    std::string_view str;       // TAG_STR, or the TAG_ERR message
+    int64_t num = 0;            // TAG_INT
+    double dbl = 0;             // TAG_DBL
+    uint32_t len = 0;           // TAG_ARR: the number of elements
+    std::string_view elems;     // TAG_ARR: the serialized elements, see reply_next()
+};
+
+// parse one value, returns the bytes consumed or -1 if it's malformed
+int64_t reply_parse(const uint8_t *data, size_t size, Reply *out);
+// iterate over the elements of an array, `pos` starts at 0
+bool reply_next(const Reply &arr, size_t *pos, Reply *elem);
+
+// called with each reply, in the order of the requests
+typedef void (*ReplyCb)(const Reply &reply, void *arg);
+
+struct Client {
+    int fd = -1;
+    bool failed = false;            // IO error, EOF or a bad reply
+    std::vector<uint8_t> outgoing;  // queued requests not yet written
+    size_t out_off = 0;
+    std::vector<uint8_t> incoming;  // replies not yet complete
+    size_t in_off = 0;
+    struct Pending {
+        ReplyCb cb = NULL;
+        void *arg = NULL;
+    };
+    std::deque<Pending> pending;    // requests waiting for a reply
+    // pub/sub messages: a message arriving with no request in flight goes here, the
+    // protocol can't tell them apart otherwise. NULL: it's an error like any stray reply.
+    ReplyCb on_push = NULL;
+    void *push_arg = NULL;
+};
+
+// a non-blocking connection, NULL on error (errno is set)
+Client *client_connect(const char *host, uint16_t port);
+void    client_close(Client *c);
+// queue a request, `cb` (if not NULL) runs when the reply arrives
+void    client_send(Client *c, const std::vector<std::string_view> &args, ReplyCb cb, void *arg);
+size_t  client_pending(const Client *c);
+
+// One event loop step for a set of connections: write the queued requests, wait up
+// to `timeout_us` (< 0: forever) for replies and run their callbacks. Returns false
+// if poll() fails; a connection that fails is marked `failed` and skipped.
+bool    client_run(Client *const *cs, size_t n, int64_t timeout_us);
+// run until every queued request is answered, false on failure or timeout
+bool    client_wait(Client *c, int timeout_ms);
+
+// a fixed set of connections to the same server
+struct ClientPool {
+    std::vector<Client *> conns;
+};
+
+bool    pool_init(ClientPool *pool, const char *host, uint16_t port, size_t n);
+void    pool_close(ClientPool *pool);
+// the connection with the fewest requests in flight
+Client *pool_pick(ClientPool *pool);
+bool    pool_wait(ClientPool *pool, int timeout_ms);
@@ -0,0 +1,253 @@
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+// proj
+#include "hash.h"
+#include "common.h"
+
+
+// ---------------------------------------------------------
+// compact encoding
+// ---------------------------------------------------------
+const size_t k_packed_head = 8;     // flen and vlen
+
+static HashPair packed_at(const uint8_t *pos) {
+    uint32_t flen = 0, vlen = 0;
+    memcpy(&flen, pos, 4);
+    memcpy(&vlen, pos + 4, 4);
+    HashPair pair;
+    pair.field = (const char *)pos + k_packed_head;
+    pair.flen = flen;
+    pair.val = pair.field + flen;
+    pair.vlen = vlen;
+    return pair;
+}
+
+static size_t packed_size(const HashPair &pair) {
+    return k_packed_head + pair.flen + pair.vlen;
+}
+
+// the offset of the field in `packed`, or packed_len
+static size_t packed_find(Hash *hash, const char *field, size_t flen) {
+    size_t pos = 0;
+    while (pos < hash->packed_len) {
+        HashPair pair = packed_at(hash->packed + pos);
+        if (pair.flen == flen && memcmp(pair.field, field, flen) == 0) {
+            break;
+        }
+        pos += packed_size(pair);
+    }
+    return pos;
+}
+
+static void packed_erase(Hash *hash, size_t pos, size_t size) {
+    memmove(hash->packed + pos, hash->packed + pos + size, hash->packed_len - pos - size);
+    hash->packed_len -= size;
+}
+
+static void packed_append(Hash *hash, const char *field, size_t flen, const char *val, size_t vlen) {
+    size_t size = k_packed_head + flen + vlen;
+    hash->packed = (uint8_t *)realloc(hash->packed, hash->packed_len + size);
+    assert(hash->packed);
+    uint8_t *pos = hash->packed + hash->packed_len;
+    uint32_t len32 = (uint32_t)flen;
+    memcpy(pos, &len32, 4);
+    len32 = (uint32_t)vlen;
+    memcpy(pos + 4, &len32, 4);
+    memcpy(pos + k_packed_head, field, flen);
+    memcpy(pos + k_packed_head + flen, val, vlen);
+    hash->packed_len += size;
+}
+
+// ---------------------------------------------------------
+// table encoding
+// ---------------------------------------------------------
+static HashField *field_new(const char *field, size_t flen, const char *val, size_t vlen, uint64_t hcode) {
+    HashField *node = (HashField *)malloc(sizeof(HashField) + flen + vlen);
+    assert(node);
+    node->node.next = NULL;
+    node->node.hcode = hcode;
+    node->flen = (uint32_t)flen;
+    node->vlen = (uint32_t)vlen;
+    memcpy(&node->data[0], field, flen);
+    memcpy(&node->data[flen], val, vlen);
+    return node;
+}
+
+static size_t field_size(const HashField *node) {
+    return sizeof(HashField) + node->flen + node->vlen;
+}
+
+// a helper structure for the hashtable lookup
+struct HKey {
+    HNode node;
+    const char *field = NULL;
+    size_t flen = 0;
+};
+
+static void hkey_init(HKey *key, const char *field, size_t flen) {
+    key->node.hcode = str_hash((const uint8_t *)field, flen);
+    key->field = field;
+    key->flen = flen;
+}
+
+static bool hcmp(HNode *node, HNode *key) {
+    HashField *hf = container_of(node, HashField, node);
+    HKey *hkey = container_of(key, HKey, node);
+    return hf->flen == hkey->flen && memcmp(hf->data, hkey->field, hf->flen) == 0;
+}
+
+static void table_insert(Hash *hash, HashField *node) {
+    hm_insert(&hash->hmap, &node->node);
+    hash->node_mem += field_size(node);
+}
+
+static HashPair field_pair(const HashField *node) {
+    HashPair pair;
+    pair.field = node->data;
+    pair.flen = node->flen;
+    pair.val = node->data + node->flen;
+    pair.vlen = node->vlen;
+    return pair;
+}
+
+// ---------------------------------------------------------
+// both
+// ---------------------------------------------------------
+bool hash_get(Hash *hash, const char *field, size_t flen, HashPair *out) {
+    if (!hash->is_table) {
+        size_t pos = packed_find(hash, field, flen);
+        if (pos == hash->packed_len) {
+            return false;
+        }
+        *out = packed_at(hash->packed + pos);
+        return true;
+    }
+    HKey key;
+    hkey_init(&key, field, flen);
+    HNode *found = hm_lookup(&hash->hmap, &key.node, &hcmp);
+    if (!found) {
+        return false;
+    }
+    *out = field_pair(container_of(found, HashField, node));
+    return true;
+}
+
+bool hash_set(Hash *hash, const char *field, size_t flen, const char *val, size_t vlen) {
+    if (!hash->is_table) {
+        size_t pos = packed_find(hash, field, flen);
+        bool added = pos == hash->packed_len;
+        if (!added) {
+            HashPair old = packed_at(hash->packed + pos);
+            if (old.vlen == vlen) {     // same size, overwrite in place
+                memcpy((char *)old.val, val, vlen);
+                return false;
+            }
+            packed_erase(hash, pos, packed_size(old));
+        }
+        packed_append(hash, field, flen, val, vlen);
+        hash->count += added;
+        return added;
+    }
+    // a new value may have a new size, the node is replaced
+    HKey key;
+    hkey_init(&key, field, flen);
+    HNode *old = hm_delete(&hash->hmap, &key.node, &hcmp);
+    if (old) {
+        hash->node_mem -= field_size(container_of(old, HashField, node));
+        free(container_of(old, HashField, node));
+    }
+    table_insert(hash, field_new(field, flen, val, vlen, key.node.hcode));
+    hash->count += !old;
+    return !old;
+}
+
+bool hash_del(Hash *hash, const char *field, size_t flen) {
+    if (!hash->is_table) {
+        size_t pos = packed_find(hash, field, flen);
+        if (pos == hash->packed_len) {
+            return false;
+        }
+        packed_erase(hash, pos, packed_size(packed_at(hash->packed + pos)));
+        hash->count--;
+        return true;
+    }
+    HKey key;
+    hkey_init(&key, field, flen);
+    HNode *found = hm_delete(&hash->hmap, &key.node, &hcmp);
+    if (!found) {
+        return false;
+    }
+    HashField *node = container_of(found, HashField, node);
+    hash->node_mem -= field_size(node);
+    free(node);
+    hash->count--;
+    return true;
+}
+
+void hash_to_table(Hash *hash) {
+    if (hash->is_table) {
+        return;
+    }
+    for (size_t pos = 0; pos < hash->packed_len; ) {
+        HashPair pair = packed_at(hash->packed + pos);
+        uint64_t hcode = str_hash((const uint8_t *)pair.field, pair.flen);
+        table_insert(hash, field_new(pair.field, pair.flen, pair.val, pair.vlen, hcode));
+        pos += packed_size(pair);
+    }
+    free(hash->packed);
+    hash->packed = NULL;
+    hash->packed_len = 0;
+    hash->is_table = true;
+}
+
+static bool cb_collect(HNode *node, void *arg) {
+    ((std::vector<HNode *> *)arg)->push_back(node);
+    return true;
+}
+
+void hash_clear(Hash *hash) {
+    free(hash->packed);
+    hash->packed = NULL;
+    hash->packed_len = 0;
+    // hm_foreach() follows HNode::next after the callback, so free afterwards
+    std::vector<HNode *> nodes;
+    hm_foreach(&hash->hmap, &cb_collect, &nodes);
+    for (HNode *node : nodes) {
+        free(container_of(node, HashField, node));
+    }
+    hm_clear(&hash->hmap);
+    hash->count = 0;
+    hash->node_mem = 0;
+    hash->is_table = false;
+}
+
+size_t hash_mem(Hash *hash) {
+    return hash->packed_len + hash->node_mem + hm_mem(&hash->hmap);
+}
+
+struct ForeachCtx {
+    bool (*f)(const HashPair &, void *);
+    void *arg;
+};
+
+static bool cb_foreach(HNode *node, void *arg) {
+    ForeachCtx *ctx = (ForeachCtx *)arg;
+    return ctx->f(field_pair(container_of(node, HashField, node)), ctx->arg);
+}
+
+void hash_foreach(Hash *hash, bool (*f)(const HashPair &, void *), void *arg) {
+    if (!hash->is_table) {
+        for (size_t pos = 0; pos < hash->packed_len; ) {
+            HashPair pair = packed_at(hash->packed + pos);
+            if (!f(pair, arg)) {
+                return;
+            }
+            pos += packed_size(pair);
+        }
+        return;
+    }
+    ForeachCtx ctx = {f, arg};
+    hm_foreach(&hash->hmap, &cb_foreach, &ctx);
+}
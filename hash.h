@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hashtable.h"
+
+
+/*A hash value (field -> value). A small hash is one packed byte array that is scanned linearly,
+which for a handful of fields is as fast as hashing and costs no per-field allocation. Once it
+grows past the limits the caller checks, hash_to_table() moves it into an HMap of HashFields for
+good.*/
+struct Hash {
+    uint8_t *packed = NULL;     // compact encoding: [u32 flen][u32 vlen][field][value] back to back
+    size_t packed_len = 0;
+    HMap hmap;                  // table encoding, HashField::node
+    size_t count = 0;           // fields, in either encoding
+    size_t node_mem = 0;        // bytes of the HashFields, see hash_mem()
+    bool is_table = false;
+};
+// a field of the table encoding, the field and the value share the allocation like ZNode::name
+struct HashField {
+    HNode   node;
+    uint32_t flen = 0;
+    uint32_t vlen = 0;
+    char    data[0];            // the field, then the value
+};
+// a field and its value, pointing into the hash until it's modified
+struct HashPair {
+    const char *field = NULL;
+    size_t flen = 0;
+    const char *val = NULL;
+    size_t vlen = 0;
+};
+
+bool   hash_get(Hash *hash, const char *field, size_t flen, HashPair *out);
+// add or overwrite, returns whether the field is new
+bool   hash_set(Hash *hash, const char *field, size_t flen, const char *val, size_t vlen);
+bool   hash_del(Hash *hash, const char *field, size_t flen);
+void   hash_to_table(Hash *hash);
+void   hash_clear(Hash *hash);
+size_t hash_mem(Hash *hash);    // bytes of the fields and the index, for maxmemory
+// invoke the callback on each field until it returns false
+void   hash_foreach(Hash *hash, bool (*f)(const HashPair &, void *), void *arg);
@@ -1,37 +1,47 @@
-#pragma once
-#include <stddef.h>
-#include <stdint.h>
-
-// hashtable node, should be embedded into the payload
-/*
-This is the "handle" you attach to your own data
-*/
-struct HNode {
-    HNode *next = NULL;        //This is the "handle" you attach to your own data
-    uint64_t hcode = 0;        //Stores the calculated hash value so we don't waste time recalculating it later.
-};
-
-/*A single, basic hash table.*/
-struct HTab {
-    HNode **tab = NULL;     //An array of pointers to HNodes. These are your "buckets."
-    size_t mask = 0;       //A clever math trick. If your table size is 8 (binary 1000), the mask is 7 (0111). We use this to quickly find which bucket an item belongs in.
-    size_t size = 0;        //How many items are currently in this specific table.
-};
-
-/*The "Manager" that handles our progressive resizing.
-Holds two HTabs. When the table gets too full, newer becomes older, and a fresh, bigger table becomes newer*/
-/*Keeps track of which bucket we are currently moving from older to newer*/
-struct HMap {
-    HTab newer;            
-    HTab older;
-    size_t migrate_pos = 0;
-};
-
-
-HNode *hm_lookup(HMap *hmap, HNode *key, bool (*eq)(HNode *, HNode *));
-void   hm_insert(HMap *hmap, HNode *node);
-HNode *hm_delete(HMap *hmap, HNode *key, bool (*eq)(HNode *, HNode *));
-void   hm_clear(HMap *hmap);
-size_t hm_size(HMap *hmap);
-// invoke the callback on each node until it returns false
-void   hm_foreach(HMap *hmap, bool (*f)(HNode *, void *), void *arg);
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// hashtable node, should be embedded into the payload
+/*
+This is the "handle" you attach to your own data
+*/
+struct HNode {
+    HNode *next = NULL;        //This is the "handle" you attach to your own data
+    uint64_t hcode = 0;        //Stores the calculated hash value so we don't waste time recalculating it later.
+};
+
+/*A single, basic hash table.*/
+struct HTab {
+    HNode **tab = NULL;     //An array of pointers to HNodes. These are your "buckets."
+    size_t mask = 0;       //A clever math trick. If your table size is 8 (binary 1000), the mask is 7 (0111). We use this to quickly find which bucket an item belongs in.
+    size_t size = 0;        //How many items are currently in this specific table.
+};
+
+/*The "Manager" that handles our progressive resizing.
+Holds two HTabs. When the table gets too full, newer becomes older, and a fresh, bigger table becomes newer*/
+/*Keeps track of which bucket we are currently moving from older to newer*/
+struct HMap {
+    HTab newer;            
+    HTab older;
+    size_t migrate_pos = 0;
+};
+
+
+HNode *hm_lookup(HMap *hmap, HNode *key, bool (*eq)(HNode *, HNode *));
+void   hm_insert(HMap *hmap, HNode *node);
+HNode *hm_delete(HMap *hmap, HNode *key, bool (*eq)(HNode *, HNode *));
+void   hm_clear(HMap *hmap);
+size_t hm_size(HMap *hmap);
+// Prefetch hints for looking up a batch of keys. Call hm_prefetch_bucket() for every key,
+// then hm_prefetch_node() for every key, then do the lookups: the cache misses of the
+// whole batch overlap instead of each lookup waiting for its own.
+void   hm_prefetch_bucket(HMap *hmap, uint64_t hcode);
+void   hm_prefetch_node(HMap *hmap, uint64_t hcode);
+// bytes of the bucket arrays, the nodes are the payload's
+size_t hm_mem(HMap *hmap);
+// Up to `n` nodes from the buckets after `start` (any number, taken modulo the table size),
+// for picking eviction candidates at random. Gives up after scanning n * 10 buckets.
+size_t hm_sample(HMap *hmap, size_t start, HNode **out, size_t n);
+// invoke the callback on each node until it returns false
+void   hm_foreach(HMap *hmap, bool (*f)(HNode *, void *), void *arg);
@@ -58,4 +58,20 @@ void heap_update(HeapItem *a, size_t pos, size_t len) {
     } else {
         heap_down(a, pos, len);
     }
-}
\ No newline at end of file
+}
+
+static size_t heap_count_from(
+    const HeapItem *a, size_t pos, size_t len, uint64_t limit, size_t max_count)
+{
+    if (pos >= len || a[pos].val >= limit || max_count == 0) {
+        return 0;   // the whole subtree is >= limit
+    }
+    size_t n = 1;
+    n += heap_count_from(a, heap_left(pos), len, limit, max_count - n);
+    n += heap_count_from(a, heap_right(pos), len, limit, max_count - n);
+    return n;
+}
+
+size_t heap_count_below(const HeapItem *a, size_t len, uint64_t limit, size_t max_count) {
+    return heap_count_from(a, 0, len, limit, max_count);
+}
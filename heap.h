@@ -9,3 +9,5 @@ struct HeapItem {
 
 
 void heap_update(HeapItem *a, size_t pos, size_t len);
+// count the items with val < `limit`, stopping at `max_count`. O(result) thanks to the heap order.
+size_t heap_count_below(const HeapItem *a, size_t len, uint64_t limit, size_t max_count);
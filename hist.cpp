@@ -0,0 +1,48 @@
+#include <math.h>
+#include "hist.h"
+
+
+// the largest value mapped to bucket `idx`
+static uint64_t hist_bucket_max(uint32_t idx) {
+    if (idx < (1u << k_hist_sub_bits)) {
+        return idx;
+    }
+    uint32_t shift = (idx >> k_hist_sub_bits) - 1;
+    uint64_t sub = idx - (shift << k_hist_sub_bits);    // in [2^sub_bits, 2^(sub_bits+1))
+    return ((sub + 1) << shift) - 1;
+}
+
+uint64_t hist_percentile(const Hist *h, double p) {
+    if (h->count == 0) {
+        return 0;
+    }
+    // the rank of the target value, 1-based
+    uint64_t rank = (uint64_t)ceil(p / 100.0 * (double)h->count);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < k_hist_buckets; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t val = hist_bucket_max(i);
+            return val < h->max ? val : h->max;
+        }
+    }
+    return h->max;
+}
+
+void hist_merge(Hist *dst, const Hist *src) {
+    for (uint32_t i = 0; i < k_hist_buckets; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+void hist_reset(Hist *h) {
+    *h = Hist{};
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*An HDR-style log-linear histogram. Values below 2^k_hist_sub_bits get their own bucket,
+every power of 2 above that is split into 2^k_hist_sub_bits linear sub-buckets, so the
+relative error stays under 1/32 (~3%) across the whole range while recording is just a
+few shifts and one increment. Values are usually nanoseconds, capped at 2^k_hist_max_bits.*/
+const uint32_t k_hist_sub_bits = 5;
+const uint32_t k_hist_max_bits = 40;    // ~18 minutes in nanoseconds
+const uint32_t k_hist_buckets = (k_hist_max_bits - k_hist_sub_bits + 1) << k_hist_sub_bits;
+
+struct Hist {
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    uint64_t buckets[k_hist_buckets] = {};
+};
+
+inline uint32_t hist_bucket(uint64_t val) {
+    if (val < (1u << k_hist_sub_bits)) {
+        return (uint32_t)val;
+    }
+    if (val >= (1ull << k_hist_max_bits)) {
+        return k_hist_buckets - 1;
+    }
+    uint32_t shift = 63 - __builtin_clzll(val) - k_hist_sub_bits;
+    return (shift << k_hist_sub_bits) + (uint32_t)(val >> shift);
+}
+
+inline void hist_record(Hist *h, uint64_t val) {
+    h->buckets[hist_bucket(val)]++;
+    h->count++;
+    h->sum += val;
+    if (val > h->max) {
+        h->max = val;
+    }
+}
+
+// the highest value that falls into the same bucket as the p-th percentile (0 < p <= 100)
+uint64_t hist_percentile(const Hist *h, double p);
+// add the counts of `src` into `dst`
+void hist_merge(Hist *dst, const Hist *src);
+void hist_reset(Hist *h);
@@ -0,0 +1,401 @@
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <immintrin.h>
+// proj
+#include "hll.h"
+
+
+enum {
+    HLL_DENSE = 0,
+    HLL_SPARSE = 1,
+};
+const uint32_t k_hll_q = 64 - k_hll_p;  // hash bits left for the rank
+const uint8_t k_hll_sparse_val_max = 32;
+const uint8_t k_card_stale = 0x80;      // in the last byte of the cached estimate
+
+// ---------------------------------------------------------
+// header
+// ---------------------------------------------------------
+static uint8_t *hll_card(uint8_t *data) {
+    return data + 8;
+}
+
+static void card_invalidate(uint8_t *data) {
+    hll_card(data)[7] |= k_card_stale;
+}
+
+static void init_header(uint8_t *data, uint8_t encoding) {
+    memcpy(data, "HYLL", 4);
+    data[4] = encoding;
+    memset(data + 5, 0, k_hll_hdr - 5);
+}
+
+bool hll_is_sparse(const uint8_t *data) {
+    return data[4] == HLL_SPARSE;
+}
+
+// ---------------------------------------------------------
+// dense encoding: 6 bits per register, the low bits first
+// ---------------------------------------------------------
+static uint8_t dense_get(const uint8_t *regs, uint32_t i) {
+    size_t byte = (size_t)i * 6 / 8;
+    uint32_t shift = i * 6 % 8;
+    uint32_t val = regs[byte] >> shift;
+    if (shift > 2) {
+        val |= (uint32_t)regs[byte + 1] << (8 - shift);
+    }
+    return (uint8_t)(val & 63);
+}
+
+static void dense_set(uint8_t *regs, uint32_t i, uint8_t val) {
+    size_t byte = (size_t)i * 6 / 8;
+    uint32_t shift = i * 6 % 8;
+    regs[byte] = (uint8_t)((regs[byte] & ~(63u << shift)) | ((uint32_t)val << shift));
+    if (shift > 2) {
+        uint32_t hi = 8 - shift;
+        regs[byte + 1] = (uint8_t)((regs[byte + 1] & ~(63u >> hi)) | ((uint32_t)val >> hi));
+    }
+}
+
+// ---------------------------------------------------------
+// sparse encoding
+// ---------------------------------------------------------
+/*Runs of registers, the opcodes Redis uses:
+    00xxxxxx            ZERO: x+1 registers (up to 64) are 0
+    01xxxxxx yyyyyyyy   XZERO: xy+1 registers (up to 16384) are 0
+    1vvvvvxx            VAL: x+1 registers (up to 4) are v+1 (up to 32)*/
+struct Run {
+    uint8_t val = 0;
+    uint32_t len = 0;
+};
+
+// the run at `p`, returns its size in bytes, 0 if it's cut short
+static size_t run_decode(const uint8_t *p, const uint8_t *end, Run *run) {
+    uint8_t op = p[0];
+    if ((op & 0xc0) == 0x00) {
+        run->val = 0;
+        run->len = (uint32_t)(op & 0x3f) + 1;
+        return 1;
+    }
+    if ((op & 0xc0) == 0x40) {
+        if (p + 1 >= end) {
+            return 0;
+        }
+        run->val = 0;
+        run->len = (((uint32_t)(op & 0x3f) << 8) | p[1]) + 1;
+        return 2;
+    }
+    run->val = (uint8_t)(((op >> 2) & 0x1f) + 1);
+    run->len = (uint32_t)(op & 0x3) + 1;
+    return 1;
+}
+
+// writes runs as opcodes, merging consecutive ones of the same value
+struct SparseWriter {
+    std::vector<uint8_t> bytes;
+    uint8_t val = 0;
+    uint32_t len = 0;
+
+    void put(uint8_t v, uint32_t n) {
+        if (n == 0) {
+            return;
+        }
+        if (len && v == val) {
+            len += n;
+            return;
+        }
+        flush();
+        val = v;
+        len = n;
+    }
+    void flush() {
+        while (len) {
+            uint32_t n = 0;
+            if (val) {
+                n = std::min(len, 4u);
+                bytes.push_back((uint8_t)(0x80 | ((val - 1) << 2) | (n - 1)));
+            } else if (len <= 64) {
+                n = len;
+                bytes.push_back((uint8_t)(n - 1));
+            } else {
+                n = std::min(len, k_hll_regs);
+                bytes.push_back((uint8_t)(0x40 | ((n - 1) >> 8)));
+                bytes.push_back((uint8_t)((n - 1) & 0xff));
+            }
+            len -= n;
+        }
+    }
+};
+
+// ---------------------------------------------------------
+// estimating, from the count of registers of each value
+// ---------------------------------------------------------
+/*Ertl's improved estimator ("New cardinality estimation algorithms for HyperLogLog sketches",
+2017), as in Redis: it needs no bias tables nor a switch to linear counting at small sizes.*/
+static double hll_sigma(double x) {
+    if (x == 1.0) {
+        return INFINITY;
+    }
+    double y = 1, z = x, prev = 0;
+    do {
+        x *= x;
+        prev = z;
+        z += x * y;
+        y += y;
+    } while (prev != z);
+    return z;
+}
+
+static double hll_tau(double x) {
+    if (x == 0.0 || x == 1.0) {
+        return 0.0;
+    }
+    double y = 1.0, z = 1 - x, prev = 0;
+    do {
+        x = sqrt(x);
+        prev = z;
+        y *= 0.5;
+        z -= pow(1 - x, 2) * y;
+    } while (prev != z);
+    return z / 3;
+}
+
+static uint64_t estimate(const uint32_t *histo) {
+    const double m = k_hll_regs;
+    double z = m * hll_tau((m - histo[k_hll_q + 1]) / m);
+    for (uint32_t k = k_hll_q; k >= 1; k--) {
+        z += histo[k];
+        z *= 0.5;
+    }
+    z += m * hll_sigma(histo[0] / m);
+    return (uint64_t)llroundl(0.5 / log(2.0) * m * m / z);
+}
+
+// ---------------------------------------------------------
+// the API
+// ---------------------------------------------------------
+RcBuf *hll_new() {
+    SparseWriter w;
+    w.put(0, k_hll_regs);
+    w.flush();
+    RcBuf *rc = rcbuf_new(NULL, k_hll_hdr + w.bytes.size());
+    init_header(rc->data, HLL_SPARSE);  // the cached 0 is right
+    memcpy(rc->data + k_hll_hdr, w.bytes.data(), w.bytes.size());
+    return rc;
+}
+
+bool hll_valid(const uint8_t *data, size_t len) {
+    if (len < k_hll_hdr || memcmp(data, "HYLL", 4) != 0) {
+        return false;
+    }
+    if (data[4] == HLL_DENSE) {
+        return len == k_hll_dense_size;
+    }
+    if (data[4] != HLL_SPARSE) {
+        return false;
+    }
+    // the runs must cover the registers exactly, so that readers need no checks
+    uint32_t total = 0;
+    const uint8_t *end = data + len;
+    for (const uint8_t *p = data + k_hll_hdr; p < end;) {
+        Run run;
+        size_t n = run_decode(p, end, &run);
+        if (n == 0 || (total += run.len) > k_hll_regs) {
+            return false;
+        }
+        p += n;
+    }
+    return total == k_hll_regs;
+}
+
+void hll_unpack(const RcBuf *rc, uint8_t *regs) {
+    if (!hll_is_sparse(rc->data)) {
+        for (uint32_t i = 0; i < k_hll_regs; i++) {
+            regs[i] = dense_get(rc->data + k_hll_hdr, i);
+        }
+        return;
+    }
+    uint32_t i = 0;
+    const uint8_t *end = rc->data + rc->len;
+    for (const uint8_t *p = rc->data + k_hll_hdr; p < end;) {
+        Run run;
+        p += run_decode(p, end, &run);
+        memset(regs + i, run.val, run.len);
+        i += run.len;
+    }
+}
+
+RcBuf *hll_from_regs(const uint8_t *regs) {
+    RcBuf *rc = rcbuf_new(NULL, k_hll_dense_size);
+    init_header(rc->data, HLL_DENSE);
+    card_invalidate(rc->data);
+    for (uint32_t i = 0; i < k_hll_regs; i++) {
+        dense_set(rc->data + k_hll_hdr, i, regs[i]);
+    }
+    return rc;
+}
+
+// the same registers, dense; the cached estimate stays valid
+static RcBuf *sparse_to_dense(RcBuf *rc) {
+    uint8_t regs[k_hll_regs];
+    hll_unpack(rc, regs);
+    RcBuf *dense = hll_from_regs(regs);
+    memcpy(hll_card(dense->data), hll_card(rc->data), 8);
+    rcbuf_unref(rc);
+    return dense;
+}
+
+// a register to raise, from a hash: the low bits pick it, the rest gives the rank
+struct Update {
+    uint32_t idx = 0;
+    uint8_t rank = 0;
+};
+
+static Update hash_update(uint64_t hash) {
+    Update up;
+    up.idx = (uint32_t)(hash & (k_hll_regs - 1));
+    hash >>= k_hll_p;
+    hash |= 1ull << k_hll_q;    // the rank is at most q+1
+    up.rank = (uint8_t)(__builtin_ctzll(hash) + 1);
+    return up;
+}
+
+/*Rewrite the runs with the updates applied, in one pass. `ups` is sorted by register with no
+duplicates. Returns NULL if the result is over `sparse_max` bytes.*/
+static RcBuf *sparse_update(RcBuf *rc, const std::vector<Update> &ups, size_t sparse_max, bool *changed) {
+    SparseWriter w;
+    size_t u = 0;
+    uint32_t start = 0;
+    const uint8_t *end = rc->data + rc->len;
+    for (const uint8_t *p = rc->data + k_hll_hdr; p < end;) {
+        Run run;
+        p += run_decode(p, end, &run);
+        uint32_t cur = start, stop = start + run.len;
+        for (; u < ups.size() && ups[u].idx < stop; u++) {
+            if (ups[u].rank <= run.val) {
+                continue;
+            }
+            w.put(run.val, ups[u].idx - cur);
+            w.put(ups[u].rank, 1);
+            cur = ups[u].idx + 1;
+            *changed = true;
+        }
+        w.put(run.val, stop - cur);
+        start = stop;
+    }
+    w.flush();
+    if (!*changed) {
+        return rc;
+    }
+    if (k_hll_hdr + w.bytes.size() > sparse_max) {
+        *changed = false;
+        return NULL;
+    }
+    // a new buffer: the size changes, and a queued reply may hold the old one
+    RcBuf *out = rcbuf_new(NULL, k_hll_hdr + w.bytes.size());
+    memcpy(out->data, rc->data, k_hll_hdr);
+    card_invalidate(out->data);
+    memcpy(out->data + k_hll_hdr, w.bytes.data(), w.bytes.size());
+    rcbuf_unref(rc);
+    return out;
+}
+
+RcBuf *hll_add(RcBuf *rc, const uint64_t *hashes, size_t n, size_t sparse_max, bool *changed) {
+    *changed = false;
+    std::vector<Update> ups(n);
+    for (size_t i = 0; i < n; i++) {
+        ups[i] = hash_update(hashes[i]);
+    }
+    if (hll_is_sparse(rc->data)) {
+        // the highest rank for each register
+        std::sort(ups.begin(), ups.end(), [](const Update &a, const Update &b) {
+            return a.idx != b.idx ? a.idx < b.idx : a.rank > b.rank;
+        });
+        auto last = std::unique(ups.begin(), ups.end(), [](const Update &a, const Update &b) {
+            return a.idx == b.idx;
+        });
+        ups.erase(last, ups.end());
+        bool fits = std::all_of(ups.begin(), ups.end(), [](const Update &up) {
+            return up.rank <= k_hll_sparse_val_max;
+        });
+        RcBuf *out = fits ? sparse_update(rc, ups, sparse_max, changed) : NULL;
+        if (out) {
+            return out;
+        }
+        rc = sparse_to_dense(rc);
+    }
+    for (const Update &up : ups) {
+        if (up.rank <= dense_get(rc->data + k_hll_hdr, up.idx)) {
+            continue;
+        }
+        if (!*changed) {
+            rc = rcbuf_writable(rc, rc->len);
+            card_invalidate(rc->data);
+            *changed = true;
+        }
+        dense_set(rc->data + k_hll_hdr, up.idx, up.rank);
+    }
+    return rc;
+}
+
+uint64_t hll_count(RcBuf *rc) {
+    uint8_t *card = hll_card(rc->data);
+    if (!(card[7] & k_card_stale)) {
+        uint64_t val = 0;
+        memcpy(&val, card, 8);
+        return val;
+    }
+    uint32_t histo[64] = {};
+    if (hll_is_sparse(rc->data)) {
+        const uint8_t *end = rc->data + rc->len;
+        for (const uint8_t *p = rc->data + k_hll_hdr; p < end;) {
+            Run run;
+            p += run_decode(p, end, &run);
+            histo[run.val] += run.len;
+        }
+    } else {
+        for (uint32_t i = 0; i < k_hll_regs; i++) {
+            histo[dense_get(rc->data + k_hll_hdr, i)]++;
+        }
+    }
+    uint64_t val = estimate(histo);
+    // a shared one is a reply being sent, which must not change under it
+    if (rc->refs == 1) {
+        memcpy(card, &val, 8);
+    }
+    return val;
+}
+
+uint64_t hll_regs_count(const uint8_t *regs) {
+    uint32_t histo[64] = {};
+    for (uint32_t i = 0; i < k_hll_regs; i++) {
+        histo[regs[i]]++;
+    }
+    return estimate(histo);
+}
+
+static void regs_max_scalar(uint8_t *dst, const uint8_t *src) {
+    for (uint32_t i = 0; i < k_hll_regs; i++) {
+        dst[i] = std::max(dst[i], src[i]);
+    }
+}
+
+__attribute__((target("avx2")))
+static void regs_max_avx2(uint8_t *dst, const uint8_t *src) {
+    for (uint32_t i = 0; i < k_hll_regs; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_max_epu8(a, b));
+    }
+}
+
+void hll_regs_max(uint8_t *dst, const uint8_t *src) {
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (has_avx2) {
+        return regs_max_avx2(dst, src);
+    }
+    return regs_max_scalar(dst, src);
+}
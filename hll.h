@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "rcbuf.h"
+
+
+/*HyperLogLog cardinality estimates, stored in a string value with the layout Redis uses: a
+16-byte header ("HYLL", the encoding, 3 unused bytes, then the cached estimate as 8 bytes little
+endian with the top bit set when stale) followed by 2^14 registers of 6 bits. A new one is sparse,
+runs of equal registers in a few bytes, and turns dense (12KB packed) when the runs get too long
+or a register can't be written in a run. Standard error is 0.81%.*/
+const uint32_t k_hll_p = 14;
+const uint32_t k_hll_regs = 1u << k_hll_p;
+const size_t   k_hll_hdr = 16;
+const size_t   k_hll_dense_size = k_hll_hdr + (k_hll_regs * 6 + 7) / 8;
+
+// a new, empty (sparse) one
+RcBuf   *hll_new();
+// whether a string value is a HyperLogLog this code can read
+bool     hll_valid(const uint8_t *data, size_t len);
+bool     hll_is_sparse(const uint8_t *data);
+/*Add elements by their 64-bit hashes, sets `changed` if an estimate may differ. May return
+another RcBuf: a copy if it was shared, or a new encoding. A sparse one past `sparse_max`
+bytes becomes dense.*/
+RcBuf   *hll_add(RcBuf *rc, const uint64_t *hashes, size_t n, size_t sparse_max, bool *changed);
+// the estimate, from the cache if it's fresh; refreshing it writes `rc` unless it's shared
+uint64_t hll_count(RcBuf *rc);
+
+// unpacked registers, one per byte, to combine several
+void     hll_unpack(const RcBuf *rc, uint8_t *regs);
+// dst = max(dst, src) for each register, vectorized when the CPU has AVX2
+void     hll_regs_max(uint8_t *dst, const uint8_t *src);
+uint64_t hll_regs_count(const uint8_t *regs);
+// a dense one with these registers
+RcBuf   *hll_from_regs(const uint8_t *regs);
@@ -0,0 +1,618 @@
+// A load generator: N threads x M connections, each connection pipelining up to
+// `depth` requests. Latencies go into HDR histograms (hist.h). With --rate the
+// requests follow a fixed schedule and the latency is measured from the time a
+// request *should* have been sent, so a stalled server can't hide its queueing
+// delay by slowing the generator down (coordinated omission).
+// The pubsub workload is different, see run_pubsub().
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "hist.h"
+#include "client_lib.h"
+
+
+static void die(const char *msg) {
+    int err = errno;
+    fprintf(stderr, "[%d] %s\n", err, msg);
+    abort();
+}
+
+static uint64_t get_monotonic_nsec() {
+    struct timespec tv = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return uint64_t(tv.tv_sec) * 1000000000 + tv.tv_nsec;
+}
+
+// command line options, --name value
+static struct {
+    std::string host = "127.0.0.1";
+    int64_t port = 1234;
+    int64_t threads = 4;
+    int64_t conns = 8;          // per thread
+    int64_t depth = 1;          // max requests in flight per connection
+    int64_t duration = 10;      // seconds
+    int64_t rate = 0;           // total requests per second, 0: closed loop
+    int64_t keys = 100000;      // key space size
+    std::string dist = "uniform";   // or "zipf"
+    double zipf_s = 0.99;
+    int64_t value_size = 64;
+    std::string workload = "kv";    // kv: get/set, zset: zscore/zquery/zadd, pubsub
+    double read_ratio = 0.9;
+    int64_t prefill = 1;        // write every key before the run
+    int64_t subscribers = 10000;    // pubsub: connections on the channel, over all threads
+} g_opt;
+
+struct Option {
+    const char *name;
+    std::string *str;
+    int64_t *num;
+    double *dbl;
+};
+static const Option k_options[] = {
+    {"host",        &g_opt.host,     NULL, NULL},
+    {"port",        NULL, &g_opt.port,       NULL},
+    {"threads",     NULL, &g_opt.threads,    NULL},
+    {"conns",       NULL, &g_opt.conns,      NULL},
+    {"depth",       NULL, &g_opt.depth,      NULL},
+    {"duration",    NULL, &g_opt.duration,   NULL},
+    {"rate",        NULL, &g_opt.rate,       NULL},
+    {"keys",        NULL, &g_opt.keys,       NULL},
+    {"dist",        &g_opt.dist,     NULL, NULL},
+    {"zipf-s",      NULL, NULL, &g_opt.zipf_s},
+    {"value-size",  NULL, &g_opt.value_size, NULL},
+    {"workload",    &g_opt.workload, NULL, NULL},
+    {"read-ratio",  NULL, NULL, &g_opt.read_ratio},
+    {"prefill",     NULL, &g_opt.prefill,    NULL},
+    {"subscribers", NULL, &g_opt.subscribers, NULL},
+};
+
+static bool parse_options(int argc, char **argv) {
+    for (int i = 1; i < argc; i += 2) {
+        std::string_view arg = argv[i];
+        const Option *opt = NULL;
+        for (const Option &o : k_options) {
+            if (arg.substr(0, 2) == "--" && arg.substr(2) == o.name) {
+                opt = &o;
+            }
+        }
+        if (!opt || i + 1 >= argc) {
+            fprintf(stderr, "bad argument: %s\n", argv[i]);
+            return false;
+        }
+        const char *val = argv[i + 1];
+        char *end = NULL;
+        if (opt->str) {
+            *opt->str = val;
+        } else if (opt->num) {
+            *opt->num = strtoll(val, &end, 10);
+        } else {
+            *opt->dbl = strtod(val, &end);
+        }
+        if (end && (end == val || *end)) {
+            fprintf(stderr, "bad value: %s %s\n", argv[i], val);
+            return false;
+        }
+    }
+    bool ok = g_opt.threads > 0 && g_opt.conns > 0 && g_opt.depth > 0
+        && g_opt.duration > 0 && g_opt.rate >= 0 && g_opt.keys > 0
+        && g_opt.value_size >= 0 && g_opt.read_ratio >= 0 && g_opt.read_ratio <= 1
+        && (g_opt.dist == "uniform" || (g_opt.dist == "zipf" && g_opt.zipf_s > 0 && g_opt.zipf_s < 1))
+        && g_opt.subscribers > 0
+        && (g_opt.workload == "kv" || g_opt.workload == "zset" || g_opt.workload == "pubsub");
+    if (!ok) {
+        fprintf(stderr, "bad option values\n");
+    }
+    return ok;
+}
+
+// xorshift64*, one per thread
+struct Rng {
+    uint64_t s;
+    uint64_t next() {
+        s ^= s >> 12;
+        s ^= s << 25;
+        s ^= s >> 27;
+        return s * 0x2545F4914F6CDD1Dull;
+    }
+    double uniform() {  // [0, 1)
+        return (double)(next() >> 11) / (double)(1ull << 53);
+    }
+};
+
+/*Zipf distributed ranks in [0, n), the method from Gray et al., "Quickly Generating
+Billion-Record Synthetic Databases" (also used by YCSB). The zeta sum is O(n) but it's
+computed once and shared by all threads. The method needs 0 < theta < 1.*/
+struct Zipf {
+    uint64_t n = 0;
+    double theta = 0, alpha = 0, zetan = 0, eta = 0;
+};
+
+static void zipf_init(Zipf *z, uint64_t n, double theta) {
+    double zeta2 = 0;
+    for (uint64_t i = 1; i <= n; i++) {
+        z->zetan += 1.0 / pow((double)i, theta);
+        if (i == 2) {
+            zeta2 = z->zetan;
+        }
+    }
+    if (n < 2) {
+        zeta2 = 1 + 1.0 / pow(2.0, theta);
+    }
+    z->n = n;
+    z->theta = theta;
+    z->alpha = 1.0 / (1.0 - theta);
+    z->eta = (1 - pow(2.0 / (double)n, 1 - theta)) / (1 - zeta2 / z->zetan);
+}
+
+static uint64_t zipf_next(const Zipf *z, Rng &rng) {
+    double u = rng.uniform();
+    double uz = u * z->zetan;
+    if (uz < 1.0) {
+        return 0;
+    }
+    if (uz < 1.0 + pow(0.5, z->theta)) {
+        return 1;
+    }
+    uint64_t r = (uint64_t)((double)z->n * pow(z->eta * u - z->eta + 1, z->alpha));
+    return r < z->n ? r : z->n - 1;
+}
+
+static Zipf g_zipf;
+
+static uint64_t next_key(Rng &rng) {
+    if (g_opt.dist == "zipf") {
+        return zipf_next(&g_zipf, rng);
+    }
+    return rng.next() % (uint64_t)g_opt.keys;
+}
+
+// request types, each one has its own latency histogram
+enum {
+    OP_GET = 0,
+    OP_SET = 1,
+    OP_ZSCORE = 2,
+    OP_ZQUERY = 3,
+    OP_ZADD = 4,
+    OP_PUBLISH = 5,
+    OP_MESSAGE = 6,     // publish to receipt, for each subscriber
+    OP_COUNT = 7,
+};
+static const char *const k_op_names[] = {"get", "set", "zscore", "zquery", "zadd", "publish", "message"};
+
+static const char *const k_zset_key = "loadgen:zset";
+
+static std::string key_name(uint64_t k) {
+    return "key:" + std::to_string(k);
+}
+
+// queue one request of the configured workload, returns its type
+static uint32_t gen_request(Client *c, Rng &rng, const std::string &value, ReplyCb cb, void *arg) {
+    uint64_t k = next_key(rng);
+    bool read = rng.uniform() < g_opt.read_ratio;
+    std::string key = key_name(k);
+    if (g_opt.workload == "kv") {
+        if (read) {
+            client_send(c, {"get", key}, cb, arg);
+            return OP_GET;
+        }
+        client_send(c, {"set", key, value}, cb, arg);
+        return OP_SET;
+    }
+    if (!read) {
+        std::string score = std::to_string(rng.next() % (uint64_t)g_opt.keys);
+        client_send(c, {"zadd", k_zset_key, score, key}, cb, arg);
+        return OP_ZADD;
+    }
+    if (rng.next() & 1) {
+        client_send(c, {"zscore", k_zset_key, key}, cb, arg);
+        return OP_ZSCORE;
+    }
+    std::string score = std::to_string(k);
+    client_send(c, {"zquery", k_zset_key, score, "", "0", "10"}, cb, arg);
+    return OP_ZQUERY;
+}
+
+struct Pending {
+    uint64_t start_ns;  // the intended send time in open-loop mode
+    uint32_t op;
+};
+
+struct ThreadStats {
+    Hist latency[OP_COUNT];
+    uint64_t errors = 0;
+};
+
+struct LgConn {
+    Client *client = NULL;
+    std::deque<Pending> pending;    // replies come back in order
+    uint64_t next_send_ns = 0;
+    ThreadStats *stats = NULL;
+};
+
+static void on_reply(const Reply &reply, void *arg) {
+    LgConn *conn = (LgConn *)arg;
+    assert(!conn->pending.empty());
+    Pending req = conn->pending.front();
+    conn->pending.pop_front();
+    if (reply.tag == TAG_ERR) {
+        conn->stats->errors++;
+    }
+    hist_record(&conn->stats->latency[req.op], get_monotonic_nsec() - req.start_ns);
+}
+
+static Client *connect_server() {
+    Client *c = client_connect(g_opt.host.c_str(), (uint16_t)g_opt.port);
+    if (!c) {
+        die("connect()");
+    }
+    return c;
+}
+
+static void run_thread(uint32_t idx, uint64_t start_ns, uint64_t end_ns, ThreadStats *st) {
+    Rng rng = {0x9E3779B97F4A7C15ull * (idx + 1)};
+    std::string value((size_t)g_opt.value_size, 'v');
+    std::vector<LgConn> conns((size_t)g_opt.conns);
+    std::vector<Client *> clients;
+    // the requests of each connection are spaced evenly, connections are staggered
+    uint64_t interval_ns = 0;
+    if (g_opt.rate > 0) {
+        interval_ns = (uint64_t)(1e9 * (double)(g_opt.threads * g_opt.conns) / (double)g_opt.rate);
+    }
+    for (size_t i = 0; i < conns.size(); i++) {
+        conns[i].client = connect_server();
+        conns[i].stats = st;
+        clients.push_back(conns[i].client);
+        uint64_t slot = idx * conns.size() + i;
+        conns[i].next_send_ns = start_ns + interval_ns * slot / (uint64_t)(g_opt.threads * g_opt.conns);
+    }
+
+    while (true) {
+        uint64_t now = get_monotonic_nsec();
+        if (now >= end_ns) {
+            break;
+        }
+        // queue the requests that are due
+        uint64_t wake_ns = end_ns;
+        for (LgConn &conn : conns) {
+            if (conn.client->failed) {
+                die("connection failed");
+            }
+            while (conn.pending.size() < (size_t)g_opt.depth) {
+                if (interval_ns && conn.next_send_ns > now) {
+                    break;
+                }
+                uint32_t op = gen_request(conn.client, rng, value, &on_reply, &conn);
+                uint64_t start = interval_ns ? conn.next_send_ns : now;
+                conn.pending.push_back(Pending{start, op});
+                conn.next_send_ns += interval_ns;
+            }
+            if (interval_ns && conn.pending.size() < (size_t)g_opt.depth
+                && conn.next_send_ns < wake_ns)
+            {
+                wake_ns = conn.next_send_ns;
+            }
+        }
+        // send, then wait for replies or the next scheduled request
+        int64_t timeout_us = wake_ns > now ? (int64_t)((wake_ns - now + 999) / 1000) : 0;
+        if (!client_run(clients.data(), clients.size(), timeout_us)) {
+            die("poll()");
+        }
+    }
+    for (LgConn &conn : conns) {
+        client_close(conn.client);
+    }
+}
+
+static void on_prefill(const Reply &reply, void *arg) {
+    if (reply.tag == TAG_ERR) {
+        (*(uint64_t *)arg)++;
+    }
+}
+
+// write every key once, so that reads hit; spread over `--conns` connections
+static void prefill() {
+    ClientPool pool;
+    if (!pool_init(&pool, g_opt.host.c_str(), (uint16_t)g_opt.port, (size_t)g_opt.conns)) {
+        die("connect()");
+    }
+    std::string value((size_t)g_opt.value_size, 'v');
+    uint64_t errors = 0;
+    const int64_t k_batch = 1000;
+    for (int64_t k = 0; k < g_opt.keys; k += k_batch) {
+        int64_t n = std::min(k_batch, g_opt.keys - k);
+        for (int64_t i = k; i < k + n; i++) {
+            std::string key = key_name((uint64_t)i);
+            Client *c = pool_pick(&pool);
+            if (g_opt.workload == "kv") {
+                client_send(c, {"set", key, value}, &on_prefill, &errors);
+            } else {
+                client_send(c, {"zadd", k_zset_key, std::to_string(i), key}, &on_prefill, &errors);
+            }
+        }
+        if (!pool_wait(&pool, -1) || errors) {
+            fprintf(stderr, "prefill failed\n");
+            exit(1);
+        }
+    }
+    pool_close(&pool);
+}
+
+// one line per request type, then `all` if given
+static void print_latency(const ThreadStats *total, const Hist *all) {
+    printf("  -> %-7s %10s %10s %10s %10s %10s %10s\n",
+        "latency", "count", "avg_us", "p50_us", "p99_us", "p999_us", "max_us");
+    for (uint32_t op = 0; op <= OP_COUNT; op++) {
+        const Hist *h = op < OP_COUNT ? &total->latency[op] : all;
+        if (!h || h->count == 0) {
+            continue;
+        }
+        printf("  -> %-7s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+            op < OP_COUNT ? k_op_names[op] : "all", (unsigned long long)h->count,
+            (double)h->sum / (double)h->count / 1e3,
+            (double)hist_percentile(h, 50) / 1e3, (double)hist_percentile(h, 99) / 1e3,
+            (double)hist_percentile(h, 99.9) / 1e3, (double)h->max / 1e3);
+    }
+}
+
+// ---------------------------------------------------------
+// pubsub workload
+// ---------------------------------------------------------
+/*Fan-out: --subscribers connections, split over the threads, subscribe to one channel and one
+more connection publishes to it. A message starts with its send time, so every receipt records
+the publish-to-delivery latency. The publisher keeps at most --depth messages that haven't
+reached every subscriber yet, or with --rate it publishes that many per second.*/
+static const char *const k_channel = "loadgen:chan";
+static std::atomic<uint64_t> g_published{0};
+static std::atomic<uint64_t> g_delivered{0};
+static std::atomic<uint32_t> g_subscribed{0};  // threads done subscribing
+static std::atomic<bool> g_publish_done{false};
+const size_t k_time_digits = 20;
+
+struct SubThread {
+    ThreadStats *stats = NULL;
+    uint64_t delivered = 0;     // not yet added to g_delivered
+};
+
+static void on_subscribed(const Reply &reply, void *arg) {
+    if (reply.tag != TAG_ARR) {
+        ((SubThread *)arg)->stats->errors++;
+    }
+}
+
+// ["message", channel, payload]
+static void on_message(const Reply &reply, void *arg) {
+    SubThread *st = (SubThread *)arg;
+    uint64_t now = get_monotonic_nsec();
+    size_t pos = 0;
+    Reply kind, chan, payload;
+    if (!reply_next(reply, &pos, &kind) || !reply_next(reply, &pos, &chan)
+        || !reply_next(reply, &pos, &payload) || kind.str != "message"
+        || payload.str.size() < k_time_digits)
+    {
+        st->stats->errors++;
+        return;
+    }
+    std::string sent(payload.str.substr(0, k_time_digits));
+    hist_record(&st->stats->latency[OP_MESSAGE], now - strtoull(sent.c_str(), NULL, 10));
+    st->delivered++;
+}
+
+static void run_subscribers(uint32_t idx, ThreadStats *stats) {
+    size_t n = (size_t)(g_opt.subscribers / g_opt.threads + (idx < g_opt.subscribers % g_opt.threads));
+    SubThread st;
+    st.stats = stats;
+    std::vector<Client *> clients;
+    // a batch at a time, so the server's accept queue keeps up
+    const size_t k_batch = 256;
+    while (clients.size() < n) {
+        size_t first = clients.size();
+        for (size_t i = first; i < std::min(n, first + k_batch); i++) {
+            Client *c = connect_server();
+            client_send(c, {"subscribe", k_channel}, &on_subscribed, &st);
+            clients.push_back(c);
+        }
+        for (size_t i = first; i < clients.size(); i++) {
+            if (!client_wait(clients[i], 10 * 1000)) {
+                die("subscribe");
+            }
+            clients[i]->on_push = &on_message;
+            clients[i]->push_arg = &st;
+        }
+    }
+    g_subscribed++;
+    // until every message arrived, or a while after the publisher stopped
+    uint64_t give_up_ns = 0;
+    uint64_t total = (uint64_t)g_opt.subscribers;
+    while (true) {
+        if (!client_run(clients.data(), clients.size(), 1000)) {
+            die("poll()");
+        }
+        for (Client *c : clients) {
+            if (c->failed) {
+                die("connection failed");
+            }
+        }
+        g_delivered += st.delivered;
+        st.delivered = 0;
+        if (g_publish_done) {
+            if (g_delivered >= g_published * total) {
+                break;
+            }
+            uint64_t now = get_monotonic_nsec();
+            give_up_ns = give_up_ns ? give_up_ns : now + 5000000000ull;
+            if (now >= give_up_ns) {
+                break;
+            }
+        }
+    }
+    for (Client *c : clients) {
+        client_close(c);
+    }
+}
+
+static void run_publisher(uint64_t start_ns, uint64_t end_ns, ThreadStats *stats) {
+    LgConn conn;
+    conn.client = connect_server();
+    conn.stats = stats;
+    uint64_t interval_ns = g_opt.rate ? (uint64_t)(1e9 / (double)g_opt.rate) : 0;
+    uint64_t next_ns = start_ns;
+    uint64_t total = (uint64_t)g_opt.subscribers;
+    std::string payload(std::max((size_t)g_opt.value_size, k_time_digits), 'v');
+    while (true) {
+        uint64_t now = get_monotonic_nsec();
+        if (now >= end_ns) {
+            break;
+        }
+        bool due = false;
+        if (interval_ns) {
+            due = next_ns <= now;
+        } else {
+            // the oldest message in flight must have reached everyone
+            uint64_t k = g_published + 1;
+            due = k <= (uint64_t)g_opt.depth || g_delivered >= (k - (uint64_t)g_opt.depth) * total;
+        }
+        if (due && now >= start_ns) {
+            uint64_t sent = interval_ns ? next_ns : now;
+            char digits[k_time_digits + 1];
+            snprintf(digits, sizeof(digits), "%020llu", (unsigned long long)sent);
+            memcpy(&payload[0], digits, k_time_digits);
+            client_send(conn.client, {"publish", k_channel, payload}, &on_reply, &conn);
+            conn.pending.push_back(Pending{sent, OP_PUBLISH});
+            g_published++;
+            next_ns += interval_ns;
+        }
+        // the subscriber threads move the closed loop on, so only wait a little
+        int64_t timeout_us = interval_ns && next_ns > now ? (int64_t)((next_ns - now + 999) / 1000) : 50;
+        if (!client_run(&conn.client, 1, std::min(timeout_us, (int64_t)1000))) {
+            die("poll()");
+        }
+        if (conn.client->failed) {
+            die("connection failed");
+        }
+    }
+    g_publish_done = true;
+    client_wait(conn.client, 5000);
+    client_close(conn.client);
+}
+
+static int run_pubsub() {
+    printf("%lld subscribers over %lld threads, %llds, %s",
+        (long long)g_opt.subscribers, (long long)g_opt.threads, (long long)g_opt.duration,
+        g_opt.rate ? "open loop at " : "closed loop, ");
+    if (g_opt.rate) {
+        printf("%lld msg/s", (long long)g_opt.rate);
+    } else {
+        printf("depth %lld", (long long)g_opt.depth);
+    }
+    printf(", %lldB messages\n", (long long)std::max(g_opt.value_size, (int64_t)k_time_digits));
+
+    std::vector<ThreadStats *> stats;
+    std::vector<std::thread> threads;
+    for (int64_t i = 0; i < g_opt.threads; i++) {
+        stats.push_back(new ThreadStats());
+        threads.emplace_back(run_subscribers, (uint32_t)i, stats.back());
+    }
+    while (g_subscribed < (uint32_t)g_opt.threads) {
+        usleep(1000);
+    }
+    stats.push_back(new ThreadStats());
+    uint64_t start_ns = get_monotonic_nsec();
+    uint64_t end_ns = start_ns + (uint64_t)g_opt.duration * 1000000000;
+    run_publisher(start_ns, end_ns, stats.back());
+    for (std::thread &t : threads) {
+        t.join();
+    }
+
+    ThreadStats *total = new ThreadStats();
+    for (ThreadStats *st : stats) {
+        for (uint32_t op = 0; op < OP_COUNT; op++) {
+            hist_merge(&total->latency[op], &st->latency[op]);
+        }
+        total->errors += st->errors;
+        delete st;
+    }
+    double secs = (double)(end_ns - start_ns) / 1e9;
+    uint64_t published = g_published, delivered = g_delivered;
+    printf("  -> %llu messages, %.0f msg/s, %llu deliveries, %.0f deliveries/s, %llu lost, %llu errors\n",
+        (unsigned long long)published, (double)published / secs,
+        (unsigned long long)delivered, (double)delivered / secs,
+        (unsigned long long)(published * (uint64_t)g_opt.subscribers - delivered),
+        (unsigned long long)total->errors);
+    print_latency(total, NULL);
+    delete total;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (!parse_options(argc, argv)) {
+        fprintf(stderr, "usage: loadgen [--threads 4] [--conns 8] [--depth 1] [--duration 10]"
+            " [--rate 0] [--keys 100000] [--dist uniform|zipf] [--zipf-s 0.99 (0 < s < 1)] [--value-size 64]"
+            " [--workload kv|zset|pubsub] [--read-ratio 0.9] [--prefill 1] [--subscribers 10000]"
+            " [--host 127.0.0.1] [--port 1234]\n");
+        return 1;
+    }
+    if (g_opt.workload == "pubsub") {
+        return run_pubsub();
+    }
+    if (g_opt.dist == "zipf") {
+        zipf_init(&g_zipf, (uint64_t)g_opt.keys, g_opt.zipf_s);
+    }
+    if (g_opt.prefill) {
+        prefill();
+    }
+
+    printf("%lld threads x %lld conns, depth %lld, %llds, %s",
+        (long long)g_opt.threads, (long long)g_opt.conns, (long long)g_opt.depth,
+        (long long)g_opt.duration, g_opt.rate ? "open loop at " : "closed loop\n");
+    if (g_opt.rate) {
+        printf("%lld rps\n", (long long)g_opt.rate);
+    }
+    printf("%s workload, %.0f%% reads, %lld keys (%s), %lldB values\n",
+        g_opt.workload.c_str(), g_opt.read_ratio * 100, (long long)g_opt.keys,
+        g_opt.dist.c_str(), (long long)g_opt.value_size);
+
+    std::vector<ThreadStats *> stats;
+    std::vector<std::thread> threads;
+    uint64_t start_ns = get_monotonic_nsec() + 100 * 1000 * 1000;  // after connecting
+    uint64_t end_ns = start_ns + (uint64_t)g_opt.duration * 1000000000;
+    for (int64_t i = 0; i < g_opt.threads; i++) {
+        stats.push_back(new ThreadStats());
+        threads.emplace_back(run_thread, (uint32_t)i, start_ns, end_ns, stats.back());
+    }
+    for (std::thread &t : threads) {
+        t.join();
+    }
+
+    ThreadStats *total = new ThreadStats();
+    for (ThreadStats *st : stats) {
+        for (uint32_t op = 0; op < OP_COUNT; op++) {
+            hist_merge(&total->latency[op], &st->latency[op]);
+        }
+        total->errors += st->errors;
+        delete st;
+    }
+    Hist all;
+    for (uint32_t op = 0; op < OP_COUNT; op++) {
+        hist_merge(&all, &total->latency[op]);
+    }
+    double secs = (double)(end_ns - start_ns) / 1e9;
+    printf("  -> %llu requests, %.0f RPS, %llu errors\n",
+        (unsigned long long)all.count, (double)all.count / secs,
+        (unsigned long long)total->errors);
+    print_latency(total, &all);
+    delete total;
+    return 0;
+}
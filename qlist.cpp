@@ -0,0 +1,190 @@
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+// proj
+#include "qlist.h"
+#include "common.h"
+
+
+const uint32_t k_elem_head = 4;     // the length
+
+static QChunk *chunk_of(DList *node) {
+    return container_of(node, QChunk, link);
+}
+
+static QElem elem_at(const QChunk *chunk, uint32_t pos) {
+    uint32_t len = 0;
+    memcpy(&len, &chunk->data[pos], 4);
+    QElem elem;
+    elem.data = (const char *)&chunk->data[pos + k_elem_head];
+    elem.len = len;
+    return elem;
+}
+
+// the byte offset of the element at `index` in the chunk, a linear scan
+static uint32_t chunk_offset(const QChunk *chunk, uint32_t index) {
+    uint32_t pos = 0;
+    for (uint32_t i = 0; i < index; i++) {
+        pos += k_elem_head + (uint32_t)elem_at(chunk, pos).len;
+    }
+    return pos;
+}
+
+static QChunk *chunk_new(QList *list, DList *before, uint32_t cap) {
+    QChunk *chunk = (QChunk *)malloc(sizeof(QChunk) + cap);
+    assert(chunk);
+    chunk->count = 0;
+    chunk->used = 0;
+    chunk->cap = cap;
+    dlist_insert_before(before, &chunk->link);
+    list->mem += sizeof(QChunk) + cap;
+    return chunk;
+}
+
+// realloc() may move the chunk, so the neighbours are pointed at the new address
+static QChunk *chunk_resize(QList *list, QChunk *chunk, uint32_t cap) {
+    list->mem = list->mem - chunk->cap + cap;
+    chunk = (QChunk *)realloc(chunk, sizeof(QChunk) + cap);
+    assert(chunk);
+    chunk->cap = cap;
+    chunk->link.prev->next = &chunk->link;
+    chunk->link.next->prev = &chunk->link;
+    return chunk;
+}
+
+static void chunk_free(QList *list, QChunk *chunk) {
+    dlist_detach(&chunk->link);
+    list->count -= chunk->count;
+    list->mem -= sizeof(QChunk) + chunk->cap;
+    free(chunk);
+}
+
+// remove `size` bytes at `pos` holding `count` elements, an emptied chunk goes away
+static void chunk_erase(QList *list, QChunk *chunk, uint32_t pos, uint32_t size, uint32_t count) {
+    if (count == chunk->count) {
+        return chunk_free(list, chunk);
+    }
+    memmove(&chunk->data[pos], &chunk->data[pos + size], chunk->used - pos - size);
+    chunk->used -= size;
+    chunk->count -= count;
+    list->count -= count;
+    if (chunk->used < chunk->cap / 4) {
+        chunk_resize(list, chunk, chunk->used);     // mostly popped or trimmed
+    }
+}
+
+void qlist_push(QList *list, bool front, const char *data, size_t len) {
+    uint32_t size = k_elem_head + (uint32_t)len;
+    DList *end = front ? list->chunks.next : list->chunks.prev;
+    QChunk *chunk = NULL;
+    if (end != &list->chunks && chunk_of(end)->used + size <= k_qchunk_max) {
+        chunk = chunk_of(end);
+        if (chunk->used + size > chunk->cap) {
+            uint32_t cap = std::max(chunk->used + size, std::min(2 * chunk->cap, k_qchunk_max));
+            chunk = chunk_resize(list, chunk, cap);
+        }
+    } else {
+        // a new chunk at that end, sized for this element and grown by doubling
+        chunk = chunk_new(list, front ? list->chunks.next : &list->chunks, size);
+    }
+    uint32_t pos = front ? 0 : chunk->used;
+    memmove(&chunk->data[pos + size], &chunk->data[pos], chunk->used - pos);
+    uint32_t len32 = (uint32_t)len;
+    memcpy(&chunk->data[pos], &len32, 4);
+    memcpy(&chunk->data[pos + k_elem_head], data, len);
+    chunk->used += size;
+    chunk->count++;
+    list->count++;
+}
+
+bool qlist_peek(QList *list, bool front, QElem *out) {
+    if (list->count == 0) {
+        return false;
+    }
+    QChunk *chunk = chunk_of(front ? list->chunks.next : list->chunks.prev);
+    *out = elem_at(chunk, front ? 0 : chunk_offset(chunk, chunk->count - 1));
+    return true;
+}
+
+void qlist_pop(QList *list, bool front) {
+    assert(list->count > 0);
+    QChunk *chunk = chunk_of(front ? list->chunks.next : list->chunks.prev);
+    uint32_t pos = front ? 0 : chunk_offset(chunk, chunk->count - 1);
+    chunk_erase(list, chunk, pos, k_elem_head + (uint32_t)elem_at(chunk, pos).len, 1);
+}
+
+void qlist_trim(QList *list, size_t front, size_t back) {
+    if (front + back >= list->count) {
+        return qlist_clear(list);
+    }
+    // whole chunks are dropped without looking inside
+    while (front > 0) {
+        QChunk *chunk = chunk_of(list->chunks.next);
+        if (front < chunk->count) {
+            chunk_erase(list, chunk, 0, chunk_offset(chunk, (uint32_t)front), (uint32_t)front);
+            break;
+        }
+        front -= chunk->count;
+        chunk_free(list, chunk);
+    }
+    while (back > 0) {
+        QChunk *chunk = chunk_of(list->chunks.prev);
+        if (back < chunk->count) {
+            uint32_t pos = chunk_offset(chunk, chunk->count - (uint32_t)back);
+            chunk_erase(list, chunk, pos, chunk->used - pos, (uint32_t)back);
+            break;
+        }
+        back -= chunk->count;
+        chunk_free(list, chunk);
+    }
+}
+
+bool qlist_seek(QList *list, size_t index, QIter *it) {
+    if (index >= list->count) {
+        return false;
+    }
+    QChunk *chunk = NULL;
+    if (index < list->count / 2) {
+        chunk = chunk_of(list->chunks.next);
+        while (index >= chunk->count) {
+            index -= chunk->count;
+            chunk = chunk_of(chunk->link.next);
+        }
+    } else {
+        size_t rindex = list->count - 1 - index;    // counted from the tail
+        chunk = chunk_of(list->chunks.prev);
+        while (rindex >= chunk->count) {
+            rindex -= chunk->count;
+            chunk = chunk_of(chunk->link.prev);
+        }
+        index = chunk->count - 1 - rindex;
+    }
+    it->chunk = chunk;
+    it->pos = chunk_offset(chunk, (uint32_t)index);
+    return true;
+}
+
+bool qlist_next(QList *list, QIter *it, QElem *out) {
+    if (!it->chunk) {
+        return false;
+    }
+    *out = elem_at(it->chunk, it->pos);
+    it->pos += k_elem_head + (uint32_t)out->len;
+    if (it->pos == it->chunk->used) {
+        DList *next = it->chunk->link.next;
+        it->chunk = next == &list->chunks ? NULL : chunk_of(next);
+        it->pos = 0;
+    }
+    return true;
+}
+
+void qlist_clear(QList *list) {
+    while (!dlist_empty(&list->chunks)) {
+        chunk_free(list, chunk_of(list->chunks.next));
+    }
+}
+
+size_t qlist_mem(QList *list) {
+    return list->mem;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "list.h"
+
+
+/*A list value, a deque of chunks linked through DList like Redis' quicklist. Each chunk packs
+its elements back to back, so a list costs one allocation per few hundred small elements rather
+than one per element, and finding an index skips whole chunks by their counts before scanning
+a single chunk.*/
+const uint32_t k_qchunk_max = 4096;     // bytes of elements per chunk, unless one is bigger
+
+struct QChunk {
+    DList link;
+    uint32_t count = 0;     // elements
+    uint32_t used = 0;      // bytes of `data` in use: [u32 len][bytes] back to back
+    uint32_t cap = 0;       // bytes of `data` allocated
+    uint8_t data[0];
+};
+struct QList {
+    DList chunks;           // QChunk::link, from the head to the tail
+    size_t count = 0;       // elements, in all chunks
+    size_t mem = 0;         // bytes of the chunks, see qlist_mem()
+    QList() { dlist_init(&chunks); }
+};
+// an element, pointing into its chunk until the list is modified
+struct QElem {
+    const char *data = NULL;
+    size_t len = 0;
+};
+// a position for qlist_next()
+struct QIter {
+    QChunk *chunk = NULL;
+    uint32_t pos = 0;       // byte offset in the chunk
+};
+
+void   qlist_push(QList *list, bool front, const char *data, size_t len);
+// the first or the last element, false if the list is empty
+bool   qlist_peek(QList *list, bool front, QElem *out);
+void   qlist_pop(QList *list, bool front);
+// remove `front` elements from the head and `back` elements from the tail
+void   qlist_trim(QList *list, size_t front, size_t back);
+// point `it` at the element at `index`, from whichever end is closer
+bool   qlist_seek(QList *list, size_t index, QIter *it);
+// the element at `it` and advance, false past the tail
+bool   qlist_next(QList *list, QIter *it, QElem *out);
+void   qlist_clear(QList *list);
+size_t qlist_mem(QList *list);  // bytes of the chunks, for maxmemory
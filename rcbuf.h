@@ -0,0 +1,77 @@
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// A reference counted byte string. A string value is one of these, and a
+// response can reference it instead of copying the bytes, so overwriting the
+// key while the response is still queued just drops one reference. Once shared
+// it's immutable, see rcbuf_writable().
+struct RcBuf {
+    uint32_t refs = 1;
+    uint32_t cap = 0;   // bytes allocated for `data`, >= len
+    size_t len = 0;
+    uint8_t data[0];
+};
+
+// `data` == NULL gives `len` zero bytes
+inline RcBuf *rcbuf_new(const void *data, size_t len) {
+    RcBuf *rc = (RcBuf *)malloc(sizeof(RcBuf) + len);
+    assert(rc);
+    rc->refs = 1;
+    rc->cap = (uint32_t)len;
+    rc->len = len;
+    if (data) {
+        memcpy(rc->data, data, len);
+    } else {
+        memset(rc->data, 0, len);
+    }
+    return rc;
+}
+
+// The string to modify in place, at least `len` bytes long (the new ones are zeroes), for
+// values edited bit by bit. Shared, it's copied first. Growing leaves room like Redis' sds
+// (double up to 1 MB, then 1 MB more), so raising the length a bit at a time reallocates
+// O(log n) times instead of every time.
+inline RcBuf *rcbuf_writable(RcBuf *rc, size_t len) {
+    size_t old_len = rc->len;
+    len = len > old_len ? len : old_len;
+    if (len > rc->cap || rc->refs > 1) {
+        size_t cap = rc->cap;
+        if (len > cap) {
+            cap = len < (1u << 20) ? 2 * len : len + (1u << 20);
+        }
+        assert(cap <= UINT32_MAX);
+        RcBuf *copy = NULL;
+        if (rc->refs > 1) {
+            copy = (RcBuf *)malloc(sizeof(RcBuf) + cap);
+            assert(copy);
+            memcpy(copy->data, rc->data, old_len);
+            rc->refs--;
+        } else {
+            copy = (RcBuf *)realloc(rc, sizeof(RcBuf) + cap);
+            assert(copy);
+        }
+        rc = copy;
+        rc->refs = 1;
+        rc->cap = (uint32_t)cap;
+    }
+    memset(rc->data + old_len, 0, len - old_len);
+    rc->len = len;
+    return rc;
+}
+
+inline RcBuf *rcbuf_ref(RcBuf *rc) {
+    rc->refs++;
+    return rc;
+}
+
+inline void rcbuf_unref(RcBuf *rc) {
+    if (rc && --rc->refs == 0) {
+        free(rc);
+    }
+}
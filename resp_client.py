@@ -0,0 +1,88 @@
+# A small RESP client for the test_*.py scripts, which talk to a server on
+# 127.0.0.1, port 1234 unless told otherwise.
+
+import socket
+
+
+def enc(*args):
+    out = b'*%d\r\n' % len(args)
+    for a in args:
+        a = a.encode() if isinstance(a, str) else a
+        out += b'$%d\r\n%s\r\n' % (len(a), a)
+    return out
+
+
+class Conn:
+    def __init__(self, port=1234):
+        self.sock = socket.create_connection(('127.0.0.1', port))
+        self.buf = b''
+
+    def reply(self):
+        # one reply; a RESP3 push comes back as ('>', [...]) and a map as a flat list,
+        # anything that isn't a bulk string or a container as its line without \r\n
+        while True:
+            end = self.buf.find(b'\r\n')
+            if end >= 0:
+                line = self.buf[:end]
+                if line[:1] in (b'*', b'>', b'%'):
+                    self.buf = self.buf[end + 2:]
+                    n = int(line[1:]) * (2 if line[:1] == b'%' else 1)
+                    items = [self.reply() for _ in range(n)]
+                    return ('>', items) if line[:1] == b'>' else items
+                if line[:1] != b'$' or line == b'$-1':
+                    self.buf = self.buf[end + 2:]
+                    return line
+                size = int(line[1:])
+                if len(self.buf) >= end + 2 + size + 2:
+                    val = self.buf[end + 2:end + 2 + size]
+                    self.buf = self.buf[end + 2 + size + 2:]
+                    return val
+            self.recv()
+
+    def recv(self):
+        chunk = self.sock.recv(1 << 20)
+        assert chunk, 'EOF'
+        self.buf += chunk
+
+    def call(self, *args):
+        self.send(*args)
+        return self.reply()
+
+    def send(self, *args):
+        self.sock.sendall(enc(*args))
+
+    def send_raw(self, data):
+        self.sock.sendall(data)
+
+    def pipeline(self, cmds):
+        self.sock.sendall(b''.join(enc(*c) for c in cmds))
+        return [self.reply() for _ in cmds]
+
+    def expect(self, want):
+        # the next bytes received, compared as they are
+        while len(self.buf) < len(want):
+            chunk = self.sock.recv(1 << 20)
+            assert chunk, f'EOF, got:{self.buf!r} want:{want!r}'
+            self.buf += chunk
+        got, self.buf = self.buf[:len(want)], self.buf[len(want):]
+        assert got == want and not self.buf, f'got:{got + self.buf!r} want:{want!r}'
+
+    def check(self, args, want):
+        self.send(*args)
+        self.expect(want)
+
+    def pending(self):
+        # whether something arrived, without waiting for it
+        self.sock.settimeout(0.1)
+        try:
+            chunk = self.sock.recv(1 << 20)
+        except socket.timeout:
+            chunk = b''
+        finally:
+            self.sock.settimeout(None)
+        self.buf += chunk
+        return len(self.buf) > 0
+
+    def info(self, section):
+        items = self.call('info', section)
+        return {items[i].decode(): int(items[i + 1][1:]) for i in range(0, len(items), 2)}
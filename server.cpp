@@ -1,1010 +1,6000 @@
-
-// stdlib
-#include <assert.h>
-#include <stdint.h>
-#include <stdlib.h>
-#include <string.h>
-#include <stdio.h>
-#include <errno.h>
-// system
-#include <fcntl.h>
-#include <poll.h>
-#include <unistd.h>
-#include <arpa/inet.h>
-#include <sys/socket.h>
-#include <netinet/ip.h>
-// C++
-#include <string>
-#include <vector>
-#include <map>
-#include <math.h>   // isnan
-#include "common.h"
-#include "zset.h"
-#include <time.h>
-#include "list.h"
-#include "hashtable.h"
-#include "heap.h"
-/*Remember how hashtable.cpp only gives us back an HNode*? We need to find the actual data (the string key/value) attached to it. This macro does pointer math. It takes the memory address of the HNode, subtracts its position inside the struct, and returns a pointer to the entire wrapper struct!*/
-
-typedef std::vector<uint8_t> Buffer;
-
-
-
-static void msg(const char *msg) {
-    fprintf(stderr, "%s\n", msg);
-}
-
-static void msg_errno(const char *msg) {
-    fprintf(stderr, "[errno:%d] %s\n", errno, msg);
-}
-
-static void die(const char *msg) {
-    int err = errno;
-    fprintf(stderr, "[%d] %s\n", err, msg);
-    abort();
-}
-/*This grabs the current time in milliseconds. It uses CLOCK_MONOTONIC instead of the regular wall clock. Why? If the server administrator manually changes the system clock (or daylight saving time happens), a regular clock might jump backward, causing timers to break. A "monotonic" clock only ticks forward, making it perfect for measuring elapsed time.*/
-static uint64_t get_monotonic_msec() {
-    struct timespec tv = {0, 0};
-    clock_gettime(CLOCK_MONOTONIC, &tv);
-    return uint64_t(tv.tv_sec) * 1000 + tv.tv_nsec / 1000 / 1000;
-}
-static void fd_set_nb(int fd) {
-    errno = 0;
-    int flags = fcntl(fd, F_GETFL, 0);  //Gets the current status flags of the file descriptor fd
-    if (errno) {
-        die("fcntl error");
-        return;
-    }
-
-    flags |= O_NONBLOCK;  /*tells the OS that read() and write() on this socket should never "block" (sleep) waiting for data. If data isn't ready, they return immediately with an error (EAGAIN).*/
-
-    errno = 0;
-    (void)fcntl(fd, F_SETFL, flags); // Applies the modified flags back to the file descriptor
-    if (errno) {
-        die("fcntl error");
-    }
-}
-
-const size_t k_max_msg = 32 << 20;  // likely larger than the kernel buffer
-struct Conn {
-    int fd = -1;
-    bool want_read = false;   // Do we want to read from the socket?
-    bool want_write = false;  // Do we have data waiting to be written?
-    bool want_close = false;  // Should we close this connection?
-    std::vector<uint8_t> incoming;  // Buffer for data received but not yet parsed
-    std::vector<uint8_t> outgoing;  // Buffer for data waiting to be sent
-    uint64_t last_active_ms = 0;    //This acts as the timestamp for when the client last did something.
-    DList idle_node;               //This is the physical "link" that connects this specific client to the rest of the clients in the line.
-};
-static struct {
-    HMap db;    // top-level hashtable
-    std::vector<Conn *> fd2conn; // a map of all client connections, keyed by fd
-    DList idle_list;     //This is the dummy "head" of the line. It sits in your global data tracker and represents the starting point of the queue.
-    std::vector<HeapItem> heap;  //The array that holds our Min-Heap timers
-} g_data;
-/*Instead of std::map, your global database is now just a wrapper around your HMap manager from hashtable.h*/
-/*std::map: It's a binary search tree (usually Red-Black Tree) under the hood. It maps a string (Key) to a string (Value).*/
-
-
-/*Buffering: Because TCP is a stream (not packets), one read() might give us half a message, or 2.5 messages.
- We append everything to incoming until we have a full message. Similarly, outgoing stores data if the socket isn't ready to send it all at once*/
-
- static void buf_append(std::vector<uint8_t> &buf, const uint8_t *data, size_t len) {
-    buf.insert(buf.end(), data, data + len);    //Adds new raw bytes to the end of the vector.
-}
-static void buf_consume(std::vector<uint8_t> &buf, size_t n) {
-    buf.erase(buf.begin(), buf.begin() + n);           //Removes bytes from the front of the vector after they have been processed or sent.
-}
-
-static Conn *handle_accept(int fd) {
-    struct sockaddr_in client_addr = {};
-    socklen_t addrlen = sizeof(client_addr);
-    int connfd = accept(fd, (struct sockaddr *)&client_addr, &addrlen);  /*Accepts a pending connection from the listening socket.*/
-    if (connfd < 0) {                                     /*The new file descriptor specifically for this client.*/
-        msg_errno("accept() error");
-        return NULL;
-    }
-       uint32_t ip = client_addr.sin_addr.s_addr;
-    fprintf(stderr, "new client from %u.%u.%u.%u:%u\n",
-        ip & 255, (ip >> 8) & 255, (ip >> 16) & 255, ip >> 24,
-        ntohs(client_addr.sin_port)
-    );
-    fd_set_nb(connfd);   /*Crucial. The new connection must also be non-blocking*/
-    Conn *conn = new Conn();    
-    conn->fd = connfd;
-    conn->want_read = true;            //initializes the state. We default to wanting to read requests from the client.
-    conn->last_active_ms = get_monotonic_msec();  //Stamps the client with the exact millisecond they connected.
-    dlist_insert_before(&g_data.idle_list, &conn->idle_node);  //Inserts the client's idle_node right before the idle_list head. Because the list loops in a circle, inserting "before the head" places them exactly at the back of the line.
-    return conn;
-}
-const size_t k_max_args = 200 * 1000;
-/*This function grabs 4 bytes from our data and turns them into a 32-bit integer (like turning 04 00 00 00 into the number 4).*/
-static bool read_u32(const uint8_t *&cur, const uint8_t *end, uint32_t &out) {
-    if (cur + 4 > end) {
-        return false;
-    }
-    memcpy(&out, cur, 4);
-    cur += 4;
-    return true;
-}
-/*Same as read_32 but for reading string*/
-static bool read_str(const uint8_t *&cur, const uint8_t *end, uint32_t n,std::string &out) {
-    if(cur+n>end){
-        return false;
-    }
-    out.assign((const char *)cur, n);  //uses out.assign(...) instead of memcpy
-    cur+=n;
-    return true;
-}
-static int32_t parse_req(const uint8_t *data,size_t size,std::vector<std::string> &out){
-    const uint8_t *end=data+size;;  //Calculates where the buffer stops so we don't crash.
-    uint32_t nstr=0;
-    // 1. Read the number of strings
-    if(!read_u32(data,end,nstr)){
-        return -1;
-    }
-    // 2. Safety check: Ensure nstr is not unreasonably large to prevent potential DoS attacks or memory issues.
-    if (nstr > k_max_args) {
-        return -1;
-    }
-    // 3. Loop to read each string
-    while(out.size()<nstr){
-        uint32_t len=0;
-        // 3a. Read length of next string
-        if(!read_u32(data,end,len)){
-            return -1;
-        }
-         // 3b. Read the actual string
-         out.push_back(std::string());    
-        if(!read_str(data,end,len,out.back())){
-            return -1;
-        }
-       
-    }
-    // 4. Check for garbage
-     if(data!=end){
-            return -1;
-        }
-        return 0;
-}
-
-// error code for TAG_ERR
-enum {
-    ERR_UNKNOWN = 1,    // unknown command
-    ERR_TOO_BIG = 2,    // response too big
-    ERR_BAD_TYP = 3,    // unexpected value type
-    ERR_BAD_ARG = 4,    // bad arguments
-};
-
-// data types of serialized data
-enum {
-    TAG_NIL = 0,    // nil
-    TAG_ERR = 1,    // error code + msg
-    TAG_STR = 2,    // string
-    TAG_INT = 3,    // int64
-    TAG_DBL = 4,    // double
-    TAG_ARR = 5,    // array
-};
-// help functions for the serialization
-static void buf_append_u8(Buffer &buf, uint8_t data) {
-    buf.push_back(data);
-}
-static void buf_append_u32(Buffer &buf, uint32_t data) {
-    buf_append(buf, (const uint8_t *)&data, 4);
-}
-static void buf_append_i64(Buffer &buf, int64_t data) {
-    buf_append(buf, (const uint8_t *)&data, 8);
-}
-static void buf_append_dbl(Buffer &buf, double data) {
-    buf_append(buf, (const uint8_t *)&data, 8);
-}
-
-
-// append serialized data types to the back
-static void out_nil(Buffer &out) {
-    buf_append_u8(out, TAG_NIL);
-}
-
-static void out_str(Buffer &out, const char *s, size_t size) {
-    buf_append_u8(out, TAG_STR);
-    buf_append_u32(out, (uint32_t)size);
-    buf_append(out, (const uint8_t *)s, size);
-}
-static void out_int(Buffer &out, int64_t val) {
-    buf_append_u8(out, TAG_INT);
-    buf_append_i64(out, val);
-}
-static void out_dbl(Buffer &out, double val) {
-     buf_append_u8(out, TAG_DBL);
-    buf_append_dbl(out, val);
- }
-static void out_err(Buffer &out, uint32_t code, const std::string &msg) {
-    buf_append_u8(out, TAG_ERR);
-    buf_append_u32(out, code);
-    buf_append_u32(out, (uint32_t)msg.size());
-    buf_append(out, (const uint8_t *)msg.data(), msg.size());
-}
-static void out_arr(Buffer &out, uint32_t n) {
-    buf_append_u8(out, TAG_ARR);
-    buf_append_u32(out, n);
-}
-static size_t out_begin_arr(Buffer &out) {
-    out.push_back(TAG_ARR);
-    buf_append_u32(out, 0);     // filled by out_end_arr()
-    return out.size() - 4;      // the `ctx` arg
-}
-static void out_end_arr(Buffer &out, size_t ctx, uint32_t n) {
-    assert(out[ctx - 1] == TAG_ARR);
-    memcpy(&out[ctx], &n, 4);
-}
-
-// // 1. The Output format
-// struct Response{
-//     uint32_t status=0;  //A simple integer code (0 = OK, 1 = Error, etc.).
-//     std::vector<uint8_t> data;  //The actual payload we want to send back to the client (like the value of a key).
-// };
-
-/*This is your actual payload. Notice how HNode node; is embedded directly inside it.
- This is the "handle glued to the back" concept we discussed earlier.
-  The hash table only cares about node, but you care about key and val.*/
-
-  // value types
-enum {
-    T_INIT  = 0,
-    T_STR   = 1,    // string
-    T_ZSET  = 2,    // sorted set
-};
-// KV pair for the top-level hashtable
-struct Entry {
-    struct HNode node;  // hashtable node
-    std::string key;
-    // value
-    size_t heap_idx = -1; // Tracks where this key's timer is in the heap (-1 means no TTL)
-    uint32_t type = 0;    // one of the following
-    std::string str;
-    ZSet zset;
-};
-
-// --- NEW HEAP HELPERS ---
-static void heap_delete(std::vector<HeapItem> &a, size_t pos) {
-    a[pos] = a.back(); // Swap the deleted item with the last item
-    a.pop_back();      // Remove the last item
-    if (pos < a.size()) {
-        heap_update(a.data(), pos, a.size()); // Re-sort the heap
-    }
-}
-
-static void heap_upsert(std::vector<HeapItem> &a, size_t pos, HeapItem t) {
-    if (pos < a.size()) {
-        a[pos] = t;         // Update existing timer
-    } else {
-        pos = a.size();
-        a.push_back(t);     // Add new timer
-    }
-    heap_update(a.data(), pos, a.size()); // Re-sort the heap
-}
-static Entry *entry_new(uint32_t type) {
-    Entry *ent = new Entry();
-    ent->type = type;
-    return ent;
-}
-static void entry_del(Entry *ent) {
-   // Remove from TTL heap if it has a timer
-    if (ent->heap_idx != (size_t)-1) {
-        heap_delete(g_data.heap, ent->heap_idx);
-        ent->heap_idx = -1;
-    }
-    if (ent->type == T_ZSET) {
-        zset_clear(&ent->zset);
-    }
-    delete ent;
-}
-static void entry_set_ttl(Entry *ent, int64_t ttl_ms) {
-    if (ttl_ms < 0 && ent->heap_idx != (size_t)-1) {
-        // A negative TTL means "remove the timer"
-        heap_delete(g_data.heap, ent->heap_idx);
-        ent->heap_idx = -1;
-    } else if (ttl_ms >= 0) {
-        // Add or update the timer in the heap
-        uint64_t expire_at = get_monotonic_msec() + (uint64_t)ttl_ms;
-        HeapItem item = {expire_at, &ent->heap_idx}; // Pass a pointer to the entry's heap_idx!
-        heap_upsert(g_data.heap, ent->heap_idx, item);
-    }
-}
-
-
-
-
-
-// -----------------------
-struct LookupKey {
-    struct HNode node;  // hashtable node
-    std::string key;
-};
-// equality comparison for the top-level hashstable
-static bool entry_eq(HNode *node, HNode *key) {
-    struct Entry *ent = container_of(node, struct Entry, node);
-    struct LookupKey *keydata = container_of(key, struct LookupKey, node);
-    return ent->key == keydata->key;
-}
-/*This is an implementation of the FNV-1a hash algorithm.
- It loops through every character in your string and scrambles it into a 64-bit integer (hcode).
-  This number tells the hash table which bucket to put the entry in.*/
-// static uint64_t str_hash(const uint8_t *data, size_t len) {
-//     uint32_t h = 0x811C9DC5;
-//     for (size_t i = 0; i < len; i++) {
-//         h = (h + data[i]) * 0x01000193;
-//     }
-//     return h;            moved to common.h 
-// }
-
-
-// static void do_get(std::vector<std::string> &cmd, Buffer &out) {
-//     // a dummy `Entry` just for the lookup
-//     Entry key;              //We create a temporary, fake Entry just to hold the key we are looking for.
-//     key.key.swap(cmd[1]);
-//     key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());         //We calculate the hash of the target string so the lookup function can find it fast.
-//     // hashtable lookup
-//     HNode *node = hm_lookup(&g_data.db, &key.node, &entry_eq);                   //We ask your custom hash table to find the node. We pass in the dummy key and our entry_eq comparison function. If it returns NULL, the key doesn't exist (RES_NX).
-//     if (!node) {
-//        return out_nil(out);
-//     }
-//     // copy the value
-//     const std::string &val = container_of(node, Entry, node)->val;
-//     out_str(out, val.data(),val.size());
-// }
-
-static void do_get(std::vector<std::string> &cmd, Buffer &out) {
-    // a dummy struct just for the lookup
-    LookupKey key;
-    key.key.swap(cmd[1]);
-    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
-    // hashtable lookup
-    HNode *node = hm_lookup(&g_data.db, &key.node, &entry_eq);
-    if (!node) {
-        return out_nil(out);
-    }
-    // copy the value
-    Entry *ent = container_of(node, Entry, node);
-    if (ent->type != T_STR) {
-        return out_err(out, ERR_BAD_TYP, "not a string value");
-    }
-    return out_str(out, ent->str.data(), ent->str.size());
-}
-
-
-// static void do_set(std::vector<std::string> &cmd, Buffer &out) {
-//     // a dummy `Entry` just for the lookup
-//     Entry key;   //Similar to get, we create a dummy key and try to find it in the database first.
-//     key.key.swap(cmd[1]);                                       //
-//     key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
-//     // hashtable lookup
-//     HNode *node = hm_lookup(&g_data.db, &key.node, &entry_eq);
-//     if (node) {       //If found: We don't need to insert a new node. We just find the existing Entry and use .swap() to quickly replace the old value with the new one.
-//         // found, update the value
-//         container_of(node, Entry, node)->val.swap(cmd[2]);
-//     } else {
-//         // not found, allocate & insert a new pair
-//         Entry *ent = new Entry();
-//         ent->key.swap(key.key);
-//         ent->node.hcode = key.node.hcode;
-//         ent->val.swap(cmd[2]);
-//         hm_insert(&g_data.db, &ent->node);
-//     }
-//     /*If not found: We allocate fresh memory (new Entry()). 
-//     We fill it with the key, the pre-calculated hash code,
-//      and the value. Finally, we hand its &ent->node over to hm_insert to link it into the hash table.*/
-
-//      return out_nil(out);  // NEW: Successfully set the data? Redis traditionally replies with NIL to save bandwidth.
-// }
-static void do_set(std::vector<std::string> &cmd, Buffer &out) {
-    // a dummy struct just for the lookup
-    LookupKey key;
-    key.key.swap(cmd[1]);
-    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
-    // hashtable lookup
-    HNode *node = hm_lookup(&g_data.db, &key.node, &entry_eq);
-    if (node) {
-        // found, update the value
-        Entry *ent = container_of(node, Entry, node);
-        if (ent->type != T_STR) {
-            return out_err(out, ERR_BAD_TYP, "a non-string value exists");
-        }
-        ent->str.swap(cmd[2]);
-    } else {
-        // not found, allocate & insert a new pair
-        Entry *ent = entry_new(T_STR);
-        ent->key.swap(key.key);
-        ent->node.hcode = key.node.hcode;
-        ent->str.swap(cmd[2]);
-        ent->heap_idx = -1;
-        hm_insert(&g_data.db, &ent->node);
-    }
-    return out_nil(out);
-}
-// static void do_del(std::vector<std::string> &cmd, Buffer &out) {
-//     // a dummy `Entry` just for the lookup
-//     Entry key;
-//     key.key.swap(cmd[1]);
-//     key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
-//     // hashtable delete
-//     HNode *node = hm_delete(&g_data.db, &key.node, &entry_eq);         //: This removes the node from the hash table's linked list and returns the detached node to us.
-//     if (node) { // deallocate the pair
-//         delete container_of(node, Entry, node);        //Because the hash table only manages links (not memory), it is our job to free the memory. We find the parent Entry and delete it so we don't cause a memory leak.
-//         return out_int(out, 1); // NEW: Send an INT tag with '1' meaning "1 item deleted"
-//     }
-//     return out_int(out,0); // NEW: If the key doesn't exist, we reply with '0' meaning "0 items deleted"
-// }
-static void do_del(std::vector<std::string> &cmd, Buffer &out) {
-    // a dummy struct just for the lookup
-    LookupKey key;
-    key.key.swap(cmd[1]);
-    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
-    // hashtable delete
-    HNode *node = hm_delete(&g_data.db, &key.node, &entry_eq);
-    if (node) { // deallocate the pair
-        entry_del(container_of(node, Entry, node));
-    }
-    return out_int(out, node ? 1 : 0);
-}
-static bool cb_keys(HNode *node, void *arg) {
-    Buffer &out = *(Buffer *)arg;
-    const std::string &key = container_of(node, Entry, node)->key;
-    out_str(out, key.data(), key.size());
-    return true;
-}
-
-
-
-
-
-static bool str2int(const std::string &s, int64_t &out) {
-    char *endp = NULL;
-    out = strtoll(s.c_str(), &endp, 10);
-    return endp == s.c_str() + s.size();
-}
-// PEXPIRE key ttl_ms
-static void do_expire(std::vector<std::string> &cmd, Buffer &out) {
-    int64_t ttl_ms = 0;
-    if (!str2int(cmd[2], ttl_ms)) {
-        return out_err(out, ERR_BAD_ARG, "expect int64");
-    }
-    LookupKey key;
-    key.key.swap(cmd[1]);
-    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
-    HNode *node = hm_lookup(&g_data.db, &key.node, &entry_eq);
-    
-    if (node) {
-        Entry *ent = container_of(node, Entry, node);
-        entry_set_ttl(ent, ttl_ms);
-    }
-    return out_int(out, node ? 1: 0);
-}
-
-// PTTL key
-static void do_ttl(std::vector<std::string> &cmd, Buffer &out) {
-    LookupKey key;
-    key.key.swap(cmd[1]);
-    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
-    HNode *node = hm_lookup(&g_data.db, &key.node, &entry_eq);
-    
-    if (!node) {
-        return out_int(out, -2);    // -2 means key not found
-    }
-    Entry *ent = container_of(node, Entry, node);
-    if (ent->heap_idx == (size_t)-1) {
-        return out_int(out, -1);    // -1 means no TTL set
-    }
-    
-    uint64_t expire_at = g_data.heap[ent->heap_idx].val;
-    uint64_t now_ms = get_monotonic_msec();
-    return out_int(out, expire_at > now_ms ? (expire_at - now_ms) : 0);
-}
-// -----------------------
-static void do_keys(std::vector<std::string> &, Buffer &out) {
-    out_arr(out, (uint32_t)hm_size(&g_data.db));
-    hm_foreach(&g_data.db, &cb_keys, (void *)&out);
-}
-
-static bool str2dbl(const std::string &s, double &out) {
-    char *endp = NULL;
-    out = strtod(s.c_str(), &endp);
-    return endp == s.c_str() + s.size() && !isnan(out);
-}
-
-
-
-// zadd zset score name
-static void do_zadd(std::vector<std::string> &cmd, Buffer &out) {
-    double score = 0;
-    if (!str2dbl(cmd[2], score)) {
-        return out_err(out, ERR_BAD_ARG, "expect float");
-    }
-
-    // look up or create the zset
-    LookupKey key;
-    key.key.swap(cmd[1]);
-    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
-    HNode *hnode = hm_lookup(&g_data.db, &key.node, &entry_eq);
-
-    Entry *ent = NULL;
-    if (!hnode) {   // insert a new key
-        ent = entry_new(T_ZSET);
-        ent->key.swap(key.key);
-        ent->node.hcode = key.node.hcode;
-        hm_insert(&g_data.db, &ent->node);
-    } else {        // check the existing key
-        ent = container_of(hnode, Entry, node);
-        if (ent->type != T_ZSET) {
-            return out_err(out, ERR_BAD_TYP, "expect zset");
-        }
-    }
-
-    // add or update the tuple
-    const std::string &name = cmd[3];
-    bool added = zset_insert(&ent->zset, name.data(), name.size(), score);
-    return out_int(out, (int64_t)added);
-}
-
-static const ZSet k_empty_zset;
-
-static ZSet *expect_zset(std::string &s) {
-    LookupKey key;
-    key.key.swap(s);
-    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
-    HNode *hnode = hm_lookup(&g_data.db, &key.node, &entry_eq);
-    if (!hnode) {   // a non-existent key is treated as an empty zset
-        return (ZSet *)&k_empty_zset;
-    }
-    Entry *ent = container_of(hnode, Entry, node);
-    return ent->type == T_ZSET ? &ent->zset : NULL;
-}
-
-// zrem zset name
-static void do_zrem(std::vector<std::string> &cmd, Buffer &out) {
-    ZSet *zset = expect_zset(cmd[1]);
-    if (!zset) {
-        return out_err(out, ERR_BAD_TYP, "expect zset");
-    }
-
-    const std::string &name = cmd[2];
-    ZNode *znode = zset_lookup(zset, name.data(), name.size());
-    if (znode) {
-        zset_delete(zset, znode);
-    }
-    return out_int(out, znode ? 1 : 0);
-}
-
-// zscore zset name
-static void do_zscore(std::vector<std::string> &cmd, Buffer &out) {
-    ZSet *zset = expect_zset(cmd[1]);
-    if (!zset) {
-        return out_err(out, ERR_BAD_TYP, "expect zset");
-    }
-
-    const std::string &name = cmd[2];
-    ZNode *znode = zset_lookup(zset, name.data(), name.size());
-    return znode ? out_dbl(out, znode->score) : out_nil(out);
-}
-
-// zquery zset score name offset limit
-static void do_zquery(std::vector<std::string> &cmd, Buffer &out) {
-    // parse args
-    double score = 0;
-    if (!str2dbl(cmd[2], score)) {
-        return out_err(out, ERR_BAD_ARG, "expect fp number");
-    }
-    const std::string &name = cmd[3];
-    int64_t offset = 0, limit = 0;
-    if (!str2int(cmd[4], offset) || !str2int(cmd[5], limit)) {
-        return out_err(out, ERR_BAD_ARG, "expect int");
-    }
-
-    // get the zset
-    ZSet *zset = expect_zset(cmd[1]);
-    if (!zset) {
-        return out_err(out, ERR_BAD_TYP, "expect zset");
-    }
-
-    // seek to the key
-    if (limit <= 0) {
-        return out_arr(out, 0);
-    }
-    ZNode *znode = zset_seekge(zset, score, name.data(), name.size());
-    znode = znode_offset(znode, offset);
-
-    // output
-    size_t ctx = out_begin_arr(out);
-    int64_t n = 0;
-    while (znode && n < limit) {
-        out_str(out, znode->name, znode->len);
-        out_dbl(out, znode->score);
-        znode = znode_offset(znode, +1);
-        n += 2;
-    }
-    out_end_arr(out, ctx, (uint32_t)n);
-}
-
-static void do_request(std::vector<std::string> &cmd, Buffer &out) {
-    if (cmd.size() == 2 && cmd[0] == "get") {
-        return do_get(cmd, out);
-    } else if (cmd.size() == 3 && cmd[0] == "set") {
-        return do_set(cmd, out);
-    } else if (cmd.size() == 2 && cmd[0] == "del") {
-        return do_del(cmd, out);
-    } else if (cmd.size() == 1 && cmd[0] == "keys") {
-        return do_keys(cmd, out);
-    } else if (cmd.size() == 4 && cmd[0] == "zadd") {
-        return do_zadd(cmd, out);
-    } else if (cmd.size() == 3 && cmd[0] == "zrem") {
-        return do_zrem(cmd, out);
-    } else if (cmd.size() == 3 && cmd[0] == "zscore") {
-        return do_zscore(cmd, out);
-    } else if (cmd.size() == 6 && cmd[0] == "zquery") {
-        return do_zquery(cmd, out);
-    } else if (cmd.size() == 2 && cmd[0] == "del") {
-        return do_del(cmd, out);
-    } else if (cmd.size() == 3 && cmd[0] == "pexpire") {  
-        return do_expire(cmd, out);                       
-    } else if (cmd.size() == 2 && cmd[0] == "pttl") {    
-        return do_ttl(cmd, out); 
-    } else {
-        return out_err(out, ERR_UNKNOWN, "unknown command.");
-    }
-}
-
-
-// /*Structure: The response protocol is simple: [Total Length] [Status Code] [Data Payload].
-// resp_len: It calculates 4 (for the status code) + size of data.
-// buf_append: This is just a helper (likely using std::vector::insert) to push raw bytes onto the output buffer*/
-// static void make_response(const Response &resp, std::vector<uint8_t> &out) {
-//     uint32_t resp_len = 4 + (uint32_t)resp.data.size();
-//     // 1. Append Total Length (4 bytes)
-//     buf_append(out, (const uint8_t *)&resp_len, 4);
-//     // 2. Append Status Code (4 bytes)
-//     buf_append(out, (const uint8_t *)&resp.status, 4);
-//     // 3. Append the Actual Data
-//     buf_append(out, resp.data.data(), resp.data.size());
-// }
-
-/*static int32_t read_full(int fd, char *buf, size_t n){
-    while(n>0){
-        ssize_t rv=read(fd, buf, n);   //Stores the return value, which is the actual number of bytes read.
-        if(rv<=0){
-            return -1;   
-              //If rv is 0, it means "End of File" (the connection was closed).
-              // If rv is negative (-1), an error occurred.      
-        }
-        assert((size_t)rv <= n);
-        n -= (size_t)rv;           //Subtracts the number of bytes just read from the total remaining count.
-        buf += rv;                 //Moves the buffer pointer forward. If we read 10 bytes, the next read should start at index 10, not 0.
-    }
-    return 0;   //Returns 0 to indicate success (all bytes were read).
-
-} */
-/*static int32_t write_all(int fd, const char *buf, size_t n) {
-    while (n > 0) {
-        ssize_t rv = write(fd, buf, n); // System call to write data
-        if (rv <= 0) {
-            return -1;  // Returns -1 on failure
-        }
-        assert((size_t)rv <= n);
-        n -= (size_t)rv;  // Decrease remaining count
-        buf += rv;        // Advance buffer pointer
-    }
-    return 0; // Success
-}  */
-
-// const size_t k_max_msg = 4096;    //It allocates 4 bytes for the header (length) and 4096 bytes for the maximum allowed message body.
-// process 1 request if there is enough data
-
-static void response_begin(Buffer &out, size_t *header) {
-    *header = out.size();       // messege header position
-    buf_append_u32(out, 0);     // reserve space
-}
-
-static size_t response_size(Buffer &out, size_t header) {
-    return out.size() - header - 4;
-}
-
-static void response_end(Buffer &out, size_t header) {
-    size_t msg_size = response_size(out, header);
-    if (msg_size > k_max_msg) {
-        out.resize(header + 4);
-        out_err(out, ERR_TOO_BIG, "response is too big.");
-        msg_size = response_size(out, header);
-    }
-    // message header
-    uint32_t len = (uint32_t)msg_size;
-    memcpy(&out[header], &len, 4);
-}
-static bool try_one_request(Conn *conn) {
-    // try to parse the protocol: message header
-    if (conn->incoming.size() < 4) {      //Checks if we have at least 4 bytes (the header). If not, returns false (need more data).
-        return false;   // want read
-    }
-    uint32_t len = 0;
-    memcpy(&len, conn->incoming.data(), 4);
-    if (len > k_max_msg) {
-        msg("too long");
-        conn->want_close = true;
-        return false;   // want close
-    }
-    // message body
-    if (4 + len > conn->incoming.size()) {     
-        return false;   // want read
-        /*Checks if the full message (Header + Body) is in the buffer. If incoming has 100 bytes but the message says it's 200 bytes long, we return false and wait for more data.*/
-    }
-    const uint8_t *request = &conn->incoming[4];
-    // got one request, do some application logic
-    std::vector<std::string> cmd;
-    //// 1. Try to parse the accumulated buffer
-    if (parse_req(request, len, cmd) < 0) {
-        msg("bad request");
-        conn->want_close = true;
-        return false;   // want close
-    }
-    // // 2. Process the command
-    //  Response resp;
-    // do_request(cmd, resp);
-    // //// 3. Send the response back
-    // make_response(resp, conn->outgoing);
-    // // application logic done! remove the request message.
-
-    
-  size_t header_pos = 0;
-    response_begin(conn->outgoing, &header_pos);
-    do_request(cmd, conn->outgoing);
-    response_end(conn->outgoing, header_pos);
-    
-    // application logic done! remove the request message.
-    buf_consume(conn->incoming, 4 + len);
-    return true;        // success
- 
-    
-}
-// application callback when the socket is writable
-static void handle_write(Conn *conn) {
-    assert(conn->outgoing.size() > 0);
-    ssize_t rv = write(conn->fd, &conn->outgoing[0], conn->outgoing.size());  /*Attempts to write everything in the outgoing buffer to the socket.*/
-    if (rv < 0 && errno == EAGAIN) {   /*This is the expected behavior for non-blocking I/O. It means the kernel's write buffer is full. We simply return and try again later.*/
-        return; // actually not ready
-    }
-    if (rv < 0) {
-        msg_errno("write() error");
-        conn->want_close = true;    // error handling
-        return;
-    }
-
-    // remove written data from `outgoing`
-    buf_consume(conn->outgoing, (size_t)rv);      /*Removes the bytes that were successfully written.*/
-
-    // update the readiness intention
-    if (conn->outgoing.size() == 0) {   // all data written
-        conn->want_read = true;
-        conn->want_write = false;  /*State Update: If the buffer is empty (all data sent), we switch flags to want_read (wait for next request) and stop want_write.*/
-    } // else: want write
-}
-static void conn_destroy(Conn *conn) {
-    (void)close(conn->fd);
-    g_data.fd2conn[conn->fd] = NULL;
-    dlist_detach(&conn->idle_node);
-    delete conn;
-}
-// application callback when the socket is readable
-static void handle_read(Conn *conn) {
-    // read some data
-    uint8_t buf[64 * 1024];
-    ssize_t rv = read(conn->fd, buf, sizeof(buf));    /*Reads as much data as available (up to 64KB) into a temporary stack buffer.*/
-    if (rv < 0 && errno == EAGAIN) {
-        return; // actually not ready
-    }
-    // handle IO error
-    if (rv < 0) {
-        msg_errno("read() error");
-        conn->want_close = true;
-        return; // want close
-    }
-    // handle EOF
-    if (rv == 0) {
-        if (conn->incoming.size() == 0) {
-            msg("client closed");
-        } else {
-            msg("unexpected EOF");
-        }
-        conn->want_close = true;
-        return; // want close
-    }
-    // got some new data
-    buf_append(conn->incoming, buf, (size_t)rv);    /*Moves the data from the temporary buffer into the connection's incoming queue.*/
-
-    // parse requests and generate responses
-    while (try_one_request(conn)) {}
-    // Q: Why calling this in a loop? See the explanation of "pipelining".
-    /*Pipelining Loop: This is a key optimization. A client might send 3 requests back-to-back in one packet. 
-    This loop processes all available complete requests in the buffer before returning.*/
-
-    // update the readiness intention
-    if (conn->outgoing.size() > 0) {    // has a response
-        conn->want_read = false;
-        conn->want_write = true;
-        // The socket is likely ready to write in a request-response protocol,
-        // try to write it without waiting for the next iteration.
-        return handle_write(conn);
-    }   // else: want read
-}
-const uint64_t k_idle_timeout_ms = 5 * 1000; // 5 seconds ,Sets the strict timeout limit (5 seconds in this code).
-
-static uint32_t next_timer_ms() {
-    uint64_t now_ms = get_monotonic_msec();
-    uint64_t next_ms = (uint64_t)-1; // Set to the absolute maximum possible value
-
-    // 1. Check idle connections
-    if (!dlist_empty(&g_data.idle_list)) {
-        Conn *conn = container_of(g_data.idle_list.next, Conn, idle_node);
-        next_ms = conn->last_active_ms + k_idle_timeout_ms;
-    }
-
-    // 2. Check the TTL heap (Compare it to the idle connection timer)
-    if (!g_data.heap.empty() && g_data.heap[0].val < next_ms) {
-        next_ms = g_data.heap[0].val; // The heap timer is sooner, use this one instead!
-    }
-
-    if (next_ms == (uint64_t)-1) {
-        return -1;  // no timers at all
-    }
-    if (next_ms <= now_ms) {
-        return 0;   // timer already expired
-    }
-    return (int32_t)(next_ms - now_ms);
-}
-static bool hnode_same(HNode *node, HNode *key) {
-    return node == key;
-}
-static void process_timers() {
-    uint64_t now_ms = get_monotonic_msec();
-
-    // 1. Clean up expired idle connections (unchanged)
-    while (!dlist_empty(&g_data.idle_list)) {
-       // Look at the oldest connection at the front of the line
-        Conn *conn = container_of(g_data.idle_list.next, Conn, idle_node);
-        uint64_t next_timeout = conn->last_active_ms + k_idle_timeout_ms;
-
-        if (next_timeout > now_ms) {
-            // Not expired yet! Since the list is ordered by age, 
-            // if this one hasn't expired, nobody else behind it has either.
-            break;
-        }
-
-        // Connection is too old, kick them out to free up resources
-        msg("idle connection expired");
-        conn_destroy(conn);
-    }
-
-    // 2. Clean up expired database keys from the Heap (NEW)
-    const size_t k_max_works = 2000; // Don't delete more than 2000 at once to prevent lag
-    size_t nworks = 0;
-    const std::vector<HeapItem> &heap = g_data.heap;
-    
-    while (!heap.empty() && heap[0].val < now_ms) {
-        Entry *ent = container_of(heap[0].ref, Entry, heap_idx); // Find the database entry
-        
-        // Remove it from the database hashtable
-        HNode *node = hm_delete(&g_data.db, &ent->node, &hnode_same);
-        if (!node) {
-            // SAFE FALLBACK: The key was somehow already missing. 
-            // Just delete the memory to clean up the ghost timer and move on.
-            ent->heap_idx = -1;
-            entry_del(ent);
-            continue;
-        }
-        
-        // Actually delete the memory (this also safely removes it from the heap!)
-        entry_del(ent); 
-        
-        if (nworks++ >= k_max_works) {
-            break; // Stop if we've been deleting for too long
-        }
-    }
-}
-/*static void do_something(int connfd) {
-    char rbuf[64] = {};
-    ssize_t n = read(connfd, rbuf, sizeof(rbuf) - 1);
-    if (n <= 0) {
-        fprintf(stderr, "read() error or client closed\n");
-        return;
-    }
-    rbuf[n] = '\0';
-    fprintf(stderr, "client says: %s\n", rbuf);
-
-    char wbuf[] = "world";
-    write(connfd, wbuf, strlen(wbuf));
-}  */
-
-int main(){
-    int fd=socket(AF_INET, SOCK_STREAM, 0);
-    dlist_init(&g_data.idle_list);
-    if(fd<0){
-        die("socket()");
-    }
-    int val=1;
-    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
-    struct sockaddr_in addr={};
-    addr.sin_family=AF_INET;
-    addr.sin_port=htons(1234);
-    addr.sin_addr.s_addr=htonl(INADDR_ANY);
-    int rv=bind(fd,(const struct sockaddr*)&addr, sizeof(addr));
-    if(rv){
-        die("bind()");
-    }
-    rv=listen(fd,SOMAXCONN);
-    if(rv){
-        die("listen()");
-    }
-  
-    std::vector<struct pollfd> poll_args;  /*A list of file descriptors we want to monitor.*/
-    while(true){
-        poll_args.clear();   /*We clear and rebuild this list every loop iteration because the state (want_read/want_write) changes constantly.*/
-        struct pollfd pfd = {fd, POLLIN, 0};  /*Listening Socket: Always added first, always watching for POLLIN (new connections).*/
-        poll_args.push_back(pfd);
-        for (Conn *conn : g_data.fd2conn ) {
-            /*Checks every active connection.*/
-            if (!conn) continue;
-            struct pollfd pfd = {conn->fd, POLLERR, 0};  /*Converts our application flags (want_read) into poll flags (POLLIN).*/
-            if (conn->want_read) {
-                pfd.events |= POLLIN;  /*POLLIN: Notify me when data is available to read.*/
-            }
-            if (conn->want_write) {
-                pfd.events |= POLLOUT;      /*POLLOUT: Notify me when space is available to write.*/
-            }
-            poll_args.push_back(pfd);
-        }
-        /*Instead of passing -1 to poll() (which means "sleep forever until a message arrives"), we now pass timeout_ms. The server will wake up automatically if the timer runs out.*/
-        int32_t timeout_ms = next_timer_ms();
-        int rv = poll(poll_args.data(), (nfds_t)poll_args.size(), timeout_ms);  /*The Blocking Point. The program stops here and sleeps until the OS wakes it up because an event occurred on one of the FDs (or an error).*/
-        if (rv < 0 && errno == EINTR) {
-            continue;   // not an error
-        }
-        if (rv < 0) {
-            die("poll");
-        }
-        // handle the listening socket
-        if (poll_args[0].revents) {        /*Checks the first entry (listening socket). If revents (returned events) is non-zero, it means a new client is waiting. We accept them and add them to the fd2conn map.*/
-            if (Conn *conn = handle_accept(fd)) {
-                if (g_data.fd2conn.size() <= (size_t)conn->fd) {
-                    g_data.fd2conn.resize(conn->fd + 1);
-                }
-                assert(!g_data.fd2conn[conn->fd]);
-                g_data.fd2conn[conn->fd] = conn;
-            }
-        }  
-        // handle connection sockets
-        for (size_t i = 1; i < poll_args.size(); ++i) {  /*Loops through the rest of the sockets.*/
-            uint32_t ready = poll_args[i].revents;
-            Conn *conn = g_data.fd2conn[poll_args[i].fd];
-            //If a client did something, refresh their timer!
-            /*If a connection was active (they sent or received data), we update their timestamp to "now", rip them out of their current spot in line (dlist_detach), and shove them to the back of the line (dlist_insert_before).*/
-            conn->last_active_ms = get_monotonic_msec();
-            dlist_detach(&conn->idle_node);
-            dlist_insert_before(&g_data.idle_list, &conn->idle_node);
-            
-            if (ready & POLLIN) {      /*If POLLIN is set, call handle_read.*/
-                handle_read(conn); 
-            }
-            if (ready & POLLOUT) {     /*If POLLOUT is set, call handle_write.*/
-                handle_write(conn);
-            }
-            
-            // close the socket from socket error or application logic
-            if ((ready & POLLERR) || conn->want_close) {
-                conn_destroy(conn);
-            }
-
-    }
-    // Kick out anyone who expired while we were sleeping
-    //Calls our cleanup function at the end of every loop.
-        process_timers();
-}
-    return 0;
+
+// stdlib
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+// system
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/ip.h>
+#include <netdb.h>
+// C++
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <new>      // placement new
+#include <math.h>   // isnan
+#include "common.h"
+#include "zset.h"
+#include "hash.h"
+#include "qlist.h"
+#include "set.h"
+#include "bitops.h"
+#include "hll.h"
+#include "stream.h"
+#include <time.h>
+#include "list.h"
+#include "hashtable.h"
+#include "heap.h"
+#include "hist.h"
+#include "uring.h"
+#include "rcbuf.h"
+/*Remember how hashtable.cpp only gives us back an HNode*? We need to find the actual data (the string key/value) attached to it. This macro does pointer math. It takes the memory address of the HNode, subtracts its position inside the struct, and returns a pointer to the entire wrapper struct!*/
+
+/*The output buffer. Responses are serialized into `data`, except that big string values are not
+copied: each `refs` item splices a reference counted value into the byte stream at `pos`, and the
+writer sends the whole thing with writev(). The value stays alive until it's sent, even if the
+key is overwritten or deleted meanwhile.*/
+// wire protocol of a connection, detected from its first bytes
+enum {
+    PROTO_UNKNOWN = 0,
+    PROTO_TLV = 1,      // our length-prefixed format, see parse_req()
+    PROTO_RESP2 = 2,    // Redis clients, see parse_resp()
+    PROTO_RESP3 = 3,    // RESP2 requests, RESP3 replies, after HELLO 3
+};
+
+struct OutRef {
+    size_t pos = 0;         // offset in `data` where the value bytes go
+    RcBuf *rc = NULL;
+};
+struct Buffer {
+    std::vector<uint8_t> data;
+    std::vector<OutRef> refs;   // ordered by `pos`
+    size_t ref_off = 0;         // bytes of refs[0] already sent
+    size_t ref_bytes = 0;       // unsent bytes in `refs`
+    uint8_t proto = PROTO_UNKNOWN;  // how the out_*() functions serialize, never swapped
+};
+
+
+
+static void msg(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+}
+
+static void msg_errno(const char *msg) {
+    fprintf(stderr, "[errno:%d] %s\n", errno, msg);
+}
+
+static void die(const char *msg) {
+    int err = errno;
+    fprintf(stderr, "[%d] %s\n", err, msg);
+    abort();
+}
+/*This grabs the current time in milliseconds. It uses CLOCK_MONOTONIC instead of the regular wall clock. Why? If the server administrator manually changes the system clock (or daylight saving time happens), a regular clock might jump backward, causing timers to break. A "monotonic" clock only ticks forward, making it perfect for measuring elapsed time.*/
+static uint64_t get_monotonic_msec() {
+    struct timespec tv = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return uint64_t(tv.tv_sec) * 1000 + tv.tv_nsec / 1000 / 1000;
+}
+// wall clock, only for timestamps shown to users
+static uint64_t get_realtime_msec() {
+    struct timespec tv = {0, 0};
+    clock_gettime(CLOCK_REALTIME, &tv);
+    return uint64_t(tv.tv_sec) * 1000 + tv.tv_nsec / 1000 / 1000;
+}
+// finer grained clock for the latency stats
+static uint64_t get_monotonic_nsec() {
+    struct timespec tv = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return uint64_t(tv.tv_sec) * 1000000000 + tv.tv_nsec;
+}
+static void fd_set_nb(int fd) {
+    errno = 0;
+    int flags = fcntl(fd, F_GETFL, 0);  //Gets the current status flags of the file descriptor fd
+    if (errno) {
+        die("fcntl error");
+        return;
+    }
+
+    flags |= O_NONBLOCK;  /*tells the OS that read() and write() on this socket should never "block" (sleep) waiting for data. If data isn't ready, they return immediately with an error (EAGAIN).*/
+
+    errno = 0;
+    (void)fcntl(fd, F_SETFL, flags); // Applies the modified flags back to the file descriptor
+    if (errno) {
+        die("fcntl error");
+    }
+}
+
+const size_t k_max_msg = 32 << 20;  // likely larger than the kernel buffer
+const size_t k_max_iov = 64;        // per writev()/sendmsg()
+const uint32_t k_max_reads = 8;     // per connection per loop iteration
+// WATCH: a key and the version of its entry at the time, 0 if it didn't exist
+struct WatchedKey {
+    std::string key;
+    uint64_t version = 0;
+};
+struct PubsubChan;
+struct Conn {
+    int fd = -1;
+    bool want_read = false;   // Do we want to read from the socket?
+    bool want_write = false;  // Do we have data waiting to be written?
+    bool want_close = false;  // Should we close this connection?
+    std::vector<uint8_t> incoming;  // Buffer for data received but not yet parsed
+    Buffer outgoing;                // Buffer for data waiting to be sent
+    uint64_t last_active_ms = 0;    //This acts as the timestamp for when the client last did something.
+    DList idle_node;               //This is the physical "link" that connects this specific client to the rest of the clients in the line.
+    // server-side zset range cursors owned by this connection,
+    // the cursor id is the slot index + 1
+    std::vector<ZCursor *> cursors;
+    bool dirty = false;             // in `g_dirty`, has output for the next flush pass
+    // MULTI/EXEC: queued commands are copied out of `incoming`, which moves on meanwhile
+    bool multi = false;
+    bool multi_aborted = false;         // a command failed to queue, EXEC discards the batch
+    std::string multi_args;             // the args of the queued commands, back to back
+    std::vector<uint32_t> multi_lens;   // the length of each arg
+    std::vector<uint32_t> multi_argc;   // the number of args of each command
+    std::vector<WatchedKey> watched;
+    // when the output went over the soft limit, 0 while it's under, see conn_check_output()
+    uint64_t out_soft_since_ms = 0;
+    // replication: a replica attached to us, or our link to the primary
+    uint32_t repl_role = 0;         // REPL_ROLE_*
+    bool repl_attached = false;     // replicas: the PSYNC payload is out, in g_repl.replicas
+    uint64_t repl_psync_offset = 0; // replicas: resume the stream here, UINT64_MAX for a snapshot
+    uint64_t repl_attach_offset = 0;    // replicas: the stream offset after the snapshot or backlog part
+    uint64_t repl_ack_ms = 0;       // replicas: the last REPLCONF ACK
+    uint64_t repl_ack_offset = 0;
+    bool asking = false;            // cluster mode: ASKING, for the next command only
+    // BLPOP: waiting on `block_keys` with the request left in `incoming`, see conn_block()
+    bool blocked = false;
+    bool block_timed_out = false;   // the request runs again to give up
+    std::vector<std::string> block_keys;
+    size_t block_heap_idx = -1;     // in g_blocked.timeouts, -1 if it waits forever
+    std::vector<StreamID> xread_ids;    // XREAD: what each `$` stood for when it blocked
+    // pub/sub: what it's subscribed to, see pubsub_add()
+    std::vector<PubsubChan *> sub_channels;
+    std::vector<PubsubChan *> sub_patterns;
+    size_t reply_header = 0;        // where the reply being written starts, see conn_next_reply()
+    // io_uring backend: ops the kernel still holds for this connection
+    uint32_t uring_inflight = 0;
+    bool uring_closing = false;     // shut down, destroyed once `uring_inflight` drops to 0
+    bool uring_sending = false;
+    bool uring_recv_armed = false;      // the multishot recv is active
+    bool uring_recv_cancelling = false; // and being cancelled, the output is over the soft limit
+    Buffer sending;                 // the send in flight, `outgoing` keeps growing meanwhile
+    std::vector<struct iovec> send_iov;
+    struct msghdr send_msg = {};
+};
+// missing keys take their WATCH version from one of these, see key_version()
+const size_t k_del_versions = 1024;
+static struct {
+    HMap db;    // top-level hashtable
+    std::vector<Conn *> fd2conn; // a map of all client connections, keyed by fd
+    DList idle_list;     //This is the dummy "head" of the line. It sits in your global data tracker and represents the starting point of the queue.
+    std::vector<HeapItem> heap;  //The array that holds our Min-Heap timers
+    uint64_t version_clock = 0;  // the last Entry::version handed out
+    uint64_t del_versions[k_del_versions] = {};  // by key hash, the version_clock at the last delete
+    size_t entries_mem = 0;      // sum of Entry::mem, see used_memory()
+    uint32_t lru_clock = 0;      // milliseconds, wraps around, set once per event loop iteration
+    bool evict_pending = false;  // over maxmemory after the eviction time budget ran out
+} g_data;
+// network and connection counters, see do_info()
+static struct {
+    uint64_t start_ms = 0;
+    uint64_t net_in_bytes = 0;
+    uint64_t net_out_bytes = 0;
+    uint64_t read_calls = 0;
+    uint64_t write_calls = 0;
+    uint64_t conns_accepted = 0;
+    uint64_t conns_current = 0;
+    uint64_t expired_keys = 0;
+    uint64_t evicted_keys = 0;
+    uint64_t output_limit_disconnects = 0;
+    uint64_t clients_output_paused = 0;     // over the soft limit right now
+} g_stats;
+// EXEC running the queued commands, which can't block or subscribe, see do_exec()
+static struct {
+    bool active = false;
+} g_exec;
+
+// replication link states of a replica, see repl_cron()
+enum {
+    REPL_NONE = 0,          // we are a primary
+    REPL_WAIT = 1,          // not connected, retry at `retry_ms`
+    REPL_CONNECTING = 2,    // non-blocking connect() in progress on `connect_fd`
+    REPL_HANDSHAKE = 3,     // PSYNC sent, waiting for +FULLRESYNC or +CONTINUE
+    REPL_SNAPSHOT = 4,      // loading the snapshot, `snapshot_left` bytes of it to go
+    REPL_STREAMING = 5,     // applying the command stream
+};
+// Conn::repl_role
+enum {
+    REPL_ROLE_CLIENT = 0,
+    REPL_ROLE_REPLICA = 1,  // a replica, we feed it the command stream
+    REPL_ROLE_PRIMARY = 2,  // the primary, we apply what it sends
+};
+/*Replication state, see the "replication" section. Both roles share the stream offset: a primary
+counts the bytes it has fed, a replica the bytes it has applied.*/
+static struct {
+    std::string replid;             // names our stream, changes when the history does
+    uint64_t offset = 0;
+    // primary side
+    std::vector<uint8_t> backlog;   // the tail of the stream, a ring; allocated by the first PSYNC
+    uint64_t backlog_start = 0;     // the offset of the oldest byte in `backlog`
+    std::vector<Conn *> replicas;
+    std::vector<Conn *> closing;    // links to drop in process_timers(), not in the middle of the loop
+    bool exec_multi_fed = false;    // the writes of EXEC go out wrapped in MULTI/EXEC
+    uint64_t sync_full = 0;
+    uint64_t sync_partial_ok = 0;
+    uint64_t sync_partial_err = 0;
+    // replica side
+    std::string primary_host;
+    int64_t primary_port = 0;       // 0: we are a primary
+    uint32_t state = REPL_NONE;
+    int connect_fd = -1;
+    Conn *primary = NULL;
+    std::string primary_replid = "?";   // "?" forces a full sync
+    uint64_t snapshot_left = 0;
+    uint64_t retry_ms = 0;
+    uint64_t last_io_ms = 0;        // connect started, or the last bytes applied
+    uint64_t next_cron_ms = 0;
+    uint64_t next_ping_ms = 0;
+} g_repl;
+
+/*Cluster mode. The keyspace is split into k_cluster_slots hash slots and each node serves some of
+them, for the others it redirects clients with -MOVED. Slots are assigned with CLUSTER
+ADDSLOTSRANGE/SETSLOT by whoever runs the cluster, nodes don't talk to each other except for
+MIGRATE. Each slot keeps a list of its keys, so moving a slot never scans the whole keyspace.*/
+const uint32_t k_cluster_slots = 16384;
+const int32_t k_node_none = -1;
+const int32_t k_node_self = 0;      // nodes[0] is "myself", we don't need our own address
+struct ClusterSlot {
+    int32_t owner = k_node_none;        // index in `nodes`
+    int32_t migrating = k_node_none;    // ours, keys are moving to this node, see cluster_route()
+    bool importing = false;             // not ours yet, keys are moving here
+};
+static struct {
+    std::vector<std::string> nodes;     // "host:port"
+    std::vector<ClusterSlot> slots;     // all empty unless cluster-enabled
+    std::vector<DList> slot_keys;       // Entry::slot_node
+    std::vector<uint32_t> slot_count;
+} g_cluster;
+/*Blocking commands. A client that has to wait is parked on the keys it waits for, and a push to
+one of them queues the key in `ready`. The request that pushed serves the waiters in the order
+they blocked once it is done, by running their requests again, so nobody polls.*/
+struct BlockedKey {
+    HNode node;
+    std::string key;
+    std::vector<Conn *> waiters;    // first come, first served
+    bool ready = false;             // in `ready`
+};
+static struct {
+    HMap keys;                          // BlockedKey::node
+    std::vector<BlockedKey *> ready;
+    std::vector<HeapItem> timeouts;     // Conn::block_heap_idx
+    size_t nclients = 0;
+} g_blocked;
+/*Pub/sub. Channels and patterns are indexed by name, each with the connections subscribed to it.
+PUBLISH serializes a message once per wire protocol and the output of every receiver references
+that buffer (see out_shared()), so a fan-out to N clients costs N reference counts, not N copies.*/
+struct PubsubChan {
+    HNode node;
+    std::string name;
+    std::vector<Conn *> subs;
+};
+static struct {
+    HMap channels;  // PubsubChan::node
+    HMap patterns;
+    uint64_t messages = 0;      // deliveries, a message to N receivers counts N times
+} g_pubsub;
+
+static bool conn_subscribed(const Conn *conn) {
+    return !conn->sub_channels.empty() || !conn->sub_patterns.empty();
+}
+/*Responses are not written as soon as they are produced. Each event loop iteration first reads and
+executes the requests of every ready socket, then flushes the connections listed here in one pass,
+so a client that pipelines gets one write for everything it sent during the iteration.*/
+static std::vector<Conn *> g_dirty;
+
+// event loop backends
+enum {
+    IO_POLL = 0,
+    IO_URING = 1,
+};
+static const char *const k_io_names[] = {"poll", "uring"};
+
+// what to drop when over maxmemory
+enum {
+    EVICT_NONE = 0,     // nothing, commands that need memory fail instead
+    EVICT_LRU = 1,      // least recently used, any key
+    EVICT_LFU = 2,      // least frequently used, any key
+    EVICT_TTL = 3,      // keys with a TTL, the nearest expiration first
+    EVICT_RANDOM = 4,   // any key
+};
+static const char *const k_evict_names[] = {
+    "noeviction", "allkeys-lru", "allkeys-lfu", "volatile-ttl", "allkeys-random",
+};
+
+static const char *const k_no_yes[] = {"no", "yes"};
+
+// runtime settings, changed with CONFIG SET or `--name value` on the command line
+static struct {
+    int64_t port = 1234;
+    int64_t io_backend = IO_POLL;
+    int64_t slowlog_threshold_us = 10 * 1000;   // < 0 disables the slow log
+    int64_t slowlog_max_len = 128;
+    int64_t loop_budget_us = 50 * 1000;         // per event loop phase, < 0 disables the watchdog
+    int64_t watchdog_max_len = 128;
+    // per-client output buffer limits in bytes, 0 disables them
+    int64_t client_output_soft_limit = 16 << 20;
+    int64_t client_output_hard_limit = 256 << 20;   // above k_max_msg, one big reply is fine
+    int64_t client_output_soft_ms = 10 * 1000;
+    // keyspace memory limit in bytes, 0 means no limit, see evict_keys()
+    int64_t maxmemory = 0;
+    int64_t maxmemory_policy = EVICT_NONE;
+    int64_t maxmemory_samples = 5;
+    int64_t lfu_log_factor = 10;    // higher: the LFU counter grows slower
+    int64_t lfu_decay_time = 1;     // minutes for the LFU counter to drop by 1, 0: never
+    // replication
+    int64_t repl_backlog_size = 1 << 20;
+    int64_t repl_timeout_ms = 60 * 1000;    // a silent link is dropped after this
+    int64_t cluster_enabled = 0;
+    // hashes up to this many fields, none longer than the value limit, use the compact encoding
+    int64_t hash_max_compact_entries = 128;
+    int64_t hash_max_compact_value = 64;
+    int64_t set_max_intset_entries = 512;
+    int64_t hll_sparse_max_bytes = 3000;
+    // a stream block takes entries up to either limit, see stream_append()
+    int64_t stream_node_max_bytes = 4096;
+    int64_t stream_node_max_entries = 100;
+} g_config;
+
+struct ConfigVar {
+    const char *name;
+    int64_t *val;
+    int64_t min;
+    int64_t max;
+    const char *const *names = NULL;    // for enums, `val` indexes this array
+    bool startup_only = false;
+};
+static const ConfigVar k_config_vars[] = {
+    {"port",                 &g_config.port,                 1, 65535, NULL, true},
+    {"io-backend",           &g_config.io_backend,           IO_POLL, IO_URING, k_io_names, true},
+    {"slowlog-threshold-us", &g_config.slowlog_threshold_us, -1, INT64_MAX},
+    {"slowlog-max-len",      &g_config.slowlog_max_len,      0, 1 << 20},
+    {"loop-budget-us",       &g_config.loop_budget_us,       -1, INT64_MAX},
+    {"watchdog-max-len",     &g_config.watchdog_max_len,     0, 1 << 20},
+    {"client-output-soft-limit", &g_config.client_output_soft_limit, 0, INT64_MAX},
+    {"client-output-hard-limit", &g_config.client_output_hard_limit, 0, INT64_MAX},
+    {"client-output-soft-ms",    &g_config.client_output_soft_ms,    0, INT64_MAX},
+    {"maxmemory",            &g_config.maxmemory,            0, INT64_MAX},
+    {"maxmemory-policy",     &g_config.maxmemory_policy,     EVICT_NONE, EVICT_RANDOM, k_evict_names},
+    {"maxmemory-samples",    &g_config.maxmemory_samples,    1, 64},
+    {"lfu-log-factor",       &g_config.lfu_log_factor,       0, 1 << 20},
+    {"lfu-decay-time",       &g_config.lfu_decay_time,       0, 1 << 20},
+    {"repl-backlog-size",    &g_config.repl_backlog_size,    16 << 10, INT64_MAX},
+    {"repl-timeout-ms",      &g_config.repl_timeout_ms,      100, INT64_MAX},
+    {"cluster-enabled",      &g_config.cluster_enabled,      0, 1, k_no_yes, true},
+    {"hash-max-compact-entries", &g_config.hash_max_compact_entries, 0, INT64_MAX},
+    {"hash-max-compact-value",   &g_config.hash_max_compact_value,   0, INT64_MAX},
+    {"set-max-intset-entries",   &g_config.set_max_intset_entries,   0, INT64_MAX},
+    {"hll-sparse-max-bytes",     &g_config.hll_sparse_max_bytes,     0, INT64_MAX},
+    {"stream-node-max-bytes",    &g_config.stream_node_max_bytes,    64, UINT32_MAX / 2},
+    {"stream-node-max-entries",  &g_config.stream_node_max_entries,  1, UINT32_MAX},
+};
+/*Instead of std::map, your global database is now just a wrapper around your HMap manager from hashtable.h*/
+/*std::map: It's a binary search tree (usually Red-Black Tree) under the hood. It maps a string (Key) to a string (Value).*/
+
+
+/*Buffering: Because TCP is a stream (not packets), one read() might give us half a message, or 2.5 messages.
+ We append everything to incoming until we have a full message. Similarly, outgoing stores data if the socket isn't ready to send it all at once*/
+
+ static void buf_append(std::vector<uint8_t> &buf, const uint8_t *data, size_t len) {
+    buf.insert(buf.end(), data, data + len);    //Adds new raw bytes to the end of the vector.
+}
+static void buf_consume(std::vector<uint8_t> &buf, size_t n) {
+    buf.erase(buf.begin(), buf.begin() + n);           //Removes bytes from the front of the vector after they have been processed or sent.
+}
+
+// output buffer helpers
+static size_t out_size(const Buffer &out) {
+    return out.data.size() + out.ref_bytes;
+}
+static void out_clear(Buffer &out) {
+    for (OutRef &ref : out.refs) {
+        rcbuf_unref(ref.rc);
+    }
+    out.data.clear();
+    out.refs.clear();
+    out.ref_off = out.ref_bytes = 0;
+}
+static void out_swap(Buffer &a, Buffer &b) {
+    std::swap(a.data, b.data);
+    std::swap(a.refs, b.refs);
+    std::swap(a.ref_off, b.ref_off);
+    std::swap(a.ref_bytes, b.ref_bytes);
+}
+/*Keep the first `size` bytes of `data` and the refs before them. A ref right at `size` was queued
+before (a pub/sub message), the refs of a reply always come after some of its bytes.*/
+static void out_truncate(Buffer &out, size_t size) {
+    while (!out.refs.empty() && out.refs.back().pos > size) {
+        out.ref_bytes -= out.refs.back().rc->len;
+        rcbuf_unref(out.refs.back().rc);
+        out.refs.pop_back();
+    }
+    out.data.resize(size);
+}
+// the unsent bytes as an iovec list, at most `max` items
+static size_t out_iovecs(Buffer &out, struct iovec *iov, size_t max) {
+    size_t n = 0;
+    size_t pos = 0;
+    for (size_t i = 0; i <= out.refs.size() && n < max; i++) {
+        size_t end = i < out.refs.size() ? out.refs[i].pos : out.data.size();
+        if (end > pos) {
+            iov[n].iov_base = &out.data[pos];
+            iov[n].iov_len = end - pos;
+            n++;
+            pos = end;
+        }
+        if (i < out.refs.size() && n < max) {
+            size_t off = i == 0 ? out.ref_off : 0;
+            iov[n].iov_base = out.refs[i].rc->data + off;
+            iov[n].iov_len = out.refs[i].rc->len - off;
+            n++;
+        }
+    }
+    return n;
+}
+// remove `n` sent bytes from the front
+static void out_consume(Buffer &out, size_t n) {
+    size_t ndata = 0;   // consumed bytes of `data`
+    size_t nrefs = 0;   // fully consumed refs
+    while (n > 0) {
+        size_t end = nrefs < out.refs.size() ? out.refs[nrefs].pos : out.data.size();
+        size_t k = std::min(n, end - ndata);
+        ndata += k;
+        n -= k;
+        if (n == 0) {
+            break;
+        }
+        RcBuf *rc = out.refs[nrefs].rc;
+        k = std::min(n, rc->len - out.ref_off);
+        out.ref_off += k;
+        out.ref_bytes -= k;
+        n -= k;
+        if (out.ref_off == rc->len) {
+            rcbuf_unref(rc);
+            out.ref_off = 0;
+            nrefs++;
+        }
+    }
+    out.data.erase(out.data.begin(), out.data.begin() + ndata);
+    out.refs.erase(out.refs.begin(), out.refs.begin() + nrefs);
+    for (OutRef &ref : out.refs) {
+        ref.pos -= ndata;
+    }
+}
+
+// all the output of a connection, including a send in flight
+static size_t conn_output_size(Conn *conn) {
+    return out_size(conn->outgoing) + out_size(conn->sending);
+}
+
+// set up the state of an accepted socket, shared by the event loop backends
+static Conn *conn_new(int connfd) {
+    Conn *conn = new Conn();    
+    conn->fd = connfd;
+    g_stats.conns_accepted++;
+    g_stats.conns_current++;
+    conn->want_read = true;            //initializes the state. We default to wanting to read requests from the client.
+    conn->last_active_ms = get_monotonic_msec();  //Stamps the client with the exact millisecond they connected.
+    dlist_insert_before(&g_data.idle_list, &conn->idle_node);  //Inserts the client's idle_node right before the idle_list head. Because the list loops in a circle, inserting "before the head" places them exactly at the back of the line.
+    if (g_data.fd2conn.size() <= (size_t)conn->fd) {
+        g_data.fd2conn.resize(conn->fd + 1);
+    }
+    assert(!g_data.fd2conn[conn->fd]);
+    g_data.fd2conn[conn->fd] = conn;
+    return conn;
+}
+
+static Conn *handle_accept(int fd) {
+    struct sockaddr_in client_addr = {};
+    socklen_t addrlen = sizeof(client_addr);
+    int connfd = accept(fd, (struct sockaddr *)&client_addr, &addrlen);  /*Accepts a pending connection from the listening socket.*/
+    if (connfd < 0) {                                     /*The new file descriptor specifically for this client.*/
+        msg_errno("accept() error");
+        return NULL;
+    }
+       uint32_t ip = client_addr.sin_addr.s_addr;
+    fprintf(stderr, "new client from %u.%u.%u.%u:%u\n",
+        ip & 255, (ip >> 8) & 255, (ip >> 16) & 255, ip >> 24,
+        ntohs(client_addr.sin_port)
+    );
+    fd_set_nb(connfd);   /*Crucial. The new connection must also be non-blocking*/
+    return conn_new(connfd);
+}
+const size_t k_max_args = 200 * 1000;
+/*This function grabs 4 bytes from our data and turns them into a 32-bit integer (like turning 04 00 00 00 into the number 4).*/
+static bool read_u32(const uint8_t *&cur, const uint8_t *end, uint32_t &out) {
+    if (cur + 4 > end) {
+        return false;
+    }
+    memcpy(&out, cur, 4);
+    cur += 4;
+    return true;
+}
+/*Same as read_32 but for reading string. The string is not copied, `out` points into the receive buffer,
+so it is only valid until the request is consumed from `Conn::incoming`.*/
+static bool read_str(const uint8_t *&cur, const uint8_t *end, uint32_t n,std::string_view &out) {
+    if(cur+n>end){
+        return false;
+    }
+    out = std::string_view((const char *)cur, n);
+    cur+=n;
+    return true;
+}
+static int32_t parse_req(const uint8_t *data,size_t size,std::vector<std::string_view> &out){
+    const uint8_t *end=data+size;;  //Calculates where the buffer stops so we don't crash.
+    uint32_t nstr=0;
+    // 1. Read the number of strings
+    if(!read_u32(data,end,nstr)){
+        return -1;
+    }
+    // 2. Safety check: Ensure nstr is not unreasonably large to prevent potential DoS attacks or memory issues.
+    if (nstr > k_max_args) {
+        return -1;
+    }
+    // 3. Loop to read each string
+    while(out.size()<nstr){
+        uint32_t len=0;
+        // 3a. Read length of next string
+        if(!read_u32(data,end,len)){
+            return -1;
+        }
+         // 3b. Read the actual string
+         out.push_back(std::string_view());
+        if(!read_str(data,end,len,out.back())){
+            return -1;
+        }
+       
+    }
+    // 4. Check for garbage
+     if(data!=end){
+            return -1;
+        }
+        return 0;
+}
+
+/*A RESP request is an array of bulk strings: `*<n>\r\n` then n times `$<len>\r\n<bytes>\r\n`.
+There is no length prefix for the whole request, so the parser also finds out if it's complete.*/
+
+// read `<type><digits>\r\n`: 1 if OK, 0 if incomplete, -1 if malformed or over `max`
+static int resp_read_len(const uint8_t *&cur, const uint8_t *end, uint8_t type, uint64_t max, uint32_t &out) {
+    if (cur == end) {
+        return 0;
+    }
+    if (*cur != type) {
+        return -1;
+    }
+    const uint8_t *p = cur + 1;
+    uint64_t val = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        val = val * 10 + (*p - '0');
+        if (val > max) {
+            return -1;
+        }
+    }
+    if (p == end || (*p == '\r' && p + 1 == end)) {
+        return 0;
+    }
+    if (p == cur + 1 || p[0] != '\r' || p[1] != '\n') {
+        return -1;
+    }
+    out = (uint32_t)val;
+    cur = p + 2;
+    return 1;
+}
+
+// Like parse_req(), the strings point into the receive buffer. Returns the size of the
+// request, 0 if it's incomplete or -1 if it's malformed.
+static int64_t parse_resp(const uint8_t *data, size_t size, std::vector<std::string_view> &out) {
+    const uint8_t *cur = data;
+    const uint8_t *end = data + size;
+    uint32_t nstr = 0;
+    int rv = resp_read_len(cur, end, '*', k_max_args, nstr);
+    if (rv <= 0) {
+        return rv;
+    }
+    while (out.size() < nstr) {
+        uint32_t len = 0;
+        rv = resp_read_len(cur, end, '$', k_max_msg, len);
+        if (rv <= 0) {
+            return rv;
+        }
+        if ((size_t)(end - cur) < (size_t)len + 2) {
+            return 0;
+        }
+        if (cur[len] != '\r' || cur[len + 1] != '\n') {
+            return -1;
+        }
+        out.push_back(std::string_view((const char *)cur, len));
+        cur += len + 2;
+    }
+    return cur - data;
+}
+
+/*The first 4 bytes decide. A RESP request starts with '*' and a digit, and its 4th byte is a digit,
+'\r' or '\n', all >= 0x0a, so as a TLV header it would be a length over k_max_msg. Nothing valid
+in one protocol is valid in the other.*/
+static uint8_t proto_detect(const uint8_t *data) {
+    uint32_t len = 0;
+    memcpy(&len, data, 4);
+    if (data[0] == '*' && data[1] >= '0' && data[1] <= '9' && len > k_max_msg) {
+        return PROTO_RESP2;
+    }
+    return PROTO_TLV;
+}
+
+// error code for TAG_ERR
+enum {
+    ERR_UNKNOWN = 1,    // unknown command
+    ERR_TOO_BIG = 2,    // response too big
+    ERR_BAD_TYP = 3,    // unexpected value type
+    ERR_BAD_ARG = 4,    // bad arguments
+    ERR_OOM = 5,        // over maxmemory and nothing to evict
+    ERR_READONLY = 6,   // a write on a replica
+    // cluster mode, see cluster_route()
+    ERR_MOVED = 7,      // the slot is served by another node: "slot host:port"
+    ERR_ASK = 8,        // the key is being migrated, try it there once: "slot host:port"
+    ERR_CROSSSLOT = 9,  // the keys of a command are in different slots
+    ERR_TRYAGAIN = 10,  // some of the keys were migrated already
+    ERR_CLUSTERDOWN = 11,   // the slot isn't served by any node
+};
+
+// data types of serialized data
+enum {
+    TAG_NIL = 0,    // nil
+    TAG_ERR = 1,    // error code + msg
+    TAG_STR = 2,    // string
+    TAG_INT = 3,    // int64
+    TAG_DBL = 4,    // double
+    TAG_ARR = 5,    // array
+};
+// help functions for the serialization
+static void buf_append_u8(Buffer &buf, uint8_t data) {
+    buf.data.push_back(data);
+}
+static void buf_append_u32(Buffer &buf, uint32_t data) {
+    buf_append(buf.data, (const uint8_t *)&data, 4);
+}
+static void buf_append_i64(Buffer &buf, int64_t data) {
+    buf_append(buf.data, (const uint8_t *)&data, 8);
+}
+static void buf_append_dbl(Buffer &buf, double data) {
+    buf_append(buf.data, (const uint8_t *)&data, 8);
+}
+
+static bool out_resp(const Buffer &out) {
+    return out.proto >= PROTO_RESP2;
+}
+static void resp_append_crlf(Buffer &buf) {
+    buf_append(buf.data, (const uint8_t *)"\r\n", 2);
+}
+// `<type><val>\r\n`, the header of most RESP types
+static void resp_append_line(Buffer &buf, uint8_t type, int64_t val) {
+    char tmp[24];
+    char *end = tmp + sizeof(tmp);
+    char *p = end;
+    uint64_t u = val < 0 ? 0 - (uint64_t)val : (uint64_t)val;
+    do {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (val < 0) {
+        *--p = '-';
+    }
+    buf.data.push_back(type);
+    buf_append(buf.data, (const uint8_t *)p, (size_t)(end - p));
+    resp_append_crlf(buf);
+}
+
+
+// append serialized data types to the back
+// in RESP, the TAG_* types map to: nil -> null bulk string (RESP3 null), err -> error,
+// str -> bulk string, int -> integer, dbl -> bulk string (RESP3 double), arr -> array
+static void out_nil(Buffer &out) {
+    if (out.proto == PROTO_RESP3) {
+        return buf_append(out.data, (const uint8_t *)"_\r\n", 3);
+    }
+    if (out.proto == PROTO_RESP2) {
+        return buf_append(out.data, (const uint8_t *)"$-1\r\n", 5);
+    }
+    buf_append_u8(out, TAG_NIL);
+}
+// done, with nothing to return: +OK in RESP, a nil in the binary protocol
+static void out_ok(Buffer &out) {
+    if (out_resp(out)) {
+        return buf_append(out.data, (const uint8_t *)"+OK\r\n", 5);
+    }
+    buf_append_u8(out, TAG_NIL);
+}
+
+static void out_str(Buffer &out, const char *s, size_t size) {
+    if (out_resp(out)) {
+        resp_append_line(out, '$', (int64_t)size);
+        buf_append(out.data, (const uint8_t *)s, size);
+        return resp_append_crlf(out);
+    }
+    buf_append_u8(out, TAG_STR);
+    buf_append_u32(out, (uint32_t)size);
+    buf_append(out.data, (const uint8_t *)s, size);
+}
+// smaller values are cheaper to copy than to reference
+const size_t k_out_ref_min = 4096;
+
+// a string value, referenced rather than copied if it's big
+static void out_rcbuf(Buffer &out, RcBuf *rc) {
+    if (rc->len < k_out_ref_min) {
+        return out_str(out, (const char *)rc->data, rc->len);
+    }
+    if (out_resp(out)) {
+        resp_append_line(out, '$', (int64_t)rc->len);
+    } else {
+        buf_append_u8(out, TAG_STR);
+        buf_append_u32(out, (uint32_t)rc->len);
+    }
+    out.refs.push_back(OutRef{out.data.size(), rcbuf_ref(rc)});
+    out.ref_bytes += rc->len;
+    if (out_resp(out)) {
+        resp_append_crlf(out);  // after the value
+    }
+}
+// a whole message serialized elsewhere, shared with the other connections it goes to
+static void out_shared(Buffer &out, RcBuf *rc) {
+    out.refs.push_back(OutRef{out.data.size(), rcbuf_ref(rc)});
+    out.ref_bytes += rc->len;
+}
+static void out_int(Buffer &out, int64_t val) {
+    if (out_resp(out)) {
+        return resp_append_line(out, ':', val);
+    }
+    buf_append_u8(out, TAG_INT);
+    buf_append_i64(out, val);
+}
+static void out_dbl(Buffer &out, double val) {
+    if (out_resp(out)) {
+        char tmp[32];
+        int n = snprintf(tmp, sizeof(tmp), "%.17g", val);   // inf, -inf, nan as RESP3 wants
+        if (out.proto == PROTO_RESP3) {
+            buf_append_u8(out, ',');
+            buf_append(out.data, (const uint8_t *)tmp, (size_t)n);
+            return resp_append_crlf(out);
+        }
+        return out_str(out, tmp, (size_t)n);
+    }
+     buf_append_u8(out, TAG_DBL);
+    buf_append_dbl(out, val);
+ }
+static void out_err(Buffer &out, uint32_t code, const std::string &msg) {
+    if (out_resp(out)) {
+        const char *prefix = "-ERR ";
+        switch (code) {
+        case ERR_BAD_TYP:   prefix = "-WRONGTYPE "; break;
+        case ERR_OOM:       prefix = "-OOM "; break;
+        case ERR_READONLY:  prefix = "-READONLY "; break;
+        case ERR_MOVED:     prefix = "-MOVED "; break;
+        case ERR_ASK:       prefix = "-ASK "; break;
+        case ERR_CROSSSLOT: prefix = "-CROSSSLOT "; break;
+        case ERR_TRYAGAIN:  prefix = "-TRYAGAIN "; break;
+        case ERR_CLUSTERDOWN: prefix = "-CLUSTERDOWN "; break;
+        }
+        buf_append(out.data, (const uint8_t *)prefix, strlen(prefix));
+        buf_append(out.data, (const uint8_t *)msg.data(), msg.size());
+        return resp_append_crlf(out);
+    }
+    buf_append_u8(out, TAG_ERR);
+    buf_append_u32(out, code);
+    buf_append_u32(out, (uint32_t)msg.size());
+    buf_append(out.data, (const uint8_t *)msg.data(), msg.size());
+}
+static void out_arr(Buffer &out, uint32_t n) {
+    if (out_resp(out)) {
+        return resp_append_line(out, '*', n);
+    }
+    buf_append_u8(out, TAG_ARR);
+    buf_append_u32(out, n);
+}
+// `n` key-value pairs, a flat array of 2n items except in RESP3
+static void out_map(Buffer &out, uint32_t n) {
+    if (out.proto == PROTO_RESP3) {
+        return resp_append_line(out, '%', n);
+    }
+    out_arr(out, n * 2);
+}
+// an out-of-band message like the ones of pub/sub, RESP3 has a type to tell them from replies
+static void out_push(Buffer &out, uint32_t n) {
+    if (out.proto == PROTO_RESP3) {
+        return resp_append_line(out, '>', n);
+    }
+    out_arr(out, n);
+}
+// room for the RESP array count: up to 10 digits and \r\n
+const size_t k_resp_arr_room = 12;
+
+static size_t out_begin_arr(Buffer &out) {
+    if (out_resp(out)) {
+        buf_append_u8(out, '*');
+        out.data.resize(out.data.size() + k_resp_arr_room);
+        return out.data.size() - k_resp_arr_room;
+    }
+    buf_append_u8(out, TAG_ARR);
+    buf_append_u32(out, 0);     // filled by out_end_arr()
+    return out.data.size() - 4; // the `ctx` arg
+}
+static void out_end_arr(Buffer &out, size_t ctx, uint32_t n) {
+    if (out_resp(out)) {
+        // RESP clients reject zero-padded counts, so close the gap after the
+        // digits. Nested arrays end first, so `ctx` of the outer ones stays valid.
+        assert(out.data[ctx - 1] == '*');
+        char tmp[k_resp_arr_room + 1];
+        size_t len = (size_t)snprintf(tmp, sizeof(tmp), "%u\r\n", n);
+        size_t gap = k_resp_arr_room - len;
+        memcpy(&out.data[ctx], tmp, len);
+        out.data.erase(out.data.begin() + (ptrdiff_t)(ctx + len),
+            out.data.begin() + (ptrdiff_t)(ctx + k_resp_arr_room));
+        for (size_t i = out.refs.size(); i > 0 && out.refs[i - 1].pos > ctx; i--) {
+            out.refs[i - 1].pos -= gap;
+        }
+        return;
+    }
+    assert(out.data[ctx - 1] == TAG_ARR);
+    memcpy(&out.data[ctx], &n, 4);
+}
+// whether the reply starting at `pos` is an error
+static bool out_is_err(const Buffer &out, size_t pos) {
+    return out.data.size() > pos && out.data[pos] == (out_resp(out) ? (uint8_t)'-' : (uint8_t)TAG_ERR);
+}
+
+// // 1. The Output format
+// struct Response{
+//     uint32_t status=0;  //A simple integer code (0 = OK, 1 = Error, etc.).
+//     std::vector<uint8_t> data;  //The actual payload we want to send back to the client (like the value of a key).
+// };
+
+/*This is your actual payload. Notice how HNode node; is embedded directly inside it.
+ This is the "handle glued to the back" concept we discussed earlier.
+  The hash table only cares about node, but you care about key and val.*/
+
+  // value types
+enum {
+    T_INIT  = 0,
+    T_STR   = 1,    // string
+    T_ZSET  = 2,    // sorted set
+    T_HASH  = 3,    // field -> value
+    T_LIST  = 4,    // deque
+    T_SET   = 5,    // unordered, no duplicates
+    T_STREAM = 6,   // append-only log of field-value entries
+};
+// KV pair for the top-level hashtable
+struct Entry {
+    struct HNode node;  // hashtable node
+    // value
+    size_t heap_idx = -1; // Tracks where this key's timer is in the heap (-1 means no TTL)
+    uint32_t type = 0;    // one of the following
+    uint64_t version = 0; // changes on every write, see entry_modified()
+    uint32_t atime = 0;   // g_data.lru_clock of the last access, see entry_touch()
+    uint8_t lfu = 0;      // logarithmic access counter, decays with time
+    uint16_t slot = 0;    // cluster mode: the hash slot, and the link in its key list
+    DList slot_node;
+    size_t mem = 0;       // bytes accounted in g_data.entries_mem, see entry_account()
+    RcBuf *str = NULL;
+    ZSet zset;
+    // the other types are allocated separately, one pointer for all of them, see `type`
+    union {
+        Hash *hash = NULL;
+        QList *list;
+        Set *set;
+        Stream *stream;
+    };
+    // the key is stored inline after the struct, like ZNode::name
+    size_t klen = 0;
+    char key[0];
+};
+
+// --- NEW HEAP HELPERS ---
+static void heap_delete(std::vector<HeapItem> &a, size_t pos) {
+    a[pos] = a.back(); // Swap the deleted item with the last item
+    a.pop_back();      // Remove the last item
+    if (pos < a.size()) {
+        heap_update(a.data(), pos, a.size()); // Re-sort the heap
+    }
+}
+
+static void heap_upsert(std::vector<HeapItem> &a, size_t pos, HeapItem t) {
+    if (pos < a.size()) {
+        a[pos] = t;         // Update existing timer
+    } else {
+        pos = a.size();
+        a.push_back(t);     // Add new timer
+    }
+    heap_update(a.data(), pos, a.size()); // Re-sort the heap
+}
+// the starting LFU count, so that a new key isn't the first to go
+const uint8_t k_lfu_init = 5;
+
+static Entry *entry_new(uint32_t type, const char *key, size_t klen, uint64_t hcode) {
+    // one allocation for the struct and the key bytes
+    void *mem = malloc(sizeof(Entry) + klen);
+    assert(mem);
+    Entry *ent = new (mem) Entry();
+    ent->node.hcode = hcode;
+    ent->type = type;
+    ent->version = ++g_data.version_clock;
+    ent->atime = g_data.lru_clock;
+    ent->lfu = k_lfu_init;
+    ent->klen = klen;
+    memcpy(&ent->key[0], key, klen);
+    return ent;
+}
+/*Memory accounting for maxmemory. It's an estimate from the sizes we allocate, malloc overhead
+not included. Whatever changes the size of a value calls this afterwards.*/
+static void entry_account(Entry *ent) {
+    size_t mem = sizeof(Entry) + ent->klen;
+    if (ent->str) {
+        mem += sizeof(RcBuf) + ent->str->cap;
+    }
+    switch (ent->type) {
+    case T_ZSET:
+        mem += zset_mem(&ent->zset);
+        break;
+    case T_HASH:
+        mem += sizeof(Hash) + hash_mem(ent->hash);
+        break;
+    case T_LIST:
+        mem += sizeof(QList) + qlist_mem(ent->list);
+        break;
+    case T_SET:
+        mem += sizeof(Set) + set_mem(ent->set);
+        break;
+    case T_STREAM:
+        mem += sizeof(Stream) + stream_mem(ent->stream);
+        break;
+    }
+    g_data.entries_mem += mem - ent->mem;
+    ent->mem = mem;
+}
+/*The slot of a key. If the key has a non-empty {hashtag}, only the tag is hashed, so that keys
+sharing a tag land in the same slot and can be used in one command. `hcode` is the hash of the
+whole key, which is what a key without a tag hashes to.*/
+static uint32_t key_slot(const char *key, size_t len, uint64_t hcode) {
+    const char *open = (const char *)memchr(key, '{', len);
+    if (open) {
+        size_t from = (size_t)(open - key) + 1;
+        const char *close = (const char *)memchr(key + from, '}', len - from);
+        if (close && close > open + 1) {
+            hcode = str_hash((const uint8_t *)open + 1, (size_t)(close - open - 1));
+        }
+    }
+    return (uint32_t)(hcode & (k_cluster_slots - 1));
+}
+// all inserts into the top-level hashtable go through here
+static void db_insert(Entry *ent) {
+    hm_insert(&g_data.db, &ent->node);
+    if (g_config.cluster_enabled) {
+        ent->slot = (uint16_t)key_slot(ent->key, ent->klen, ent->node.hcode);
+        dlist_insert_before(&g_cluster.slot_keys[ent->slot], &ent->slot_node);
+        g_cluster.slot_count[ent->slot]++;
+    }
+}
+static void entry_del(Entry *ent) {
+    if (ent->slot_node.next) {
+        dlist_detach(&ent->slot_node);
+        g_cluster.slot_count[ent->slot]--;
+    }
+   // Remove from TTL heap if it has a timer
+    if (ent->heap_idx != (size_t)-1) {
+        heap_delete(g_data.heap, ent->heap_idx);
+        ent->heap_idx = -1;
+    }
+    switch (ent->type) {
+    case T_ZSET:
+        zset_clear(&ent->zset);
+        break;
+    case T_HASH:
+        hash_clear(ent->hash);
+        delete ent->hash;
+        break;
+    case T_LIST:
+        qlist_clear(ent->list);
+        delete ent->list;
+        break;
+    case T_SET:
+        set_clear(ent->set);
+        delete ent->set;
+        break;
+    case T_STREAM:
+        stream_clear(ent->stream);
+        delete ent->stream;
+        break;
+    }
+    rcbuf_unref(ent->str);
+    g_data.del_versions[ent->node.hcode % k_del_versions] = ++g_data.version_clock;
+    g_data.entries_mem -= ent->mem;
+    ent->~Entry();
+    free(ent);
+}
+/*Commands that change a value or its TTL call this, so that WATCH can tell if a key was
+written since. A new entry gets a fresh version too, so delete + recreate is also noticed.*/
+static void entry_modified(Entry *ent) {
+    ent->version = ++g_data.version_clock;
+}
+// xorshift64*, for LFU and for picking eviction candidates
+static uint64_t rand64() {
+    static uint64_t x = 0x9E3779B97F4A7C15ull;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    return x * 0x2545F4914F6CDD1Dull;
+}
+// the LFU count after the decay for the time since the last access
+static uint8_t entry_lfu(const Entry *ent) {
+    if (g_config.lfu_decay_time <= 0) {
+        return ent->lfu;
+    }
+    uint32_t minutes = (g_data.lru_clock - ent->atime) / (60 * 1000);
+    uint64_t periods = minutes / (uint64_t)g_config.lfu_decay_time;
+    return periods >= ent->lfu ? 0 : (uint8_t)(ent->lfu - periods);
+}
+/*Called on every lookup that a command makes on behalf of the client. LRU just needs the time,
+LFU counts logarithmically in 8 bits: the more hits the counter has, the less likely the next
+one increments it, so 255 stands for about a million hits at the default log factor.*/
+static void entry_touch(Entry *ent) {
+    uint8_t count = entry_lfu(ent);
+    if (count < 255) {
+        double base = count > k_lfu_init ? count - k_lfu_init : 0;
+        double r = (double)(rand64() >> 11) / (double)(1ull << 53);
+        if (r * (base * (double)g_config.lfu_log_factor + 1) < 1) {
+            count++;
+        }
+    }
+    ent->lfu = count;
+    ent->atime = g_data.lru_clock;
+}
+static void entry_set_ttl(Entry *ent, int64_t ttl_ms) {
+    if (ttl_ms < 0 && ent->heap_idx != (size_t)-1) {
+        // A negative TTL means "remove the timer"
+        heap_delete(g_data.heap, ent->heap_idx);
+        ent->heap_idx = -1;
+    } else if (ttl_ms >= 0) {
+        // Add or update the timer in the heap
+        uint64_t expire_at = get_monotonic_msec() + (uint64_t)ttl_ms;
+        HeapItem item = {expire_at, &ent->heap_idx}; // Pass a pointer to the entry's heap_idx!
+        heap_upsert(g_data.heap, ent->heap_idx, item);
+    }
+}
+
+
+
+
+
+// -----------------------
+/*A dummy key for the lookup. It only borrows the bytes (usually straight from the receive buffer),
+so a lookup never allocates. The hash table already compared `hcode` before calling entry_eq().*/
+struct LookupKey {
+    struct HNode node;  // hashtable node
+    const char *data = NULL;
+    size_t len = 0;
+};
+static void key_init(LookupKey *key, std::string_view name) {
+    key->data = name.data();
+    key->len = name.size();
+    key->node.hcode = str_hash((const uint8_t *)name.data(), name.size());
+}
+// equality comparison for the top-level hashstable
+static bool entry_eq(HNode *node, HNode *key) {
+    struct Entry *ent = container_of(node, struct Entry, node);
+    struct LookupKey *keydata = container_of(key, struct LookupKey, node);
+    return ent->klen == keydata->len
+        && memcmp(ent->key, keydata->data, keydata->len) == 0;
+}
+static bool hnode_same(HNode *node, HNode *key) {
+    return node == key;
+}
+// a lookup on behalf of the client, which counts as an access for LRU/LFU
+static HNode *db_lookup(LookupKey *key) {
+    HNode *node = hm_lookup(&g_data.db, &key->node, &entry_eq);
+    if (node) {
+        entry_touch(container_of(node, Entry, node));
+    }
+    return node;
+}
+
+/*Eviction. Like Redis, there is no global LRU list: each round samples a few keys at random
+(maxmemory-samples, from the hashtable, or from the TTL heap for volatile-ttl) and keeps the best
+candidates seen so far in a small pool, ordered by how much we'd like to evict them. The pool
+outlives the round, so the result gets close to true LRU/LFU with a handful of samples. The
+pool holds copies of the keys, a key that was deleted meanwhile just isn't found.*/
+struct EvictCand {
+    uint64_t score = 0;     // higher goes first
+    uint64_t hcode = 0;
+    std::string key;
+};
+const size_t k_evict_pool = 16;
+static std::vector<EvictCand> g_evict_pool;    // sorted by score, ascending
+
+// a sampled key competes for a place in the pool
+static void evict_pool_offer(Entry *ent, uint64_t score) {
+    std::vector<EvictCand> &pool = g_evict_pool;
+    if (pool.size() == k_evict_pool) {
+        if (score <= pool[0].score) {
+            return;
+        }
+        pool.erase(pool.begin());
+    }
+    auto it = std::upper_bound(pool.begin(), pool.end(), score,
+        [](uint64_t v, const EvictCand &c) { return v < c.score; });
+    it = pool.insert(it, EvictCand{});
+    it->score = score;
+    it->hcode = ent->node.hcode;
+    it->key.assign(ent->key, ent->klen);
+}
+
+static void evict_pool_populate() {
+    const size_t k_max_samples = 64;
+    HNode *nodes[k_max_samples];
+    Entry *ents[k_max_samples];
+    size_t n = (size_t)g_config.maxmemory_samples;
+    if (g_config.maxmemory_policy == EVICT_TTL) {
+        std::vector<HeapItem> &heap = g_data.heap;
+        n = std::min(n, heap.size());
+        for (size_t i = 0; i < n; i++) {
+            ents[i] = container_of(heap[rand64() % heap.size()].ref, Entry, heap_idx);
+        }
+    } else {
+        n = hm_sample(&g_data.db, (size_t)rand64(), nodes, n);
+        for (size_t i = 0; i < n; i++) {
+            ents[i] = container_of(nodes[i], Entry, node);
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        Entry *ent = ents[i];
+        uint64_t score = 0;
+        switch (g_config.maxmemory_policy) {
+        case EVICT_LRU:
+            score = (uint32_t)(g_data.lru_clock - ent->atime);  // idle time
+            break;
+        case EVICT_LFU:
+            score = 255 - entry_lfu(ent);
+            break;
+        case EVICT_TTL:
+            score = UINT64_MAX - g_data.heap[ent->heap_idx].val;
+            break;
+        }
+        evict_pool_offer(ent, score);
+    }
+}
+
+// the next key to evict, NULL if there is none
+static Entry *evict_pick() {
+    if (g_config.maxmemory_policy == EVICT_RANDOM) {
+        HNode *node = NULL;
+        return hm_sample(&g_data.db, (size_t)rand64(), &node, 1) ? container_of(node, Entry, node) : NULL;
+    }
+    for (;;) {
+        evict_pool_populate();
+        if (g_evict_pool.empty()) {
+            return NULL;
+        }
+        EvictCand cand = std::move(g_evict_pool.back());
+        g_evict_pool.pop_back();
+        LookupKey key;
+        key.data = cand.key.data();
+        key.len = cand.key.size();
+        key.node.hcode = cand.hcode;
+        HNode *node = hm_lookup(&g_data.db, &key.node, &entry_eq);
+        Entry *ent = node ? container_of(node, Entry, node) : NULL;
+        if (ent && (g_config.maxmemory_policy != EVICT_TTL || ent->heap_idx != (size_t)-1)) {
+            return ent;
+        }
+    }
+}
+
+// keyspace memory: the entries, the top-level buckets and the TTL heap
+static size_t used_memory() {
+    return g_data.entries_mem + hm_mem(&g_data.db) + g_data.heap.capacity() * sizeof(HeapItem);
+}
+
+enum {
+    EVICT_OK = 0,       // under maxmemory
+    EVICT_RUNNING = 1,  // still over, process_timers() continues in the next iteration
+    EVICT_FAIL = 2,     // over, and nothing can be evicted
+};
+// evicting a lot at once is a latency spike, so each call gets a time budget
+const uint64_t k_evict_budget_ns = 500 * 1000;
+
+static void repl_feed(const std::string_view *args, size_t n);
+static void repl_feed_del(Entry *ent);
+
+static int evict_keys() {
+    g_data.evict_pending = false;
+    if (!g_config.maxmemory || used_memory() <= (size_t)g_config.maxmemory) {
+        return EVICT_OK;
+    }
+    if (g_config.maxmemory_policy == EVICT_NONE) {
+        return EVICT_FAIL;
+    }
+    uint64_t t0 = get_monotonic_nsec();
+    for (size_t nevict = 1; used_memory() > (size_t)g_config.maxmemory; nevict++) {
+        Entry *ent = evict_pick();
+        if (!ent) {
+            return EVICT_FAIL;
+        }
+        hm_delete(&g_data.db, &ent->node, &hnode_same);
+        repl_feed_del(ent);
+        entry_del(ent);
+        g_stats.evicted_keys++;
+        if (nevict % 16 == 0 && get_monotonic_nsec() - t0 > k_evict_budget_ns) {
+            g_data.evict_pending = true;
+            return EVICT_RUNNING;
+        }
+    }
+    return EVICT_OK;
+}
+/*This is an implementation of the FNV-1a hash algorithm.
+ It loops through every character in your string and scrambles it into a 64-bit integer (hcode).
+  This number tells the hash table which bucket to put the entry in.*/
+// static uint64_t str_hash(const uint8_t *data, size_t len) {
+//     uint32_t h = 0x811C9DC5;
+//     for (size_t i = 0; i < len; i++) {
+//         h = (h + data[i]) * 0x01000193;
+//     }
+//     return h;            moved to common.h 
+// }
+
+
+// static void do_get(std::vector<std::string> &cmd, Buffer &out) {
+//     // a dummy `Entry` just for the lookup
+//     Entry key;              //We create a temporary, fake Entry just to hold the key we are looking for.
+//     key.key.swap(cmd[1]);
+//     key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());         //We calculate the hash of the target string so the lookup function can find it fast.
+//     // hashtable lookup
+//     HNode *node = hm_lookup(&g_data.db, &key.node, &entry_eq);                   //We ask your custom hash table to find the node. We pass in the dummy key and our entry_eq comparison function. If it returns NULL, the key doesn't exist (RES_NX).
+//     if (!node) {
+//        return out_nil(out);
+//     }
+//     // copy the value
+//     const std::string &val = container_of(node, Entry, node)->val;
+//     out_str(out, val.data(),val.size());
+// }
+
+static void do_get(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    // a dummy struct just for the lookup
+    LookupKey key;
+    key_init(&key, cmd[1]);
+    // hashtable lookup
+    HNode *node = db_lookup(&key);
+    if (!node) {
+        return out_nil(out);
+    }
+    Entry *ent = container_of(node, Entry, node);
+    if (ent->type != T_STR) {
+        return out_err(out, ERR_BAD_TYP, "not a string value");
+    }
+    return out_rcbuf(out, ent->str);
+}
+
+
+// static void do_set(std::vector<std::string> &cmd, Buffer &out) {
+//     // a dummy `Entry` just for the lookup
+//     Entry key;   //Similar to get, we create a dummy key and try to find it in the database first.
+//     key.key.swap(cmd[1]);                                       //
+//     key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
+//     // hashtable lookup
+//     HNode *node = hm_lookup(&g_data.db, &key.node, &entry_eq);
+//     if (node) {       //If found: We don't need to insert a new node. We just find the existing Entry and use .swap() to quickly replace the old value with the new one.
+//         // found, update the value
+//         container_of(node, Entry, node)->val.swap(cmd[2]);
+//     } else {
+//         // not found, allocate & insert a new pair
+//         Entry *ent = new Entry();
+//         ent->key.swap(key.key);
+//         ent->node.hcode = key.node.hcode;
+//         ent->val.swap(cmd[2]);
+//         hm_insert(&g_data.db, &ent->node);
+//     }
+//     /*If not found: We allocate fresh memory (new Entry()). 
+//     We fill it with the key, the pre-calculated hash code,
+//      and the value. Finally, we hand its &ent->node over to hm_insert to link it into the hash table.*/
+
+//      return out_nil(out);  // NEW: Successfully set the data? Redis traditionally replies with NIL to save bandwidth.
+// }
+// `node` is the lookup result for `key`, a string entry or NULL
+static void entry_set_str(HNode *node, LookupKey *key, std::string_view val) {
+    if (node) {
+        // found, update the value
+        Entry *ent = container_of(node, Entry, node);
+        assert(ent->type == T_STR);
+        // queued responses may still reference the old value
+        rcbuf_unref(ent->str);
+        ent->str = rcbuf_new(val.data(), val.size());
+        entry_modified(ent);
+        entry_account(ent);
+    } else {
+        // not found, allocate & insert a new pair
+        Entry *ent = entry_new(T_STR, key->data, key->len, key->node.hcode);
+        ent->str = rcbuf_new(val.data(), val.size());
+        entry_account(ent);
+        db_insert(ent);
+    }
+}
+static void do_set(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    // a dummy struct just for the lookup
+    LookupKey key;
+    key_init(&key, cmd[1]);
+    // hashtable lookup
+    HNode *node = db_lookup(&key);
+    if (node && container_of(node, Entry, node)->type != T_STR) {
+        return out_err(out, ERR_BAD_TYP, "a non-string value exists");
+    }
+    entry_set_str(node, &key, cmd[2]);
+    return out_ok(out);
+}
+// static void do_del(std::vector<std::string> &cmd, Buffer &out) {
+//     // a dummy `Entry` just for the lookup
+//     Entry key;
+//     key.key.swap(cmd[1]);
+//     key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
+//     // hashtable delete
+//     HNode *node = hm_delete(&g_data.db, &key.node, &entry_eq);         //: This removes the node from the hash table's linked list and returns the detached node to us.
+//     if (node) { // deallocate the pair
+//         delete container_of(node, Entry, node);        //Because the hash table only manages links (not memory), it is our job to free the memory. We find the parent Entry and delete it so we don't cause a memory leak.
+//         return out_int(out, 1); // NEW: Send an INT tag with '1' meaning "1 item deleted"
+//     }
+//     return out_int(out,0); // NEW: If the key doesn't exist, we reply with '0' meaning "0 items deleted"
+// }
+/*Multi-key commands go through the keys in batches. Each batch is hashed, then the buckets
+and the first nodes are prefetched, so the batch costs about one round of cache misses
+instead of one per key.*/
+const size_t k_key_batch = 16;
+
+// the keys cmd[pos], cmd[pos + step], ..., at most k_key_batch of them
+static size_t keys_batch_init(std::vector<std::string_view> &cmd, size_t pos, size_t step, LookupKey *keys) {
+    size_t n = 0;
+    for (; n < k_key_batch && pos < cmd.size(); n++, pos += step) {
+        key_init(&keys[n], cmd[pos]);
+    }
+    for (size_t i = 0; i < n; i++) {
+        hm_prefetch_bucket(&g_data.db, keys[i].node.hcode);
+    }
+    for (size_t i = 0; i < n; i++) {
+        hm_prefetch_node(&g_data.db, keys[i].node.hcode);
+    }
+    return n;
+}
+
+// DEL key [key...]
+static void do_del(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    int64_t count = 0;
+    LookupKey keys[k_key_batch];
+    for (size_t pos = 1; pos < cmd.size(); pos += k_key_batch) {
+        size_t n = keys_batch_init(cmd, pos, 1, keys);
+        for (size_t i = 0; i < n; i++) {
+            // hashtable delete
+            HNode *node = hm_delete(&g_data.db, &keys[i].node, &entry_eq);
+            if (node) { // deallocate the pair
+                entry_del(container_of(node, Entry, node));
+                count++;
+            }
+        }
+    }
+    return out_int(out, count);
+}
+
+// MGET key [key...]: nil for missing keys and non-string values
+static void do_mget(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    out_arr(out, (uint32_t)(cmd.size() - 1));
+    LookupKey keys[k_key_batch];
+    for (size_t pos = 1; pos < cmd.size(); pos += k_key_batch) {
+        size_t n = keys_batch_init(cmd, pos, 1, keys);
+        for (size_t i = 0; i < n; i++) {
+            HNode *node = db_lookup(&keys[i]);
+            Entry *ent = node ? container_of(node, Entry, node) : NULL;
+            if (ent && ent->type == T_STR) {
+                out_rcbuf(out, ent->str);
+            } else {
+                out_nil(out);
+            }
+        }
+    }
+}
+
+// MSET key value [key value...]: all or nothing, fails if any key holds a non-string
+static void do_mset(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    if (cmd.size() % 2 != 1) {
+        return out_err(out, ERR_BAD_ARG, "wrong number of arguments.");
+    }
+    LookupKey keys[k_key_batch];
+    for (size_t pos = 1; pos < cmd.size(); pos += 2 * k_key_batch) {
+        size_t n = keys_batch_init(cmd, pos, 2, keys);
+        for (size_t i = 0; i < n; i++) {
+            HNode *node = hm_lookup(&g_data.db, &keys[i].node, &entry_eq);
+            if (node && container_of(node, Entry, node)->type != T_STR) {
+                return out_err(out, ERR_BAD_TYP, "a non-string value exists");
+            }
+        }
+    }
+    // checked, now set, looking up again because a key can appear twice
+    for (size_t pos = 1; pos < cmd.size(); pos += 2 * k_key_batch) {
+        size_t n = keys_batch_init(cmd, pos, 2, keys);
+        for (size_t i = 0; i < n; i++) {
+            HNode *node = db_lookup(&keys[i]);
+            entry_set_str(node, &keys[i], cmd[pos + 2 * i + 1]);
+        }
+    }
+    return out_ok(out);
+}
+static bool cb_keys(HNode *node, void *arg) {
+    Buffer &out = *(Buffer *)arg;
+    Entry *ent = container_of(node, Entry, node);
+    out_str(out, ent->key, ent->klen);
+    return true;
+}
+
+
+
+
+
+// the arguments are not NUL-terminated, copy short numbers to the stack first
+static bool arg2cstr(std::string_view s, char (&buf)[64]) {
+    if (s.size() >= sizeof(buf)) {
+        return false;
+    }
+    memcpy(buf, s.data(), s.size());
+    buf[s.size()] = '\0';
+    return true;
+}
+static bool str2int(std::string_view s, int64_t &out) {
+    char buf[64];
+    if (!arg2cstr(s, buf)) {
+        return false;
+    }
+    char *endp = NULL;
+    out = strtoll(buf, &endp, 10);
+    return endp == buf + s.size();
+}
+static constexpr uint8_t ascii_lower(uint8_t c) {
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+// compare with a lower case name, ignoring the case of `s`
+static bool str_ieq(std::string_view s, const char *lower) {
+    size_t i = 0;
+    for (; i < s.size() && lower[i]; i++) {
+        if (ascii_lower((uint8_t)s[i]) != (uint8_t)lower[i]) {
+            return false;
+        }
+    }
+    return i == s.size() && !lower[i];
+}
+// PEXPIRE key ttl_ms
+static void do_expire(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    int64_t ttl_ms = 0;
+    if (!str2int(cmd[2], ttl_ms)) {
+        return out_err(out, ERR_BAD_ARG, "expect int64");
+    }
+    LookupKey key;
+    key_init(&key, cmd[1]);
+    HNode *node = db_lookup(&key);
+    
+    if (node) {
+        Entry *ent = container_of(node, Entry, node);
+        entry_set_ttl(ent, ttl_ms);
+        entry_modified(ent);
+    }
+    return out_int(out, node ? 1: 0);
+}
+
+// PTTL key
+static void do_ttl(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    LookupKey key;
+    key_init(&key, cmd[1]);
+    HNode *node = hm_lookup(&g_data.db, &key.node, &entry_eq);
+    
+    if (!node) {
+        return out_int(out, -2);    // -2 means key not found
+    }
+    Entry *ent = container_of(node, Entry, node);
+    if (ent->heap_idx == (size_t)-1) {
+        return out_int(out, -1);    // -1 means no TTL set
+    }
+    
+    uint64_t expire_at = g_data.heap[ent->heap_idx].val;
+    uint64_t now_ms = get_monotonic_msec();
+    return out_int(out, expire_at > now_ms ? (expire_at - now_ms) : 0);
+}
+// -----------------------
+static void do_keys(Conn *, std::vector<std::string_view> &, Buffer &out) {
+    out_arr(out, (uint32_t)hm_size(&g_data.db));
+    hm_foreach(&g_data.db, &cb_keys, (void *)&out);
+}
+
+static bool str2dbl(std::string_view s, double &out) {
+    char buf[64];
+    if (!arg2cstr(s, buf)) {
+        return false;
+    }
+    char *endp = NULL;
+    out = strtod(buf, &endp);
+    return endp == buf + s.size() && !isnan(out);
+}
+
+
+
+// ---------------------------------------------------------
+// bitmaps, on string values
+// ---------------------------------------------------------
+// a bitmap is a string, so it's bounded like one: it must fit in a reply
+const uint64_t k_max_bit_offset = (uint64_t)k_max_msg * 8;
+
+// the string at `s` for a read, NULL if there is no such key; false if the key holds another type
+static bool expect_str(std::string_view s, RcBuf **out) {
+    LookupKey key;
+    key_init(&key, s);
+    HNode *hnode = db_lookup(&key);
+    Entry *ent = hnode ? container_of(hnode, Entry, node) : NULL;
+    *out = ent ? ent->str : NULL;
+    return !ent || ent->type == T_STR;
+}
+
+static bool arg2bit_offset(std::string_view arg, uint64_t &out) {
+    int64_t val = 0;
+    if (!str2int(arg, val) || val < 0 || (uint64_t)val >= k_max_bit_offset) {
+        return false;
+    }
+    out = (uint64_t)val;
+    return true;
+}
+
+// setbit key offset 0|1: the old bit, the string grows with zeroes as needed
+static void do_setbit(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    uint64_t offset = 0;
+    if (!arg2bit_offset(cmd[2], offset)) {
+        return out_err(out, ERR_BAD_ARG, "bit offset is not an integer or out of range.");
+    }
+    if (cmd[3] != "0" && cmd[3] != "1") {
+        return out_err(out, ERR_BAD_ARG, "bit is not an integer or out of range.");
+    }
+    LookupKey key;
+    key_init(&key, cmd[1]);
+    HNode *hnode = db_lookup(&key);
+    Entry *ent = NULL;
+    if (hnode) {
+        ent = container_of(hnode, Entry, node);
+        if (ent->type != T_STR) {
+            return out_err(out, ERR_BAD_TYP, "not a string value");
+        }
+    } else {
+        ent = entry_new(T_STR, key.data, key.len, key.node.hcode);
+        ent->str = rcbuf_new(NULL, 0);
+        db_insert(ent);
+    }
+    size_t byte = (size_t)(offset >> 3);
+    uint8_t mask = (uint8_t)(0x80 >> (offset & 7));
+    // a queued reply may hold the old value, then this is a copy
+    ent->str = rcbuf_writable(ent->str, byte + 1);
+    bool old = ent->str->data[byte] & mask;
+    if (cmd[3] == "1") {
+        ent->str->data[byte] |= mask;
+    } else {
+        ent->str->data[byte] &= (uint8_t)~mask;
+    }
+    entry_modified(ent);
+    entry_account(ent);
+    return out_int(out, old);
+}
+
+// getbit key offset
+static void do_getbit(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    uint64_t offset = 0;
+    if (!arg2bit_offset(cmd[2], offset)) {
+        return out_err(out, ERR_BAD_ARG, "bit offset is not an integer or out of range.");
+    }
+    RcBuf *str = NULL;
+    if (!expect_str(cmd[1], &str)) {
+        return out_err(out, ERR_BAD_TYP, "not a string value");
+    }
+    size_t byte = (size_t)(offset >> 3);
+    bool bit = str && byte < str->len && (str->data[byte] & (0x80 >> (offset & 7)));
+    return out_int(out, bit);
+}
+
+// start and end bytes, inclusive, negative ones count from the end; [from, to) or false if empty
+static bool byte_range(int64_t start, int64_t end, size_t len, size_t &from, size_t &to) {
+    if (start < 0) {
+        start += (int64_t)len;
+    }
+    if (end < 0) {
+        end += (int64_t)len;
+    }
+    start = std::max(start, (int64_t)0);
+    end = std::min(end, (int64_t)len - 1);
+    if (start > end) {
+        return false;
+    }
+    from = (size_t)start;
+    to = (size_t)end + 1;
+    return true;
+}
+
+// bitcount key [start end]: the bits set, in a byte range
+static void do_bitcount(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    int64_t start = 0, end = -1;
+    if (cmd.size() == 3 || cmd.size() > 4) {
+        return out_err(out, ERR_BAD_ARG, "syntax error.");
+    }
+    if (cmd.size() == 4 && (!str2int(cmd[2], start) || !str2int(cmd[3], end))) {
+        return out_err(out, ERR_BAD_ARG, "expect int64");
+    }
+    RcBuf *str = NULL;
+    if (!expect_str(cmd[1], &str)) {
+        return out_err(out, ERR_BAD_TYP, "not a string value");
+    }
+    size_t from = 0, to = 0;
+    if (!str || !byte_range(start, end, str->len, from, to)) {
+        return out_int(out, 0);
+    }
+    return out_int(out, (int64_t)bit_count(str->data + from, to - from));
+}
+
+/*bitpos key 0|1 [start [end]]: the first bit with that value, in a byte range. Like Redis, a
+string of all ones has its first clear bit right after it, unless the range has an explicit end.*/
+static void do_bitpos(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    if (cmd[2] != "0" && cmd[2] != "1") {
+        return out_err(out, ERR_BAD_ARG, "the bit argument must be 1 or 0.");
+    }
+    bool bit = cmd[2] == "1";
+    int64_t start = 0, end = -1;
+    if ((cmd.size() > 3 && !str2int(cmd[3], start)) || (cmd.size() > 4 && !str2int(cmd[4], end))) {
+        return out_err(out, ERR_BAD_ARG, "expect int64");
+    }
+    RcBuf *str = NULL;
+    if (!expect_str(cmd[1], &str)) {
+        return out_err(out, ERR_BAD_TYP, "not a string value");
+    }
+    if (!str) {
+        return out_int(out, bit ? -1 : 0);
+    }
+    size_t from = 0, to = 0;
+    if (!byte_range(start, end, str->len, from, to)) {
+        return out_int(out, -1);
+    }
+    int64_t pos = bit_pos(str->data + from, to - from, bit);
+    if (pos >= 0) {
+        return out_int(out, (int64_t)from * 8 + pos);
+    }
+    bool end_given = cmd.size() > 4;
+    return out_int(out, !bit && !end_given ? (int64_t)to * 8 : -1);
+}
+
+// bitop and|or|xor|not destkey key [key ...]: the length of the result, missing bytes are zeroes
+static void do_bitop(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    uint32_t op = 0;
+    if (str_ieq(cmd[1], "and")) {
+        op = BITOP_AND;
+    } else if (str_ieq(cmd[1], "or")) {
+        op = BITOP_OR;
+    } else if (str_ieq(cmd[1], "xor")) {
+        op = BITOP_XOR;
+    } else if (str_ieq(cmd[1], "not")) {
+        op = BITOP_NOT;
+    } else {
+        return out_err(out, ERR_BAD_ARG, "syntax error.");
+    }
+    if (op == BITOP_NOT && cmd.size() != 4) {
+        return out_err(out, ERR_BAD_ARG, "BITOP NOT must be called with a single source key.");
+    }
+    std::vector<RcBuf *> srcs;
+    size_t len = 0;
+    for (size_t i = 3; i < cmd.size(); i++) {
+        RcBuf *str = NULL;
+        if (!expect_str(cmd[i], &str)) {
+            return out_err(out, ERR_BAD_TYP, "not a string value");
+        }
+        srcs.push_back(str);
+        len = std::max(len, str ? str->len : 0);
+    }
+    // the first source zero-padded, then the others folded in
+    RcBuf *res = rcbuf_new(NULL, len);
+    if (srcs[0]) {
+        memcpy(res->data, srcs[0]->data, srcs[0]->len);
+    }
+    if (op == BITOP_NOT) {
+        bit_combine(op, res->data, NULL, len);
+    }
+    for (size_t i = 1; i < srcs.size(); i++) {
+        size_t n = srcs[i] ? srcs[i]->len : 0;
+        bit_combine(op, res->data, n ? srcs[i]->data : NULL, n);
+        if (op == BITOP_AND) {
+            memset(res->data + n, 0, len - n);
+        }
+    }
+    // the destination is replaced whatever it held, an empty result deletes it
+    LookupKey key;
+    key_init(&key, cmd[2]);
+    HNode *hnode = db_lookup(&key);
+    if (hnode && (len == 0 || container_of(hnode, Entry, node)->type != T_STR)) {
+        hm_delete(&g_data.db, hnode, &hnode_same);
+        entry_del(container_of(hnode, Entry, node));
+        hnode = NULL;
+    }
+    if (len == 0) {
+        rcbuf_unref(res);
+        return out_int(out, 0);
+    }
+    Entry *ent = NULL;
+    if (hnode) {
+        ent = container_of(hnode, Entry, node);
+        rcbuf_unref(ent->str);
+        ent->str = res;
+        entry_modified(ent);
+    } else {
+        ent = entry_new(T_STR, key.data, key.len, key.node.hcode);
+        ent->str = res;
+        db_insert(ent);
+    }
+    entry_account(ent);
+    return out_int(out, (int64_t)len);
+}
+
+// ---------------------------------------------------------
+// HyperLogLog, on string values
+// ---------------------------------------------------------
+/*Elements are hashed like keys, then mixed into 64 bits with the murmur3 finalizer: str_hash()
+has 32, and the estimate needs uniform low bits for the register and high bits for the rank.*/
+static uint64_t hll_hash(std::string_view s) {
+    uint64_t h = str_hash((const uint8_t *)s.data(), s.size());
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+static bool entry_is_hll(Entry *ent) {
+    return ent->type == T_STR && hll_valid(ent->str->data, ent->str->len);
+}
+
+// the entry at `s`, NULL if there is no such key; false if it's not a HyperLogLog
+static bool expect_hll(std::string_view s, Entry **out) {
+    LookupKey key;
+    key_init(&key, s);
+    HNode *hnode = db_lookup(&key);
+    *out = hnode ? container_of(hnode, Entry, node) : NULL;
+    return !*out || entry_is_hll(*out);
+}
+
+// pfadd key [element ...]: 1 if the estimate may have changed
+static void do_pfadd(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    LookupKey key;
+    key_init(&key, cmd[1]);
+    HNode *hnode = db_lookup(&key);
+    Entry *ent = NULL;
+    bool changed = false;
+    if (hnode) {
+        ent = container_of(hnode, Entry, node);
+        if (!entry_is_hll(ent)) {
+            return out_err(out, ERR_BAD_TYP, "not a valid HyperLogLog string value");
+        }
+    } else {
+        ent = entry_new(T_STR, key.data, key.len, key.node.hcode);
+        ent->str = hll_new();
+        db_insert(ent);
+        changed = true;
+    }
+    std::vector<uint64_t> hashes;
+    for (size_t i = 2; i < cmd.size(); i++) {
+        hashes.push_back(hll_hash(cmd[i]));
+    }
+    bool updated = false;
+    ent->str = hll_add(ent->str, hashes.data(), hashes.size(), (size_t)g_config.hll_sparse_max_bytes, &updated);
+    changed = changed || updated;
+    if (changed) {
+        entry_modified(ent);
+        entry_account(ent);
+    }
+    return out_int(out, changed);
+}
+
+/*pfcount key [key ...]: the estimated distinct elements of their union. One key answers from its
+cached estimate, which it refreshes in place; that isn't a change to the value.*/
+static void do_pfcount(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    Entry *ent = NULL;
+    if (cmd.size() == 2) {
+        if (!expect_hll(cmd[1], &ent)) {
+            return out_err(out, ERR_BAD_TYP, "not a valid HyperLogLog string value");
+        }
+        return out_int(out, ent ? (int64_t)hll_count(ent->str) : 0);
+    }
+    std::vector<uint8_t> regs(k_hll_regs), tmp(k_hll_regs);
+    for (size_t i = 1; i < cmd.size(); i++) {
+        if (!expect_hll(cmd[i], &ent)) {
+            return out_err(out, ERR_BAD_TYP, "not a valid HyperLogLog string value");
+        }
+        if (ent) {
+            hll_unpack(ent->str, tmp.data());
+            hll_regs_max(regs.data(), tmp.data());
+        }
+    }
+    return out_int(out, (int64_t)hll_regs_count(regs.data()));
+}
+
+// pfmerge destkey [sourcekey ...]: the union into destkey, which is one of the sources
+static void do_pfmerge(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    std::vector<uint8_t> regs(k_hll_regs), tmp(k_hll_regs);
+    for (size_t i = 1; i < cmd.size(); i++) {
+        Entry *ent = NULL;
+        if (!expect_hll(cmd[i], &ent)) {
+            return out_err(out, ERR_BAD_TYP, "not a valid HyperLogLog string value");
+        }
+        if (ent) {
+            hll_unpack(ent->str, tmp.data());
+            hll_regs_max(regs.data(), tmp.data());
+        }
+    }
+    LookupKey key;
+    key_init(&key, cmd[1]);
+    HNode *hnode = db_lookup(&key);
+    Entry *ent = NULL;
+    if (hnode) {
+        ent = container_of(hnode, Entry, node);
+        rcbuf_unref(ent->str);
+        ent->str = hll_from_regs(regs.data());
+        entry_modified(ent);
+    } else {
+        ent = entry_new(T_STR, key.data, key.len, key.node.hcode);
+        ent->str = hll_from_regs(regs.data());
+        db_insert(ent);
+    }
+    entry_account(ent);
+    return out_ok(out);
+}
+
+// zadd zset score name
+static void do_zadd(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    double score = 0;
+    if (!str2dbl(cmd[2], score)) {
+        return out_err(out, ERR_BAD_ARG, "expect float");
+    }
+
+    // look up or create the zset
+    LookupKey key;
+    key_init(&key, cmd[1]);
+    HNode *hnode = db_lookup(&key);
+
+    Entry *ent = NULL;
+    if (!hnode) {   // insert a new key
+        ent = entry_new(T_ZSET, key.data, key.len, key.node.hcode);
+        db_insert(ent);
+    } else {        // check the existing key
+        ent = container_of(hnode, Entry, node);
+        if (ent->type != T_ZSET) {
+            return out_err(out, ERR_BAD_TYP, "expect zset");
+        }
+    }
+
+    // add or update the tuple
+    std::string_view name = cmd[3];
+    bool added = zset_insert(&ent->zset, name.data(), name.size(), score);
+    entry_modified(ent);
+    entry_account(ent);
+    return out_int(out, (int64_t)added);
+}
+
+static const ZSet k_empty_zset;
+
+static ZSet *expect_zset(std::string_view s) {
+    LookupKey key;
+    key_init(&key, s);
+    HNode *hnode = db_lookup(&key);
+    if (!hnode) {   // a non-existent key is treated as an empty zset
+        return (ZSet *)&k_empty_zset;
+    }
+    Entry *ent = container_of(hnode, Entry, node);
+    return ent->type == T_ZSET ? &ent->zset : NULL;
+}
+
+// zrem zset name
+static void do_zrem(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    ZSet *zset = expect_zset(cmd[1]);
+    if (!zset) {
+        return out_err(out, ERR_BAD_TYP, "expect zset");
+    }
+
+    std::string_view name = cmd[2];
+    ZNode *znode = zset_lookup(zset, name.data(), name.size());
+    if (znode) {
+        zset_delete(zset, znode);
+        Entry *ent = container_of(zset, Entry, zset);
+        entry_modified(ent);
+        entry_account(ent);
+    }
+    return out_int(out, znode ? 1 : 0);
+}
+
+// zscore zset name
+static void do_zscore(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    ZSet *zset = expect_zset(cmd[1]);
+    if (!zset) {
+        return out_err(out, ERR_BAD_TYP, "expect zset");
+    }
+
+    std::string_view name = cmd[2];
+    ZNode *znode = zset_lookup(zset, name.data(), name.size());
+    return znode ? out_dbl(out, znode->score) : out_nil(out);
+}
+
+// zquery zset score name offset limit
+static void do_zquery(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    // parse args
+    double score = 0;
+    if (!str2dbl(cmd[2], score)) {
+        return out_err(out, ERR_BAD_ARG, "expect fp number");
+    }
+    std::string_view name = cmd[3];
+    int64_t offset = 0, limit = 0;
+    if (!str2int(cmd[4], offset) || !str2int(cmd[5], limit)) {
+        return out_err(out, ERR_BAD_ARG, "expect int");
+    }
+
+    // get the zset
+    ZSet *zset = expect_zset(cmd[1]);
+    if (!zset) {
+        return out_err(out, ERR_BAD_TYP, "expect zset");
+    }
+
+    // seek to the key
+    if (limit <= 0) {
+        return out_arr(out, 0);
+    }
+    ZNode *znode = zset_seekge(zset, score, name.data(), name.size());
+    znode = znode_offset(znode, offset);
+
+    // output
+    size_t ctx = out_begin_arr(out);
+    int64_t n = 0;
+    while (znode && n < limit) {
+        out_str(out, znode->name, znode->len);
+        out_dbl(out, znode->score);
+        znode = znode_offset(znode, +1);
+        n += 2;
+    }
+    out_end_arr(out, ctx, (uint32_t)n);
+}
+
+const size_t k_max_cursors = 64;   // per connection
+
+// zcursor zset score name offset
+static void do_zcursor(Conn *conn, std::vector<std::string_view> &cmd, Buffer &out) {
+    double score = 0;
+    if (!str2dbl(cmd[2], score)) {
+        return out_err(out, ERR_BAD_ARG, "expect fp number");
+    }
+    std::string_view name = cmd[3];
+    int64_t offset = 0;
+    if (!str2int(cmd[4], offset)) {
+        return out_err(out, ERR_BAD_ARG, "expect int");
+    }
+    ZSet *zset = expect_zset(cmd[1]);
+    if (!zset) {
+        return out_err(out, ERR_BAD_TYP, "expect zset");
+    }
+    size_t slot = 0;
+    while (slot < conn->cursors.size() && conn->cursors[slot]) {
+        slot++;
+    }
+    if (slot >= k_max_cursors) {
+        return out_err(out, ERR_BAD_ARG, "too many cursors");
+    }
+    // the only O(log N) seek, later pages continue from the saved node
+    ZNode *znode = zset_seekge(zset, score, name.data(), name.size());
+    znode = znode_offset(znode, offset);
+
+    ZCursor *cur = new ZCursor();
+    zcursor_open(cur, zset, znode);
+    if (slot == conn->cursors.size()) {
+        conn->cursors.push_back(NULL);
+    }
+    conn->cursors[slot] = cur;
+    return out_int(out, (int64_t)slot + 1);
+}
+
+static ZCursor *lookup_cursor(Conn *conn, int64_t id) {
+    if (id < 1 || (size_t)id > conn->cursors.size()) {
+        return NULL;
+    }
+    return conn->cursors[id - 1];
+}
+
+// zfetch cursor count
+static void do_zfetch(Conn *conn, std::vector<std::string_view> &cmd, Buffer &out) {
+    int64_t id = 0, limit = 0;
+    if (!str2int(cmd[1], id) || !str2int(cmd[2], limit)) {
+        return out_err(out, ERR_BAD_ARG, "expect int");
+    }
+    ZCursor *cur = lookup_cursor(conn, id);
+    if (!cur) {
+        return out_err(out, ERR_BAD_ARG, "no such cursor");
+    }
+    // same output as zquery, an empty array means the cursor is exhausted
+    size_t ctx = out_begin_arr(out);
+    int64_t n = 0;
+    ZNode *znode = NULL;
+    while (n < limit && (znode = zcursor_next(cur))) {
+        out_str(out, znode->name, znode->len);
+        out_dbl(out, znode->score);
+        n += 2;
+    }
+    out_end_arr(out, ctx, (uint32_t)n);
+}
+
+// zclose cursor
+static void do_zclose(Conn *conn, std::vector<std::string_view> &cmd, Buffer &out) {
+    int64_t id = 0;
+    if (!str2int(cmd[1], id)) {
+        return out_err(out, ERR_BAD_ARG, "expect int");
+    }
+    ZCursor *cur = lookup_cursor(conn, id);
+    if (!cur) {
+        return out_int(out, 0);
+    }
+    zcursor_close(cur);
+    delete cur;
+    conn->cursors[id - 1] = NULL;
+    return out_int(out, 1);
+}
+
+static Hash k_empty_hash;
+
+// the hash at `s`, an empty one if there is no such key, NULL if the key holds another type
+static Hash *expect_hash(std::string_view s) {
+    LookupKey key;
+    key_init(&key, s);
+    HNode *hnode = db_lookup(&key);
+    if (!hnode) {
+        return &k_empty_hash;
+    }
+    Entry *ent = container_of(hnode, Entry, node);
+    return ent->type == T_HASH ? ent->hash : NULL;
+}
+
+// the hash at `s` for a write, created if missing, NULL if the key holds another type
+static Entry *expect_hash_entry(std::string_view s) {
+    LookupKey key;
+    key_init(&key, s);
+    HNode *hnode = db_lookup(&key);
+    if (!hnode) {
+        Entry *ent = entry_new(T_HASH, key.data, key.len, key.node.hcode);
+        ent->hash = new Hash();
+        db_insert(ent);
+        return ent;
+    }
+    Entry *ent = container_of(hnode, Entry, node);
+    return ent->type == T_HASH ? ent : NULL;
+}
+
+static void hash_set_checked(Hash *hash, std::string_view field, std::string_view val, int64_t &added) {
+    added += hash_set(hash, field.data(), field.size(), val.data(), val.size());
+    if (!hash->is_table && (hash->count > (size_t)g_config.hash_max_compact_entries
+        || field.size() > (size_t)g_config.hash_max_compact_value
+        || val.size() > (size_t)g_config.hash_max_compact_value))
+    {
+        hash_to_table(hash);
+    }
+}
+
+// hset key field value [field value ...]
+static void do_hset(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    if (cmd.size() % 2 != 0) {
+        return out_err(out, ERR_BAD_ARG, "wrong number of arguments.");
+    }
+    Entry *ent = expect_hash_entry(cmd[1]);
+    if (!ent) {
+        return out_err(out, ERR_BAD_TYP, "expect hash");
+    }
+    int64_t added = 0;
+    for (size_t i = 2; i < cmd.size(); i += 2) {
+        hash_set_checked(ent->hash, cmd[i], cmd[i + 1], added);
+    }
+    entry_modified(ent);
+    entry_account(ent);
+    return out_int(out, added);
+}
+
+// hget key field
+static void do_hget(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    Hash *hash = expect_hash(cmd[1]);
+    if (!hash) {
+        return out_err(out, ERR_BAD_TYP, "expect hash");
+    }
+    HashPair pair;
+    if (!hash_get(hash, cmd[2].data(), cmd[2].size(), &pair)) {
+        return out_nil(out);
+    }
+    return out_str(out, pair.val, pair.vlen);
+}
+
+// hmget key field [field ...]
+static void do_hmget(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    Hash *hash = expect_hash(cmd[1]);
+    if (!hash) {
+        return out_err(out, ERR_BAD_TYP, "expect hash");
+    }
+    out_arr(out, (uint32_t)(cmd.size() - 2));
+    for (size_t i = 2; i < cmd.size(); i++) {
+        HashPair pair;
+        if (hash_get(hash, cmd[i].data(), cmd[i].size(), &pair)) {
+            out_str(out, pair.val, pair.vlen);
+        } else {
+            out_nil(out);
+        }
+    }
+}
+
+static bool cb_hgetall(const HashPair &pair, void *arg) {
+    Buffer &out = *(Buffer *)arg;
+    out_str(out, pair.field, pair.flen);
+    out_str(out, pair.val, pair.vlen);
+    return true;
+}
+
+// hgetall key: field, value pairs
+static void do_hgetall(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    Hash *hash = expect_hash(cmd[1]);
+    if (!hash) {
+        return out_err(out, ERR_BAD_TYP, "expect hash");
+    }
+    out_map(out, (uint32_t)hash->count);
+    hash_foreach(hash, &cb_hgetall, &out);
+}
+
+// hdel key field [field ...], the key goes away with the last field
+static void do_hdel(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    LookupKey key;
+    key_init(&key, cmd[1]);
+    HNode *hnode = db_lookup(&key);
+    if (!hnode) {
+        return out_int(out, 0);
+    }
+    Entry *ent = container_of(hnode, Entry, node);
+    if (ent->type != T_HASH) {
+        return out_err(out, ERR_BAD_TYP, "expect hash");
+    }
+    int64_t removed = 0;
+    for (size_t i = 2; i < cmd.size(); i++) {
+        removed += hash_del(ent->hash, cmd[i].data(), cmd[i].size());
+    }
+    if (!removed) {
+        return out_int(out, 0);
+    }
+    if (ent->hash->count) {
+        entry_modified(ent);
+        entry_account(ent);
+    } else {
+        hm_delete(&g_data.db, &ent->node, &hnode_same);
+        entry_del(ent);
+    }
+    return out_int(out, removed);
+}
+
+// hincrby key field increment
+static void do_hincrby(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    int64_t incr = 0;
+    if (!str2int(cmd[3], incr)) {
+        return out_err(out, ERR_BAD_ARG, "expect int64");
+    }
+    Entry *ent = expect_hash_entry(cmd[1]);
+    if (!ent) {
+        return out_err(out, ERR_BAD_TYP, "expect hash");
+    }
+    int64_t val = 0;
+    HashPair pair;
+    if (hash_get(ent->hash, cmd[2].data(), cmd[2].size(), &pair)
+        && !str2int(std::string_view(pair.val, pair.vlen), val))
+    {
+        return out_err(out, ERR_BAD_ARG, "hash value is not an integer.");
+    }
+    if (__builtin_add_overflow(val, incr, &val)) {
+        return out_err(out, ERR_BAD_ARG, "increment or decrement would overflow.");
+    }
+    std::string str = std::to_string(val);
+    int64_t added = 0;
+    hash_set_checked(ent->hash, cmd[2], str, added);
+    entry_modified(ent);
+    entry_account(ent);
+    return out_int(out, val);
+}
+
+static Set k_empty_set;
+
+// the set at `s`, an empty one if there is no such key, NULL if the key holds another type
+static Set *expect_set(std::string_view s) {
+    LookupKey key;
+    key_init(&key, s);
+    HNode *hnode = db_lookup(&key);
+    if (!hnode) {
+        return &k_empty_set;
+    }
+    Entry *ent = container_of(hnode, Entry, node);
+    return ent->type == T_SET ? ent->set : NULL;
+}
+
+static void set_add_checked(Set *set, std::string_view member, int64_t &added) {
+    added += set_add(set, member.data(), member.size());
+    if (!set->is_table && set->count > (size_t)g_config.set_max_intset_entries) {
+        set_to_table(set);
+    }
+}
+
+// sadd key member [member ...]
+static void do_sadd(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    LookupKey key;
+    key_init(&key, cmd[1]);
+    HNode *hnode = db_lookup(&key);
+    Entry *ent = NULL;
+    if (hnode) {
+        ent = container_of(hnode, Entry, node);
+        if (ent->type != T_SET) {
+            return out_err(out, ERR_BAD_TYP, "expect set");
+        }
+    } else {
+        ent = entry_new(T_SET, key.data, key.len, key.node.hcode);
+        ent->set = new Set();
+        db_insert(ent);
+    }
+    int64_t added = 0;
+    for (size_t i = 2; i < cmd.size(); i++) {
+        set_add_checked(ent->set, cmd[i], added);
+    }
+    entry_modified(ent);
+    entry_account(ent);
+    return out_int(out, added);
+}
+
+// srem key member [member ...], the key goes away with the last member
+static void do_srem(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    LookupKey key;
+    key_init(&key, cmd[1]);
+    HNode *hnode = db_lookup(&key);
+    if (!hnode) {
+        return out_int(out, 0);
+    }
+    Entry *ent = container_of(hnode, Entry, node);
+    if (ent->type != T_SET) {
+        return out_err(out, ERR_BAD_TYP, "expect set");
+    }
+    int64_t removed = 0;
+    for (size_t i = 2; i < cmd.size(); i++) {
+        removed += set_del(ent->set, cmd[i].data(), cmd[i].size());
+    }
+    if (!removed) {
+        return out_int(out, 0);
+    }
+    if (ent->set->count) {
+        entry_modified(ent);
+        entry_account(ent);
+    } else {
+        hm_delete(&g_data.db, &ent->node, &hnode_same);
+        entry_del(ent);
+    }
+    return out_int(out, removed);
+}
+
+// sismember key member
+static void do_sismember(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    Set *set = expect_set(cmd[1]);
+    if (!set) {
+        return out_err(out, ERR_BAD_TYP, "expect set");
+    }
+    return out_int(out, set_has(set, cmd[2].data(), cmd[2].size()));
+}
+
+// scard key
+static void do_scard(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    Set *set = expect_set(cmd[1]);
+    if (!set) {
+        return out_err(out, ERR_BAD_TYP, "expect set");
+    }
+    return out_int(out, (int64_t)set->count);
+}
+
+static bool cb_smembers(const char *member, size_t len, void *arg) {
+    out_str(*(Buffer *)arg, member, len);
+    return true;
+}
+
+// smembers key
+static void do_smembers(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    Set *set = expect_set(cmd[1]);
+    if (!set) {
+        return out_err(out, ERR_BAD_TYP, "expect set");
+    }
+    out_arr(out, (uint32_t)set->count);
+    set_foreach(set, &cb_smembers, &out);
+}
+
+// the sets at cmd[1:], false if a key holds another type
+static bool expect_sets(std::vector<std::string_view> &cmd, std::vector<Set *> &sets) {
+    for (size_t i = 1; i < cmd.size(); i++) {
+        Set *set = expect_set(cmd[i]);
+        if (!set) {
+            return false;
+        }
+        sets.push_back(set);
+    }
+    return true;
+}
+
+struct SinterCtx {
+    std::vector<Set *> *others;
+    Buffer *out;
+    uint32_t n;
+};
+
+static bool cb_sinter(const char *member, size_t len, void *arg) {
+    SinterCtx &ctx = *(SinterCtx *)arg;
+    for (Set *set : *ctx.others) {
+        if (!set_has(set, member, len)) {
+            return true;
+        }
+    }
+    out_str(*ctx.out, member, len);
+    ctx.n++;
+    return true;
+}
+
+/*sinter key [key ...]. Starting from the smallest set, intsets are merged with the SIMD kernel,
+otherwise each member of the smallest is looked up in the others.*/
+static void do_sinter(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    std::vector<Set *> sets;
+    if (!expect_sets(cmd, sets)) {
+        return out_err(out, ERR_BAD_TYP, "expect set");
+    }
+    std::sort(sets.begin(), sets.end(), [](Set *a, Set *b) { return a->count < b->count; });
+    bool all_ints = std::none_of(sets.begin(), sets.end(), [](Set *set) { return set->is_table; });
+    if (all_ints) {
+        std::vector<int64_t> acc(sets[0]->ints, sets[0]->ints + sets[0]->count);
+        for (size_t i = 1; i < sets.size() && !acc.empty(); i++) {
+            acc.resize(intset_intersect(acc.data(), acc.size(), sets[i]->ints, sets[i]->count, acc.data()));
+        }
+        out_arr(out, (uint32_t)acc.size());
+        for (int64_t val : acc) {
+            char buf[24];
+            int len = snprintf(buf, sizeof(buf), "%lld", (long long)val);
+            out_str(out, buf, (size_t)len);
+        }
+        return;
+    }
+    std::vector<Set *> others(sets.begin() + 1, sets.end());
+    SinterCtx ctx = {&others, &out, 0};
+    size_t arr = out_begin_arr(out);
+    set_foreach(sets[0], &cb_sinter, &ctx);
+    out_end_arr(out, arr, ctx.n);
+}
+
+struct SunionCtx {
+    Set *set;
+    int64_t added;
+};
+
+static bool cb_sunion(const char *member, size_t len, void *arg) {
+    SunionCtx &ctx = *(SunionCtx *)arg;
+    set_add_checked(ctx.set, std::string_view(member, len), ctx.added);
+    return true;
+}
+
+// sunion key [key ...], collected in a temporary set
+static void do_sunion(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    std::vector<Set *> sets;
+    if (!expect_sets(cmd, sets)) {
+        return out_err(out, ERR_BAD_TYP, "expect set");
+    }
+    Set result;
+    SunionCtx ctx = {&result, 0};
+    for (Set *set : sets) {
+        set_foreach(set, &cb_sunion, &ctx);
+    }
+    out_arr(out, (uint32_t)result.count);
+    set_foreach(&result, &cb_smembers, &out);
+    set_clear(&result);
+}
+
+// ---------------------------------------------------------
+// blocking
+// ---------------------------------------------------------
+static bool blocked_key_eq(HNode *node, HNode *key) {
+    BlockedKey *bk = container_of(node, BlockedKey, node);
+    LookupKey *lk = container_of(key, LookupKey, node);
+    return bk->key.size() == lk->len && memcmp(bk->key.data(), lk->data, lk->len) == 0;
+}
+
+static BlockedKey *blocked_key_lookup(LookupKey *key) {
+    HNode *node = hm_lookup(&g_blocked.keys, &key->node, &blocked_key_eq);
+    return node ? container_of(node, BlockedKey, node) : NULL;
+}
+
+// a push to the key, its waiters are served after the current request, see serve_blocked()
+static void signal_key_ready(Entry *ent) {
+    if (hm_size(&g_blocked.keys) == 0) {
+        return;
+    }
+    LookupKey key;
+    key.node.hcode = ent->node.hcode;
+    key.data = ent->key;
+    key.len = ent->klen;
+    BlockedKey *bk = blocked_key_lookup(&key);
+    if (bk && !bk->ready) {
+        bk->ready = true;
+        g_blocked.ready.push_back(bk);
+    }
+}
+
+/*Park the client until one of the keys gets pushed to or `timeout_ms` (0: never) is over. The
+command replies nothing and its request stays in `incoming`, so the client's pipeline waits
+behind it, and waking up is running the request again.*/
+static void conn_block(Conn *conn, const std::string_view *keys, size_t n, uint64_t timeout_ms) {
+    conn->blocked = true;
+    g_blocked.nclients++;
+    for (size_t i = 0; i < n; i++) {
+        if (std::find(conn->block_keys.begin(), conn->block_keys.end(), keys[i]) != conn->block_keys.end()) {
+            continue;
+        }
+        conn->block_keys.emplace_back(keys[i]);
+        LookupKey key;
+        key_init(&key, keys[i]);
+        BlockedKey *bk = blocked_key_lookup(&key);
+        if (!bk) {
+            bk = new BlockedKey();
+            bk->node.hcode = key.node.hcode;
+            bk->key.assign(keys[i]);
+            hm_insert(&g_blocked.keys, &bk->node);
+        }
+        bk->waiters.push_back(conn);
+    }
+    if (timeout_ms) {
+        HeapItem item;
+        item.val = get_monotonic_msec() + timeout_ms;
+        item.ref = &conn->block_heap_idx;
+        heap_upsert(g_blocked.timeouts, conn->block_heap_idx, item);
+    }
+    // it waits for as long as it asked, not for the idle timeout
+    dlist_detach(&conn->idle_node);
+    dlist_init(&conn->idle_node);
+}
+
+static void conn_unblock(Conn *conn) {
+    for (const std::string &name : conn->block_keys) {
+        LookupKey key;
+        key_init(&key, name);
+        BlockedKey *bk = blocked_key_lookup(&key);
+        bk->waiters.erase(std::find(bk->waiters.begin(), bk->waiters.end(), conn));
+        if (bk->waiters.empty() && !bk->ready) {    // a ready one is freed by serve_blocked()
+            hm_delete(&g_blocked.keys, &bk->node, &hnode_same);
+            delete bk;
+        }
+    }
+    conn->block_keys.clear();
+    if (conn->block_heap_idx != (size_t)-1) {
+        heap_delete(g_blocked.timeouts, conn->block_heap_idx);
+        conn->block_heap_idx = -1;
+    }
+    conn->blocked = false;
+    g_blocked.nclients--;
+    if (!conn_subscribed(conn)) {
+        conn->last_active_ms = get_monotonic_msec();
+        dlist_insert_before(&g_data.idle_list, &conn->idle_node);
+    }
+}
+
+// ---------------------------------------------------------
+// lists
+// ---------------------------------------------------------
+static QList k_empty_list;
+
+// the list at `s`, an empty one if there is no such key, NULL if the key holds another type
+static QList *expect_list(std::string_view s) {
+    LookupKey key;
+    key_init(&key, s);
+    HNode *hnode = db_lookup(&key);
+    if (!hnode) {
+        return &k_empty_list;
+    }
+    Entry *ent = container_of(hnode, Entry, node);
+    return ent->type == T_LIST ? ent->list : NULL;
+}
+
+// the number of elements for serve_blocked(), without counting as an access
+static size_t list_len(std::string_view s) {
+    LookupKey key;
+    key_init(&key, s);
+    HNode *hnode = hm_lookup(&g_data.db, &key.node, &entry_eq);
+    Entry *ent = hnode ? container_of(hnode, Entry, node) : NULL;
+    return ent && ent->type == T_LIST ? ent->list->count : 0;
+}
+
+// [lr]push key element [element ...]
+static void list_push(std::vector<std::string_view> &cmd, Buffer &out, bool front) {
+    LookupKey key;
+    key_init(&key, cmd[1]);
+    HNode *hnode = db_lookup(&key);
+    Entry *ent = NULL;
+    if (hnode) {
+        ent = container_of(hnode, Entry, node);
+        if (ent->type != T_LIST) {
+            return out_err(out, ERR_BAD_TYP, "expect list");
+        }
+    } else {
+        ent = entry_new(T_LIST, key.data, key.len, key.node.hcode);
+        ent->list = new QList();
+        db_insert(ent);
+    }
+    for (size_t i = 2; i < cmd.size(); i++) {
+        qlist_push(ent->list, front, cmd[i].data(), cmd[i].size());
+    }
+    entry_modified(ent);
+    entry_account(ent);
+    signal_key_ready(ent);
+    return out_int(out, (int64_t)ent->list->count);
+}
+
+static void do_lpush(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    return list_push(cmd, out, true);
+}
+
+static void do_rpush(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    return list_push(cmd, out, false);
+}
+
+// reply with the element at one end and remove it, the key goes away with the last element
+static void list_pop_to(Entry *ent, bool front, Buffer &out) {
+    QElem elem;
+    bool found = qlist_peek(ent->list, front, &elem);
+    assert(found);
+    (void)found;
+    out_str(out, elem.data, elem.len);
+    qlist_pop(ent->list, front);
+    if (ent->list->count) {
+        entry_modified(ent);
+        entry_account(ent);
+    } else {
+        hm_delete(&g_data.db, &ent->node, &hnode_same);
+        entry_del(ent);
+    }
+}
+
+// [lr]pop key
+static void list_pop(std::vector<std::string_view> &cmd, Buffer &out, bool front) {
+    LookupKey key;
+    key_init(&key, cmd[1]);
+    HNode *hnode = db_lookup(&key);
+    if (!hnode) {
+        return out_nil(out);
+    }
+    Entry *ent = container_of(hnode, Entry, node);
+    if (ent->type != T_LIST) {
+        return out_err(out, ERR_BAD_TYP, "expect list");
+    }
+    return list_pop_to(ent, front, out);
+}
+
+static void do_lpop(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    return list_pop(cmd, out, true);
+}
+
+static void do_rpop(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    return list_pop(cmd, out, false);
+}
+
+// llen key
+static void do_llen(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    QList *list = expect_list(cmd[1]);
+    if (!list) {
+        return out_err(out, ERR_BAD_TYP, "expect list");
+    }
+    return out_int(out, (int64_t)list->count);
+}
+
+// start and stop, inclusive, negative ones count from the tail; false if the range is empty
+static bool list_range(size_t len, int64_t &start, int64_t &stop) {
+    if (start < 0) {
+        start += (int64_t)len;
+    }
+    if (stop < 0) {
+        stop += (int64_t)len;
+    }
+    start = std::max(start, (int64_t)0);
+    stop = std::min(stop, (int64_t)len - 1);
+    return start <= stop;
+}
+
+// lrange key start stop: the cost is skipping whole chunks up to `start`, then the elements
+static void do_lrange(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    int64_t start = 0, stop = 0;
+    if (!str2int(cmd[2], start) || !str2int(cmd[3], stop)) {
+        return out_err(out, ERR_BAD_ARG, "expect int64");
+    }
+    QList *list = expect_list(cmd[1]);
+    if (!list) {
+        return out_err(out, ERR_BAD_TYP, "expect list");
+    }
+    if (!list_range(list->count, start, stop)) {
+        return out_arr(out, 0);
+    }
+    out_arr(out, (uint32_t)(stop - start + 1));
+    QIter it;
+    qlist_seek(list, (size_t)start, &it);
+    for (int64_t i = start; i <= stop; i++) {
+        QElem elem;
+        qlist_next(list, &it, &elem);
+        out_str(out, elem.data, elem.len);
+    }
+}
+
+// ltrim key start stop: keep only that range, an empty one deletes the key
+static void do_ltrim(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    int64_t start = 0, stop = 0;
+    if (!str2int(cmd[2], start) || !str2int(cmd[3], stop)) {
+        return out_err(out, ERR_BAD_ARG, "expect int64");
+    }
+    LookupKey key;
+    key_init(&key, cmd[1]);
+    HNode *hnode = db_lookup(&key);
+    if (!hnode) {
+        return out_ok(out);
+    }
+    Entry *ent = container_of(hnode, Entry, node);
+    if (ent->type != T_LIST) {
+        return out_err(out, ERR_BAD_TYP, "expect list");
+    }
+    size_t len = ent->list->count;
+    if (!list_range(len, start, stop)) {
+        hm_delete(&g_data.db, &ent->node, &hnode_same);
+        entry_del(ent);
+        return out_ok(out);
+    }
+    qlist_trim(ent->list, (size_t)start, len - 1 - (size_t)stop);
+    entry_modified(ent);
+    entry_account(ent);
+    return out_ok(out);
+}
+
+// blpop key [key ...] timeout: pop from the first non-empty list, or wait for a push
+static void do_blpop(Conn *conn, std::vector<std::string_view> &cmd, Buffer &out) {
+    double timeout = 0;
+    if (!str2dbl(cmd.back(), timeout) || timeout < 0) {
+        return out_err(out, ERR_BAD_ARG, "timeout is not a float or out of range.");
+    }
+    for (size_t i = 1; i + 1 < cmd.size(); i++) {
+        LookupKey key;
+        key_init(&key, cmd[i]);
+        HNode *hnode = db_lookup(&key);
+        if (!hnode) {
+            continue;
+        }
+        Entry *ent = container_of(hnode, Entry, node);
+        if (ent->type != T_LIST) {
+            return out_err(out, ERR_BAD_TYP, "expect list");
+        }
+        // replicas pop without waiting
+        std::string_view args[2] = {"lpop", cmd[i]};
+        repl_feed(args, 2);
+        out_arr(out, 2);
+        out_str(out, cmd[i].data(), cmd[i].size());
+        return list_pop_to(ent, true, out);
+    }
+    // nothing to pop: give up when the time is over, or inside EXEC, which can't wait
+    if (conn->block_timed_out || g_exec.active) {
+        return out_nil(out);
+    }
+    uint64_t timeout_ms = timeout > 0 ? (uint64_t)std::max(1.0, std::min(timeout * 1000, 1e15)) : 0;
+    conn_block(conn, &cmd[1], cmd.size() - 2, timeout_ms);
+}
+
+// ---------------------------------------------------------
+// streams
+// ---------------------------------------------------------
+const StreamID k_sid_max = {UINT64_MAX, UINT64_MAX};
+
+// an unsigned decimal, digits only
+static bool str2u64(std::string_view s, uint64_t &out) {
+    if (s.empty() || s.size() > 20) {
+        return false;
+    }
+    out = 0;
+    for (char c : s) {
+        uint8_t digit = (uint8_t)(c - '0');
+        if (digit > 9 || __builtin_mul_overflow(out, 10, &out) || __builtin_add_overflow(out, digit, &out)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// "ms-seq", or just "ms" with `missing_seq`
+static bool str2sid(std::string_view s, uint64_t missing_seq, StreamID &id) {
+    size_t dash = s.find('-');
+    if (dash == std::string_view::npos) {
+        id.seq = missing_seq;
+        return str2u64(s, id.ms);
+    }
+    return str2u64(s.substr(0, dash), id.ms) && str2u64(s.substr(dash + 1), id.seq);
+}
+
+static bool sid_incr(StreamID &id) {
+    if (id.seq < UINT64_MAX) {
+        id.seq++;
+        return true;
+    }
+    id.seq = 0;
+    return id.ms < UINT64_MAX && ++id.ms;
+}
+
+static bool sid_decr(StreamID &id) {
+    if (id.seq > 0) {
+        id.seq--;
+        return true;
+    }
+    id.seq = UINT64_MAX;
+    return id.ms > 0 && id.ms--;
+}
+
+static void out_sid(Buffer &out, StreamID id) {
+    char buf[48];
+    int len = snprintf(buf, sizeof(buf), "%llu-%llu", (unsigned long long)id.ms, (unsigned long long)id.seq);
+    out_str(out, buf, (size_t)len);
+}
+
+static Stream k_empty_stream;
+
+// the stream at `s`, an empty one if there is no such key, NULL if the key holds another type
+static Stream *expect_stream(std::string_view s) {
+    LookupKey key;
+    key_init(&key, s);
+    HNode *hnode = db_lookup(&key);
+    if (!hnode) {
+        return &k_empty_stream;
+    }
+    Entry *ent = container_of(hnode, Entry, node);
+    return ent->type == T_STREAM ? ent->stream : NULL;
+}
+
+// the type for serve_blocked(), without counting as an access
+static uint32_t key_type(std::string_view s) {
+    LookupKey key;
+    key_init(&key, s);
+    HNode *hnode = hm_lookup(&g_data.db, &key.node, &entry_eq);
+    return hnode ? container_of(hnode, Entry, node)->type : (uint32_t)T_INIT;
+}
+
+struct XTrim {
+    size_t maxlen = SIZE_MAX;
+    StreamID minid;
+    bool approx = false;
+    size_t pos = 0;     // where MAXLEN|MINID is in the command
+};
+
+// [MAXLEN|MINID [=|~] threshold] at cmd[i], `i` moves past it; false if it's malformed
+static bool xtrim_parse(std::vector<std::string_view> &cmd, size_t &i, XTrim &trim, bool &found) {
+    found = i < cmd.size() && (str_ieq(cmd[i], "maxlen") || str_ieq(cmd[i], "minid"));
+    if (!found) {
+        return true;
+    }
+    trim.pos = i;
+    bool by_len = str_ieq(cmd[i++], "maxlen");
+    if (i < cmd.size() && (cmd[i] == "=" || cmd[i] == "~")) {
+        trim.approx = cmd[i++] == "~";
+    }
+    if (i >= cmd.size()) {
+        return false;
+    }
+    std::string_view arg = cmd[i++];
+    if (!by_len) {
+        return str2sid(arg, 0, trim.minid);
+    }
+    uint64_t maxlen = 0;
+    if (!str2u64(arg, maxlen)) {
+        return false;
+    }
+    trim.maxlen = (size_t)maxlen;
+    return true;
+}
+
+/*`~` trims whole blocks, and a replica cuts its blocks elsewhere once it loaded the stream
+from a snapshot, so it could keep more. Replicas get the result instead: MAXLEN = what's left.*/
+static void xtrim_propagate(std::vector<std::string_view> &cmd, const XTrim &trim, const Stream *s) {
+    if (!trim.approx) {
+        return;
+    }
+    static char buf[24];
+    int len = snprintf(buf, sizeof(buf), "%zu", s->count);
+    cmd[trim.pos] = "maxlen";
+    cmd[trim.pos + 1] = "=";
+    cmd[trim.pos + 2] = std::string_view(buf, (size_t)len);
+}
+
+/*The ID of XADD. `*` takes the clock in ms, "ms-*" and "ms" take the next sequence number in
+that ms, which starts from 0 (1 for 0-*).*/
+static bool xadd_id(std::string_view arg, const Stream *stream, StreamID &id, Buffer &out) {
+    StreamID last = stream->last_id;
+    bool auto_seq = true;
+    if (arg == "*") {
+        id.ms = std::max(get_realtime_msec(), last.ms);
+    } else {
+        size_t dash = arg.find('-');
+        auto_seq = dash == std::string_view::npos || arg.substr(dash + 1) == "*";
+        if (!str2u64(arg.substr(0, dash), id.ms) || (!auto_seq && !str2u64(arg.substr(dash + 1), id.seq))) {
+            out_err(out, ERR_BAD_ARG, "Invalid stream ID specified as stream command argument");
+            return false;
+        }
+    }
+    if (auto_seq) {
+        id.seq = 0;
+        if (id.ms == last.ms) {
+            id = last;
+            // the ms ran out of numbers, only `*` can move on to the next one
+            if (!sid_incr(id) || (arg != "*" && id.ms != last.ms)) {
+                id = last;
+            }
+        }
+    } else if (id.ms == 0 && id.seq == 0) {
+        out_err(out, ERR_BAD_ARG, "The ID specified in XADD must be greater than 0-0");
+        return false;
+    }
+    if (!sid_less(last, id)) {
+        out_err(out, ERR_BAD_ARG, "The ID specified in XADD is equal or smaller than the target stream top item");
+        return false;
+    }
+    return true;
+}
+
+// xadd key [NOMKSTREAM] [MAXLEN|MINID [=|~] threshold] id|* field value [field value ...]
+static void do_xadd(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    size_t i = 2;
+    bool mkstream = true;
+    if (str_ieq(cmd[i], "nomkstream")) {
+        mkstream = false;
+        i++;
+    }
+    XTrim trim;
+    bool trimming = false;
+    if (!xtrim_parse(cmd, i, trim, trimming)) {
+        return out_err(out, ERR_BAD_ARG, "syntax error.");
+    }
+    if (i + 3 > cmd.size() || (cmd.size() - i - 1) % 2 != 0) {
+        return out_err(out, ERR_BAD_ARG, "wrong number of arguments.");
+    }
+    LookupKey key;
+    key_init(&key, cmd[1]);
+    HNode *hnode = db_lookup(&key);
+    Entry *ent = hnode ? container_of(hnode, Entry, node) : NULL;
+    if (ent && ent->type != T_STREAM) {
+        return out_err(out, ERR_BAD_TYP, "expect stream");
+    }
+    if (!ent && !mkstream) {
+        return out_nil(out);
+    }
+    StreamID id;
+    if (!xadd_id(cmd[i], ent ? ent->stream : &k_empty_stream, id, out)) {
+        return;
+    }
+    if (!ent) {
+        ent = entry_new(T_STREAM, key.data, key.len, key.node.hcode);
+        ent->stream = new Stream();
+        db_insert(ent);
+    }
+    stream_append(ent->stream, id, &cmd[i + 1], cmd.size() - i - 1,
+        (uint32_t)g_config.stream_node_max_bytes, (uint32_t)g_config.stream_node_max_entries);
+    if (trimming) {
+        stream_trim(ent->stream, trim.maxlen, trim.minid, trim.approx);
+        xtrim_propagate(cmd, trim, ent->stream);
+    }
+    entry_modified(ent);
+    entry_account(ent);
+    signal_key_ready(ent);
+    // replicas and the log get the ID, not the `*`
+    static char buf[48];
+    int len = snprintf(buf, sizeof(buf), "%llu-%llu", (unsigned long long)id.ms, (unsigned long long)id.seq);
+    cmd[i] = std::string_view(buf, (size_t)len);
+    return out_str(out, buf, (size_t)len);
+}
+
+// xlen key
+static void do_xlen(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    Stream *stream = expect_stream(cmd[1]);
+    if (!stream) {
+        return out_err(out, ERR_BAD_TYP, "expect stream");
+    }
+    return out_int(out, (int64_t)stream->count);
+}
+
+// xtrim key MAXLEN|MINID [=|~] threshold: an emptied stream stays, with its last ID
+static void do_xtrim(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    size_t i = 2;
+    XTrim trim;
+    bool found = false;
+    if (!xtrim_parse(cmd, i, trim, found) || !found || i != cmd.size()) {
+        return out_err(out, ERR_BAD_ARG, "syntax error.");
+    }
+    LookupKey key;
+    key_init(&key, cmd[1]);
+    HNode *hnode = db_lookup(&key);
+    if (!hnode) {
+        return out_int(out, 0);
+    }
+    Entry *ent = container_of(hnode, Entry, node);
+    if (ent->type != T_STREAM) {
+        return out_err(out, ERR_BAD_TYP, "expect stream");
+    }
+    size_t removed = stream_trim(ent->stream, trim.maxlen, trim.minid, trim.approx);
+    if (removed) {
+        entry_modified(ent);
+        entry_account(ent);
+    }
+    xtrim_propagate(cmd, trim, ent->stream);
+    return out_int(out, (int64_t)removed);
+}
+
+struct XRangeCtx {
+    Buffer *out;
+    size_t limit;
+    uint32_t n;
+};
+
+// [id, [field, value, ...]]
+static bool cb_xrange(const SEntry &sent, void *arg) {
+    XRangeCtx &ctx = *(XRangeCtx *)arg;
+    if (ctx.n >= ctx.limit) {
+        return false;
+    }
+    Buffer &out = *ctx.out;
+    out_arr(out, 2);
+    out_sid(out, sent.id);
+    out_arr(out, sent.nfields);
+    size_t pos = 0;
+    for (uint32_t i = 0; i < sent.nfields; i++) {
+        std::string_view field = sentry_field(sent, &pos);
+        out_str(out, field.data(), field.size());
+    }
+    ctx.n++;
+    return true;
+}
+
+// the entries of a range, an array even when there are none
+static void out_xrange(Buffer &out, Stream *stream, StreamID start, StreamID end, bool rev, size_t limit) {
+    XRangeCtx ctx = {&out, limit, 0};
+    size_t arr = out_begin_arr(out);
+    stream_range(stream, start, end, rev, &cb_xrange, &ctx);
+    out_end_arr(out, arr, ctx.n);
+}
+
+// an end of XRANGE: - and + are the extremes, ( excludes the ID itself
+static bool xrange_bound(std::string_view arg, bool is_start, StreamID &id) {
+    if (arg == "-" || arg == "+") {
+        id = arg == "-" ? StreamID{} : k_sid_max;
+        return true;
+    }
+    bool exclusive = !arg.empty() && arg[0] == '(';
+    if (!str2sid(exclusive ? arg.substr(1) : arg, is_start ? 0 : UINT64_MAX, id)) {
+        return false;
+    }
+    return !exclusive || (is_start ? sid_incr(id) : sid_decr(id));
+}
+
+// x[rev]range key start end [COUNT count], the ends swapped for XREVRANGE
+static void xrange(std::vector<std::string_view> &cmd, Buffer &out, bool rev) {
+    StreamID start, end;
+    if (!xrange_bound(cmd[rev ? 3 : 2], true, start) || !xrange_bound(cmd[rev ? 2 : 3], false, end)) {
+        return out_err(out, ERR_BAD_ARG, "Invalid stream ID specified as stream command argument");
+    }
+    int64_t count = -1;
+    if (cmd.size() == 6 && str_ieq(cmd[4], "count")) {
+        if (!str2int(cmd[5], count)) {
+            return out_err(out, ERR_BAD_ARG, "expect int64");
+        }
+    } else if (cmd.size() != 4) {
+        return out_err(out, ERR_BAD_ARG, "syntax error.");
+    }
+    Stream *stream = expect_stream(cmd[1]);
+    if (!stream) {
+        return out_err(out, ERR_BAD_TYP, "expect stream");
+    }
+    return out_xrange(out, stream, start, end, rev, count < 0 ? SIZE_MAX : (size_t)count);
+}
+
+static void do_xrange(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    return xrange(cmd, out, false);
+}
+
+static void do_xrevrange(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    return xrange(cmd, out, true);
+}
+
+/*xread [COUNT count] [BLOCK ms] STREAMS key [key ...] id [id ...]: the entries after each ID, `$`
+is the last one now. With BLOCK it waits for an XADD to one of the keys if there are none, and
+runs again when woken, with the `$` it started with.*/
+static void do_xread(Conn *conn, std::vector<std::string_view> &cmd, Buffer &out) {
+    std::vector<StreamID> saved;
+    saved.swap(conn->xread_ids);
+    int64_t count = 0, block_ms = -1;
+    size_t i = 1;
+    for (; i < cmd.size() && !str_ieq(cmd[i], "streams"); i += 2) {
+        bool is_block = str_ieq(cmd[i], "block");
+        if ((!is_block && !str_ieq(cmd[i], "count")) || i + 1 >= cmd.size()) {
+            return out_err(out, ERR_BAD_ARG, "syntax error.");
+        }
+        int64_t &val = is_block ? block_ms : count;
+        if (!str2int(cmd[i + 1], val) || val < 0) {
+            return out_err(out, ERR_BAD_ARG, is_block ? "timeout is negative or not an integer." : "expect int64");
+        }
+    }
+    size_t first = i + 1;
+    if (first >= cmd.size() || (cmd.size() - first) % 2 != 0) {
+        return out_err(out, ERR_BAD_ARG, "Unbalanced 'xread' list of streams: for each stream key an ID or '$' must be specified.");
+    }
+    size_t nkeys = (cmd.size() - first) / 2;
+    std::vector<Stream *> streams(nkeys);
+    std::vector<StreamID> ids(nkeys);
+    size_t ready = 0;
+    for (size_t k = 0; k < nkeys; k++) {
+        streams[k] = expect_stream(cmd[first + k]);
+        if (!streams[k]) {
+            return out_err(out, ERR_BAD_TYP, "expect stream");
+        }
+        std::string_view arg = cmd[first + nkeys + k];
+        if (arg == "$") {
+            ids[k] = saved.size() == nkeys ? saved[k] : streams[k]->last_id;
+        } else if (!str2sid(arg, 0, ids[k])) {
+            return out_err(out, ERR_BAD_ARG, "Invalid stream ID specified as stream command argument");
+        }
+        // without XDEL the newest entry is `last_id`, so this says whether any is after the ID
+        ready += streams[k]->count > 0 && sid_less(ids[k], streams[k]->last_id);
+    }
+    if (!ready) {
+        // give up when the time is over, or inside EXEC, which can't wait
+        if (block_ms < 0 || conn->block_timed_out || g_exec.active) {
+            return out_nil(out);
+        }
+        conn->xread_ids = ids;
+        return conn_block(conn, &cmd[first], nkeys, (uint64_t)block_ms);
+    }
+    // RESP3 has a map from key to entries, the others an array of [key, entries]
+    if (out.proto == PROTO_RESP3) {
+        out_map(out, (uint32_t)ready);
+    } else {
+        out_arr(out, (uint32_t)ready);
+    }
+    for (size_t k = 0; k < nkeys; k++) {
+        if (streams[k]->count == 0 || !sid_less(ids[k], streams[k]->last_id)) {
+            continue;
+        }
+        if (out.proto != PROTO_RESP3) {
+            out_arr(out, 2);
+        }
+        out_str(out, cmd[first + k].data(), cmd[first + k].size());
+        StreamID start = ids[k];
+        sid_incr(start);
+        out_xrange(out, streams[k], start, k_sid_max, false, count > 0 ? (size_t)count : SIZE_MAX);
+    }
+}
+
+static void do_info(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_config(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_slowlog(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_watchdog(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_ping(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_hello(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_multi(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_exec(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_discard(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_watch(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_unwatch(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_replicaof(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_psync(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_replconf(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_cluster(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_asking(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_migrate(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_subscribe(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_unsubscribe(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_psubscribe(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_punsubscribe(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+static void do_publish(Conn *, std::vector<std::string_view> &cmd, Buffer &out);
+
+// command flags
+enum {
+    CMD_READ  = 1 << 0,     // reads the keyspace
+    CMD_WRITE = 1 << 1,     // may modify the keyspace, goes to the persistence log
+    CMD_TXN   = 1 << 2,     // transaction control, runs right away inside MULTI
+    CMD_DENYOOM = 1 << 3,   // may need more memory, refused when over maxmemory
+    CMD_BLOCK = 1 << 4,     // may wait for a key, feeds replicas what it did instead of itself
+    CMD_PUBSUB = 1 << 5,    // the only ones a subscribed RESP2 or TLV connection may run
+};
+
+/*Everything the server knows about a command. The key positions are 1-based argument indexes
+(first_key == 0 means no keys, last_key < 0 counts from the end) so that code which only cares
+about the keys (stats, the persistence log, the sharding router) doesn't need to know the command.*/
+struct CmdSpec {
+    const char *name;
+    int32_t arity;          // >= 0: exact number of args including the name, < 0: at least -arity
+    uint32_t flags;
+    int32_t first_key;
+    int32_t last_key;
+    int32_t key_step;
+    void (*handler)(Conn *conn, std::vector<std::string_view> &cmd, Buffer &out);
+};
+
+static constexpr CmdSpec k_cmds[] = {
+    {"get",     2,  CMD_READ,   1, 1, 1, do_get},
+    {"set",     3,  CMD_WRITE | CMD_DENYOOM, 1, 1, 1, do_set},
+    {"del",     -2, CMD_WRITE,  1, -1, 1, do_del},
+    {"mget",    -2, CMD_READ,   1, -1, 1, do_mget},
+    {"mset",    -3, CMD_WRITE | CMD_DENYOOM, 1, -1, 2, do_mset},
+    {"keys",    1,  CMD_READ,   0, 0, 0, do_keys},
+    {"pexpire", 3,  CMD_WRITE,  1, 1, 1, do_expire},
+    {"pttl",    2,  CMD_READ,   1, 1, 1, do_ttl},
+    {"zadd",    4,  CMD_WRITE | CMD_DENYOOM, 1, 1, 1, do_zadd},
+    {"zrem",    3,  CMD_WRITE,  1, 1, 1, do_zrem},
+    {"zscore",  3,  CMD_READ,   1, 1, 1, do_zscore},
+    {"zquery",  6,  CMD_READ,   1, 1, 1, do_zquery},
+    {"zcursor", 5,  CMD_READ,   1, 1, 1, do_zcursor},
+    {"zfetch",  3,  CMD_READ,   0, 0, 0, do_zfetch},
+    {"zclose",  2,  0,          0, 0, 0, do_zclose},
+    {"hset",    -4, CMD_WRITE | CMD_DENYOOM, 1, 1, 1, do_hset},
+    {"hget",    3,  CMD_READ,   1, 1, 1, do_hget},
+    {"hmget",   -3, CMD_READ,   1, 1, 1, do_hmget},
+    {"hgetall", 2,  CMD_READ,   1, 1, 1, do_hgetall},
+    {"hdel",    -3, CMD_WRITE,  1, 1, 1, do_hdel},
+    {"hincrby", 4,  CMD_WRITE | CMD_DENYOOM, 1, 1, 1, do_hincrby},
+    {"lpush",   -3, CMD_WRITE | CMD_DENYOOM, 1, 1, 1, do_lpush},
+    {"rpush",   -3, CMD_WRITE | CMD_DENYOOM, 1, 1, 1, do_rpush},
+    {"lpop",    2,  CMD_WRITE,  1, 1, 1, do_lpop},
+    {"rpop",    2,  CMD_WRITE,  1, 1, 1, do_rpop},
+    {"llen",    2,  CMD_READ,   1, 1, 1, do_llen},
+    {"lrange",  4,  CMD_READ,   1, 1, 1, do_lrange},
+    {"ltrim",   4,  CMD_WRITE,  1, 1, 1, do_ltrim},
+    {"blpop",   -3, CMD_WRITE | CMD_BLOCK, 1, -2, 1, do_blpop},
+    {"setbit",  4,  CMD_WRITE | CMD_DENYOOM, 1, 1, 1, do_setbit},
+    {"getbit",  3,  CMD_READ,   1, 1, 1, do_getbit},
+    {"bitcount", -2, CMD_READ,  1, 1, 1, do_bitcount},
+    {"bitpos",  -3, CMD_READ,   1, 1, 1, do_bitpos},
+    {"bitop",   -4, CMD_WRITE | CMD_DENYOOM, 2, -1, 1, do_bitop},
+    {"pfadd",   -2, CMD_WRITE | CMD_DENYOOM, 1, 1, 1, do_pfadd},
+    {"pfcount", -2, CMD_READ,   1, -1, 1, do_pfcount},
+    {"pfmerge", -2, CMD_WRITE | CMD_DENYOOM, 1, -1, 1, do_pfmerge},
+    {"subscribe",   -2, CMD_PUBSUB, 0, 0, 0, do_subscribe},
+    {"unsubscribe", -1, CMD_PUBSUB, 0, 0, 0, do_unsubscribe},
+    {"psubscribe",  -2, CMD_PUBSUB, 0, 0, 0, do_psubscribe},
+    {"punsubscribe", -1, CMD_PUBSUB, 0, 0, 0, do_punsubscribe},
+    {"publish", 3,  0,          0, 0, 0, do_publish},
+    {"sadd",    -3, CMD_WRITE | CMD_DENYOOM, 1, 1, 1, do_sadd},
+    {"srem",    -3, CMD_WRITE,  1, 1, 1, do_srem},
+    {"sismember", 3, CMD_READ,  1, 1, 1, do_sismember},
+    {"scard",   2,  CMD_READ,   1, 1, 1, do_scard},
+    {"smembers", 2, CMD_READ,   1, 1, 1, do_smembers},
+    {"sinter",  -2, CMD_READ,   1, -1, 1, do_sinter},
+    {"sunion",  -2, CMD_READ,   1, -1, 1, do_sunion},
+    {"xadd",    -5, CMD_WRITE | CMD_DENYOOM, 1, 1, 1, do_xadd},
+    {"xlen",    2,  CMD_READ,   1, 1, 1, do_xlen},
+    {"xtrim",   -4, CMD_WRITE,  1, 1, 1, do_xtrim},
+    {"xrange",  -4, CMD_READ,   1, 1, 1, do_xrange},
+    {"xrevrange", -4, CMD_READ, 1, 1, 1, do_xrevrange},
+    {"xread",   -4, CMD_READ | CMD_BLOCK, 0, 0, 0, do_xread},  // the keys follow STREAMS, not routed
+    {"info",    -1, 0,          0, 0, 0, do_info},
+    {"config",  -3, 0,          0, 0, 0, do_config},
+    {"slowlog", -2, 0,          0, 0, 0, do_slowlog},
+    {"watchdog", -2, 0,         0, 0, 0, do_watchdog},
+    {"ping",    -1, CMD_PUBSUB, 0, 0, 0, do_ping},
+    {"hello",   -1, 0,          0, 0, 0, do_hello},
+    {"multi",   1,  CMD_TXN,    0, 0, 0, do_multi},
+    {"exec",    1,  CMD_TXN,    0, 0, 0, do_exec},
+    {"discard", 1,  CMD_TXN,    0, 0, 0, do_discard},
+    {"watch",   -2, CMD_TXN | CMD_READ, 1, -1, 1, do_watch},
+    {"unwatch", 1,  CMD_TXN,    0, 0, 0, do_unwatch},
+    {"replicaof", 3, 0,         0, 0, 0, do_replicaof},
+    {"psync",   3,  0,          0, 0, 0, do_psync},
+    {"replconf", -2, 0,         0, 0, 0, do_replconf},
+    {"cluster", -2, 0,          0, 0, 0, do_cluster},
+    {"asking",  1,  0,          0, 0, 0, do_asking},
+    {"migrate", -5, 0,          0, 0, 0, do_migrate},  // local keys only, not routed
+};
+const size_t k_num_cmds = sizeof(k_cmds) / sizeof(k_cmds[0]);
+
+/*A perfect hash over the command names, built by the compiler. We try seeds until every name lands
+in its own slot, so a lookup is one hash, one table load and one string compare. Names are case
+insensitive (Redis clients send "GET"), the hash and the compare fold ASCII letters to lower case.*/
+const size_t k_cmd_slots = 1024;    // power of 2, sparse enough to find a seed quickly
+const uint8_t k_cmd_none = 0xff;
+static_assert(k_num_cmds < k_cmd_none, "too many commands for the index");
+
+static constexpr uint32_t cmd_hash(uint32_t seed, const char *name, size_t len) {
+    uint32_t h = 0x811C9DC5 ^ (seed * 0x9E3779B9);
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ ascii_lower((uint8_t)name[i])) * 0x01000193;
+    }
+    return (h ^ (h >> 16)) & (k_cmd_slots - 1);
+}
+
+static constexpr size_t cstr_len(const char *s) {
+    size_t n = 0;
+    while (s[n]) {
+        n++;
+    }
+    return n;
+}
+
+struct CmdIndex {
+    uint32_t seed = 0;
+    uint8_t slots[k_cmd_slots] = {};
+};
+
+static constexpr CmdIndex cmd_index_build() {
+    for (uint32_t seed = 0; ; seed++) {
+        CmdIndex idx;
+        idx.seed = seed;
+        for (size_t i = 0; i < k_cmd_slots; i++) {
+            idx.slots[i] = k_cmd_none;
+        }
+        bool ok = true;
+        for (size_t i = 0; ok && i < k_num_cmds; i++) {
+            uint8_t &slot = idx.slots[cmd_hash(seed, k_cmds[i].name, cstr_len(k_cmds[i].name))];
+            ok = (slot == k_cmd_none);
+            slot = (uint8_t)i;
+        }
+        if (ok) {
+            return idx;
+        }
+    }
+}
+static constexpr CmdIndex k_cmd_index = cmd_index_build();
+
+static const CmdSpec *cmd_lookup(std::string_view name) {
+    uint8_t i = k_cmd_index.slots[cmd_hash(k_cmd_index.seed, name.data(), name.size())];
+    if (i == k_cmd_none || !str_ieq(name, k_cmds[i].name)) {
+        return NULL;
+    }
+    return &k_cmds[i];
+}
+
+static bool cmd_arity_ok(const CmdSpec *spec, size_t argc) {
+    return spec->arity >= 0 ? argc == (size_t)spec->arity : argc >= (size_t)-spec->arity;
+}
+
+// names and their values are matched ignoring case, like command names
+static const ConfigVar *config_lookup(std::string_view name) {
+    for (const ConfigVar &v : k_config_vars) {
+        if (str_ieq(name, v.name)) {
+            return &v;
+        }
+    }
+    return NULL;
+}
+
+static bool config_set(const ConfigVar *var, std::string_view arg) {
+    int64_t val = 0;
+    if (var->names) {
+        for (val = var->min; val <= var->max && !str_ieq(arg, var->names[val]); val++) {}
+    } else if (!str2int(arg, val)) {
+        return false;
+    }
+    if (val < var->min || val > var->max) {
+        return false;
+    }
+    *var->val = val;
+    return true;
+}
+
+// CONFIG GET name | CONFIG SET name value
+static void do_config(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    const ConfigVar *var = config_lookup(cmd[2]);
+    if (!var) {
+        return out_err(out, ERR_BAD_ARG, "unknown config.");
+    }
+    if (str_ieq(cmd[1], "get") && cmd.size() == 3) {
+        if (var->names) {
+            const char *name = var->names[*var->val];
+            return out_str(out, name, strlen(name));
+        }
+        return out_int(out, *var->val);
+    }
+    if (str_ieq(cmd[1], "set") && cmd.size() == 4) {
+        if (var->startup_only) {
+            return out_err(out, ERR_BAD_ARG, "can only be set at startup.");
+        }
+        if (!config_set(var, cmd[3])) {
+            return out_err(out, ERR_BAD_ARG, "bad config value.");
+        }
+        return out_ok(out);
+    }
+    return out_err(out, ERR_BAD_ARG, "expect CONFIG GET|SET.");
+}
+
+/*The slow log keeps the most recent commands that ran longer than slowlog-threshold-us.
+It is a ring buffer: once full, the oldest entry is overwritten, so recording is O(1).*/
+const size_t k_slowlog_max_args = 32;
+const size_t k_slowlog_max_arg_len = 128;
+
+struct SlowlogEntry {
+    uint64_t id = 0;
+    uint64_t unix_ms = 0;
+    uint64_t duration_us = 0;
+    int fd = -1;
+    std::vector<std::string> args;  // truncated copies
+};
+
+static struct {
+    std::vector<SlowlogEntry> ring;
+    size_t next = 0;            // the slot to overwrite once the ring is full
+    uint64_t next_id = 0;
+} g_slowlog;
+
+static void slowlog_push(Conn *conn, std::vector<std::string_view> &cmd, uint64_t duration_us) {
+    size_t cap = (size_t)g_config.slowlog_max_len;
+    if (cap == 0) {
+        return;
+    }
+    std::vector<SlowlogEntry> &ring = g_slowlog.ring;
+    if (ring.size() > cap) {    // the limit was lowered
+        ring.clear();
+        g_slowlog.next = 0;
+    }
+    if (ring.size() < cap) {
+        ring.emplace_back();
+        g_slowlog.next = ring.size() - 1;
+    }
+    SlowlogEntry &ent = ring[g_slowlog.next];
+    g_slowlog.next = (g_slowlog.next + 1) % cap;
+
+    ent.id = g_slowlog.next_id++;
+    ent.unix_ms = get_realtime_msec();
+    ent.duration_us = duration_us;
+    ent.fd = conn->fd;
+    ent.args.clear();
+    for (size_t i = 0; i < cmd.size() && i < k_slowlog_max_args; i++) {
+        std::string_view arg = cmd[i].substr(0, k_slowlog_max_arg_len);
+        ent.args.emplace_back(arg.data(), arg.size());
+    }
+}
+
+// iterate the ring from the newest entry
+template <class T, class F>
+static void ring_foreach_newest(const std::vector<T> &ring, size_t next, size_t max_n, F &&f) {
+    size_t n = ring.size() < max_n ? ring.size() : max_n;
+    for (size_t i = 0; i < n; i++) {
+        // `next` is the oldest slot when full, or one past the newest while filling
+        size_t pos = (next + ring.size() - 1 - i) % ring.size();
+        f(ring[pos]);
+    }
+}
+
+static bool arg_count(std::vector<std::string_view> &cmd, size_t pos, int64_t &n) {
+    n = 10;
+    return cmd.size() <= pos || (str2int(cmd[pos], n) && n >= 0);
+}
+
+// SLOWLOG GET [n] | SLOWLOG LEN | SLOWLOG RESET
+static void do_slowlog(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    if (str_ieq(cmd[1], "len")) {
+        return out_int(out, (int64_t)g_slowlog.ring.size());
+    }
+    if (str_ieq(cmd[1], "reset")) {
+        g_slowlog.ring.clear();
+        g_slowlog.next = 0;
+        return out_ok(out);
+    }
+    int64_t n = 0;
+    if (!str_ieq(cmd[1], "get") || !arg_count(cmd, 2, n)) {
+        return out_err(out, ERR_BAD_ARG, "expect SLOWLOG GET [n]|LEN|RESET.");
+    }
+    // each entry: [id, unix_ms, duration_us, fd, [args...]]
+    size_t ctx = out_begin_arr(out);
+    uint32_t count = 0;
+    ring_foreach_newest(g_slowlog.ring, g_slowlog.next, (size_t)n, [&](const SlowlogEntry &ent) {
+        out_arr(out, 5);
+        out_int(out, (int64_t)ent.id);
+        out_int(out, (int64_t)ent.unix_ms);
+        out_int(out, (int64_t)ent.duration_us);
+        out_int(out, ent.fd);
+        out_arr(out, (uint32_t)ent.args.size());
+        for (const std::string &arg : ent.args) {
+            out_str(out, arg.data(), arg.size());
+        }
+        count++;
+    });
+    out_end_arr(out, ctx, count);
+}
+
+/*The event loop watchdog. Each loop iteration is split into phases, and a phase that takes longer
+than loop-budget-us is recorded with the iteration it happened in. The "poll" phase is the time spent
+building the pollfd list and accepting, time blocked inside poll() is idle time, not a stall.*/
+enum {
+    PHASE_POLL = 0,     // pollfd setup and accept
+    PHASE_READ,         // read, parse and execute
+    PHASE_WRITE,        // flushing `outgoing`
+    PHASE_TIMERS,       // idle connections and TTL expiration
+    PHASE_MAX,
+};
+static const char *const k_phase_names[PHASE_MAX] = {"poll", "read", "write", "timers"};
+
+struct StallEntry {
+    uint64_t id = 0;
+    uint64_t unix_ms = 0;
+    uint64_t iteration = 0;
+    uint32_t phase = 0;
+    uint64_t duration_us = 0;
+};
+
+static struct {
+    uint64_t iteration = 0;
+    uint32_t phase = PHASE_POLL;
+    uint64_t phase_start_ns = 0;
+    uint64_t phase_ns[PHASE_MAX] = {};  // accumulated in the current iteration
+    std::vector<StallEntry> ring;
+    size_t next = 0;
+    uint64_t next_id = 0;
+} g_loop;
+
+// switch the current phase, return the previous one
+static uint32_t loop_phase_enter(uint32_t phase) {
+    uint64_t now_ns = get_monotonic_nsec();
+    uint32_t prev = g_loop.phase;
+    g_loop.phase_ns[prev] += now_ns - g_loop.phase_start_ns;
+    g_loop.phase = phase;
+    g_loop.phase_start_ns = now_ns;
+    return prev;
+}
+
+static void loop_stall_push(uint32_t phase, uint64_t duration_us) {
+    size_t cap = (size_t)g_config.watchdog_max_len;
+    if (cap == 0) {
+        return;
+    }
+    std::vector<StallEntry> &ring = g_loop.ring;
+    if (ring.size() > cap) {
+        ring.clear();
+        g_loop.next = 0;
+    }
+    if (ring.size() < cap) {
+        ring.emplace_back();
+        g_loop.next = ring.size() - 1;
+    }
+    StallEntry &ent = ring[g_loop.next];
+    g_loop.next = (g_loop.next + 1) % cap;
+    ent.id = g_loop.next_id++;
+    ent.unix_ms = get_realtime_msec();
+    ent.iteration = g_loop.iteration;
+    ent.phase = phase;
+    ent.duration_us = duration_us;
+}
+
+// called when poll() returns, the time spent blocked is not accounted
+static void loop_wake() {
+    g_loop.phase = PHASE_POLL;
+    g_loop.phase_start_ns = get_monotonic_nsec();
+    g_data.lru_clock = (uint32_t)(g_loop.phase_start_ns / (1000 * 1000));
+}
+
+// called before blocking in poll(), closes the current iteration
+static void loop_iteration_end() {
+    loop_phase_enter(PHASE_POLL);
+    for (uint32_t i = 0; i < PHASE_MAX; i++) {
+        uint64_t us = g_loop.phase_ns[i] / 1000;
+        if (g_config.loop_budget_us >= 0 && us > (uint64_t)g_config.loop_budget_us) {
+            loop_stall_push(i, us);
+        }
+        g_loop.phase_ns[i] = 0;
+    }
+    g_loop.iteration++;
+}
+
+// WATCHDOG GET [n] | WATCHDOG RESET
+static void do_watchdog(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    if (str_ieq(cmd[1], "reset")) {
+        g_loop.ring.clear();
+        g_loop.next = 0;
+        return out_ok(out);
+    }
+    int64_t n = 0;
+    if (!str_ieq(cmd[1], "get") || !arg_count(cmd, 2, n)) {
+        return out_err(out, ERR_BAD_ARG, "expect WATCHDOG GET [n]|RESET.");
+    }
+    // each entry: [id, unix_ms, iteration, phase, duration_us]
+    size_t ctx = out_begin_arr(out);
+    uint32_t count = 0;
+    ring_foreach_newest(g_loop.ring, g_loop.next, (size_t)n, [&](const StallEntry &ent) {
+        out_arr(out, 5);
+        out_int(out, (int64_t)ent.id);
+        out_int(out, (int64_t)ent.unix_ms);
+        out_int(out, (int64_t)ent.iteration);
+        const char *name = k_phase_names[ent.phase];
+        out_str(out, name, strlen(name));
+        out_int(out, (int64_t)ent.duration_us);
+        count++;
+    });
+    out_end_arr(out, ctx, count);
+}
+
+// PING [message]
+static void do_ping(Conn *conn, std::vector<std::string_view> &cmd, Buffer &out) {
+    if (cmd.size() > 2) {
+        return out_err(out, ERR_BAD_ARG, "wrong number of arguments.");
+    }
+    // like Redis: a subscribed client reads pushes, so it gets one
+    if (conn_subscribed(conn) && out.proto != PROTO_RESP3) {
+        std::string_view arg = cmd.size() == 2 ? cmd[1] : "";
+        out_push(out, 2);
+        out_str(out, "pong", 4);
+        return out_str(out, arg.data(), arg.size());
+    }
+    std::string_view reply = cmd.size() == 2 ? cmd[1] : "PONG";
+    out_str(out, reply.data(), reply.size());
+}
+
+// HELLO [2|3]: switch a RESP connection to RESP3 replies and back
+static void do_hello(Conn *conn, std::vector<std::string_view> &cmd, Buffer &out) {
+    int64_t ver = conn->outgoing.proto == PROTO_RESP3 ? 3 : 2;
+    if (cmd.size() > 2) {
+        return out_err(out, ERR_BAD_ARG, "HELLO only takes a protocol version.");
+    }
+    if (cmd.size() == 2 && (!str2int(cmd[1], ver) || ver < 2 || ver > 3)) {
+        return out_err(out, ERR_BAD_ARG, "unsupported protocol version.");
+    }
+    if (conn->outgoing.proto == PROTO_TLV && cmd.size() == 2) {
+        return out_err(out, ERR_BAD_ARG, "not a RESP connection.");
+    }
+    if (conn->outgoing.proto != PROTO_TLV) {
+        // the reply already uses the new version
+        conn->outgoing.proto = ver == 3 ? PROTO_RESP3 : PROTO_RESP2;
+    }
+    out_map(out, 2);
+    out_str(out, "server", 6);
+    out_str(out, "redis-lite", 10);
+    out_str(out, "proto", 5);
+    out_int(out, conn->outgoing.proto == PROTO_TLV ? 0 : ver);
+}
+
+// per-command counters, indexed like k_cmds
+struct CmdStats {
+    uint64_t calls = 0;
+    uint64_t errors = 0;
+    Hist latency;   // nanoseconds
+};
+static CmdStats g_cmd_stats[k_num_cmds];
+
+static void multi_queue(Conn *conn, std::vector<std::string_view> &cmd, Buffer &out);
+static bool cluster_route(const CmdSpec *spec, std::vector<std::string_view> &cmd, bool asking, Buffer &out);
+
+static void do_request(Conn *conn, std::vector<std::string_view> &cmd, Buffer &out) {
+    const CmdSpec *spec = cmd.empty() ? NULL : cmd_lookup(cmd[0]);
+    if (!spec) {
+        conn->multi_aborted |= conn->multi;
+        return out_err(out, ERR_UNKNOWN, "unknown command.");
+    }
+    if (!cmd_arity_ok(spec, cmd.size())) {
+        conn->multi_aborted |= conn->multi;
+        return out_err(out, ERR_BAD_ARG, "wrong number of arguments.");
+    }
+    // only RESP3 can tell a reply from a message, the others are left with pub/sub commands
+    if (conn_subscribed(conn) && out.proto != PROTO_RESP3 && !(spec->flags & CMD_PUBSUB)) {
+        return out_err(out, ERR_BAD_ARG, "only (P)SUBSCRIBE / (P)UNSUBSCRIBE / PING are allowed in this context.");
+    }
+    // cluster mode: are the keys ours? Checked before queuing like the other errors
+    bool asking = conn->asking;
+    conn->asking = false;
+    if (g_config.cluster_enabled && spec->first_key > 0 && conn->repl_role != REPL_ROLE_PRIMARY
+        && !cluster_route(spec, cmd, asking, out))
+    {
+        conn->multi_aborted |= conn->multi;
+        return;
+    }
+    if (conn->multi && !(spec->flags & CMD_TXN)) {
+        return multi_queue(conn, cmd, out);
+    }
+    // a replica only takes writes from its primary
+    if (g_repl.primary_port && (spec->flags & CMD_WRITE) && conn->repl_role != REPL_ROLE_PRIMARY) {
+        return out_err(out, ERR_READONLY, "You can't write against a read only replica.");
+    }
+    // make room before a write, deletes and reads still work when nothing can be evicted
+    if (g_config.maxmemory && !g_repl.primary_port && (spec->flags & CMD_WRITE)) {
+        if (evict_keys() == EVICT_FAIL && (spec->flags & CMD_DENYOOM)) {
+            return out_err(out, ERR_OOM, "command not allowed when used memory > 'maxmemory'.");
+        }
+    }
+    size_t start = out.data.size();
+    uint64_t t0 = get_monotonic_nsec();
+    spec->handler(conn, cmd, out);
+    uint64_t t1 = get_monotonic_nsec();
+    if (conn->blocked) {
+        return;     // no reply yet, it runs again once woken, see conn_block()
+    }
+
+    CmdStats &st = g_cmd_stats[spec - k_cmds];
+    st.calls++;
+    if (out_is_err(out, start)) {
+        st.errors++;
+    } else if ((spec->flags & CMD_WRITE) && !(spec->flags & CMD_BLOCK)) {
+        repl_feed(cmd.data(), cmd.size());
+    }
+    hist_record(&st.latency, t1 - t0);
+
+    uint64_t duration_us = (t1 - t0) / 1000;
+    if (g_config.slowlog_threshold_us >= 0 && duration_us >= (uint64_t)g_config.slowlog_threshold_us) {
+        slowlog_push(conn, cmd, duration_us);
+    }
+}
+
+/*Transactions. Commands after MULTI are checked and queued, EXEC runs the whole batch in one
+go, and since the event loop is single-threaded nothing else runs in between. The replies
+go out as one array. WATCH is optimistic: EXEC gives up (nil) if a watched key has a
+different Entry::version than when it was watched.*/
+static void multi_reset(Conn *conn) {
+    conn->multi = false;
+    conn->multi_aborted = false;
+    conn->multi_args.clear();
+    conn->multi_lens.clear();
+    conn->multi_argc.clear();
+}
+
+static void multi_queue(Conn *conn, std::vector<std::string_view> &cmd, Buffer &out) {
+    size_t bytes = 0;
+    for (std::string_view arg : cmd) {
+        bytes += arg.size();
+    }
+    if (conn->multi_args.size() + bytes > k_max_msg) {
+        conn->multi_aborted = true;
+        return out_err(out, ERR_TOO_BIG, "transaction is too big.");
+    }
+    for (std::string_view arg : cmd) {
+        conn->multi_args.append(arg.data(), arg.size());
+        conn->multi_lens.push_back((uint32_t)arg.size());
+    }
+    conn->multi_argc.push_back((uint32_t)cmd.size());
+    out_str(out, "QUEUED", 6);
+}
+
+/*A missing key has the version of the last delete among the keys that share its slot in
+`del_versions`, so a key created and deleted again after WATCH is noticed too. Another key with
+the same slot being deleted makes EXEC fail for nothing, which is allowed.*/
+static uint64_t key_version(std::string_view name) {
+    LookupKey key;
+    key_init(&key, name);
+    HNode *node = hm_lookup(&g_data.db, &key.node, &entry_eq);
+    if (!node) {
+        return g_data.del_versions[key.node.hcode % k_del_versions];
+    }
+    return container_of(node, Entry, node)->version;
+}
+
+static bool watch_changed(Conn *conn) {
+    for (const WatchedKey &w : conn->watched) {
+        if (key_version(w.key) != w.version) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void do_multi(Conn *conn, std::vector<std::string_view> &, Buffer &out) {
+    if (conn->multi) {
+        return out_err(out, ERR_BAD_ARG, "MULTI calls can not be nested.");
+    }
+    conn->multi = true;
+    return out_ok(out);
+}
+
+static void do_exec(Conn *conn, std::vector<std::string_view> &, Buffer &out) {
+    if (!conn->multi) {
+        return out_err(out, ERR_BAD_ARG, "EXEC without MULTI.");
+    }
+    bool changed = watch_changed(conn);
+    conn->watched.clear();
+    if (conn->multi_aborted || changed) {
+        bool aborted = conn->multi_aborted;
+        multi_reset(conn);
+        if (aborted) {
+            return out_err(out, ERR_BAD_ARG, "transaction discarded because of previous errors.");
+        }
+        return out_nil(out);
+    }
+    // Out of MULTI, so the commands run instead of being queued. Nothing can queue
+    // more meanwhile: MULTI itself is never queued.
+    conn->multi = false;
+    out_arr(out, (uint32_t)conn->multi_argc.size());
+    std::vector<std::string_view> cmd;
+    size_t off = 0;
+    size_t arg = 0;
+    g_exec.active = true;
+    g_repl.exec_multi_fed = false;  // replicas apply the writes in one go too
+    for (uint32_t argc : conn->multi_argc) {
+        cmd.clear();
+        for (uint32_t i = 0; i < argc; i++, arg++) {
+            cmd.push_back(std::string_view(&conn->multi_args[off], conn->multi_lens[arg]));
+            off += conn->multi_lens[arg];
+        }
+        do_request(conn, cmd, out);
+    }
+    g_exec.active = false;
+    if (g_repl.exec_multi_fed) {
+        std::string_view exec = "exec";
+        repl_feed(&exec, 1);
+    }
+    multi_reset(conn);
+}
+
+static void do_discard(Conn *conn, std::vector<std::string_view> &, Buffer &out) {
+    if (!conn->multi) {
+        return out_err(out, ERR_BAD_ARG, "DISCARD without MULTI.");
+    }
+    multi_reset(conn);
+    conn->watched.clear();
+    return out_ok(out);
+}
+
+static void do_watch(Conn *conn, std::vector<std::string_view> &cmd, Buffer &out) {
+    if (conn->multi) {
+        return out_err(out, ERR_BAD_ARG, "WATCH inside MULTI is not allowed.");
+    }
+    for (size_t i = 1; i < cmd.size(); i++) {
+        conn->watched.push_back(WatchedKey{std::string(cmd[i]), key_version(cmd[i])});
+    }
+    return out_ok(out);
+}
+
+static void do_unwatch(Conn *conn, std::vector<std::string_view> &, Buffer &out) {
+    conn->watched.clear();
+    return out_ok(out);
+}
+
+/*Replication. A replica connects to its primary like a client and sends PSYNC with the id of the
+stream it follows and how much of it it has applied. If the primary still has the rest in its
+backlog ring, it answers +CONTINUE and sends just that. Otherwise it answers +FULLRESYNC with its
+stream id and offset and sends a snapshot: the keyspace as SET/ZADD/PEXPIRE commands, in one
+bulk. After that the replica gets every write as the same RESP command the primary executed,
+plus a DEL for every key that expired or was evicted on the primary, which is why replicas don't
+expire keys themselves. Replicas are read-only. The primary pings and the replica ACKs its
+offset every second, a link that stays silent for repl-timeout-ms is dropped and retried.*/
+const uint64_t k_repl_cron_ms = 100;
+const uint64_t k_repl_ping_ms = 1000;
+const uint64_t k_repl_retry_ms = 200;
+
+static void conn_mark_dirty(Conn *conn);
+static void conn_destroy(Conn *conn);
+static void uring_arm_recv(Conn *conn);
+
+// output produced outside of a request, from a timer or for another connection
+static void conn_queue_output(Conn *conn) {
+    conn->want_write = true;
+    conn_mark_dirty(conn);
+}
+
+static void repl_append_cmd(std::vector<uint8_t> &buf, const std::string_view *args, size_t n) {
+    char head[32];
+    int len = snprintf(head, sizeof(head), "*%zu\r\n", n);
+    buf_append(buf, (const uint8_t *)head, (size_t)len);
+    for (size_t i = 0; i < n; i++) {
+        len = snprintf(head, sizeof(head), "$%zu\r\n", args[i].size());
+        buf_append(buf, (const uint8_t *)head, (size_t)len);
+        buf_append(buf, (const uint8_t *)args[i].data(), args[i].size());
+        buf_append(buf, (const uint8_t *)"\r\n", 2);
+    }
+}
+
+static void repl_new_id() {
+    char id[41];
+    snprintf(id, sizeof(id), "%016llx%016llx%08x",
+        (unsigned long long)(rand64() ^ get_monotonic_nsec()),
+        (unsigned long long)(rand64() ^ ((uint64_t)getpid() << 32)), (unsigned)rand64());
+    g_repl.replid = id;
+}
+
+// the ring is created by the first PSYNC, and starts over when resized
+static void repl_backlog_check() {
+    if (g_repl.backlog.size() != (size_t)g_config.repl_backlog_size) {
+        g_repl.backlog.assign((size_t)g_config.repl_backlog_size, 0);
+        g_repl.backlog_start = g_repl.offset;
+    }
+}
+
+/*A replica that reads slower than the writes come in is dropped once the stream queued for it
+goes over client-output-hard-limit, instead of growing until repl-timeout. It reconnects and
+resyncs. The snapshot at the front of its output doesn't count, only what follows it.*/
+static void repl_check_output(Conn *conn) {
+    uint64_t queued = std::min<uint64_t>(conn_output_size(conn), g_repl.offset - conn->repl_attach_offset);
+    int64_t hard = g_config.client_output_hard_limit;
+    if (!conn->want_close && hard > 0 && queued > (uint64_t)hard) {
+        msg("replica output buffer limit reached");
+        g_stats.output_limit_disconnects++;
+        conn->want_close = true;
+    }
+}
+
+static void repl_feed_raw(const uint8_t *data, size_t len) {
+    std::vector<uint8_t> &ring = g_repl.backlog;
+    for (size_t done = 0; done < len; ) {
+        size_t pos = (size_t)((g_repl.offset + done) % ring.size());
+        size_t n = std::min(len - done, ring.size() - pos);
+        memcpy(&ring[pos], data + done, n);
+        done += n;
+    }
+    g_repl.offset += len;
+    if (g_repl.offset - g_repl.backlog_start > ring.size()) {
+        g_repl.backlog_start = g_repl.offset - ring.size();
+    }
+    for (Conn *conn : g_repl.replicas) {
+        if (conn->want_close) {
+            continue;
+        }
+        buf_append(conn->outgoing.data, data, len);
+        conn_queue_output(conn);
+        repl_check_output(conn);
+    }
+}
+
+// called with every write that succeeded
+static void repl_feed(const std::string_view *args, size_t n) {
+    if (g_repl.backlog.empty() || g_repl.primary_port) {
+        return;     // no replica ever attached, or we are one
+    }
+    repl_backlog_check();
+    if (g_exec.active && !g_repl.exec_multi_fed) {
+        g_repl.exec_multi_fed = true;
+        std::string_view multi = "multi";
+        repl_feed(&multi, 1);
+    }
+    static std::vector<uint8_t> buf;
+    buf.clear();
+    repl_append_cmd(buf, args, n);
+    repl_feed_raw(buf.data(), buf.size());
+}
+
+// a key that expired or was evicted
+static void repl_feed_del(Entry *ent) {
+    std::string_view args[2] = {"del", std::string_view(ent->key, ent->klen)};
+    repl_feed(args, 2);
+}
+
+// the key is due and waits for process_timers()
+static bool entry_is_due(Entry *ent, uint64_t now_ms) {
+    return ent->heap_idx != (size_t)-1 && g_data.heap[ent->heap_idx].val <= now_ms;
+}
+
+/*The commands that recreate a key, for the replication snapshot and for MIGRATE. `emit` is
+called with each command's args.*/
+template <class F>
+static void entry_to_cmds(Entry *ent, uint64_t now_ms, F emit) {
+    std::string_view key(ent->key, ent->klen);
+    if (ent->type == T_STR) {
+        std::string_view args[3] = {"set", key, std::string_view((const char *)ent->str->data, ent->str->len)};
+        emit(args, 3);
+    } else if (ent->type == T_ZSET) {
+        ZNode *znode = zset_seekge(&ent->zset, -INFINITY, "", 0);
+        for (; znode; znode = znode_offset(znode, +1)) {
+            char score[64];
+            snprintf(score, sizeof(score), "%.17g", znode->score);
+            std::string_view args[4] = {"zadd", key, score, std::string_view(znode->name, znode->len)};
+            emit(args, 4);
+        }
+    } else if (ent->type == T_HASH) {
+        struct Ctx {
+            std::string_view key;
+            F *emit;
+        } ctx = {key, &emit};
+        hash_foreach(ent->hash, [](const HashPair &pair, void *arg) {
+            Ctx &ctx = *(Ctx *)arg;
+            std::string_view args[4] = {"hset", ctx.key, std::string_view(pair.field, pair.flen),
+                std::string_view(pair.val, pair.vlen)};
+            (*ctx.emit)(args, 4);
+            return true;
+        }, &ctx);
+    } else if (ent->type == T_LIST) {
+        QIter it;
+        QElem elem;
+        qlist_seek(ent->list, 0, &it);
+        while (qlist_next(ent->list, &it, &elem)) {
+            std::string_view args[3] = {"rpush", key, std::string_view(elem.data, elem.len)};
+            emit(args, 3);
+        }
+    } else if (ent->type == T_SET) {
+        struct Ctx {
+            std::string_view key;
+            F *emit;
+        } ctx = {key, &emit};
+        set_foreach(ent->set, [](const char *member, size_t len, void *arg) {
+            Ctx &ctx = *(Ctx *)arg;
+            std::string_view args[3] = {"sadd", ctx.key, std::string_view(member, len)};
+            (*ctx.emit)(args, 3);
+            return true;
+        }, &ctx);
+    } else if (ent->type == T_STREAM) {
+        struct Ctx {
+            std::string_view key;
+            F *emit;
+        } ctx = {key, &emit};
+        stream_range(ent->stream, StreamID{}, k_sid_max, false, [](const SEntry &sent, void *arg) {
+            Ctx &ctx = *(Ctx *)arg;
+            char id[48];
+            int len = snprintf(id, sizeof(id), "%llu-%llu", (unsigned long long)sent.id.ms, (unsigned long long)sent.id.seq);
+            std::vector<std::string_view> args = {"xadd", ctx.key, std::string_view(id, (size_t)len)};
+            size_t pos = 0;
+            for (uint32_t i = 0; i < sent.nfields; i++) {
+                args.push_back(sentry_field(sent, &pos));
+            }
+            (*ctx.emit)(args.data(), args.size());
+            return true;
+        }, &ctx);
+        // trimmed to nothing: an entry trimmed right away leaves the stream with its last ID
+        if (ent->stream->count == 0) {
+            char id[48];
+            StreamID last = ent->stream->last_id;
+            int len = snprintf(id, sizeof(id), "%llu-%llu", (unsigned long long)last.ms, (unsigned long long)last.seq);
+            std::string_view args[7] = {"xadd", key, "maxlen", "0", std::string_view(id, (size_t)len), "", ""};
+            emit(args, 7);
+        }
+    }
+    if (ent->heap_idx != (size_t)-1) {
+        std::string ttl = std::to_string(g_data.heap[ent->heap_idx].val - now_ms);
+        std::string_view args[3] = {"pexpire", key, ttl};
+        emit(args, 3);
+    }
+}
+
+struct SnapshotCtx {
+    std::vector<uint8_t> *buf;
+    uint64_t now_ms;
+};
+
+static bool cb_snapshot(HNode *node, void *arg) {
+    SnapshotCtx &ctx = *(SnapshotCtx *)arg;
+    Entry *ent = container_of(node, Entry, node);
+    if (!entry_is_due(ent, ctx.now_ms)) {   // due: the DEL follows in the stream
+        entry_to_cmds(ent, ctx.now_ms, [&](const std::string_view *args, size_t n) {
+            repl_append_cmd(*ctx.buf, args, n);
+        });
+    }
+    return true;
+}
+
+// PSYNC replid offset: answered here, the payload goes out right after the reply, see repl_attach()
+static void do_psync(Conn *conn, std::vector<std::string_view> &cmd, Buffer &out) {
+    int64_t offset = 0;
+    if (!str2int(cmd[2], offset)) {
+        return out_err(out, ERR_BAD_ARG, "expect int64");
+    }
+    if (g_repl.primary_port) {
+        return out_err(out, ERR_BAD_ARG, "replica chaining is not supported.");
+    }
+    if (conn->repl_role != REPL_ROLE_CLIENT || !out_resp(out) || conn->multi) {
+        return out_err(out, ERR_BAD_ARG, "PSYNC not allowed here.");
+    }
+    if (g_repl.backlog.empty()) {
+        repl_backlog_check();
+    }
+    conn->repl_role = REPL_ROLE_REPLICA;
+    bool partial = cmd[1] == g_repl.replid && offset >= 0
+        && (uint64_t)offset >= g_repl.backlog_start && (uint64_t)offset <= g_repl.offset;
+    std::string line;
+    if (partial) {
+        g_repl.sync_partial_ok++;
+        conn->repl_psync_offset = (uint64_t)offset;
+        line = "+CONTINUE\r\n";
+    } else {
+        g_repl.sync_partial_err += cmd[1] != "?";
+        g_repl.sync_full++;
+        conn->repl_psync_offset = UINT64_MAX;
+        line = "+FULLRESYNC " + g_repl.replid + " " + std::to_string(g_repl.offset) + "\r\n";
+    }
+    buf_append(out.data, (const uint8_t *)line.data(), line.size());
+}
+
+// the snapshot or the missing part of the stream, not subject to k_max_msg
+static void repl_attach(Conn *conn) {
+    std::vector<uint8_t> &out = conn->outgoing.data;
+    if (conn->repl_psync_offset == UINT64_MAX) {
+        std::vector<uint8_t> snap;
+        SnapshotCtx ctx = {&snap, get_monotonic_msec()};
+        hm_foreach(&g_data.db, &cb_snapshot, &ctx);
+        std::string head = "$" + std::to_string(snap.size()) + "\r\n";
+        buf_append(out, (const uint8_t *)head.data(), head.size());
+        buf_append(out, snap.data(), snap.size());
+        msg("replica attached, full sync");
+    } else {
+        std::vector<uint8_t> &ring = g_repl.backlog;
+        for (uint64_t off = conn->repl_psync_offset; off < g_repl.offset; ) {
+            size_t pos = (size_t)(off % ring.size());
+            size_t n = (size_t)std::min<uint64_t>(g_repl.offset - off, ring.size() - pos);
+            buf_append(out, &ring[pos], n);
+            off += n;
+        }
+        msg("replica attached, partial sync");
+    }
+    conn->repl_attach_offset = g_repl.offset;
+    conn->repl_attached = true;
+    conn->repl_ack_ms = get_monotonic_msec();
+    g_repl.replicas.push_back(conn);
+}
+
+// REPLCONF ACK offset: no reply, the primary isn't reading any
+static void do_replconf(Conn *conn, std::vector<std::string_view> &cmd, Buffer &) {
+    int64_t offset = 0;
+    if (cmd.size() == 3 && str_ieq(cmd[1], "ack") && str2int(cmd[2], offset)) {
+        conn->repl_ack_ms = get_monotonic_msec();
+        conn->repl_ack_offset = (uint64_t)offset;
+    }
+}
+
+// the connection is going away
+static void repl_conn_gone(Conn *conn) {
+    auto it = std::find(g_repl.closing.begin(), g_repl.closing.end(), conn);
+    if (it != g_repl.closing.end()) {
+        g_repl.closing.erase(it);
+    }
+    it = std::find(g_repl.replicas.begin(), g_repl.replicas.end(), conn);
+    if (it != g_repl.replicas.end()) {
+        g_repl.replicas.erase(it);
+        msg("replica detached");
+    }
+    if (conn == g_repl.primary) {
+        msg("lost the link to the primary");
+        if (g_repl.state == REPL_SNAPSHOT) {
+            g_repl.primary_replid = "?";    // half loaded, start over
+        }
+        g_repl.primary = NULL;
+        g_repl.state = REPL_WAIT;
+        g_repl.retry_ms = get_monotonic_msec() + k_repl_retry_ms;
+    }
+}
+
+static void repl_drop_link() {
+    if (g_repl.connect_fd >= 0) {
+        (void)close(g_repl.connect_fd);
+        g_repl.connect_fd = -1;
+    }
+    if (Conn *conn = g_repl.primary) {
+        g_repl.primary = NULL;
+        conn->want_close = true;
+        g_repl.closing.push_back(conn);
+    }
+}
+
+static void repl_connect() {
+    struct addrinfo hints = {}, *res = NULL;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    std::string port = std::to_string(g_repl.primary_port);
+    int fd = -1;
+    if (getaddrinfo(g_repl.primary_host.c_str(), port.c_str(), &hints, &res) == 0) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+    }
+    if (fd >= 0) {
+        fd_set_nb(fd);
+        if (connect(fd, res->ai_addr, res->ai_addrlen) < 0 && errno != EINPROGRESS) {
+            (void)close(fd);
+            fd = -1;
+        }
+    }
+    if (res) {
+        freeaddrinfo(res);
+    }
+    if (fd < 0) {
+        msg_errno("can't connect to the primary");
+        g_repl.retry_ms = get_monotonic_msec() + k_repl_retry_ms;
+        return;
+    }
+    g_repl.connect_fd = fd;
+    g_repl.state = REPL_CONNECTING;
+    g_repl.last_io_ms = get_monotonic_msec();
+}
+
+// the connect() finished, the link becomes a connection that we read commands from
+static void repl_link_up() {
+    Conn *conn = conn_new(g_repl.connect_fd);
+    g_repl.connect_fd = -1;
+    conn->repl_role = REPL_ROLE_PRIMARY;
+    conn->outgoing.proto = PROTO_RESP2;
+    g_repl.primary = conn;
+    g_repl.state = REPL_HANDSHAKE;
+    g_repl.last_io_ms = get_monotonic_msec();
+    std::string offset = g_repl.primary_replid == "?" ? "-1" : std::to_string(g_repl.offset);
+    std::string_view args[3] = {"psync", g_repl.primary_replid, offset};
+    repl_append_cmd(conn->outgoing.data, args, 3);
+    conn_queue_output(conn);
+    if (g_config.io_backend == IO_URING) {
+        uring_arm_recv(conn);
+    }
+    msg("connected to the primary");
+}
+
+static void db_flush() {
+    std::vector<Entry *> ents;
+    hm_foreach(&g_data.db, [](HNode *node, void *arg) {
+        ((std::vector<Entry *> *)arg)->push_back(container_of(node, Entry, node));
+        return true;
+    }, &ents);
+    hm_clear(&g_data.db);
+    for (Entry *ent : ents) {
+        entry_del(ent);
+    }
+}
+
+// +FULLRESYNC replid offset\r\n$size\r\n or +CONTINUE\r\n from the primary
+static bool repl_read_handshake(Conn *conn) {
+    std::string_view in((const char *)conn->incoming.data(), conn->incoming.size());
+    size_t end = in.find("\r\n");
+    if (end == in.npos) {
+        if (in.size() > 1024) {
+            conn->want_close = true;
+        }
+        return false;
+    }
+    std::string_view line = in.substr(0, end);
+    size_t consumed = end + 2;
+    if (line == "+CONTINUE") {
+        g_repl.state = REPL_STREAMING;
+        msg("partial resync with the primary");
+    } else if (line.substr(0, 12) == "+FULLRESYNC ") {
+        size_t end2 = in.find("\r\n", consumed);
+        if (end2 == in.npos) {
+            return false;   // the snapshot size is next
+        }
+        std::string_view rest = line.substr(12);
+        size_t sp = rest.find(' ');
+        int64_t offset = 0, size = 0;
+        std::string_view bulk = in.substr(consumed, end2 - consumed);
+        if (sp == rest.npos || !str2int(rest.substr(sp + 1), offset) || offset < 0
+            || bulk.substr(0, 1) != "$" || !str2int(bulk.substr(1), size) || size < 0)
+        {
+            conn->want_close = true;
+            return false;
+        }
+        consumed = end2 + 2;
+        db_flush();
+        g_repl.primary_replid = std::string(rest.substr(0, sp));
+        g_repl.offset = (uint64_t)offset;
+        g_repl.snapshot_left = (uint64_t)size;
+        g_repl.state = size ? REPL_SNAPSHOT : REPL_STREAMING;
+        msg("full resync with the primary");
+    } else {
+        msg("the primary refused PSYNC");
+        g_repl.primary_replid = "?";
+        conn->want_close = true;
+        return false;
+    }
+    buf_consume(conn->incoming, consumed);
+    g_repl.last_io_ms = get_monotonic_msec();
+    return true;
+}
+
+// a command from the primary was applied
+static void repl_applied(size_t len) {
+    size_t in_snapshot = (size_t)std::min<uint64_t>(len, g_repl.snapshot_left);
+    g_repl.snapshot_left -= in_snapshot;
+    g_repl.offset += len - in_snapshot;
+    g_repl.last_io_ms = get_monotonic_msec();
+    if (g_repl.state == REPL_SNAPSHOT && !g_repl.snapshot_left) {
+        g_repl.state = REPL_STREAMING;
+        msg("snapshot loaded");
+    }
+}
+
+// from process_timers(), every k_repl_cron_ms
+static void repl_cron() {
+    uint64_t now_ms = get_monotonic_msec();
+    uint64_t timeout = (uint64_t)g_config.repl_timeout_ms;
+    // primary: drop silent replicas, ping the others
+    for (size_t i = 0; i < g_repl.replicas.size(); ) {
+        Conn *conn = g_repl.replicas[i];
+        if (!conn->want_close && now_ms - conn->repl_ack_ms > timeout) {
+            msg("replica timed out");
+            conn->want_close = true;
+        }
+        if (conn->want_close) {
+            conn_destroy(conn);     // leaves `replicas`
+        } else {
+            i++;
+        }
+    }
+    if (!g_repl.replicas.empty() && now_ms >= g_repl.next_ping_ms) {
+        std::string_view ping = "ping";
+        repl_feed(&ping, 1);
+        g_repl.next_ping_ms = now_ms + k_repl_ping_ms;
+    }
+    // replica: keep the link up
+    if (g_repl.state == REPL_WAIT && now_ms >= g_repl.retry_ms) {
+        repl_connect();
+    } else if (g_repl.state == REPL_CONNECTING) {
+        struct pollfd pfd = {g_repl.connect_fd, POLLOUT, 0};
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (poll(&pfd, 1, 0) == 1) {
+            (void)getsockopt(g_repl.connect_fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (!err) {
+                return repl_link_up();
+            }
+        }
+        if (err || now_ms - g_repl.last_io_ms > timeout) {
+            errno = err ? err : ETIMEDOUT;
+            msg_errno("can't connect to the primary");
+            repl_drop_link();
+            g_repl.state = REPL_WAIT;
+            g_repl.retry_ms = now_ms + k_repl_retry_ms;
+        }
+    } else if (Conn *conn = g_repl.primary) {
+        if (now_ms - g_repl.last_io_ms > timeout) {
+            msg("the primary timed out");
+            conn_destroy(conn);
+        } else if (g_repl.state == REPL_STREAMING && now_ms >= g_repl.next_ping_ms) {
+            std::string offset = std::to_string(g_repl.offset);
+            std::string_view args[3] = {"replconf", "ack", offset};
+            repl_append_cmd(conn->outgoing.data, args, 3);
+            conn_queue_output(conn);
+            g_repl.next_ping_ms = now_ms + k_repl_ping_ms;
+        }
+    }
+}
+
+// REPLICAOF host port | REPLICAOF NO ONE
+static void do_replicaof(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    if (str_ieq(cmd[1], "no") && str_ieq(cmd[2], "one")) {
+        if (g_repl.primary_port) {
+            repl_drop_link();
+            g_repl.primary_port = 0;
+            g_repl.state = REPL_NONE;
+            // our history is the old primary's now, which replicas of ours can't resume
+            repl_new_id();
+            g_repl.backlog.clear();
+            msg("now a primary");
+        }
+        return out_ok(out);
+    }
+    int64_t port = 0;
+    if (!str2int(cmd[2], port) || port < 1 || port > 65535) {
+        return out_err(out, ERR_BAD_ARG, "expect a port number");
+    }
+    if (g_repl.primary_port == port && g_repl.primary_host == cmd[1]) {
+        return out_ok(out);
+    }
+    repl_drop_link();
+    for (Conn *conn : g_repl.replicas) {
+        conn->want_close = true;
+        g_repl.closing.push_back(conn);
+    }
+    g_repl.primary_host = std::string(cmd[1]);
+    g_repl.primary_port = port;
+    g_repl.primary_replid = "?";
+    g_repl.state = REPL_WAIT;
+    g_repl.retry_ms = 0;
+    g_repl.next_cron_ms = 0;
+    msg("now a replica");
+    return out_ok(out);
+}
+
+// cluster mode, see ClusterSlot
+static int32_t cluster_node(std::string_view addr) {
+    for (size_t i = 1; i < g_cluster.nodes.size(); i++) {
+        if (g_cluster.nodes[i] == addr) {
+            return (int32_t)i;
+        }
+    }
+    g_cluster.nodes.push_back(std::string(addr));
+    return (int32_t)g_cluster.nodes.size() - 1;
+}
+
+static void out_redirect(Buffer &out, uint32_t code, uint32_t slot, int32_t node) {
+    return out_err(out, code, std::to_string(slot) + " " + g_cluster.nodes[node]);
+}
+
+/*Whether this node runs the command, or the client is sent elsewhere. All the keys must be in
+one slot. While a slot migrates, the keys that are still here are served here and the rest is
+asked from the target, which only takes them from clients that sent ASKING first, because the
+slot isn't its own until the migration is over.*/
+static bool cluster_route(const CmdSpec *spec, std::vector<std::string_view> &cmd, bool asking, Buffer &out) {
+    size_t last = spec->last_key < 0 ? cmd.size() + spec->last_key : (size_t)spec->last_key;
+    uint32_t slot = k_cluster_slots;
+    size_t nkeys = 0, present = 0;
+    for (size_t i = (size_t)spec->first_key; i <= last && i < cmd.size(); i += spec->key_step) {
+        LookupKey key;
+        key_init(&key, cmd[i]);
+        uint32_t s = key_slot(key.data, key.len, key.node.hcode);
+        if (slot != k_cluster_slots && s != slot) {
+            out_err(out, ERR_CROSSSLOT, "Keys in request don't hash to the same slot.");
+            return false;
+        }
+        slot = s;
+        nkeys++;
+        if (g_cluster.slots[slot].migrating != k_node_none) {
+            present += hm_lookup(&g_data.db, &key.node, &entry_eq) != NULL;
+        }
+    }
+    if (!nkeys) {
+        return true;
+    }
+    const ClusterSlot &cs = g_cluster.slots[slot];
+    if (cs.owner == k_node_self) {
+        if (cs.migrating == k_node_none || present == nkeys) {
+            return true;
+        }
+        if (present) {
+            out_err(out, ERR_TRYAGAIN, "Multiple keys request during rehashing of slot.");
+        } else {
+            out_redirect(out, ERR_ASK, slot, cs.migrating);
+        }
+        return false;
+    }
+    if (cs.importing && asking) {
+        return true;
+    }
+    if (cs.owner == k_node_none) {
+        out_err(out, ERR_CLUSTERDOWN, "Hash slot not served.");
+    } else {
+        out_redirect(out, ERR_MOVED, slot, cs.owner);
+    }
+    return false;
+}
+
+static void do_asking(Conn *conn, std::vector<std::string_view> &, Buffer &out) {
+    if (!g_config.cluster_enabled) {
+        return out_err(out, ERR_BAD_ARG, "This instance has cluster support disabled.");
+    }
+    conn->asking = true;
+    return out_ok(out);
+}
+
+static bool arg2slot(std::string_view arg, uint32_t &slot) {
+    int64_t val = 0;
+    if (!str2int(arg, val) || val < 0 || val >= (int64_t)k_cluster_slots) {
+        return false;
+    }
+    slot = (uint32_t)val;
+    return true;
+}
+
+/*CLUSTER KEYSLOT key | ADDSLOTSRANGE start end [start end ...] | SLOTS
+| SETSLOT slot NODE host:port | SETSLOT slot MIGRATING host:port | SETSLOT slot IMPORTING
+| SETSLOT slot STABLE | COUNTKEYSINSLOT slot | GETKEYSINSLOT slot count*/
+static void do_cluster(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    if (!g_config.cluster_enabled) {
+        return out_err(out, ERR_BAD_ARG, "This instance has cluster support disabled.");
+    }
+    std::string_view sub = cmd[1];
+    uint32_t slot = 0, end = 0;
+    if (str_ieq(sub, "keyslot") && cmd.size() == 3) {
+        LookupKey key;
+        key_init(&key, cmd[2]);
+        return out_int(out, key_slot(key.data, key.len, key.node.hcode));
+    }
+    if (str_ieq(sub, "addslotsrange") && cmd.size() % 2 == 0) {
+        for (size_t i = 2; i < cmd.size(); i += 2) {
+            if (!arg2slot(cmd[i], slot) || !arg2slot(cmd[i + 1], end) || slot > end) {
+                return out_err(out, ERR_BAD_ARG, "Invalid slot range.");
+            }
+        }
+        // also ends an import: the slot is ours now
+        for (size_t i = 2; i < cmd.size(); i += 2) {
+            arg2slot(cmd[i], slot);
+            arg2slot(cmd[i + 1], end);
+            for (uint32_t s = slot; s <= end; s++) {
+                g_cluster.slots[s] = ClusterSlot{k_node_self, k_node_none, false};
+            }
+        }
+        return out_ok(out);
+    }
+    if (str_ieq(sub, "slots") && cmd.size() == 2) {
+        // [start, end, "host:port" or "myself"] for each run of slots with the same owner
+        size_t ctx = out_begin_arr(out);
+        uint32_t n = 0;
+        for (uint32_t s = 0; s < k_cluster_slots; s = end + 1) {
+            int32_t owner = g_cluster.slots[s].owner;
+            for (end = s; end + 1 < k_cluster_slots && g_cluster.slots[end + 1].owner == owner; end++) {}
+            if (owner != k_node_none) {
+                const std::string &addr = g_cluster.nodes[owner];
+                out_arr(out, 3);
+                out_int(out, s);
+                out_int(out, end);
+                out_str(out, addr.data(), addr.size());
+                n++;
+            }
+        }
+        return out_end_arr(out, ctx, n);
+    }
+    if (cmd.size() < 3 || !arg2slot(cmd[2], slot)) {
+        return out_err(out, ERR_BAD_ARG, "expect CLUSTER subcommand and slot.");
+    }
+    ClusterSlot &cs = g_cluster.slots[slot];
+    if (str_ieq(sub, "countkeysinslot") && cmd.size() == 3) {
+        return out_int(out, g_cluster.slot_count[slot]);
+    }
+    if (str_ieq(sub, "getkeysinslot") && cmd.size() == 4) {
+        int64_t count = 0;
+        if (!str2int(cmd[3], count) || count < 0) {
+            return out_err(out, ERR_BAD_ARG, "expect int64");
+        }
+        uint32_t n = (uint32_t)std::min<int64_t>(count, g_cluster.slot_count[slot]);
+        out_arr(out, n);
+        DList *head = &g_cluster.slot_keys[slot];
+        DList *node = head->next;
+        for (uint32_t i = 0; i < n; i++, node = node->next) {
+            Entry *ent = container_of(node, Entry, slot_node);
+            out_str(out, ent->key, ent->klen);
+        }
+        return;
+    }
+    if (!str_ieq(sub, "setslot")) {
+        return out_err(out, ERR_BAD_ARG, "unknown CLUSTER subcommand.");
+    }
+    std::string_view how = cmd.size() > 3 ? cmd[3] : "";
+    if (str_ieq(how, "node") && cmd.size() == 5) {
+        // also ends a migration: the slot is theirs now
+        cs = ClusterSlot{cluster_node(cmd[4]), k_node_none, false};
+    } else if (str_ieq(how, "migrating") && cmd.size() == 5) {
+        if (cs.owner != k_node_self) {
+            return out_err(out, ERR_BAD_ARG, "I'm not the owner of hash slot.");
+        }
+        cs.migrating = cluster_node(cmd[4]);
+    } else if (str_ieq(how, "importing") && cmd.size() == 4) {
+        if (cs.owner == k_node_self) {
+            return out_err(out, ERR_BAD_ARG, "I'm already the owner of hash slot.");
+        }
+        cs.importing = true;
+    } else if (str_ieq(how, "stable") && cmd.size() == 4) {
+        cs.migrating = k_node_none;
+        cs.importing = false;
+    } else {
+        return out_err(out, ERR_BAD_ARG, "expect NODE, MIGRATING, IMPORTING or STABLE.");
+    }
+    return out_ok(out);
+}
+
+// a blocking connection with timeouts, for MIGRATE
+static int migrate_dial(std::string_view host, std::string_view port, int64_t timeout_ms) {
+    struct addrinfo hints = {}, *res = NULL;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(std::string(host).c_str(), std::string(port).c_str(), &hints, &res) != 0) {
+        return -1;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct timeval tv = {(time_t)(timeout_ms / 1000), (suseconds_t)(timeout_ms % 1000 * 1000)};
+    if (fd >= 0) {
+        // SO_SNDTIMEO bounds connect() too
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        if (connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+            (void)close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+// the size of the RESP reply at the front of `in`, 0 if it's incomplete or -1 if it's malformed
+static int64_t resp_reply_size(std::string_view in) {
+    size_t end = in.find("\r\n");
+    if (end == in.npos) {
+        return 0;
+    }
+    int64_t len = 0;
+    if (in[0] == '+' || in[0] == '-' || in[0] == ':') {
+        return (int64_t)end + 2;
+    }
+    if ((in[0] != '$' && in[0] != '*') || !str2int(in.substr(1, end - 1), len) || len < -1) {
+        return -1;
+    }
+    size_t size = end + 2;
+    if (in[0] == '$') {
+        size += len < 0 ? 0 : (size_t)len + 2;
+        return in.size() >= size ? (int64_t)size : 0;
+    }
+    for (int64_t i = 0; i < len; i++) {
+        int64_t n = resp_reply_size(in.substr(size));
+        if (n <= 0) {
+            return n;
+        }
+        size += (size_t)n;
+    }
+    return (int64_t)size;
+}
+
+/*Send the commands and wait for all `nreplies` replies, the first error fails the whole thing.
+Returns an error message, empty on success.*/
+static std::string migrate_exchange(int fd, const std::vector<uint8_t> &req, size_t nreplies) {
+    for (size_t done = 0; done < req.size(); ) {
+        ssize_t rv = write(fd, &req[done], req.size() - done);
+        if (rv <= 0) {
+            return "IOERR error or timeout writing to target instance.";
+        }
+        done += (size_t)rv;
+    }
+    std::string in;
+    size_t pos = 0;
+    size_t seen = 0;
+    while (seen < nreplies) {
+        int64_t size = resp_reply_size(std::string_view(in).substr(pos));
+        if (size < 0) {
+            return "IOERR bad reply from target instance.";
+        }
+        if (size > 0) {
+            if (in[pos] == '-') {
+                return "target instance replied: " + in.substr(pos + 1, (size_t)size - 3);
+            }
+            pos += (size_t)size;
+            seen++;
+            continue;
+        }
+        in.erase(0, pos);
+        pos = 0;
+        char rbuf[4096];
+        ssize_t rv = read(fd, rbuf, sizeof(rbuf));
+        if (rv <= 0) {
+            return "IOERR error or timeout reading from target instance.";
+        }
+        in.append(rbuf, (size_t)rv);
+    }
+    return "";
+}
+
+/*MIGRATE host port timeout-ms key [key ...]: moves the keys that exist to another node and
+deletes them here, returns how many moved. Like in Redis it blocks until the target confirmed,
+so a key is always in exactly one place. The target gets each key as DEL + the commands that
+recreate it, each after ASKING since the slot isn't its own yet.*/
+static void do_migrate(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    int64_t timeout_ms = 0;
+    if (!str2int(cmd[3], timeout_ms) || timeout_ms <= 0) {
+        return out_err(out, ERR_BAD_ARG, "expect a timeout in milliseconds");
+    }
+    if (g_repl.primary_port) {
+        return out_err(out, ERR_READONLY, "You can't write against a read only replica.");
+    }
+    uint64_t now_ms = get_monotonic_msec();
+    std::vector<Entry *> ents;
+    for (size_t i = 4; i < cmd.size(); i++) {
+        LookupKey key;
+        key_init(&key, cmd[i]);
+        HNode *node = hm_lookup(&g_data.db, &key.node, &entry_eq);
+        Entry *ent = node ? container_of(node, Entry, node) : NULL;
+        if (ent && std::find(ents.begin(), ents.end(), ent) == ents.end()) {
+            ents.push_back(ent);
+        }
+    }
+    std::vector<uint8_t> req;
+    size_t nreplies = 0;
+    std::string_view asking = "asking";
+    auto emit = [&](const std::string_view *args, size_t n) {
+        repl_append_cmd(req, &asking, 1);
+        repl_append_cmd(req, args, n);
+        nreplies += 2;
+    };
+    for (Entry *ent : ents) {
+        std::string_view del[2] = {"del", std::string_view(ent->key, ent->klen)};
+        emit(del, 2);
+        if (!entry_is_due(ent, now_ms)) {
+            entry_to_cmds(ent, now_ms, emit);
+        }
+    }
+    if (ents.empty()) {
+        return out_int(out, 0);
+    }
+    int fd = migrate_dial(cmd[1], cmd[2], timeout_ms);
+    if (fd < 0) {
+        return out_err(out, ERR_BAD_ARG, "IOERR can't connect to target instance.");
+    }
+    std::string err = migrate_exchange(fd, req, nreplies);
+    (void)close(fd);
+    if (!err.empty()) {
+        return out_err(out, ERR_BAD_ARG, err);  // the keys stay, a retry overwrites the copies
+    }
+    for (Entry *ent : ents) {
+        hm_delete(&g_data.db, &ent->node, &hnode_same);
+        repl_feed_del(ent);
+        entry_del(ent);
+    }
+    return out_int(out, (int64_t)ents.size());
+}
+
+// INFO output is a flat array of (name, value) pairs
+static void out_info_int(Buffer &out, uint32_t &n, const char *name, int64_t val) {
+    out_str(out, name, strlen(name));
+    out_int(out, val);
+    n += 2;
+}
+static void out_info_dbl(Buffer &out, uint32_t &n, const std::string &name, double val) {
+    out_str(out, name.data(), name.size());
+    out_dbl(out, val);
+    n += 2;
+}
+
+const size_t k_max_expire_backlog = 100 * 1000;    // bounds the INFO cost
+
+// info [section]
+static void do_info(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    std::string_view section = cmd.size() > 1 ? cmd[1] : "all";
+    bool all = str_ieq(section, "all");
+    uint64_t now_ms = get_monotonic_msec();
+
+    size_t ctx = out_begin_arr(out);
+    uint32_t n = 0;
+    if (all || str_ieq(section, "server")) {
+        out_info_int(out, n, "uptime_ms", (int64_t)(now_ms - g_stats.start_ms));
+    }
+    if (all || str_ieq(section, "clients")) {
+        out_info_int(out, n, "connected_clients", (int64_t)g_stats.conns_current);
+        out_info_int(out, n, "total_connections", (int64_t)g_stats.conns_accepted);
+        // buffer memory held for clients, summed over the connections
+        size_t in_bytes = 0, out_bytes = 0, out_max = 0;
+        for (Conn *conn : g_data.fd2conn) {
+            if (conn) {
+                size_t size = conn_output_size(conn);
+                in_bytes += conn->incoming.size() + conn->multi_args.size();
+                out_bytes += size;
+                out_max = std::max(out_max, size);
+            }
+        }
+        out_info_int(out, n, "client_input_bytes", (int64_t)in_bytes);
+        out_info_int(out, n, "client_output_bytes", (int64_t)out_bytes);
+        out_info_int(out, n, "client_output_max", (int64_t)out_max);
+        out_info_int(out, n, "clients_output_paused", (int64_t)g_stats.clients_output_paused);
+        out_info_int(out, n, "blocked_clients", (int64_t)g_blocked.nclients);
+        out_info_int(out, n, "output_limit_disconnects", (int64_t)g_stats.output_limit_disconnects);
+    }
+    if (all || str_ieq(section, "stats")) {
+        uint64_t calls = 0;
+        for (const CmdStats &st : g_cmd_stats) {
+            calls += st.calls;
+        }
+        out_info_int(out, n, "total_commands", (int64_t)calls);
+        out_info_int(out, n, "net_input_bytes", (int64_t)g_stats.net_in_bytes);
+        out_info_int(out, n, "net_output_bytes", (int64_t)g_stats.net_out_bytes);
+        out_info_int(out, n, "read_calls", (int64_t)g_stats.read_calls);
+        out_info_int(out, n, "write_calls", (int64_t)g_stats.write_calls);
+        out_info_int(out, n, "pubsub_channels", (int64_t)hm_size(&g_pubsub.channels));
+        out_info_int(out, n, "pubsub_patterns", (int64_t)hm_size(&g_pubsub.patterns));
+        out_info_int(out, n, "pubsub_messages", (int64_t)g_pubsub.messages);
+    }
+    if (all || str_ieq(section, "keyspace")) {
+        HMap &db = g_data.db;
+        out_info_int(out, n, "keys", (int64_t)hm_size(&db));
+        out_info_int(out, n, "expires", (int64_t)g_data.heap.size());
+        out_info_int(out, n, "expired_keys", (int64_t)g_stats.expired_keys);
+        out_info_int(out, n, "evicted_keys", (int64_t)g_stats.evicted_keys);
+        // keys already due but not yet removed by process_timers()
+        size_t backlog = heap_count_below(
+            g_data.heap.data(), g_data.heap.size(), now_ms, k_max_expire_backlog);
+        out_info_int(out, n, "expire_backlog", (int64_t)backlog);
+        out_info_int(out, n, "hashtable_buckets", (int64_t)(db.newer.tab ? db.newer.mask + 1 : 0));
+        out_info_int(out, n, "rehashing", db.older.tab ? 1 : 0);
+        out_info_int(out, n, "rehash_pending_keys", (int64_t)db.older.size);
+    }
+    if (all || str_ieq(section, "memory")) {
+        out_info_int(out, n, "used_memory", (int64_t)used_memory());
+        out_info_int(out, n, "maxmemory", g_config.maxmemory);
+        out_info_int(out, n, "evict_pending", g_data.evict_pending ? 1 : 0);
+    }
+    if (all || str_ieq(section, "cluster")) {
+        int64_t owned = 0, migrating = 0, importing = 0;
+        for (const ClusterSlot &cs : g_cluster.slots) {
+            owned += cs.owner == k_node_self;
+            migrating += cs.migrating != k_node_none;
+            importing += cs.importing;
+        }
+        out_info_int(out, n, "cluster_enabled", g_config.cluster_enabled);
+        out_info_int(out, n, "cluster_slots_owned", owned);
+        out_info_int(out, n, "cluster_slots_migrating", migrating);
+        out_info_int(out, n, "cluster_slots_importing", importing);
+        out_info_int(out, n, "cluster_known_nodes", (int64_t)g_cluster.nodes.size());
+    }
+    if (all || str_ieq(section, "replication")) {
+        out_info_int(out, n, "is_replica", g_repl.primary_port ? 1 : 0);
+        out_info_int(out, n, "repl_offset", (int64_t)g_repl.offset);
+        out_info_int(out, n, "connected_replicas", (int64_t)g_repl.replicas.size());
+        out_info_int(out, n, "repl_backlog_histlen", (int64_t)(g_repl.offset - g_repl.backlog_start));
+        out_info_int(out, n, "sync_full", (int64_t)g_repl.sync_full);
+        out_info_int(out, n, "sync_partial_ok", (int64_t)g_repl.sync_partial_ok);
+        out_info_int(out, n, "sync_partial_err", (int64_t)g_repl.sync_partial_err);
+        out_info_int(out, n, "primary_link_up", g_repl.state == REPL_STREAMING ? 1 : 0);
+        out_info_int(out, n, "primary_sync_in_progress", g_repl.state == REPL_SNAPSHOT ? 1 : 0);
+    }
+    if (all || str_ieq(section, "commands")) {
+        for (size_t i = 0; i < k_num_cmds; i++) {
+            const CmdStats &st = g_cmd_stats[i];
+            if (!st.calls) {
+                continue;
+            }
+            std::string prefix = std::string("cmd.") + k_cmds[i].name + ".";
+            out_info_int(out, n, (prefix + "calls").c_str(), (int64_t)st.calls);
+            out_info_int(out, n, (prefix + "errors").c_str(), (int64_t)st.errors);
+            const Hist *h = &st.latency;
+            out_info_dbl(out, n, prefix + "avg_us", (double)h->sum / (double)h->count / 1e3);
+            out_info_dbl(out, n, prefix + "p50_us", (double)hist_percentile(h, 50) / 1e3);
+            out_info_dbl(out, n, prefix + "p99_us", (double)hist_percentile(h, 99) / 1e3);
+            out_info_dbl(out, n, prefix + "p999_us", (double)hist_percentile(h, 99.9) / 1e3);
+            out_info_dbl(out, n, prefix + "max_us", (double)h->max / 1e3);
+        }
+    }
+    out_end_arr(out, ctx, n);
+}
+
+
+// /*Structure: The response protocol is simple: [Total Length] [Status Code] [Data Payload].
+// resp_len: It calculates 4 (for the status code) + size of data.
+// buf_append: This is just a helper (likely using std::vector::insert) to push raw bytes onto the output buffer*/
+// static void make_response(const Response &resp, std::vector<uint8_t> &out) {
+//     uint32_t resp_len = 4 + (uint32_t)resp.data.size();
+//     // 1. Append Total Length (4 bytes)
+//     buf_append(out, (const uint8_t *)&resp_len, 4);
+//     // 2. Append Status Code (4 bytes)
+//     buf_append(out, (const uint8_t *)&resp.status, 4);
+//     // 3. Append the Actual Data
+//     buf_append(out, resp.data.data(), resp.data.size());
+// }
+
+/*static int32_t read_full(int fd, char *buf, size_t n){
+    while(n>0){
+        ssize_t rv=read(fd, buf, n);   //Stores the return value, which is the actual number of bytes read.
+        if(rv<=0){
+            return -1;   
+              //If rv is 0, it means "End of File" (the connection was closed).
+              // If rv is negative (-1), an error occurred.      
+        }
+        assert((size_t)rv <= n);
+        n -= (size_t)rv;           //Subtracts the number of bytes just read from the total remaining count.
+        buf += rv;                 //Moves the buffer pointer forward. If we read 10 bytes, the next read should start at index 10, not 0.
+    }
+    return 0;   //Returns 0 to indicate success (all bytes were read).
+
+} */
+/*static int32_t write_all(int fd, const char *buf, size_t n) {
+    while (n > 0) {
+        ssize_t rv = write(fd, buf, n); // System call to write data
+        if (rv <= 0) {
+            return -1;  // Returns -1 on failure
+        }
+        assert((size_t)rv <= n);
+        n -= (size_t)rv;  // Decrease remaining count
+        buf += rv;        // Advance buffer pointer
+    }
+    return 0; // Success
+}  */
+
+// const size_t k_max_msg = 4096;    //It allocates 4 bytes for the header (length) and 4096 bytes for the maximum allowed message body.
+// process 1 request if there is enough data
+
+// TLV responses are prefixed by their length, RESP ones are not
+static size_t response_header_size(const Buffer &out) {
+    return out.proto == PROTO_TLV ? 4 : 0;
+}
+
+static void response_begin(Buffer &out, size_t *header) {
+    *header = out.data.size();  // messege header position
+    if (out.proto == PROTO_TLV) {
+        buf_append_u32(out, 0);     // reserve space
+    }
+}
+
+static size_t response_size(Buffer &out, size_t header) {
+    size_t size = out.data.size() - header - response_header_size(out);
+    for (size_t i = out.refs.size(); i > 0 && out.refs[i - 1].pos > header; i--) {
+        size += out.refs[i - 1].rc->len;
+    }
+    return size;
+}
+
+static void response_end(Buffer &out, size_t header) {
+    size_t msg_size = response_size(out, header);
+    if (msg_size > k_max_msg) {
+        out_truncate(out, header + response_header_size(out));
+        out_err(out, ERR_TOO_BIG, "response is too big.");
+        msg_size = response_size(out, header);
+    }
+    if (out.proto != PROTO_TLV) {
+        return;
+    }
+    // message header
+    uint32_t len = (uint32_t)msg_size;
+    memcpy(&out.data[header], &len, 4);
+}
+
+static void serve_blocked();
+
+// the command path is the same for both protocols, only parsing and serialization differ
+static void process_request(Conn *conn, std::vector<std::string_view> &cmd) {
+    size_t header_pos = 0;
+    response_begin(conn->outgoing, &header_pos);
+    conn->reply_header = header_pos;
+    do_request(conn, cmd, conn->outgoing);
+    conn->block_timed_out = false;
+    if (conn->blocked) {
+        out_truncate(conn->outgoing, header_pos);   // the request stays in `incoming`
+        return;
+    }
+    response_end(conn->outgoing, conn->reply_header);
+    if (conn->repl_role == REPL_ROLE_REPLICA && !conn->repl_attached) {
+        repl_attach(conn);  // PSYNC was answered, the payload follows
+    } else if (conn->repl_role == REPL_ROLE_PRIMARY) {
+        out_truncate(conn->outgoing, header_pos);   // the primary doesn't read replies
+    }
+    if (!g_blocked.ready.empty()) {
+        serve_blocked();
+    }
+}
+
+static bool try_one_resp_request(Conn *conn) {
+    std::vector<std::string_view> cmd;    // points into conn->incoming
+    int64_t len = parse_resp(conn->incoming.data(), conn->incoming.size(), cmd);
+    if (len < 0) {
+        msg("bad request");
+        conn->want_close = true;
+        return false;   // want close
+    }
+    if (len == 0) {
+        if (conn->incoming.size() > k_max_msg) {
+            msg("too long");
+            conn->want_close = true;
+        }
+        return false;   // want read
+    }
+    process_request(conn, cmd);
+    if (conn->blocked) {
+        return false;
+    }
+    buf_consume(conn->incoming, (size_t)len);
+    if (conn->repl_role == REPL_ROLE_PRIMARY) {
+        repl_applied((size_t)len);
+    }
+    return true;
+}
+
+/*Output buffer limits for clients that send faster than they read. Over the soft limit, the
+connection stops executing requests (they wait in `incoming`) and stops reading, until the
+output drains below it. Staying over it for client-output-soft-ms, or going over the hard
+limit, disconnects the client. Returns whether requests may be executed.*/
+static bool conn_check_output(Conn *conn) {
+    if (conn->repl_role != REPL_ROLE_CLIENT) {
+        return !conn->want_close;   // replication links, see repl_check_output() and repl_cron()
+    }
+    size_t size = conn_output_size(conn);
+    int64_t soft = g_config.client_output_soft_limit;
+    int64_t hard = g_config.client_output_hard_limit;
+    if (soft > 0 && size >= (size_t)soft) {
+        if (!conn->out_soft_since_ms) {
+            conn->out_soft_since_ms = get_monotonic_msec();
+            g_stats.clients_output_paused++;
+        }
+    } else if (conn->out_soft_since_ms) {
+        conn->out_soft_since_ms = 0;
+        g_stats.clients_output_paused--;
+    }
+    bool too_long = conn->out_soft_since_ms
+        && get_monotonic_msec() - conn->out_soft_since_ms >= (uint64_t)g_config.client_output_soft_ms;
+    if (!conn->want_close && (too_long || (hard > 0 && size > (size_t)hard))) {
+        msg("output buffer limit reached");
+        g_stats.output_limit_disconnects++;
+        conn->want_close = true;
+    }
+    return !conn->out_soft_since_ms && !conn->want_close;
+}
+
+// ---------------------------------------------------------
+// pub/sub
+// ---------------------------------------------------------
+// whether the pattern item at `*p` (not a star) matches `c`, moves `*p` past it
+static bool glob_one(std::string_view pat, size_t *p, uint8_t c) {
+    uint8_t pc = (uint8_t)pat[*p];
+    if (pc == '?') {
+        (*p)++;
+        return true;
+    }
+    if (pc == '\\' && *p + 1 < pat.size()) {
+        *p += 2;
+        return (uint8_t)pat[*p - 1] == c;
+    }
+    if (pc != '[') {
+        (*p)++;
+        return pc == c;
+    }
+    size_t i = *p + 1;
+    bool neg = i < pat.size() && pat[i] == '^';
+    i += neg;
+    bool match = false;
+    while (i < pat.size() && pat[i] != ']') {
+        if (pat[i] == '\\' && i + 1 < pat.size()) {
+            match |= (uint8_t)pat[i + 1] == c;
+            i += 2;
+        } else if (i + 2 < pat.size() && pat[i + 1] == '-' && pat[i + 2] != ']') {
+            uint8_t lo = (uint8_t)pat[i], hi = (uint8_t)pat[i + 2];
+            match |= std::min(lo, hi) <= c && c <= std::max(lo, hi);
+            i += 3;
+        } else {
+            match |= (uint8_t)pat[i] == c;
+            i++;
+        }
+    }
+    *p = i < pat.size() ? i + 1 : i;    // an unclosed [ runs to the end, like Redis
+    return match != neg;
+}
+
+/*Glob-style patterns like Redis' stringmatchlen(): * ? [abc] [^a-z] and \ to escape. On a mismatch
+the last star takes one more byte and matching resumes after it, so there is no recursion.*/
+static bool glob_match(std::string_view pat, std::string_view str) {
+    size_t p = 0, s = 0;
+    size_t star_p = std::string_view::npos, star_s = 0;
+    while (s < str.size()) {
+        if (p < pat.size() && pat[p] == '*') {
+            star_p = p++;
+            star_s = s;
+            continue;
+        }
+        size_t next = p;
+        if (p < pat.size() && glob_one(pat, &next, (uint8_t)str[s])) {
+            p = next;
+            s++;
+            continue;
+        }
+        if (star_p == std::string_view::npos) {
+            return false;
+        }
+        p = star_p + 1;
+        s = ++star_s;
+    }
+    while (p < pat.size() && pat[p] == '*') {
+        p++;
+    }
+    return p == pat.size();
+}
+
+static bool pubsub_chan_eq(HNode *node, HNode *key) {
+    PubsubChan *ch = container_of(node, PubsubChan, node);
+    LookupKey *lk = container_of(key, LookupKey, node);
+    return ch->name.size() == lk->len && memcmp(ch->name.data(), lk->data, lk->len) == 0;
+}
+
+static HMap *pubsub_map(bool pattern) {
+    return pattern ? &g_pubsub.patterns : &g_pubsub.channels;
+}
+
+static std::vector<PubsubChan *> &conn_subs(Conn *conn, bool pattern) {
+    return pattern ? conn->sub_patterns : conn->sub_channels;
+}
+
+static PubsubChan *pubsub_lookup(bool pattern, std::string_view name) {
+    LookupKey key;
+    key_init(&key, name);
+    HNode *node = hm_lookup(pubsub_map(pattern), &key.node, &pubsub_chan_eq);
+    return node ? container_of(node, PubsubChan, node) : NULL;
+}
+
+static void pubsub_add(Conn *conn, bool pattern, std::string_view name) {
+    std::vector<PubsubChan *> &mine = conn_subs(conn, pattern);
+    PubsubChan *ch = pubsub_lookup(pattern, name);
+    if (ch && std::find(mine.begin(), mine.end(), ch) != mine.end()) {
+        return;
+    }
+    if (!ch) {
+        ch = new PubsubChan();
+        ch->node.hcode = str_hash((const uint8_t *)name.data(), name.size());
+        ch->name.assign(name);
+        hm_insert(pubsub_map(pattern), &ch->node);
+    }
+    ch->subs.push_back(conn);
+    mine.push_back(ch);
+    // it waits for messages, not for the idle timeout
+    dlist_detach(&conn->idle_node);
+    dlist_init(&conn->idle_node);
+}
+
+static void pubsub_remove(Conn *conn, bool pattern, PubsubChan *ch) {
+    std::vector<PubsubChan *> &mine = conn_subs(conn, pattern);
+    mine.erase(std::find(mine.begin(), mine.end(), ch));
+    // the order of the receivers doesn't matter
+    auto it = std::find(ch->subs.begin(), ch->subs.end(), conn);
+    *it = ch->subs.back();
+    ch->subs.pop_back();
+    if (ch->subs.empty()) {
+        hm_delete(pubsub_map(pattern), &ch->node, &hnode_same);
+        delete ch;
+    }
+    if (!conn_subscribed(conn) && !conn->blocked) {
+        conn->last_active_ms = get_monotonic_msec();
+        dlist_insert_before(&g_data.idle_list, &conn->idle_node);
+    }
+}
+
+static void pubsub_remove_all(Conn *conn, bool pattern) {
+    std::vector<PubsubChan *> &mine = conn_subs(conn, pattern);
+    while (!mine.empty()) {
+        pubsub_remove(conn, pattern, mine.back());
+    }
+}
+
+// a command with several replies ends the one it's writing and starts the next
+static void conn_next_reply(Conn *conn) {
+    response_end(conn->outgoing, conn->reply_header);
+    response_begin(conn->outgoing, &conn->reply_header);
+}
+
+// [kind, channel or nil, subscriptions left], one per channel
+static void pubsub_confirm(Conn *conn, Buffer &out, const char *kind, const std::string_view *name) {
+    out_push(out, 3);
+    out_str(out, kind, strlen(kind));
+    if (name) {
+        out_str(out, name->data(), name->size());
+    } else {
+        out_nil(out);
+    }
+    out_int(out, (int64_t)(conn->sub_channels.size() + conn->sub_patterns.size()));
+}
+
+// The replies go out one by one (see conn_next_reply()), which EXEC couldn't count as one.
+static void pubsub_subscribe(Conn *conn, std::vector<std::string_view> &cmd, Buffer &out, bool pattern) {
+    if (g_exec.active) {
+        return out_err(out, ERR_BAD_ARG, "(P)SUBSCRIBE is not allowed inside MULTI.");
+    }
+    for (size_t i = 1; i < cmd.size(); i++) {
+        if (i > 1) {
+            conn_next_reply(conn);
+        }
+        pubsub_add(conn, pattern, cmd[i]);
+        pubsub_confirm(conn, out, pattern ? "psubscribe" : "subscribe", &cmd[i]);
+    }
+}
+
+// without names it's all of them, or a single reply with a nil name if there are none
+static void pubsub_unsubscribe(Conn *conn, std::vector<std::string_view> &cmd, Buffer &out, bool pattern) {
+    if (g_exec.active) {
+        return out_err(out, ERR_BAD_ARG, "(P)UNSUBSCRIBE is not allowed inside MULTI.");
+    }
+    const char *kind = pattern ? "punsubscribe" : "unsubscribe";
+    std::vector<PubsubChan *> &mine = conn_subs(conn, pattern);
+    if (cmd.size() == 1 && mine.empty()) {
+        return pubsub_confirm(conn, out, kind, NULL);
+    }
+    for (size_t i = 1; cmd.size() == 1 ? !mine.empty() : i < cmd.size(); i++) {
+        if (i > 1) {
+            conn_next_reply(conn);
+        }
+        std::string name(cmd.size() == 1 ? mine.back()->name : cmd[i]);
+        PubsubChan *ch = pubsub_lookup(pattern, name);
+        if (ch && std::find(mine.begin(), mine.end(), ch) != mine.end()) {
+            pubsub_remove(conn, pattern, ch);
+        }
+        std::string_view view = name;
+        pubsub_confirm(conn, out, kind, &view);
+    }
+}
+
+// subscribe channel [channel ...]
+static void do_subscribe(Conn *conn, std::vector<std::string_view> &cmd, Buffer &out) {
+    pubsub_subscribe(conn, cmd, out, false);
+}
+// unsubscribe [channel ...]
+static void do_unsubscribe(Conn *conn, std::vector<std::string_view> &cmd, Buffer &out) {
+    pubsub_unsubscribe(conn, cmd, out, false);
+}
+// psubscribe pattern [pattern ...]
+static void do_psubscribe(Conn *conn, std::vector<std::string_view> &cmd, Buffer &out) {
+    pubsub_subscribe(conn, cmd, out, true);
+}
+// punsubscribe [pattern ...]
+static void do_punsubscribe(Conn *conn, std::vector<std::string_view> &cmd, Buffer &out) {
+    pubsub_unsubscribe(conn, cmd, out, true);
+}
+
+// a published message, serialized on first use for each protocol and shared by the receivers
+struct PubsubMsg {
+    std::string_view chan;
+    std::string_view msg;
+    const std::string *pattern = NULL;  // for the pmessage of a pattern subscription
+    RcBuf *enc[4] = {};                 // by PROTO_*
+};
+
+static RcBuf *pubsub_encoded(PubsubMsg &m, uint8_t proto) {
+    if (!m.enc[proto]) {
+        Buffer buf;
+        buf.proto = proto;
+        size_t header = 0;
+        response_begin(buf, &header);
+        out_push(buf, m.pattern ? 4 : 3);
+        if (m.pattern) {
+            out_str(buf, "pmessage", 8);
+            out_str(buf, m.pattern->data(), m.pattern->size());
+        } else {
+            out_str(buf, "message", 7);
+        }
+        out_str(buf, m.chan.data(), m.chan.size());
+        out_str(buf, m.msg.data(), m.msg.size());
+        response_end(buf, header);
+        m.enc[proto] = rcbuf_new(buf.data.data(), buf.data.size());
+    }
+    return m.enc[proto];
+}
+
+// send to every subscriber of `ch`, returns how many
+static size_t pubsub_fanout(PubsubMsg &m, PubsubChan *ch) {
+    for (Conn *conn : ch->subs) {
+        out_shared(conn->outgoing, pubsub_encoded(m, conn->outgoing.proto));
+        conn_queue_output(conn);
+        conn_check_output(conn);    // one that doesn't read is dropped like any client
+    }
+    for (RcBuf *&rc : m.enc) {
+        if (rc) {
+            rcbuf_unref(rc);    // the receivers hold it now
+            rc = NULL;
+        }
+    }
+    g_pubsub.messages += ch->subs.size();
+    return ch->subs.size();
+}
+
+struct PublishCtx {
+    std::string_view chan;
+    std::string_view msg;
+    size_t receivers = 0;
+};
+
+static bool cb_publish_pattern(HNode *node, void *arg) {
+    PublishCtx *ctx = (PublishCtx *)arg;
+    PubsubChan *pat = container_of(node, PubsubChan, node);
+    if (glob_match(pat->name, ctx->chan)) {
+        PubsubMsg m;
+        m.chan = ctx->chan;
+        m.msg = ctx->msg;
+        m.pattern = &pat->name;
+        ctx->receivers += pubsub_fanout(m, pat);
+    }
+    return true;
+}
+
+// publish channel message: the number of receivers, a client subscribed twice (channel and pattern) counts twice
+static void do_publish(Conn *, std::vector<std::string_view> &cmd, Buffer &out) {
+    PublishCtx ctx;
+    ctx.chan = cmd[1];
+    ctx.msg = cmd[2];
+    if (PubsubChan *ch = pubsub_lookup(false, ctx.chan)) {
+        PubsubMsg m;
+        m.chan = ctx.chan;
+        m.msg = ctx.msg;
+        ctx.receivers += pubsub_fanout(m, ch);
+    }
+    if (hm_size(&g_pubsub.patterns)) {
+        hm_foreach(&g_pubsub.patterns, &cb_publish_pattern, &ctx);
+    }
+    return out_int(out, (int64_t)ctx.receivers);
+}
+
+static bool try_one_request(Conn *conn) {
+    if (conn->blocked) {
+        // the rest of the pipeline waits behind the blocked request
+        if (conn->incoming.size() > k_max_msg) {
+            msg("too long");
+            conn->want_close = true;
+        }
+        return false;
+    }
+    if (!conn_check_output(conn)) {
+        return false;   // wait for the output to drain
+    }
+    if (conn == g_repl.primary && g_repl.state == REPL_HANDSHAKE) {
+        return repl_read_handshake(conn);
+    }
+    if (conn->outgoing.proto == PROTO_UNKNOWN) {
+        if (conn->incoming.size() < 4) {
+            return false;   // want read
+        }
+        conn->outgoing.proto = proto_detect(conn->incoming.data());
+    }
+    if (conn->outgoing.proto != PROTO_TLV) {
+        return try_one_resp_request(conn);
+    }
+    // try to parse the protocol: message header
+    if (conn->incoming.size() < 4) {      //Checks if we have at least 4 bytes (the header). If not, returns false (need more data).
+        return false;   // want read
+    }
+    uint32_t len = 0;
+    memcpy(&len, conn->incoming.data(), 4);
+    if (len > k_max_msg) {
+        msg("too long");
+        conn->want_close = true;
+        return false;   // want close
+    }
+    // message body
+    if (4 + len > conn->incoming.size()) {     
+        return false;   // want read
+        /*Checks if the full message (Header + Body) is in the buffer. If incoming has 100 bytes but the message says it's 200 bytes long, we return false and wait for more data.*/
+    }
+    const uint8_t *request = &conn->incoming[4];
+    // got one request, do some application logic
+    std::vector<std::string_view> cmd;    // points into conn->incoming
+    //// 1. Try to parse the accumulated buffer
+    if (parse_req(request, len, cmd) < 0) {
+        msg("bad request");
+        conn->want_close = true;
+        return false;   // want close
+    }
+    // // 2. Process the command
+    //  Response resp;
+    // do_request(cmd, resp);
+    // //// 3. Send the response back
+    // make_response(resp, conn->outgoing);
+    // // application logic done! remove the request message.
+
+    process_request(conn, cmd);
+    if (conn->blocked) {
+        return false;
+    }
+
+    // application logic done! remove the request message.
+    buf_consume(conn->incoming, 4 + len);
+    return true;        // success
+ 
+    
+}
+// run the requests of a client that stopped waiting, like handle_read() does
+static void conn_resume(Conn *conn) {
+    while (try_one_request(conn)) {}
+    if (out_size(conn->outgoing) > 0) {
+        conn->want_read = false;
+        conn->want_write = true;
+        conn_mark_dirty(conn);
+    }
+}
+
+/*Serve the clients waiting on the keys that got pushed to, in the order they blocked, while the
+lists have elements; all the readers of a stream. A woken request runs again and pops or reads,
+then whatever the client pipelined behind it runs too, which may push and make more keys ready.*/
+static void serve_blocked() {
+    static bool serving = false;
+    if (serving) {
+        return;     // a woken request pushed, the loop below sees it
+    }
+    serving = true;
+    while (!g_blocked.ready.empty()) {
+        std::vector<BlockedKey *> ready;
+        ready.swap(g_blocked.ready);
+        for (BlockedKey *bk : ready) {
+            if (key_type(bk->key) == T_STREAM) {
+                // readers take nothing away, so everyone waiting now gets to read once
+                std::vector<Conn *> waiters = bk->waiters;
+                for (Conn *conn : waiters) {
+                    if (std::find(bk->waiters.begin(), bk->waiters.end(), conn) != bk->waiters.end()) {
+                        conn_unblock(conn);
+                        conn_resume(conn);
+                    }
+                }
+            }
+            while (!bk->waiters.empty() && list_len(bk->key) > 0) {
+                Conn *conn = bk->waiters.front();
+                conn_unblock(conn);
+                conn_resume(conn);
+            }
+            bk->ready = false;
+            if (bk->waiters.empty()) {
+                hm_delete(&g_blocked.keys, &bk->node, &hnode_same);
+                delete bk;
+            }
+        }
+    }
+    serving = false;
+}
+
+// application callback when the socket is writable
+static void handle_write_phase(Conn *conn);
+static void conn_mark_dirty(Conn *conn);
+static void handle_write(Conn *conn) {
+    uint32_t prev = loop_phase_enter(PHASE_WRITE);
+    handle_write_phase(conn);
+    loop_phase_enter(prev);
+}
+static void handle_write_phase(Conn *conn) {
+    assert(out_size(conn->outgoing) > 0);
+    while (out_size(conn->outgoing) > 0) {
+        // the serialized bytes interleaved with the referenced values
+        struct iovec iov[k_max_iov];
+        struct msghdr mh = {};
+        mh.msg_iov = iov;
+        mh.msg_iovlen = out_iovecs(conn->outgoing, iov, k_max_iov);
+        size_t nbytes = 0;
+        for (size_t i = 0; i < mh.msg_iovlen; i++) {
+            nbytes += iov[i].iov_len;
+        }
+        // more to come right after this call, let the kernel fill the packets
+        int flags = MSG_NOSIGNAL;
+        if (nbytes < out_size(conn->outgoing)) {
+            flags |= MSG_MORE;
+        }
+        ssize_t rv = sendmsg(conn->fd, &mh, flags);  /*Attempts to write everything in the outgoing buffer to the socket.*/
+        g_stats.write_calls++;
+        if (rv < 0 && errno == EAGAIN) {   /*This is the expected behavior for non-blocking I/O. It means the kernel's write buffer is full. We simply return and try again later.*/
+            return; // actually not ready
+        }
+        if (rv < 0) {
+            msg_errno("write() error");
+            conn->want_close = true;    // error handling
+            return;
+        }
+
+        // remove written data from `outgoing`
+        g_stats.net_out_bytes += (size_t)rv;
+        out_consume(conn->outgoing, (size_t)rv);      /*Removes the bytes that were successfully written.*/
+        if ((size_t)rv < nbytes) {
+            break;  // the socket buffer is full
+        }
+    }
+
+    // update the readiness intention
+    if (out_size(conn->outgoing) == 0) {    // all data written
+        conn->want_read = true;
+        conn->want_write = false;  /*State Update: If the buffer is empty (all data sent), we switch flags to want_read (wait for next request) and stop want_write.*/
+    } // else: want write
+
+    // resume the requests held back by the output limits
+    if (!conn->incoming.empty()) {
+        while (try_one_request(conn)) {}
+        if (out_size(conn->outgoing) > 0) {
+            conn->want_read = false;
+            conn->want_write = true;
+            conn_mark_dirty(conn);
+        }
+    }
+}
+// queue the connection for the flush pass at the end of the iteration
+static void conn_mark_dirty(Conn *conn) {
+    if (!conn->dirty && !conn->uring_closing) {
+        conn->dirty = true;
+        g_dirty.push_back(conn);
+    }
+}
+static void conn_destroy(Conn *conn) {
+    if (conn->repl_role != REPL_ROLE_CLIENT) {
+        repl_conn_gone(conn);
+    }
+    if (conn->blocked) {
+        conn_unblock(conn);
+    }
+    pubsub_remove_all(conn, false);
+    pubsub_remove_all(conn, true);
+    if (conn->uring_inflight > 0) {
+        // The kernel still holds the socket and maybe our send buffer. Shutting down makes the
+        // pending ops complete, the last completion destroys the connection for real.
+        if (!conn->uring_closing) {
+            conn->uring_closing = true;
+            (void)shutdown(conn->fd, SHUT_RDWR);
+            dlist_detach(&conn->idle_node);
+            dlist_init(&conn->idle_node);   // so the final detach is a no-op
+        }
+        return;
+    }
+    for (ZCursor *cur : conn->cursors) {
+        if (cur) {
+            zcursor_close(cur);
+            delete cur;
+        }
+    }
+    if (conn->dirty) {
+        g_dirty.erase(std::find(g_dirty.begin(), g_dirty.end(), conn));
+    }
+    if (conn->out_soft_since_ms) {
+        g_stats.clients_output_paused--;
+    }
+    // drop the references to values
+    out_clear(conn->outgoing);
+    out_clear(conn->sending);
+    (void)close(conn->fd);
+    g_data.fd2conn[conn->fd] = NULL;
+    g_stats.conns_current--;
+    dlist_detach(&conn->idle_node);
+    delete conn;
+}
+// application callback when the socket is readable
+static void handle_read_once(Conn *conn, bool *more);
+static void handle_read(Conn *conn) {
+    // A full buffer means the client has probably sent more, so read again (a bounded
+    // number of times) instead of waiting for the next iteration. A short read costs
+    // no extra syscall, which matters for request-response clients.
+    bool more = true;
+    for (uint32_t i = 0; i < k_max_reads && more && !conn->want_close; i++) {
+        handle_read_once(conn, &more);
+    }
+    // update the readiness intention
+    if (out_size(conn->outgoing) > 0) {     // has a response
+        conn->want_read = false;
+        conn->want_write = true;
+        // Not written right away, the flush pass at the end of the
+        // iteration writes everything this connection produced.
+        conn_mark_dirty(conn);
+    }   // else: want read
+}
+static void handle_read_once(Conn *conn, bool *more) {
+    *more = false;
+    // read some data
+    uint8_t buf[64 * 1024];
+    ssize_t rv = read(conn->fd, buf, sizeof(buf));    /*Reads as much data as available (up to 64KB) into a temporary stack buffer.*/
+    g_stats.read_calls++;
+    if (rv < 0 && errno == EAGAIN) {
+        return; // actually not ready
+    }
+    // handle IO error
+    if (rv < 0) {
+        msg_errno("read() error");
+        conn->want_close = true;
+        return; // want close
+    }
+    // handle EOF
+    if (rv == 0) {
+        if (conn->incoming.size() == 0) {
+            msg("client closed");
+        } else {
+            msg("unexpected EOF");
+        }
+        conn->want_close = true;
+        return; // want close
+    }
+    // got some new data
+    g_stats.net_in_bytes += (size_t)rv;
+    buf_append(conn->incoming, buf, (size_t)rv);    /*Moves the data from the temporary buffer into the connection's incoming queue.*/
+
+    // parse requests and generate responses
+    while (try_one_request(conn)) {}
+    // Q: Why calling this in a loop? See the explanation of "pipelining".
+    /*Pipelining Loop: This is a key optimization. A client might send 3 requests back-to-back in one packet. 
+    This loop processes all available complete requests in the buffer before returning.*/
+    *more = (size_t)rv == sizeof(buf) && out_size(conn->outgoing) < k_max_msg;
+}
+const uint64_t k_idle_timeout_ms = 5 * 1000; // 5 seconds ,Sets the strict timeout limit (5 seconds in this code).
+
+// move the client to the back of the idle line, a blocked or subscribed one is out of it
+static void conn_touch(Conn *conn) {
+    if (conn->blocked || conn_subscribed(conn)) {
+        return;
+    }
+    conn->last_active_ms = get_monotonic_msec();
+    dlist_detach(&conn->idle_node);
+    dlist_insert_before(&g_data.idle_list, &conn->idle_node);
+}
+
+static uint32_t next_timer_ms() {
+    uint64_t now_ms = get_monotonic_msec();
+    uint64_t next_ms = (uint64_t)-1; // Set to the absolute maximum possible value
+
+    // 1. Check idle connections
+    if (!dlist_empty(&g_data.idle_list)) {
+        Conn *conn = container_of(g_data.idle_list.next, Conn, idle_node);
+        next_ms = conn->last_active_ms + k_idle_timeout_ms;
+    }
+
+    // 2. Check the TTL heap (Compare it to the idle connection timer)
+    // replicas wait for the primary's DEL instead
+    if (!g_repl.primary_port && !g_data.heap.empty() && g_data.heap[0].val < next_ms) {
+        next_ms = g_data.heap[0].val; // The heap timer is sooner, use this one instead!
+    }
+
+    // 3. Eviction that ran out of its time budget continues right away
+    if (g_data.evict_pending) {
+        return 0;
+    }
+
+    // 4. Clients over the output soft limit, rare enough to just scan for them
+    for (size_t i = 0; g_stats.clients_output_paused > 0 && i < g_data.fd2conn.size(); i++) {
+        Conn *conn = g_data.fd2conn[i];
+        if (conn && conn->out_soft_since_ms && !conn->uring_closing) {
+            uint64_t deadline = conn->out_soft_since_ms + (uint64_t)g_config.client_output_soft_ms;
+            next_ms = std::min(next_ms, deadline);
+        }
+    }
+
+    // 5. Blocked clients that asked for a timeout
+    if (!g_blocked.timeouts.empty()) {
+        next_ms = std::min(next_ms, g_blocked.timeouts[0].val);
+    }
+
+    // 6. Replication links
+    if (!g_repl.closing.empty()) {
+        return 0;
+    }
+    if (g_repl.primary_port || !g_repl.replicas.empty()) {
+        next_ms = std::min(next_ms, g_repl.next_cron_ms);
+    }
+
+    if (next_ms == (uint64_t)-1) {
+        return -1;  // no timers at all
+    }
+    if (next_ms <= now_ms) {
+        return 0;   // timer already expired
+    }
+    return (int32_t)(next_ms - now_ms);
+}
+static void process_timers() {
+    uint64_t now_ms = get_monotonic_msec();
+
+    // 1. Clean up expired idle connections (unchanged)
+    while (!dlist_empty(&g_data.idle_list)) {
+       // Look at the oldest connection at the front of the line
+        Conn *conn = container_of(g_data.idle_list.next, Conn, idle_node);
+        uint64_t next_timeout = conn->last_active_ms + k_idle_timeout_ms;
+
+        if (next_timeout > now_ms) {
+            // Not expired yet! Since the list is ordered by age, 
+            // if this one hasn't expired, nobody else behind it has either.
+            break;
+        }
+
+        // Connection is too old, kick them out to free up resources
+        msg("idle connection expired");
+        conn_destroy(conn);
+    }
+
+    // stuck over the output soft limit, the client doesn't read at all
+    for (size_t i = 0; g_stats.clients_output_paused > 0 && i < g_data.fd2conn.size(); i++) {
+        Conn *conn = g_data.fd2conn[i];
+        if (conn && conn->out_soft_since_ms && !conn->uring_closing) {
+            conn_check_output(conn);
+            if (conn->want_close) {
+                conn_destroy(conn);
+            }
+        }
+    }
+
+    // blocked clients that waited long enough get their nil
+    while (!g_blocked.timeouts.empty() && g_blocked.timeouts[0].val <= now_ms) {
+        Conn *conn = container_of(g_blocked.timeouts[0].ref, Conn, block_heap_idx);
+        conn_unblock(conn);
+        conn->block_timed_out = true;
+        conn_resume(conn);
+    }
+
+    // replication links dropped by REPLICAOF, and the periodic work
+    while (!g_repl.closing.empty()) {
+        conn_destroy(g_repl.closing.back());    // leaves `closing`
+    }
+    if ((g_repl.primary_port || !g_repl.replicas.empty()) && now_ms >= g_repl.next_cron_ms) {
+        repl_cron();
+        // a connect() in progress is polled more often
+        uint64_t every = g_repl.state == REPL_CONNECTING ? 10 : k_repl_cron_ms;
+        g_repl.next_cron_ms = get_monotonic_msec() + every;
+    }
+    if (g_repl.primary_port) {
+        return;     // no expiration or eviction of its own, the primary sends a DEL
+    }
+
+    // over maxmemory, from a write or from CONFIG SET, a bit at a time
+    if (g_config.maxmemory) {
+        evict_keys();
+    }
+
+    // 2. Clean up expired database keys from the Heap (NEW)
+    const size_t k_max_works = 2000; // Don't delete more than 2000 at once to prevent lag
+    size_t nworks = 0;
+    const std::vector<HeapItem> &heap = g_data.heap;
+    
+    while (!heap.empty() && heap[0].val < now_ms) {
+        Entry *ent = container_of(heap[0].ref, Entry, heap_idx); // Find the database entry
+        
+        // Remove it from the database hashtable
+        HNode *node = hm_delete(&g_data.db, &ent->node, &hnode_same);
+        if (!node) {
+            // SAFE FALLBACK: The key was somehow already missing. 
+            // Just delete the memory to clean up the ghost timer and move on.
+            ent->heap_idx = -1;
+            entry_del(ent);
+            continue;
+        }
+        
+        // Actually delete the memory (this also safely removes it from the heap!)
+        repl_feed_del(ent);
+        entry_del(ent); 
+        g_stats.expired_keys++;
+        
+        if (nworks++ >= k_max_works) {
+            break; // Stop if we've been deleting for too long
+        }
+    }
+}
+/*static void do_something(int connfd) {
+    char rbuf[64] = {};
+    ssize_t n = read(connfd, rbuf, sizeof(rbuf) - 1);
+    if (n <= 0) {
+        fprintf(stderr, "read() error or client closed\n");
+        return;
+    }
+    rbuf[n] = '\0';
+    fprintf(stderr, "client says: %s\n", rbuf);
+
+    char wbuf[] = "world";
+    write(connfd, wbuf, strlen(wbuf));
+}  */
+
+/*The default backend: rebuild a pollfd list every iteration and call read()/write() per ready socket.*/
+static void run_poll_loop(int fd) {
+    std::vector<struct pollfd> poll_args;  /*A list of file descriptors we want to monitor.*/
+    loop_wake();
+    while(true){
+        poll_args.clear();   /*We clear and rebuild this list every loop iteration because the state (want_read/want_write) changes constantly.*/
+        struct pollfd pfd = {fd, POLLIN, 0};  /*Listening Socket: Always added first, always watching for POLLIN (new connections).*/
+        poll_args.push_back(pfd);
+        for (Conn *conn : g_data.fd2conn ) {
+            /*Checks every active connection.*/
+            if (!conn) continue;
+            struct pollfd pfd = {conn->fd, POLLERR, 0};  /*Converts our application flags (want_read) into poll flags (POLLIN).*/
+            if (conn->want_read) {
+                pfd.events |= POLLIN;  /*POLLIN: Notify me when data is available to read.*/
+            }
+            if (conn->want_write) {
+                pfd.events |= POLLOUT;      /*POLLOUT: Notify me when space is available to write.*/
+            }
+            poll_args.push_back(pfd);
+        }
+        /*Instead of passing -1 to poll() (which means "sleep forever until a message arrives"), we now pass timeout_ms. The server will wake up automatically if the timer runs out.*/
+        int32_t timeout_ms = next_timer_ms();
+        loop_iteration_end();
+        int rv = poll(poll_args.data(), (nfds_t)poll_args.size(), timeout_ms);  /*The Blocking Point. The program stops here and sleeps until the OS wakes it up because an event occurred on one of the FDs (or an error).*/
+        loop_wake();
+        if (rv < 0 && errno == EINTR) {
+            continue;   // not an error
+        }
+        if (rv < 0) {
+            die("poll");
+        }
+        // handle the listening socket
+        if (poll_args[0].revents) {        /*Checks the first entry (listening socket). If revents (returned events) is non-zero, it means a new client is waiting. We accept them and add them to the fd2conn map.*/
+            (void)handle_accept(fd);
+        }  
+        // handle connection sockets
+        for (size_t i = 1; i < poll_args.size(); ++i) {  /*Loops through the rest of the sockets.*/
+            uint32_t ready = poll_args[i].revents;
+            Conn *conn = g_data.fd2conn[poll_args[i].fd];
+            //If a client did something, refresh their timer!
+            /*If a connection was active (they sent or received data), we update their timestamp to "now", rip them out of their current spot in line (dlist_detach), and shove them to the back of the line (dlist_insert_before).*/
+            conn_touch(conn);
+            
+            if (ready & POLLIN) {      /*If POLLIN is set, call handle_read.*/
+                loop_phase_enter(PHASE_READ);
+                handle_read(conn); 
+            }
+            if (ready & POLLOUT) {     /*If POLLOUT is set, call handle_write.*/
+                handle_write(conn);
+            }
+            
+            // close the socket from socket error or application logic
+            if ((ready & POLLERR) || conn->want_close) {
+                conn_destroy(conn);
+            }
+
+    }
+        // flush everything the ready sockets produced
+        std::vector<Conn *> dirty;
+        dirty.swap(g_dirty);
+        for (Conn *conn : dirty) {
+            conn->dirty = false;
+            if (out_size(conn->outgoing) > 0) {
+                handle_write(conn);
+            }
+            if (conn->want_close) {
+                conn_destroy(conn);
+            }
+        }
+    // Kick out anyone who expired while we were sleeping
+    //Calls our cleanup function at the end of every loop.
+        loop_phase_enter(PHASE_TIMERS);
+        process_timers();
+        loop_phase_enter(PHASE_POLL);
+}
+}
+
+/*The io_uring backend. A multishot accept and one multishot recv per connection stay armed in the
+kernel, received bytes land in the provided buffer ring, and all the sends of an iteration are
+queued as SQEs, so a single io_uring_enter() per iteration submits them and waits for more input.*/
+enum {
+    UOP_ACCEPT = 1,
+    UOP_RECV = 2,
+    UOP_SEND = 3,
+    UOP_CANCEL = 4,
+};
+const unsigned k_uring_entries = 4096;
+const uint32_t k_uring_nbufs = 4096;
+const uint32_t k_uring_buf_size = 16 * 1024;
+
+static URing g_uring;
+
+static uint64_t uring_udata(uint32_t op, int fd) {
+    return ((uint64_t)op << 32) | (uint32_t)fd;
+}
+
+static io_uring_sqe *uring_sqe() {
+    io_uring_sqe *sqe = uring_get_sqe(&g_uring);
+    if (!sqe) {
+        // the queue is full, submit without waiting and retry
+        if (uring_submit_and_wait(&g_uring, 0, -1) < 0) {
+            die("io_uring_enter");
+        }
+        sqe = uring_get_sqe(&g_uring);
+        assert(sqe);
+    }
+    return sqe;
+}
+
+static void uring_arm_accept(int fd) {
+    io_uring_sqe *sqe = uring_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = uring_udata(UOP_ACCEPT, fd);
+}
+
+static void uring_arm_recv(Conn *conn) {
+    io_uring_sqe *sqe = uring_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = g_uring.bgid;
+    sqe->user_data = uring_udata(UOP_RECV, conn->fd);
+    conn->uring_inflight++;
+    conn->uring_recv_armed = true;
+}
+
+// Read only while the output is under the soft limit. A multishot recv keeps going, so
+// pausing means cancelling it, and resuming arms a new one once the old one is gone.
+static void uring_update_recv(Conn *conn) {
+    if (conn->uring_closing || conn->want_close) {
+        return;
+    }
+    bool paused = conn->out_soft_since_ms != 0;
+    if (paused && conn->uring_recv_armed && !conn->uring_recv_cancelling) {
+        io_uring_sqe *sqe = uring_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = uring_udata(UOP_RECV, conn->fd);
+        sqe->user_data = uring_udata(UOP_CANCEL, conn->fd);
+        conn->uring_inflight++;
+        conn->uring_recv_cancelling = true;
+    } else if (!paused && !conn->uring_recv_armed) {
+        uring_arm_recv(conn);
+    }
+}
+
+// queue a send for everything in `outgoing`, unless one is already in flight
+static void uring_flush(Conn *conn) {
+    if (conn->uring_sending || conn->uring_closing) {
+        return;
+    }
+    if (out_size(conn->sending) == 0) {
+        if (out_size(conn->outgoing) == 0) {
+            return;
+        }
+        out_swap(conn->sending, conn->outgoing);
+    }
+    // the iovecs and the msghdr must stay put until the op completes
+    conn->send_iov.resize(k_max_iov);
+    struct msghdr &mh = conn->send_msg;
+    mh = {};
+    mh.msg_iov = conn->send_iov.data();
+    mh.msg_iovlen = out_iovecs(conn->sending, mh.msg_iov, k_max_iov);
+    io_uring_sqe *sqe = uring_sqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conn->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&mh;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = uring_udata(UOP_SEND, conn->fd);
+    conn->uring_sending = true;
+    conn->uring_inflight++;
+    g_stats.write_calls++;
+}
+
+static void uring_on_accept(int listen_fd, io_uring_cqe *cqe) {
+    if (cqe->res >= 0) {
+        int connfd = cqe->res;
+        struct sockaddr_in client_addr = {};
+        socklen_t addrlen = sizeof(client_addr);
+        (void)getpeername(connfd, (struct sockaddr *)&client_addr, &addrlen);
+        uint32_t ip = client_addr.sin_addr.s_addr;
+        fprintf(stderr, "new client from %u.%u.%u.%u:%u\n",
+            ip & 255, (ip >> 8) & 255, (ip >> 16) & 255, ip >> 24,
+            ntohs(client_addr.sin_port)
+        );
+        fd_set_nb(connfd);
+        uring_arm_recv(conn_new(connfd));
+    } else {
+        errno = -cqe->res;
+        msg_errno("accept() error");
+    }
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        uring_arm_accept(listen_fd);    // the multishot accept was terminated
+    }
+}
+
+static void uring_on_recv(Conn *conn, io_uring_cqe *cqe) {
+    bool more = cqe->flags & IORING_CQE_F_MORE;
+    if (!more) {
+        conn->uring_inflight--;
+        conn->uring_recv_armed = false;
+        conn->uring_recv_cancelling = false;
+    }
+    if (cqe->res > 0) {
+        assert(cqe->flags & IORING_CQE_F_BUFFER);
+        uint16_t bid = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        g_stats.read_calls++;
+        g_stats.net_in_bytes += (size_t)cqe->res;
+        if (!conn->uring_closing) {
+            buf_append(conn->incoming, uring_buf(&g_uring, bid), (size_t)cqe->res);
+            conn_touch(conn);
+            while (try_one_request(conn)) {}
+            if (out_size(conn->outgoing) > 0) {
+                conn_mark_dirty(conn);
+            }
+        }
+        uring_buf_recycle(&g_uring, bid);
+        uring_update_recv(conn);
+    } else if (cqe->res == -ENOBUFS || cqe->res == -ECANCELED) {
+        // ran out of provided buffers (they are recycled by now), or paused
+        uring_update_recv(conn);
+    } else if (cqe->res == 0) {
+        if (!conn->uring_closing) {
+            msg(conn->incoming.empty() ? "client closed" : "unexpected EOF");
+        }
+        conn->want_close = true;
+    } else {
+        if (!conn->uring_closing) {
+            errno = -cqe->res;
+            msg_errno("recv() error");
+        }
+        conn->want_close = true;
+    }
+}
+
+static void uring_on_send(Conn *conn, io_uring_cqe *cqe) {
+    conn->uring_inflight--;
+    conn->uring_sending = false;
+    if (cqe->res < 0) {
+        if (!conn->uring_closing) {
+            errno = -cqe->res;
+            msg_errno("send() error");
+        }
+        conn->want_close = true;
+        return;
+    }
+    g_stats.net_out_bytes += (size_t)cqe->res;
+    out_consume(conn->sending, (size_t)cqe->res);
+    // resume the requests held back by the output limits
+    if (!conn->uring_closing) {
+        while (try_one_request(conn)) {}
+        uring_update_recv(conn);
+    }
+    if (out_size(conn->sending) > 0 || out_size(conn->outgoing) > 0) {
+        conn_mark_dirty(conn);     // a short send, or more responses queued meanwhile
+    }
+}
+
+// returns false if the kernel lacks the features we need
+static bool run_uring_loop(int fd) {
+    int err = uring_init(&g_uring, k_uring_entries);
+    if (err == 0 && !(uring_has_op(&g_uring, IORING_OP_ACCEPT)
+        && uring_has_op(&g_uring, IORING_OP_RECV) && uring_has_op(&g_uring, IORING_OP_SENDMSG)
+        && uring_has_op(&g_uring, IORING_OP_ASYNC_CANCEL)))
+    {
+        err = -ENOSYS;
+    }
+    if (err == 0) {
+        err = uring_setup_bufs(&g_uring, 0, k_uring_nbufs, k_uring_buf_size);
+    }
+    if (err < 0) {
+        errno = -err;
+        msg_errno("io_uring is not available");
+        uring_destroy(&g_uring);
+        return false;
+    }
+    msg("using the io_uring backend");
+
+    uring_arm_accept(fd);
+    loop_wake();
+    while (true) {
+        // flush the responses produced by the last batch of completions
+        loop_phase_enter(PHASE_WRITE);
+        for (Conn *conn : g_dirty) {
+            conn->dirty = false;
+            uring_flush(conn);
+        }
+        g_dirty.clear();
+
+        int32_t timeout_ms = next_timer_ms();
+        loop_iteration_end();
+        err = uring_submit_and_wait(&g_uring, 1, timeout_ms);
+        loop_wake();
+        if (err < 0) {
+            errno = -err;
+            die("io_uring_enter");
+        }
+
+        loop_phase_enter(PHASE_READ);
+        while (io_uring_cqe *cqe = uring_peek_cqe(&g_uring)) {
+            uint32_t op = (uint32_t)(cqe->user_data >> 32);
+            int cfd = (int)(uint32_t)cqe->user_data;
+            if (op == UOP_ACCEPT) {
+                uring_on_accept(fd, cqe);
+            } else {
+                // the fd is only closed after its last op completes, so it still maps to the conn
+                Conn *conn = g_data.fd2conn[cfd];
+                assert(conn);
+                if (op == UOP_RECV) {
+                    uring_on_recv(conn, cqe);
+                } else if (op == UOP_SEND) {
+                    uring_on_send(conn, cqe);
+                } else {
+                    conn->uring_inflight--;     // UOP_CANCEL, the recv reports the result
+                }
+                if (conn->want_close || (conn->uring_closing && conn->uring_inflight == 0)) {
+                    conn_destroy(conn);
+                }
+            }
+            uring_cqe_seen(&g_uring);
+        }
+        loop_phase_enter(PHASE_TIMERS);
+        process_timers();
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    // command line: --name value, the same names as CONFIG SET
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        const ConfigVar *var = arg.substr(0, 2) == "--" ? config_lookup(arg.substr(2)) : NULL;
+        if (!var || i + 1 >= argc || !config_set(var, argv[i + 1])) {
+            fprintf(stderr, "bad argument: %s\n", argv[i]);
+            return 1;
+        }
+        i++;
+    }
+
+    int fd=socket(AF_INET, SOCK_STREAM, 0);
+    dlist_init(&g_data.idle_list);
+    g_stats.start_ms = get_monotonic_msec();
+    repl_new_id();
+    if (g_config.cluster_enabled) {
+        g_cluster.nodes.assign(1, "myself");
+        g_cluster.slots.resize(k_cluster_slots);
+        g_cluster.slot_keys.resize(k_cluster_slots);
+        for (DList &head : g_cluster.slot_keys) {
+            dlist_init(&head);
+        }
+        g_cluster.slot_count.resize(k_cluster_slots);
+    }
+    if(fd<0){
+        die("socket()");
+    }
+    int val=1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+    struct sockaddr_in addr={};
+    addr.sin_family=AF_INET;
+    addr.sin_port=htons((uint16_t)g_config.port);
+    addr.sin_addr.s_addr=htonl(INADDR_ANY);
+    int rv=bind(fd,(const struct sockaddr*)&addr, sizeof(addr));
+    if(rv){
+        die("bind()");
+    }
+    rv=listen(fd,SOMAXCONN);
+    if(rv){
+        die("listen()");
+    }
+  
+    if (g_config.io_backend == IO_URING && !run_uring_loop(fd)) {
+        msg("falling back to poll()");
+        g_config.io_backend = IO_POLL;
+    }
+    run_poll_loop(fd);
+    return 0;
 }
\ No newline at end of file
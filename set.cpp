@@ -0,0 +1,298 @@
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+#include <immintrin.h>
+// proj
+#include "set.h"
+#include "common.h"
+
+
+// ---------------------------------------------------------
+// intset encoding
+// ---------------------------------------------------------
+bool set_parse_int(const char *member, size_t len, int64_t *out) {
+    // "-0", "007" or "+1" would not print back the same, so they are strings
+    size_t pos = len > 0 && member[0] == '-' ? 1 : 0;
+    if (len == pos || len > 20 || (member[pos] == '0' && len > 1)) {
+        return false;
+    }
+    uint64_t val = 0;
+    for (size_t i = pos; i < len; i++) {
+        uint8_t digit = (uint8_t)(member[i] - '0');
+        if (digit > 9 || __builtin_mul_overflow(val, 10, &val) || __builtin_add_overflow(val, digit, &val)) {
+            return false;
+        }
+    }
+    uint64_t limit = pos ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    if (val > limit) {
+        return false;
+    }
+    *out = pos ? (int64_t)(0 - val) : (int64_t)val;
+    return true;
+}
+
+static size_t ints_find(Set *set, int64_t val) {
+    return (size_t)(std::lower_bound(set->ints, set->ints + set->count, val) - set->ints);
+}
+
+// the bytes of a member, `buf` holds the digits of an integer
+static size_t int_format(int64_t val, char (&buf)[24]) {
+    return (size_t)snprintf(buf, sizeof(buf), "%lld", (long long)val);
+}
+
+// ---------------------------------------------------------
+// table encoding
+// ---------------------------------------------------------
+static SetMember *member_new(const char *member, size_t len, uint64_t hcode) {
+    SetMember *node = (SetMember *)malloc(sizeof(SetMember) + len);
+    assert(node);
+    node->node.next = NULL;
+    node->node.hcode = hcode;
+    node->len = (uint32_t)len;
+    memcpy(&node->data[0], member, len);
+    return node;
+}
+
+// a helper structure for the hashtable lookup
+struct SKey {
+    HNode node;
+    const char *member = NULL;
+    size_t len = 0;
+};
+
+static void skey_init(SKey *key, const char *member, size_t len) {
+    key->node.hcode = str_hash((const uint8_t *)member, len);
+    key->member = member;
+    key->len = len;
+}
+
+static bool scmp(HNode *node, HNode *key) {
+    SetMember *sm = container_of(node, SetMember, node);
+    SKey *skey = container_of(key, SKey, node);
+    return sm->len == skey->len && memcmp(sm->data, skey->member, sm->len) == 0;
+}
+
+static void table_insert(Set *set, SetMember *node) {
+    hm_insert(&set->hmap, &node->node);
+    set->node_mem += sizeof(SetMember) + node->len;
+}
+
+// ---------------------------------------------------------
+// both
+// ---------------------------------------------------------
+bool set_add(Set *set, const char *member, size_t len) {
+    if (!set->is_table) {
+        int64_t val = 0;
+        if (set_parse_int(member, len, &val)) {
+            size_t pos = ints_find(set, val);
+            if (pos < set->count && set->ints[pos] == val) {
+                return false;
+            }
+            set->ints = (int64_t *)realloc(set->ints, (set->count + 1) * sizeof(int64_t));
+            assert(set->ints);
+            memmove(&set->ints[pos + 1], &set->ints[pos], (set->count - pos) * sizeof(int64_t));
+            set->ints[pos] = val;
+            set->count++;
+            return true;
+        }
+        set_to_table(set);
+    }
+    SKey key;
+    skey_init(&key, member, len);
+    if (hm_lookup(&set->hmap, &key.node, &scmp)) {
+        return false;
+    }
+    table_insert(set, member_new(member, len, key.node.hcode));
+    set->count++;
+    return true;
+}
+
+bool set_del(Set *set, const char *member, size_t len) {
+    if (!set->is_table) {
+        int64_t val = 0;
+        if (!set_parse_int(member, len, &val)) {
+            return false;
+        }
+        size_t pos = ints_find(set, val);
+        if (pos == set->count || set->ints[pos] != val) {
+            return false;
+        }
+        memmove(&set->ints[pos], &set->ints[pos + 1], (set->count - pos - 1) * sizeof(int64_t));
+        set->count--;
+        return true;
+    }
+    SKey key;
+    skey_init(&key, member, len);
+    HNode *found = hm_delete(&set->hmap, &key.node, &scmp);
+    if (!found) {
+        return false;
+    }
+    SetMember *node = container_of(found, SetMember, node);
+    set->node_mem -= sizeof(SetMember) + node->len;
+    free(node);
+    set->count--;
+    return true;
+}
+
+bool set_has(Set *set, const char *member, size_t len) {
+    if (!set->is_table) {
+        int64_t val = 0;
+        if (!set_parse_int(member, len, &val)) {
+            return false;
+        }
+        size_t pos = ints_find(set, val);
+        return pos < set->count && set->ints[pos] == val;
+    }
+    SKey key;
+    skey_init(&key, member, len);
+    return hm_lookup(&set->hmap, &key.node, &scmp) != NULL;
+}
+
+void set_to_table(Set *set) {
+    if (set->is_table) {
+        return;
+    }
+    for (size_t i = 0; i < set->count; i++) {
+        char buf[24];
+        size_t len = int_format(set->ints[i], buf);
+        table_insert(set, member_new(buf, len, str_hash((const uint8_t *)buf, len)));
+    }
+    free(set->ints);
+    set->ints = NULL;
+    set->is_table = true;
+}
+
+static bool cb_collect(HNode *node, void *arg) {
+    ((std::vector<HNode *> *)arg)->push_back(node);
+    return true;
+}
+
+void set_clear(Set *set) {
+    free(set->ints);
+    set->ints = NULL;
+    // hm_foreach() follows HNode::next after the callback, so free afterwards
+    std::vector<HNode *> nodes;
+    hm_foreach(&set->hmap, &cb_collect, &nodes);
+    for (HNode *node : nodes) {
+        free(container_of(node, SetMember, node));
+    }
+    hm_clear(&set->hmap);
+    set->count = 0;
+    set->node_mem = 0;
+    set->is_table = false;
+}
+
+size_t set_mem(Set *set) {
+    if (!set->is_table) {
+        return set->count * sizeof(int64_t);
+    }
+    return set->node_mem + hm_mem(&set->hmap);
+}
+
+struct ForeachCtx {
+    bool (*f)(const char *, size_t, void *);
+    void *arg;
+};
+
+static bool cb_foreach(HNode *node, void *arg) {
+    ForeachCtx *ctx = (ForeachCtx *)arg;
+    SetMember *sm = container_of(node, SetMember, node);
+    return ctx->f(sm->data, sm->len, ctx->arg);
+}
+
+void set_foreach(Set *set, bool (*f)(const char *, size_t, void *), void *arg) {
+    if (!set->is_table) {
+        for (size_t i = 0; i < set->count; i++) {
+            char buf[24];
+            size_t len = int_format(set->ints[i], buf);
+            if (!f(buf, len, arg)) {
+                return;
+            }
+        }
+        return;
+    }
+    ForeachCtx ctx = {f, arg};
+    hm_foreach(&set->hmap, &cb_foreach, &ctx);
+}
+
+// ---------------------------------------------------------
+// intersection kernels
+// ---------------------------------------------------------
+// In all of them a member of `a` is written after it is read and never ahead of where `a` is
+// read next, which is what makes `out == a` work.
+
+size_t intset_intersect_scalar(const int64_t *a, size_t na, const int64_t *b, size_t nb, int64_t *out) {
+    size_t i = 0, j = 0, k = 0;
+    while (i < na && j < nb) {
+        if (a[i] < b[j]) {
+            i++;
+        } else if (b[j] < a[i]) {
+            j++;
+        } else {
+            out[k++] = a[i];
+            i++;
+            j++;
+        }
+    }
+    return k;
+}
+
+/*4 members of each side per step: every lane of `a` is compared with every lane of `b` by
+rotating `b` three times, and the side with the smaller last member moves on (both if equal).
+A member of `a` matches at most one of `b`, so a block that stays never matches twice.*/
+__attribute__((target("avx2")))
+static size_t intersect_avx2(const int64_t *a, size_t na, const int64_t *b, size_t nb, int64_t *out) {
+    size_t i = 0, j = 0, k = 0;
+    while (i + 4 <= na && j + 4 <= nb) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)&a[i]);
+        __m256i vb = _mm256_loadu_si256((const __m256i *)&b[j]);
+        __m256i eq = _mm256_cmpeq_epi64(va, vb);
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x39)));
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x4e)));
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x93)));
+        uint32_t mask = (uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(eq));
+        int64_t amax = a[i + 3], bmax = b[j + 3];
+        while (mask) {
+            out[k++] = a[i + (size_t)__builtin_ctz(mask)];
+            mask &= mask - 1;
+        }
+        i += amax <= bmax ? 4 : 0;
+        j += bmax <= amax ? 4 : 0;
+    }
+    return k + intset_intersect_scalar(a + i, na - i, b + j, nb - j, out + k);
+}
+
+// one side is much smaller: binary search its members in the other instead of a merge
+const size_t k_gallop_ratio = 32;
+
+static size_t intersect_gallop(const int64_t *small, size_t ns, const int64_t *big, size_t nb,
+    bool out_small, int64_t *out)
+{
+    size_t k = 0;
+    const int64_t *lo = big;
+    for (size_t i = 0; i < ns && lo < big + nb; i++) {
+        lo = std::lower_bound(lo, big + nb, small[i]);
+        if (lo < big + nb && *lo == small[i]) {
+            out[k++] = out_small ? small[i] : *lo;
+            lo++;
+        }
+    }
+    return k;
+}
+
+size_t intset_intersect(const int64_t *a, size_t na, const int64_t *b, size_t nb, int64_t *out) {
+    if (na * k_gallop_ratio < nb) {
+        return intersect_gallop(a, na, b, nb, true, out);
+    }
+    if (nb * k_gallop_ratio < na) {
+        return intersect_gallop(b, nb, a, na, false, out);
+    }
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (has_avx2) {
+        return intersect_avx2(a, na, b, nb, out);
+    }
+    return intset_intersect_scalar(a, na, b, nb, out);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hashtable.h"
+
+
+/*A set value (unordered, no duplicates). While every member is an integer in its canonical form
+and there are few of them, the set is an intset: a sorted array of int64, 8 bytes per member and
+no per-member allocation, where intersections are merges. A member that is not an integer, or
+more members than the caller allows, moves it into an HMap of SetMembers for good.*/
+struct Set {
+    int64_t *ints = NULL;       // intset encoding: sorted, `count` of them
+    HMap hmap;                  // table encoding, SetMember::node
+    size_t count = 0;           // members, in either encoding
+    size_t node_mem = 0;        // bytes of the SetMembers, see set_mem()
+    bool is_table = false;
+};
+// a member of the table encoding, the bytes are inline like HashField
+struct SetMember {
+    HNode   node;
+    uint32_t len = 0;
+    char    data[0];
+};
+
+// returns whether the member is new, a non-integer one makes the set a table
+bool   set_add(Set *set, const char *member, size_t len);
+bool   set_del(Set *set, const char *member, size_t len);
+bool   set_has(Set *set, const char *member, size_t len);
+void   set_to_table(Set *set);
+void   set_clear(Set *set);
+size_t set_mem(Set *set);       // bytes of the members and the index, for maxmemory
+// invoke the callback on each member until it returns false, in order for an intset
+void   set_foreach(Set *set, bool (*f)(const char *member, size_t len, void *arg), void *arg);
+
+// whether the member can live in an intset: an int64 that prints back as the same bytes
+bool   set_parse_int(const char *member, size_t len, int64_t *out);
+/*The common members of two sorted arrays, written to `out` (room for the smaller one, may be
+`a`), returns how many. The AVX2 merge is used when the CPU has it.*/
+size_t intset_intersect(const int64_t *a, size_t na, const int64_t *b, size_t nb, int64_t *out);
+size_t intset_intersect_scalar(const int64_t *a, size_t na, const int64_t *b, size_t nb, int64_t *out);
@@ -0,0 +1,300 @@
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+// proj
+#include "stream.h"
+#include "common.h"
+
+
+// ---------------------------------------------------------
+// encoding
+// ---------------------------------------------------------
+// LEB128: 7 bits per byte, the high bit says another byte follows
+static uint32_t varint_put(uint8_t *p, uint64_t val) {
+    uint32_t n = 0;
+    while (val >= 0x80) {
+        p[n++] = (uint8_t)(val | 0x80);
+        val >>= 7;
+    }
+    p[n++] = (uint8_t)val;
+    return n;
+}
+
+static uint32_t varint_len(uint64_t val) {
+    uint32_t n = 1;
+    while (val >= 0x80) {
+        val >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static uint64_t varint_get(const uint8_t *p, uint32_t *pos) {
+    uint64_t val = 0;
+    for (uint32_t shift = 0;; shift += 7) {
+        uint8_t byte = p[(*pos)++];
+        val |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return val;
+        }
+    }
+}
+
+/*An entry: [ms - base.ms][seq, minus base.seq if the ms are the same][nfields], then each field
+and value as [len][bytes], all numbers varints. Returns the offset of the next entry.*/
+static uint32_t entry_at(const SBlock *b, uint32_t pos, SEntry *ent) {
+    const uint8_t *p = b->data;
+    uint64_t dms = varint_get(p, &pos);
+    uint64_t seq = varint_get(p, &pos);
+    ent->id.ms = b->base.ms + dms;
+    ent->id.seq = dms ? seq : b->base.seq + seq;
+    ent->nfields = (uint32_t)varint_get(p, &pos);
+    ent->fields = p + pos;
+    for (uint32_t i = 0; i < ent->nfields; i++) {
+        pos += (uint32_t)varint_get(p, &pos);
+    }
+    return pos;
+}
+
+std::string_view sentry_field(const SEntry &ent, size_t *pos) {
+    uint32_t at = (uint32_t)*pos;
+    uint32_t len = (uint32_t)varint_get(ent.fields, &at);
+    *pos = at + len;
+    return std::string_view((const char *)ent.fields + at, len);
+}
+
+// ---------------------------------------------------------
+// blocks
+// ---------------------------------------------------------
+static SBlock *block_of(AVLNode *node) {
+    return node ? container_of(node, SBlock, tree) : NULL;
+}
+
+static SBlock *block_next(SBlock *b, int64_t offset) {
+    return block_of(avl_offset(&b->tree, offset));
+}
+
+static SBlock *block_first(Stream *s) {
+    AVLNode *node = s->root;
+    while (node && node->left) {
+        node = node->left;
+    }
+    return block_of(node);
+}
+
+// the last block with a base <= `id`, NULL if all are greater
+static SBlock *block_seekle(Stream *s, StreamID id) {
+    AVLNode *found = NULL;
+    for (AVLNode *node = s->root; node;) {
+        if (sid_less(id, block_of(node)->base)) {
+            node = node->left;
+        } else {
+            found = node;
+            node = node->right;
+        }
+    }
+    return block_of(found);
+}
+
+// a new tail, the rightmost node since IDs only grow
+static SBlock *block_new(Stream *s, StreamID base, uint32_t cap) {
+    SBlock *b = (SBlock *)malloc(sizeof(SBlock) + cap);
+    assert(b);
+    avl_init(&b->tree);
+    b->base = base;
+    b->count = 0;
+    b->used = 0;
+    b->cap = cap;
+    AVLNode *parent = s->root;
+    while (parent && parent->right) {
+        parent = parent->right;
+    }
+    if (parent) {
+        parent->right = &b->tree;
+        b->tree.parent = parent;
+    }
+    s->root = avl_fix(&b->tree);
+    s->tail = b;
+    s->mem += sizeof(SBlock) + cap;
+    return b;
+}
+
+// realloc() may move the block, so its tree neighbours are pointed at the new address
+static SBlock *block_resize(Stream *s, SBlock *b, uint32_t cap) {
+    AVLNode *parent = b->tree.parent;
+    bool is_left = parent && parent->left == &b->tree;
+    bool is_tail = s->tail == b;
+    s->mem = s->mem - b->cap + cap;
+    b = (SBlock *)realloc(b, sizeof(SBlock) + cap);
+    assert(b);
+    b->cap = cap;
+    AVLNode *node = &b->tree;
+    if (!parent) {
+        s->root = node;
+    } else if (is_left) {
+        parent->left = node;
+    } else {
+        parent->right = node;
+    }
+    if (node->left) {
+        node->left->parent = node;
+    }
+    if (node->right) {
+        node->right->parent = node;
+    }
+    if (is_tail) {
+        s->tail = b;
+    }
+    return b;
+}
+
+static void block_free(Stream *s, SBlock *b) {
+    s->root = avl_del(&b->tree);
+    s->count -= b->count;
+    s->mem -= sizeof(SBlock) + b->cap;
+    if (s->tail == b) {
+        s->tail = NULL;     // trimmed to nothing, the next entry starts a block
+    }
+    free(b);
+}
+
+// ---------------------------------------------------------
+// the stream
+// ---------------------------------------------------------
+void stream_append(Stream *s, StreamID id, const std::string_view *fields, size_t n,
+    uint32_t max_bytes, uint32_t max_entries)
+{
+    assert(sid_less(s->last_id, id));
+    SBlock *b = s->tail;
+    // the size, with the ID relative to the block it would go into
+    uint32_t fsize = varint_len(n);
+    for (size_t i = 0; i < n; i++) {
+        fsize += varint_len(fields[i].size()) + (uint32_t)fields[i].size();
+    }
+    auto id_size = [&](StreamID base) {
+        uint64_t dms = id.ms - base.ms;
+        return varint_len(dms) + varint_len(dms ? id.seq : id.seq - base.seq);
+    };
+    if (!b || b->count >= max_entries || b->used + id_size(b->base) + fsize > max_bytes) {
+        uint32_t size = id_size(id) + fsize;
+        b = block_new(s, id, std::max(size, std::min((uint32_t)64, max_bytes)));
+    }
+    uint32_t size = id_size(b->base) + fsize;
+    if (b->used + size > b->cap) {
+        b = block_resize(s, b, std::max(b->used + size, std::min(b->cap * 2, max_bytes)));
+    }
+    uint8_t *p = b->data + b->used;
+    uint64_t dms = id.ms - b->base.ms;
+    p += varint_put(p, dms);
+    p += varint_put(p, dms ? id.seq : id.seq - b->base.seq);
+    p += varint_put(p, n);
+    for (size_t i = 0; i < n; i++) {
+        p += varint_put(p, fields[i].size());
+        memcpy(p, fields[i].data(), fields[i].size());
+        p += fields[i].size();
+    }
+    assert(p == b->data + b->used + size);
+    b->used += size;
+    b->count++;
+    s->count++;
+    s->last_id = id;
+}
+
+void stream_range(Stream *s, StreamID start, StreamID end, bool rev,
+    bool (*f)(const SEntry &, void *), void *arg)
+{
+    if (sid_less(end, start)) {
+        return;
+    }
+    if (!rev) {
+        // from the block that may hold `start`, or the first one
+        SBlock *b = block_seekle(s, start);
+        b = b ? b : block_first(s);
+        for (; b; b = block_next(b, +1)) {
+            SEntry ent;
+            for (uint32_t pos = 0, i = 0; i < b->count; i++) {
+                pos = entry_at(b, pos, &ent);
+                if (sid_less(ent.id, start)) {
+                    continue;
+                }
+                if (sid_less(end, ent.id) || !f(ent, arg)) {
+                    return;
+                }
+            }
+        }
+        return;
+    }
+    // entries only decode forward, so a block's offsets are collected before going backwards
+    std::vector<uint32_t> offsets;
+    for (SBlock *b = block_seekle(s, end); b; b = block_next(b, -1)) {
+        offsets.clear();
+        SEntry ent;
+        for (uint32_t pos = 0, i = 0; i < b->count; i++) {
+            offsets.push_back(pos);
+            pos = entry_at(b, pos, &ent);
+        }
+        for (size_t i = offsets.size(); i > 0; i--) {
+            entry_at(b, offsets[i - 1], &ent);
+            if (sid_less(end, ent.id)) {
+                continue;
+            }
+            if (sid_less(ent.id, start) || !f(ent, arg)) {
+                return;
+            }
+        }
+    }
+}
+
+size_t stream_trim(Stream *s, size_t maxlen, StreamID minid, bool approx) {
+    size_t before = s->count;
+    while (SBlock *b = block_first(s)) {
+        // whole blocks: what's left is still enough, or the next block starts at or below `minid`
+        SBlock *next = block_next(b, +1);
+        if (s->count - b->count >= maxlen || (next && !sid_less(minid, next->base))) {
+            block_free(s, b);
+            continue;
+        }
+        if (approx) {
+            break;
+        }
+        // then the front of the oldest one
+        uint32_t pos = 0, k = 0;
+        while (k < b->count) {
+            SEntry ent;
+            uint32_t after = entry_at(b, pos, &ent);
+            if (s->count - k <= maxlen && !sid_less(ent.id, minid)) {
+                break;
+            }
+            pos = after;
+            k++;
+        }
+        if (k == b->count) {
+            block_free(s, b);
+            continue;
+        }
+        if (k > 0) {
+            memmove(b->data, b->data + pos, b->used - pos);
+            b->used -= pos;
+            b->count -= k;
+            s->count -= k;
+            if (b->used < b->cap / 4) {
+                block_resize(s, b, b->used);    // mostly trimmed
+            }
+        }
+        break;
+    }
+    return before - s->count;
+}
+
+void stream_clear(Stream *s) {
+    while (SBlock *b = block_first(s)) {
+        block_free(s, b);
+    }
+    assert(s->count == 0 && s->mem == 0);
+}
+
+size_t stream_mem(Stream *s) {
+    return s->mem;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+#include "avl.h"
+
+
+/*A stream value, an append-only log of field-value entries under increasing IDs. Like Redis,
+entries are packed into blocks indexed by ID (an AVL tree of blocks here, where Redis uses a
+radix tree). An entry stores its ID as varint deltas from the block's base ID and its strings
+as varint lengths and bytes, so it costs a few bytes more than its data, and a range read is
+one tree seek followed by a sequential scan.*/
+struct StreamID {
+    uint64_t ms = 0;
+    uint64_t seq = 0;
+};
+
+inline bool sid_less(const StreamID &a, const StreamID &b) {
+    return a.ms != b.ms ? a.ms < b.ms : a.seq < b.seq;
+}
+
+struct SBlock {
+    AVLNode tree;           // Stream::root, ordered by `base`
+    StreamID base;          // the ID of its first entry when created, the entries are relative to it
+    uint32_t count = 0;     // entries
+    uint32_t used = 0;      // bytes of `data` in use
+    uint32_t cap = 0;       // bytes of `data` allocated
+    uint8_t data[0];
+};
+struct Stream {
+    AVLNode *root = NULL;   // SBlock::tree
+    SBlock *tail = NULL;    // the newest block, where entries are appended
+    size_t count = 0;       // entries, in all blocks
+    StreamID last_id;       // the newest ID ever added, a new one must be greater
+    size_t mem = 0;         // bytes of the blocks, see stream_mem()
+};
+// an entry, pointing into its block until the stream is modified
+struct SEntry {
+    StreamID id;
+    uint32_t nfields = 0;           // fields and values, twice the number of pairs
+    const uint8_t *fields = NULL;   // read with sentry_field()
+};
+
+/*Append an entry with an ID greater than `last_id`. It goes into a new block when the tail has
+`max_entries` or the entry doesn't fit in `max_bytes`.*/
+void   stream_append(Stream *s, StreamID id, const std::string_view *fields, size_t n,
+    uint32_t max_bytes, uint32_t max_entries);
+// the entries from `start` to `end`, both included, newest first if `rev`, until `f` returns false
+void   stream_range(Stream *s, StreamID start, StreamID end, bool rev,
+    bool (*f)(const SEntry &, void *), void *arg);
+// the next field or value of an entry, `*pos` starts at 0
+std::string_view sentry_field(const SEntry &ent, size_t *pos);
+/*Remove the oldest entries while there are more than `maxlen` or their IDs are below `minid`,
+return how many. `approx` only removes whole blocks, so it may leave a few more, like Redis' ~.*/
+size_t stream_trim(Stream *s, size_t maxlen, StreamID minid, bool approx);
+void   stream_clear(Stream *s);
+size_t stream_mem(Stream *s);   // bytes of the blocks, for maxmemory
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+# Bitmaps on strings, run against a server on port 1234.
+
+import random
+
+from resp_client import Conn, enc
+
+
+def popcount(data):
+    return sum(bin(x).count('1') for x in data)
+
+
+def bitpos(data, bit):
+    for i in range(len(data) * 8):
+        if (data[i // 8] >> (7 - i % 8)) & 1 == bit:
+            return i
+    return -1
+
+
+c = Conn()
+NIL = b'$-1'
+c.call('del', 'b_a', 'b_b', 'b_c', 'b_d', 'b_z', 'b_big')
+
+# bit 0 is the top bit of byte 0, like Redis
+assert c.call('setbit', 'b_a', '1', '1') == b':0'
+assert c.call('setbit', 'b_a', '7', '1') == b':0'
+assert c.call('get', 'b_a') == b'\x41'
+assert c.call('setbit', 'b_a', '7', '0') == b':1'
+assert c.call('getbit', 'b_a', '1') == b':1'
+assert c.call('getbit', 'b_a', '7') == b':0'
+assert c.call('getbit', 'b_a', '100000') == b':0'
+assert c.call('getbit', 'b_nokey', '5') == b':0'
+assert c.call('setbit', 'b_a', '-1', '1') == b'-ERR bit offset is not an integer or out of range.'
+assert c.call('setbit', 'b_a', '1', '2') == b'-ERR bit is not an integer or out of range.'
+
+# the string grows with zeroes, and SET/GET see the same bytes
+assert c.call('setbit', 'b_a', '23', '1') == b':0'
+assert c.call('get', 'b_a') == b'\x40\x00\x01'
+c.call('set', 'b_b', 'foobar')
+assert c.call('bitcount', 'b_b') == b':26'
+assert c.call('bitcount', 'b_b', '1', '1') == b':6'
+assert c.call('bitcount', 'b_b', '-2', '-1') == b':7'
+assert c.call('bitcount', 'b_b', '5', '2') == b':0'
+assert c.call('bitcount', 'b_b', '1') == b'-ERR syntax error.'
+assert c.call('bitcount', 'b_nokey') == b':0'
+
+# BITPOS, including the implicit clear bit past the end
+c.call('set', 'b_c', b'\xff\xf0\x00')
+assert c.call('bitpos', 'b_c', '0') == b':12'
+assert c.call('bitpos', 'b_c', '1', '2') == b':-1'
+assert c.call('bitpos', 'b_c', '0', '1') == b':12'
+c.call('set', 'b_c', b'\xff\xff')
+assert c.call('bitpos', 'b_c', '0') == b':16'
+assert c.call('bitpos', 'b_c', '0', '0', '-1') == b':-1'
+assert c.call('bitpos', 'b_nokey', '1') == b':-1'
+assert c.call('bitpos', 'b_nokey', '0') == b':0'
+
+# type checks both ways
+c.call('rpush', 'b_z', 'x')
+assert c.call('setbit', 'b_z', '1', '1') == b'-WRONGTYPE not a string value'
+assert c.call('bitcount', 'b_z') == b'-WRONGTYPE not a string value'
+assert c.call('bitop', 'and', 'b_d', 'b_z') == b'-WRONGTYPE not a string value'
+
+# BITOP against a model, on lengths around the vector widths
+random.seed(11)
+for _ in range(30):
+    vals = [bytes(random.getrandbits(8) for _ in range(random.choice([0, 1, 7, 31, 32, 33, 100, 257])))
+            for _ in range(3)]
+    for i, v in enumerate(vals):
+        c.call('set', 'b_s%d' % i, v)
+    n = max(len(v) for v in vals)
+    pad = [v + b'\0' * (n - len(v)) for v in vals]
+    for op, f in [('and', lambda x, y: x & y), ('or', lambda x, y: x | y), ('xor', lambda x, y: x ^ y)]:
+        want = pad[0]
+        for v in pad[1:]:
+            want = bytes(f(x, y) for x, y in zip(want, v))
+        assert c.call('bitop', op, 'b_d', 'b_s0', 'b_s1', 'b_s2') == b':%d' % n
+        assert c.call('get', 'b_d') == (want if n else NIL), op
+    assert c.call('bitop', 'not', 'b_d', 'b_s2') == b':%d' % len(vals[2])
+    if vals[2]:
+        assert c.call('get', 'b_d') == bytes(255 - x for x in vals[2])
+        assert c.call('bitcount', 'b_s2') == b':%d' % popcount(vals[2])
+        assert c.call('bitpos', 'b_s2', '1') == b':%d' % bitpos(vals[2], 1)
+assert c.call('bitop', 'not', 'b_d', 'b_s0', 'b_s1') == b'-ERR BITOP NOT must be called with a single source key.'
+assert c.call('bitop', 'nand', 'b_d', 'b_s0') == b'-ERR syntax error.'
+# a missing source is all zeroes, the destination can be of any type
+assert c.call('bitop', 'or', 'b_z', 'b_nokey', 'b_b') == b':6'
+assert c.call('get', 'b_z') == b'foobar'
+c.call('del', 'b_s0', 'b_s1', 'b_s2', 'b_z')
+
+# a reply still being sent keeps the value it was given, SETBIT copies
+c.call('del', 'b_big')
+c.call('setbit', 'b_big', str(8 * 100000 - 1), '1')
+w = Conn()
+w.sock.sendall(enc('get', 'b_big') + enc('setbit', 'b_big', '0', '1') + enc('get', 'b_big'))
+first, old, second = w.reply(), w.reply(), w.reply()
+assert old == b':0' and first[0] == 0 and second[0] == 0x80 and len(first) == len(second) == 100000
+
+# high offsets grow the string in steps, not a reallocation per bit
+base = c.info('memory')['used_memory']
+for i in range(0, 8 * 50000, 997):
+    c.call('setbit', 'b_a', str(i), '1')
+assert len(c.call('get', 'b_a')) == (8 * 50000 - 1) // 997 * 997 // 8 + 1
+used = c.info('memory')['used_memory'] - base
+assert used < 3 * 50000, used
+
+# daily active users: one bitmap instead of a key per user
+c.call('del', 'b_a', 'b_big')
+users = random.sample(range(100000), 10000)
+base = c.info('memory')['used_memory']
+for i in range(0, len(users), 500):
+    c.sock.sendall(b''.join(enc('set', 'b_dau:%d' % u, '1') for u in users[i:i + 500]))
+    for _ in users[i:i + 500]:
+        c.reply()
+per_key = c.info('memory')['used_memory'] - base
+base = c.info('memory')['used_memory']
+for i in range(0, len(users), 500):
+    c.sock.sendall(b''.join(enc('setbit', 'b_dau', str(u), '1') for u in users[i:i + 500]))
+    for _ in users[i:i + 500]:
+        c.reply()
+bitmap = c.info('memory')['used_memory'] - base
+assert c.call('bitcount', 'b_dau') == b':10000'
+assert bitmap * 20 < per_key, (bitmap, per_key)
+for i in range(0, len(users), 500):
+    c.call('del', *['b_dau:%d' % u for u in users[i:i + 500]])
+c.call('del', 'b_dau', 'b_b', 'b_c', 'b_d')
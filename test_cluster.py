@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+# Cluster mode. Starts three nodes of its own, ./server --cluster-enabled yes
+# on ports 1240-1242, and moves a slot between two of them.
+
+import subprocess
+import time
+
+from resp_client import Conn
+
+
+OK = b'+OK'
+PORTS = [1240, 1241, 1242]
+
+
+def fnv(data):
+    h = 0x811C9DC5
+    for c in data:
+        h = ((h + c) * 0x01000193) & 0xffffffff
+    return h
+
+
+def slot_of(key):
+    # the same as key_slot() in server.cpp
+    key = key.encode()
+    start = key.find(b'{')
+    if start >= 0:
+        end = key.find(b'}', start + 1)
+        if end > start + 1:
+            key = key[start + 1:end]
+    return fnv(key) & 16383
+
+
+class Cluster:
+    # a client that follows -MOVED and -ASK
+    def __init__(self, nodes):
+        self.nodes = nodes
+        self.redirects = {'MOVED': 0, 'ASK': 0}
+
+    def call(self, *args, port=PORTS[0]):
+        for _ in range(5):
+            got = self.nodes[port].call(*args)
+            if isinstance(got, bytes) and got[:6] == b'-MOVED':
+                port = int(got.split(b':')[-1])
+                self.redirects['MOVED'] += 1
+                continue
+            if isinstance(got, bytes) and got[:4] == b'-ASK':
+                port = int(got.split(b':')[-1])
+                self.redirects['ASK'] += 1
+                assert self.nodes[port].call('asking') == OK
+                return self.nodes[port].call(*args)
+            return got
+        assert False, 'redirect loop'
+
+
+procs = [subprocess.Popen(['./server', '--port', str(p), '--cluster-enabled', 'yes'],
+                          stderr=subprocess.DEVNULL) for p in PORTS]
+try:
+    nodes = {}
+    deadline = time.time() + 5
+    for p in PORTS:
+        while p not in nodes:
+            try:
+                nodes[p] = Conn(p)
+            except ConnectionRefusedError:
+                assert time.time() < deadline, 'a node did not start'
+                time.sleep(0.02)
+    a, b, c = (nodes[p] for p in PORTS)
+
+    # slots and hashtags
+    for key in ['foo', 'user:1000', '{user1000}.following', 'a{}b', '{x}{y}', '{', 'x}{']:
+        assert a.call('cluster', 'keyslot', key) == b':%d' % slot_of(key), key
+    assert slot_of('{user1000}.following') == slot_of('{user1000}.followers') == slot_of('user1000')
+    assert slot_of('a{}b') != slot_of('b')
+
+    # nobody serves anything yet
+    assert a.call('get', 'foo').startswith(b'-CLUSTERDOWN')
+
+    # three ranges, each node knows where the others are
+    ranges = [(0, 5460), (5461, 10922), (10923, 16383)]
+    for i, p in enumerate(PORTS):
+        assert nodes[p].call('cluster', 'addslotsrange', *map(str, ranges[i])) == OK
+        for j, q in enumerate(PORTS):
+            if j != i:
+                cmds = [('cluster', 'setslot', str(s), 'node', '127.0.0.1:%d' % q)
+                        for s in range(ranges[j][0], ranges[j][1] + 1)]
+                assert set(nodes[p].pipeline(cmds)) == {OK}
+    assert a.call('cluster', 'slots') == [
+        [b':0', b':5460', b'myself'],
+        [b':5461', b':10922', b'127.0.0.1:1241'],
+        [b':10923', b':16383', b'127.0.0.1:1242']]
+
+    # keys land on the node that owns their slot, the others redirect
+    cl = Cluster(nodes)
+    keys = ['key%d' % i for i in range(300)]
+    for k in keys:
+        assert cl.call('set', k, 'v' + k) == OK
+    for k in keys:
+        assert cl.call('get', k, port=PORTS[2]) == b'v' + k.encode()
+    owner = {k: PORTS[next(i for i, r in enumerate(ranges) if r[0] <= slot_of(k) <= r[1])] for k in keys}
+    for p in PORTS:
+        mine = [k for k in keys if owner[k] == p]
+        assert 50 < len(mine) < 150, (p, len(mine))
+        assert nodes[p].call('get', mine[0]) == b'v' + mine[0].encode()
+    k = next(k for k in keys if owner[k] == PORTS[1])
+    assert a.call('get', k) == b'-MOVED %d 127.0.0.1:1241' % slot_of(k)
+
+    # multi-key commands need one slot, hashtags make that possible
+    assert a.call('mget', 'key1', 'key2').startswith(b'-CROSSSLOT')
+    assert cl.call('mset', '{u}a', '1', '{u}b', '2') == OK
+    assert cl.call('mget', '{u}a', '{u}b') == [b'1', b'2']
+    # commands without keys run anywhere
+    assert a.call('ping') == b'PONG'
+
+    # move the slot of {mig} from its owner to another node, a batch at a time,
+    # while clients keep using it
+    slot = slot_of('{mig}')
+    src = PORTS[next(i for i, r in enumerate(ranges) if r[0] <= slot <= r[1])]
+    dst = PORTS[(PORTS.index(src) + 1) % 3]
+    other = next(p for p in PORTS if p not in (src, dst))
+    s, d = nodes[src], nodes[dst]
+    mig = ['{mig}%d' % i for i in range(250)]
+    for k in mig:
+        cl.call('set', k, 'm' + k)
+    cl.call('zadd', '{mig}z', '1.5', 'one')
+    cl.call('zadd', '{mig}z', '2.5', 'two')
+    cl.call('pexpire', '{mig}z', '100000')
+    # a stream goes over as XADDs, each replied to with a bulk string
+    before = s.info('memory')['used_memory']
+    for i in range(0, 3000, 500):
+        s.pipeline([('xadd', '{mig}s', '%d-1' % (j + 1), 'f', 'x' * 100) for j in range(i, i + 500)])
+    stream_mem = s.info('memory')['used_memory'] - before
+    entries = s.call('xrange', '{mig}s', '-', '+')
+    assert len(entries) == 3000
+    assert s.call('cluster', 'countkeysinslot', str(slot)) == b':252'
+    assert d.call('cluster', 'countkeysinslot', str(slot)) == b':0'
+
+    assert d.call('cluster', 'setslot', str(slot), 'importing') == OK
+    assert s.call('cluster', 'setslot', str(slot), 'migrating', '127.0.0.1:%d' % dst) == OK
+    # not the target's yet, unless the client was told to ask
+    assert d.call('get', mig[0]) == b'-MOVED %d 127.0.0.1:%d' % (slot, src)
+    # a target that runs out of memory near the end of the stream: the key stays here
+    assert d.call('config', 'set', 'maxmemory', str(d.info('memory')['used_memory'] + stream_mem * 9 // 10)) == OK
+    got = s.call('migrate', '127.0.0.1', str(dst), '1000', '{mig}s')
+    assert got.startswith(b'-ERR target instance replied: OOM'), got
+    assert s.call('xlen', '{mig}s') == b':3000'
+    assert d.call('config', 'set', 'maxmemory', '0') == OK
+    moved = 0
+    step = 0
+    while True:
+        batch = s.call('cluster', 'getkeysinslot', str(slot), '40')
+        if not batch:
+            break
+        got = s.call('migrate', '127.0.0.1', str(dst), '1000', *batch)
+        moved += int(got[1:])
+        if step == 0:
+            # the keys go in insertion order, some are there and some here
+            assert s.call('mget', mig[0], mig[-1]) == b'-TRYAGAIN Multiple keys request during rehashing of slot.'
+        # reads find every key, wherever it is right now; new keys go to the target
+        for k in mig[::25]:
+            assert cl.call('get', k) == b'm' + k.encode(), k
+        assert cl.call('set', '{mig}new%d' % step, 'n') == OK
+        step += 1
+    assert moved == 252
+    assert cl.redirects['ASK'] > 0
+    assert s.call('mget', mig[0], mig[-1]) == b'-ASK %d 127.0.0.1:%d' % (slot, dst)
+
+    # done, the target owns it and everybody knows
+    assert d.call('cluster', 'addslotsrange', str(slot), str(slot)) == OK
+    assert s.call('cluster', 'setslot', str(slot), 'node', '127.0.0.1:%d' % dst) == OK
+    assert nodes[other].call('cluster', 'setslot', str(slot), 'node', '127.0.0.1:%d' % dst) == OK
+    assert s.call('cluster', 'countkeysinslot', str(slot)) == b':0'
+    assert d.call('cluster', 'countkeysinslot', str(slot)) == b':%d' % (252 + step)
+    assert s.call('get', mig[0]) == b'-MOVED %d 127.0.0.1:%d' % (slot, dst)
+    for k in mig:
+        assert d.call('get', k) == b'm' + k.encode()
+    assert d.call('zquery', '{mig}z', '0', '', '0', '10') == [b'one', b'1.5', b'two', b'2.5']
+    assert d.call('xrange', '{mig}s', '-', '+') == entries
+    ttl = int(d.call('pttl', '{mig}z')[1:])
+    assert 90000 < ttl <= 100000, ttl
+    assert set(d.call('cluster', 'getkeysinslot', str(slot), '1000')) == \
+        set(k.encode() for k in mig + ['{mig}z', '{mig}s'] + ['{mig}new%d' % i for i in range(step)])
+    # the rest of the source is untouched
+    for k in keys:
+        assert cl.call('get', k) == b'v' + k.encode()
+finally:
+    for proc in procs:
+        proc.kill()
+        proc.wait()
+
+# not a cluster node
+plain = Conn(1234)
+assert plain.call('cluster', 'keyslot', 'foo') == b'-ERR This instance has cluster support disabled.'
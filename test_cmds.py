@@ -39,6 +39,28 @@ $ ./client zquery zset 1 "" 0 10
 (str) n2
 (dbl) 2
 (arr) end
+$ ./client mset mk1 v1 mk2 v2 mk1 v3
+(nil)
+$ ./client mget mk1 mk2 mk3 zset
+(arr) len=4
+(str) v3
+(str) v2
+(nil)
+(nil)
+(arr) end
+$ ./client mset mk3 v3 zset v4
+(err) 3 a non-string value exists
+$ ./client get mk3
+(nil)
+$ ./client mset mk3
+(err) 4 wrong number of arguments.
+$ ./client del mk1 mk2 mk3
+(int) 2
+$ ./client mget mk1 mk2
+(arr) len=2
+(nil)
+(nil)
+(arr) end
 '''
 
 
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+# Hashes, run against a server on port 1234. Also compares the memory of an
+# object stored as one hash with the same object flattened into string keys.
+
+from resp_client import Conn
+
+
+c = Conn()
+NIL = b'$-1'
+c.call('del', 'h_a', 'h_s', 'h_big')
+
+def pairs(reply):
+    return dict(zip(reply[::2], reply[1::2]))
+
+# the basics, in the compact encoding
+assert c.call('hset', 'h_a', 'name', 'ann', 'email', 'ann@x') == b':2'
+assert c.call('hset', 'h_a', 'name', 'anna', 'age', '30') == b':1'
+assert c.call('hget', 'h_a', 'name') == b'anna'
+assert c.call('hget', 'h_a', 'nope') == NIL
+assert c.call('hget', 'h_nokey', 'name') == NIL
+assert c.call('hmget', 'h_a', 'email', 'nope', 'age') == [b'ann@x', NIL, b'30']
+assert pairs(c.call('hgetall', 'h_a')) == {b'name': b'anna', b'email': b'ann@x', b'age': b'30'}
+assert c.call('hgetall', 'h_nokey') == []
+assert c.call('hincrby', 'h_a', 'age', '5') == b':35'
+assert c.call('hincrby', 'h_a', 'visits', '-2') == b':-2'
+assert c.call('hincrby', 'h_a', 'name', '1') == b'-ERR hash value is not an integer.'
+c.call('hset', 'h_a', 'max', str(2**63 - 1))
+assert c.call('hincrby', 'h_a', 'max', '1') == b'-ERR increment or decrement would overflow.'
+assert c.call('hdel', 'h_a', 'max', 'visits', 'nope') == b':2'
+
+# type checks both ways
+c.call('set', 'h_s', 'str')
+assert c.call('hset', 'h_s', 'f', 'v') == b'-WRONGTYPE expect hash'
+assert c.call('hget', 'h_s', 'f') == b'-WRONGTYPE expect hash'
+assert c.call('get', 'h_a') == b'-WRONGTYPE not a string value'
+assert c.call('hset', 'h_a', 'odd') == b'-ERR wrong number of arguments.'
+
+# the last field takes the key with it
+assert c.call('hdel', 'h_a', 'name', 'email', 'age') == b':3'
+assert c.call('pttl', 'h_a') == b':-2'
+assert c.call('hset', 'h_a', 'x', '1') == b':1'
+
+# past the limits the hash becomes a table, nothing changes for the client
+fields = {('f%d' % i).encode(): ('v%d' % i).encode() for i in range(1000)}
+for i in range(0, 1000, 100):
+    c.call('hset', 'h_big', *[x for k in list(fields)[i:i + 100] for x in (k, fields[k])])
+c.call('hset', 'h_a', 'long', 'x' * 100)
+assert c.call('hget', 'h_a', 'long') == b'x' * 100
+assert pairs(c.call('hgetall', 'h_big')) == fields
+assert c.call('hmget', 'h_big', 'f0', 'f999', 'f1000') == [b'v0', b'v999', NIL]
+assert c.call('hdel', 'h_big', *fields) == b':1000'
+c.call('del', 'h_a', 'h_s')
+
+# memory per object: 10 short fields as one hash vs 10 string keys
+N = 1000
+FIELDS = ['name', 'email', 'city', 'country', 'age', 'plan', 'created', 'updated', 'logins', 'score']
+
+
+def measure(store):
+    base = c.info('memory')['used_memory']
+    for i in range(0, N, 100):
+        c.pipeline([cmd for j in range(i, i + 100) for cmd in store(j)])
+    return (c.info('memory')['used_memory'] - base) / N
+
+
+flat = measure(lambda j: [('set', 'h_u:%d:%s' % (j, f), 'value%d' % j) for f in FIELDS])
+compact = measure(lambda j: [('hset', 'h_u:%d' % j) + tuple(x for f in FIELDS for x in (f, 'value%d' % j))])
+c.pipeline([('del', 'h_u:%d' % j) for j in range(N)])
+c.call('config', 'set', 'hash-max-compact-entries', '0')
+table = measure(lambda j: [('hset', 'h_u:%d' % j) + tuple(x for f in FIELDS for x in (f, 'value%d' % j))])
+c.call('config', 'set', 'hash-max-compact-entries', '128')
+assert compact * 4 < flat, (flat, compact)
+assert compact < table < flat, (flat, compact, table)
+c.pipeline([('del', 'h_u:%d' % j) for j in range(N)])
+c.pipeline([('del',) + tuple('h_u:%d:%s' % (j, f) for f in FIELDS) for j in range(N)])
@@ -0,0 +1,70 @@
+#include <assert.h>
+#include <stdint.h>
+#include "hist.h"
+
+
+// every value has a bucket, and the buckets go up one at a time
+static void test_buckets() {
+    for (uint64_t v = 0; v < (1u << k_hist_sub_bits); v++) {
+        assert(hist_bucket(v) == v);
+    }
+    uint32_t prev = hist_bucket(0);
+    for (uint64_t v = 1; v < (1u << 20); v++) {
+        uint32_t idx = hist_bucket(v);
+        assert(idx == prev || idx == prev + 1);
+        prev = idx;
+    }
+    // the last bucket takes everything from 2^k_hist_max_bits up
+    uint32_t last = k_hist_buckets - 1;
+    assert(hist_bucket((1ull << k_hist_max_bits) - 1) == last);
+    assert(hist_bucket(1ull << k_hist_max_bits) == last);
+    assert(hist_bucket(UINT64_MAX) == last);
+    assert(hist_bucket((1ull << (k_hist_max_bits - 1)) - 1) < last);
+}
+
+// a percentile reports the top of the bucket, never more than the max
+static void test_percentile() {
+    Hist h;
+    assert(hist_percentile(&h, 50) == 0);
+    for (uint64_t v = 1; v <= 100; v++) {
+        hist_record(&h, v);
+    }
+    assert(h.count == 100 && h.sum == 5050 && h.max == 100);
+    assert(hist_percentile(&h, 0) == 1);
+    assert(hist_percentile(&h, 1) == 1);
+    assert(hist_percentile(&h, 50) == 50);      // below 64, buckets are exact
+    assert(hist_percentile(&h, 98) == 99);      // 98 and 99 share a bucket
+    assert(hist_percentile(&h, 99) == 99);
+    assert(hist_percentile(&h, 100) == 100);    // capped by the max
+
+    // the top of a bucket stays within 1/32 of the values in it
+    for (uint64_t v = 1; v < (1ull << 36); v = v * 3 + 1) {
+        Hist one;
+        hist_record(&one, v);
+        hist_record(&one, 1ull << 39);
+        uint64_t top = hist_percentile(&one, 50);
+        assert(top >= v && top - v <= v / 32);
+    }
+}
+
+static void test_merge() {
+    Hist a, b;
+    hist_record(&a, 10);
+    hist_record(&a, 1000);
+    hist_record(&b, 5);
+    hist_record(&b, 1u << 20);
+    hist_merge(&a, &b);
+    assert(a.count == 4 && a.sum == 10 + 1000 + 5 + (1u << 20) && a.max == (1u << 20));
+    assert(hist_percentile(&a, 25) == 5);
+    assert(hist_percentile(&a, 100) == (1u << 20));
+    hist_reset(&a);
+    assert(a.count == 0 && a.sum == 0 && a.max == 0);
+    assert(hist_percentile(&a, 100) == 0);
+}
+
+int main() {
+    test_buckets();
+    test_percentile();
+    test_merge();
+    return 0;
+}
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+# HyperLogLog, run against a server on port 1234.
+
+from resp_client import Conn
+
+
+def pfadd_many(key, elems):
+    # pipelined, 1000 elements a command
+    for i in range(0, len(elems), 1000):
+        c.call('pfadd', key, *elems[i:i + 1000])
+
+
+def close(got, want, tol=0.02):
+    return abs(int(got[1:]) - want) <= want * tol
+
+
+c = Conn()
+NIL = b'$-1'
+c.call('del', 'h_a', 'h_b', 'h_u', 'h_s', 'h_l', 'h_set')
+
+# small counts are exact in practice, and the value is a string that starts like Redis'
+assert c.call('pfadd', 'h_a', 'a', 'b', 'c') == b':1'
+assert c.call('pfadd', 'h_a', 'b', 'a') == b':0'
+assert c.call('pfadd', 'h_a') == b':0'
+assert c.call('pfadd', 'h_new') == b':1'
+assert c.call('pfcount', 'h_new') == b':0'
+assert c.call('pfcount', 'h_a') == b':3'
+assert c.call('pfcount', 'h_nokey') == b':0'
+val = c.call('get', 'h_a')
+assert val[:5] == b'HYLL\x01' and len(val) < 32
+c.call('del', 'h_new')
+
+# the estimate is cached until the next change
+assert c.call('get', 'h_a')[15] & 0x80 == 0
+c.call('pfadd', 'h_a', 'd')
+assert c.call('get', 'h_a')[15] & 0x80
+assert c.call('pfcount', 'h_a') == b':4'
+assert c.call('get', 'h_a')[15] & 0x80 == 0
+
+# type checks: another type, or a string that isn't one
+c.call('rpush', 'h_l', 'x')
+c.call('set', 'h_s', 'HYLL but not really')
+for key in ('h_l', 'h_s'):
+    err = b'-WRONGTYPE not a valid HyperLogLog string value'
+    assert c.call('pfadd', key, 'x') == err
+    assert c.call('pfcount', key) == err
+    assert c.call('pfcount', 'h_a', key) == err
+    assert c.call('pfmerge', 'h_a', key) == err
+
+# many elements: sparse, then dense at 12KB, within the 0.81% standard error (a few of them)
+pfadd_many('h_a', ['user:%d' % i for i in range(200)])
+assert c.call('get', 'h_a')[4] == 1
+pfadd_many('h_a', ['user:%d' % i for i in range(100000)])
+val = c.call('get', 'h_a')
+assert val[4] == 0 and len(val) == 16 + 12288
+assert close(c.call('pfcount', 'h_a'), 100004)
+assert c.call('pfadd', 'h_a', 'user:5') == b':0'
+
+# the sparse limit is a setting
+c.call('config', 'set', 'hll-sparse-max-bytes', '0')
+c.call('pfadd', 'h_b', 'x')
+assert len(c.call('get', 'h_b')) == 16 + 12288
+assert c.call('pfcount', 'h_b') == b':1'
+c.call('config', 'set', 'hll-sparse-max-bytes', '3000')
+c.call('del', 'h_b')
+
+# the union: several keys in PFCOUNT, or kept with PFMERGE, sparse and dense mixed
+pfadd_many('h_b', ['user:%d' % i for i in range(50000, 150000)])
+assert close(c.call('pfcount', 'h_a', 'h_b', 'h_nokey'), 150004)
+c.call('pfadd', 'h_small', 'only-here')
+assert c.call('pfmerge', 'h_u', 'h_a', 'h_b', 'h_small', 'h_nokey') == b'+OK'
+assert close(c.call('pfcount', 'h_u'), 150005)
+assert c.call('pfmerge', 'h_small') == b'+OK'
+assert c.call('pfcount', 'h_small') == b':1'
+assert c.call('pfmerge', 'h_small', 'h_a') == b'+OK'
+assert close(c.call('pfcount', 'h_small'), 100005)
+
+# unique visitors: a few KB at most, against a set of the same ids
+c.call('del', 'h_a', 'h_b', 'h_u', 'h_small')
+base = c.info('memory')['used_memory']
+pfadd_many('h_a', ['visitor:%d' % i for i in range(20000)])
+hll = c.info('memory')['used_memory'] - base
+base = c.info('memory')['used_memory']
+for i in range(0, 20000, 1000):
+    c.call('sadd', 'h_set', *['visitor:%d' % j for j in range(i, i + 1000)])
+exact = c.info('memory')['used_memory'] - base
+assert hll < 13000 and hll * 50 < exact, (hll, exact)
+assert close(c.call('pfcount', 'h_a'), 20000)
+c.call('del', 'h_a', 'h_l', 'h_s', 'h_set')
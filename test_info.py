@@ -0,0 +1,35 @@
+#!/usr/bin/env python3
+# INFO commands: per-command calls, errors and latency, run against a server on port 1234.
+
+from resp_client import Conn
+
+
+def commands(c):
+    items = c.call('info', 'commands')
+    return {items[i].decode(): items[i + 1] for i in range(0, len(items), 2)}
+
+
+def calls(st, name):
+    return int(st[name][1:]) if name in st else 0
+
+
+c = Conn()
+before = commands(c)
+for i in range(5):
+    c.call('set', 'info_k', str(i))
+c.call('get', 'info_k')
+assert c.call('zscore', 'info_k', 'm').startswith(b'-WRONGTYPE')
+after = commands(c)
+
+assert calls(after, 'cmd.set.calls') - calls(before, 'cmd.set.calls') == 5
+assert calls(after, 'cmd.set.errors') == calls(before, 'cmd.set.errors')
+assert calls(after, 'cmd.get.calls') - calls(before, 'cmd.get.calls') == 1
+assert calls(after, 'cmd.zscore.errors') - calls(before, 'cmd.zscore.errors') == 1
+# commands never called are left out
+assert 'cmd.pfmerge.calls' not in after or 'cmd.pfmerge.calls' in before
+
+lat = {k: float(after['cmd.set.' + k]) for k in ('avg_us', 'p50_us', 'p99_us', 'p999_us', 'max_us')}
+assert 0 < lat['p50_us'] <= lat['p99_us'] <= lat['p999_us'] <= lat['max_us']
+assert 0 < lat['avg_us'] <= lat['max_us']
+
+c.call('del', 'info_k')
@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+# Lists and BLPOP, run against a server on port 1234.
+
+import random
+import time
+
+from resp_client import Conn
+
+
+c = Conn()
+NIL = b'$-1'
+c.call('del', 'l_a', 'l_s', 'l_big', 'l_b', 'l_b2', 'l_m')
+
+# the basics
+assert c.call('rpush', 'l_a', 'b', 'c') == b':2'
+assert c.call('lpush', 'l_a', 'a', 'z') == b':4'
+assert c.call('lrange', 'l_a', '0', '-1') == [b'z', b'a', b'b', b'c']
+assert c.call('llen', 'l_a') == b':4'
+assert c.call('lpop', 'l_a') == b'z'
+assert c.call('rpop', 'l_a') == b'c'
+assert c.call('lrange', 'l_a', '-100', '100') == [b'a', b'b']
+assert c.call('lrange', 'l_a', '1', '0') == []
+assert c.call('lrange', 'l_nokey', '0', '-1') == []
+assert c.call('llen', 'l_nokey') == b':0'
+assert c.call('lpop', 'l_nokey') == NIL
+assert c.call('lrange', 'l_a', 'x', '1') == b'-ERR expect int64'
+
+# type checks both ways
+c.call('set', 'l_s', 'str')
+assert c.call('lpush', 'l_s', 'x') == b'-WRONGTYPE expect list'
+assert c.call('lrange', 'l_s', '0', '-1') == b'-WRONGTYPE expect list'
+assert c.call('get', 'l_a') == b'-WRONGTYPE not a string value'
+
+# the last element takes the key with it
+c.call('lpop', 'l_a')
+c.call('lpop', 'l_a')
+assert c.call('pttl', 'l_a') == b':-2'
+
+# many chunks: every operation against a model, ranges at any offset
+random.seed(7)
+model = []
+for step in range(3000):
+    op = random.random()
+    val = ('v%d:' % step + 'x' * random.choice([0, 5, 50, 500, 5000])).encode()
+    if op < 0.35:
+        c.call('rpush', 'l_big', val)
+        model.append(val)
+    elif op < 0.7:
+        c.call('lpush', 'l_big', val)
+        model.insert(0, val)
+    elif op < 0.8:
+        assert c.call('lpop', 'l_big') == (model.pop(0) if model else NIL)
+    elif op < 0.9:
+        assert c.call('rpop', 'l_big') == (model.pop() if model else NIL)
+    elif op < 0.95:
+        start, stop = random.randint(-60, 60), random.randint(-60, 60)
+        got = c.call('lrange', 'l_big', str(start), str(stop))
+        n = len(model)
+        lo, hi = max(start + n if start < 0 else start, 0), min(stop + n if stop < 0 else stop, n - 1)
+        assert got == model[lo:hi + 1], (start, stop)
+    else:
+        assert c.call('llen', 'l_big') == b':%d' % len(model)
+assert c.call('lrange', 'l_big', '0', '-1') == model
+start = len(model) // 3
+assert c.call('lrange', 'l_big', str(start), str(start + 9)) == model[start:start + 10]
+assert c.call('ltrim', 'l_big', '3', '-5') == b'+OK'
+model = model[3:-4]
+assert c.call('lrange', 'l_big', '0', '-1') == model
+assert c.call('ltrim', 'l_big', '5', '4') == b'+OK'
+assert c.call('llen', 'l_big') == b':0'
+
+# small elements pack into chunks, a few bytes of overhead each
+base = c.info('memory')['used_memory']
+for i in range(0, 10000, 1000):
+    c.call('rpush', 'l_big', *['e%d' % j for j in range(i, i + 1000)])
+per_elem = (c.info('memory')['used_memory'] - base) / 10000
+assert per_elem < 12, per_elem
+assert c.call('lrange', 'l_big', '5000', '5002') == [b'e5000', b'e5001', b'e5002']
+c.call('del', 'l_big', 'l_s')
+
+# BLPOP returns right away when there is something to pop, from the first list that has it
+c.call('rpush', 'l_b2', 'x')
+assert c.call('blpop', 'l_b', 'l_b2', '0') == [b'l_b2', b'x']
+assert c.call('blpop', 'l_b', '-1') == b'-ERR timeout is not a float or out of range.'
+
+# otherwise it waits for a push, first come first served
+w1, w2 = Conn(), Conn()
+w1.send('blpop', 'l_b', 'l_b2', '0')
+time.sleep(0.05)
+w2.send('blpop', 'l_b', '0')
+w2.send('ping')     # pipelined behind the blocked request
+assert not w1.pending() and not w2.pending()
+assert c.info('clients')['blocked_clients'] == 2
+assert c.call('rpush', 'l_b', 'one', 'two', 'three') == b':3'
+assert w1.reply() == [b'l_b', b'one']
+assert w2.reply() == [b'l_b', b'two']
+assert w2.reply() == b'PONG'
+assert c.call('lrange', 'l_b', '0', '-1') == [b'three']
+assert c.info('clients')['blocked_clients'] == 0
+c.call('del', 'l_b')
+
+# a push inside MULTI wakes the waiter after EXEC, which sees everything
+w1.send('blpop', 'l_b', '0')
+time.sleep(0.05)
+c.call('multi')
+c.call('rpush', 'l_b', 'a')
+c.call('rpush', 'l_b', 'b')
+assert c.call('exec') == [b':1', b':2']
+assert w1.reply() == [b'l_b', b'a']
+assert c.call('lrange', 'l_b', '0', '-1') == [b'b']
+c.call('del', 'l_b')
+
+# inside MULTI it can't wait
+c.call('multi')
+c.call('blpop', 'l_b', '0')
+assert c.call('exec') == [NIL]
+
+# the timeout gives up with nil
+t0 = time.time()
+assert w1.call('blpop', 'l_b', '0.2') == NIL
+assert 0.15 < time.time() - t0 < 1.5
+
+# a waiter that goes away is forgotten
+w2.send('blpop', 'l_b', '0')
+time.sleep(0.05)
+w2.sock.close()
+time.sleep(0.05)
+assert c.call('rpush', 'l_b', 'kept') == b':1'
+assert c.call('lpop', 'l_b') == b'kept'
+assert c.info('clients')['blocked_clients'] == 0
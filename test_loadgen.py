@@ -0,0 +1,36 @@
+#!/usr/bin/env python3
+# ./loadgen against a server on port 1234: the prefill goes through a ClientPool,
+# then a short run.
+
+import subprocess
+
+from resp_client import Conn
+
+
+def loadgen(*args):
+    return subprocess.run(['./loadgen', '--threads', '1', '--duration', '1', *args],
+                          capture_output=True, text=True)
+
+
+c = Conn()
+KEYS = 3000
+c.pipeline([('del', 'key:%d' % i) for i in range(KEYS)] + [('del', 'loadgen:zset')])
+
+# every key written once, spread over the pool's connections
+before = c.info('clients')['total_connections']
+run = loadgen('--keys', str(KEYS), '--conns', '4', '--value-size', '10', '--read-ratio', '1')
+assert run.returncode == 0, run.stderr
+assert c.info('clients')['total_connections'] - before == 4 + 4   # the pool, then the run
+got = c.pipeline([('get', 'key:%d' % i) for i in range(KEYS)])
+assert got == [b'v' * 10] * KEYS
+
+run = loadgen('--keys', str(KEYS), '--conns', '3', '--workload', 'zset', '--read-ratio', '1')
+assert run.returncode == 0, run.stderr
+got = c.pipeline([('zscore', 'loadgen:zset', 'key:%d' % i) for i in range(KEYS)])
+assert got == [str(i).encode() for i in range(KEYS)]
+
+# the Zipf sampler only works for 0 < s < 1
+assert loadgen('--dist', 'zipf', '--zipf-s', '1').returncode == 1
+
+c.pipeline([('del', 'key:%d' % i) for i in range(KEYS)] + [('del', 'loadgen:zset')])
+print('loadgen OK')
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+# maxmemory and the eviction policies, run against a server on port 1234.
+
+import time
+
+from resp_client import Conn
+
+
+c = Conn()
+VAL = 'v' * 200
+OK = b'+OK'
+NIL = b'$-1'
+
+
+def used():
+    return c.info('memory')['used_memory']
+
+
+def fill(prefix, n, *extra):
+    for i in range(0, n, 100):
+        c.pipeline([('set', '%s%d' % (prefix, j), VAL) for j in range(i, min(n, i + 100))])
+        if extra:
+            c.pipeline([(extra[0], '%s%d' % (prefix, j)) + extra[1:] for j in range(i, min(n, i + 100))])
+
+
+def alive(prefix, n):
+    keys = ['%s%d' % (prefix, i) for i in range(n)]
+    return sum(1 for v in c.call('mget', *keys) if v != NIL)
+
+
+def cleanup(*prefixes):
+    for p in prefixes:
+        c.pipeline([('del', '%s%d' % (p, i)) for i in range(3000)])
+
+
+# the accounting follows the values
+base = used()
+c.call('set', 'mm_k', 'x' * 10000)
+assert used() - base >= 10000
+c.call('set', 'mm_k', 'x')
+assert used() - base < 1000
+for i in range(100):
+    c.call('zadd', 'mm_z', str(i), 'member%d' % i)
+assert used() - base > 100 * 50
+c.call('del', 'mm_k', 'mm_z')
+assert used() - base <= 64, (used(), base)     # the top-level buckets may have been created
+
+# noeviction: writes that need memory fail, deletes and reads don't
+fill('mm_a', 100)
+assert c.call('config', 'set', 'maxmemory', str(used())) == OK
+assert c.call('set', 'mm_x', VAL) == OK
+assert c.call('set', 'mm_y', VAL) == b"-OOM command not allowed when used memory > 'maxmemory'."
+assert c.call('get', 'mm_a1') == VAL.encode()
+assert c.call('del', 'mm_x') == b':1'
+assert c.call('set', 'mm_y', VAL) == OK
+cleanup('mm_a')
+c.call('del', 'mm_y')
+c.call('config', 'set', 'maxmemory', '0')
+
+# allkeys-lru: keys read after the rest are written survive
+stats = c.info('keyspace')
+c.call('config', 'set', 'maxmemory-samples', '10')
+fill('mm_a', 2000)
+time.sleep(0.05)
+c.pipeline([('get', 'mm_a%d' % i) for i in range(200)])
+time.sleep(0.05)
+assert c.call('config', 'set', 'MaxMemory-Policy', 'ALLKEYS-LRU') == OK   # names and values ignore case
+assert c.call('config', 'get', 'MAXMEMORY-POLICY') == b'allkeys-lru'
+c.call('config', 'set', 'maxmemory', str(used()))
+fill('mm_b', 1000)
+assert used() <= c.info('memory')['maxmemory']
+evicted = c.info('keyspace')['evicted_keys'] - stats['evicted_keys']
+assert 900 <= evicted <= 1100, evicted
+assert alive('mm_a', 200) >= 180, alive('mm_a', 200)
+assert alive('mm_a', 2000) - alive('mm_a', 200) < 1000
+cleanup('mm_a', 'mm_b')
+
+# allkeys-lfu: keys read many times survive, no matter when
+c.call('config', 'set', 'maxmemory', '0')
+fill('mm_a', 2000)
+for _ in range(10):
+    c.call('mget', *['mm_a%d' % i for i in range(200)])
+c.call('config', 'set', 'maxmemory-policy', 'allkeys-lfu')
+c.call('config', 'set', 'maxmemory', str(used()))
+fill('mm_b', 1000)
+assert alive('mm_a', 200) >= 180, alive('mm_a', 200)
+cleanup('mm_a', 'mm_b')
+
+# volatile-ttl: only keys with a TTL go, the nearest expiration first
+c.call('config', 'set', 'maxmemory', '0')
+fill('mm_a', 1000)
+fill('mm_t', 1000, 'pexpire', '1000000')
+c.pipeline([('pexpire', 'mm_t%d' % i, '2000000') for i in range(500)])
+c.call('config', 'set', 'maxmemory-policy', 'volatile-ttl')
+c.call('config', 'set', 'maxmemory', str(used()))
+fill('mm_b', 400)
+assert alive('mm_a', 1000) == 1000
+assert alive('mm_b', 400) == 400
+assert alive('mm_t', 500) >= 450, alive('mm_t', 500)
+assert alive('mm_t', 1000) - alive('mm_t', 500) < 200
+# out of keys with a TTL
+fill('mm_c', 1000)
+assert c.call('set', 'mm_x', VAL).startswith(b'-OOM')
+cleanup('mm_a', 'mm_b', 'mm_c', 'mm_t')
+
+# lowering maxmemory evicts in the background, in bounded steps
+c.call('config', 'set', 'maxmemory', '0')
+c.call('config', 'set', 'maxmemory-policy', 'allkeys-random')
+fill('mm_a', 3000)
+c.call('config', 'set', 'maxmemory', str(used() - 1000 * 300))
+deadline = time.time() + 5
+while used() > c.info('memory')['maxmemory'] and time.time() < deadline:
+    time.sleep(0.01)
+assert used() <= c.info('memory')['maxmemory']
+assert c.info('memory')['evict_pending'] == 0
+cleanup('mm_a')
+
+c.call('config', 'set', 'maxmemory', '0')
+c.call('config', 'set', 'maxmemory-policy', 'noeviction')
+c.call('config', 'set', 'maxmemory-samples', '5')
@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+# Output buffer limits for slow consumers, run against a server on port 1234.
+
+import socket
+import time
+
+from resp_client import enc
+
+
+def connect(rcvbuf=0):
+    sock = socket.socket()
+    if rcvbuf:
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, rcvbuf)
+    sock.connect(('127.0.0.1', 1234))
+    return sock
+
+
+def call(sock, *args):
+    sock.sendall(enc(*args))
+    return sock.recv(1 << 16)
+
+
+def info_clients(sock):
+    # a flat RESP array of name, value pairs
+    sock.sendall(enc('info', 'clients'))
+    data = b''
+    while not data.endswith(b'\r\n') or data.count(b'\r\n') < 21:
+        data += sock.recv(1 << 16)
+    lines = data.split(b'\r\n')[1:]
+    items = [x for x in lines if x and not x.startswith(b'$')]
+    return {items[i].decode(): int(items[i + 1][1:]) for i in range(0, len(items) - 1, 2)}
+
+
+def wait_disconnects(sock, want):
+    # the kernel socket buffers fill up first, so this takes a while
+    deadline = time.time() + 10
+    while info_clients(sock)['output_limit_disconnects'] < want and time.time() < deadline:
+        time.sleep(0.1)
+    return info_clients(sock)['output_limit_disconnects']
+
+
+def is_closed(sock):
+    sock.settimeout(2)
+    try:
+        while sock.recv(1 << 20):
+            pass
+        return True
+    except (ConnectionResetError, socket.timeout):
+        return False
+
+
+ctl = socket.create_connection(('127.0.0.1', 1234))
+assert call(ctl, 'config', 'set', 'client-output-soft-limit', str(256 << 10)) == b'+OK\r\n'
+assert call(ctl, 'config', 'set', 'client-output-hard-limit', str(1 << 20)) == b'+OK\r\n'
+assert call(ctl, 'config', 'set', 'client-output-soft-ms', '500') == b'+OK\r\n'
+call(ctl, 'del', 'ol_z')
+for i in range(0, 1000, 100):
+    for j in range(i, i + 100):
+        ctl.sendall(enc('zadd', 'ol_z', str(j), 'member%04d' % j))
+    got = b''
+    while got.count(b'\r\n') < 100:
+        got += ctl.recv(1 << 16)
+# 1000 (name, score) pairs, about 26KB per reply
+query = enc('zquery', 'ol_z', '0', '', '0', '2000')
+before = info_clients(ctl)['output_limit_disconnects']
+
+# a slow but steady reader gets every reply, the server pauses and resumes it;
+# enough of them to get past the socket buffers in the kernel
+slow = connect()
+slow.sendall(query * 1000)
+ctl.sendall(query)
+one = b''
+while one.count(b'\r\n') < 1 + 4 * 1000:
+    chunk = ctl.recv(1 << 16)
+    assert chunk
+    one += chunk
+want = one * 1000
+stats = info_clients(ctl)
+assert stats['clients_output_paused'] == 1, stats
+assert stats['client_output_max'] < (1 << 20), stats
+got = bytearray()
+while len(got) < len(want):
+    chunk = slow.recv(1 << 16)
+    assert chunk, 'EOF after %d bytes' % len(got)
+    got += chunk
+    time.sleep(0.0005)
+assert got == want
+assert info_clients(ctl)['clients_output_paused'] == 0
+
+# one that stops reading is disconnected after client-output-soft-ms
+stuck = connect(4096)
+stuck.sendall(query * 400)
+assert wait_disconnects(ctl, before + 1) == before + 1
+assert is_closed(stuck)
+
+# over the hard limit right away
+assert call(ctl, 'config', 'set', 'client-output-soft-limit', '0') == b'+OK\r\n'
+greedy = connect(4096)
+greedy.sendall(query * 400)
+assert wait_disconnects(ctl, before + 2) == before + 2
+assert is_closed(greedy)
+
+call(ctl, 'config', 'set', 'client-output-soft-limit', str(16 << 20))
+call(ctl, 'config', 'set', 'client-output-hard-limit', str(256 << 20))
+call(ctl, 'config', 'set', 'client-output-soft-ms', '10000')
+call(ctl, 'del', 'ol_z')
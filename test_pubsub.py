@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+# Pub/sub, run against a server on port 1234.
+
+import time
+
+from resp_client import Conn
+
+
+c = Conn()
+base = c.info('stats')
+
+# one confirmation per channel, with the number of subscriptions so far
+s1 = Conn()
+s1.send('subscribe', 'ps_a', 'ps_b', 'ps_a')
+assert s1.reply() == [b'subscribe', b'ps_a', b':1']
+assert s1.reply() == [b'subscribe', b'ps_b', b':2']
+assert s1.reply() == [b'subscribe', b'ps_a', b':2']
+assert c.call('publish', 'ps_a', 'hello') == b':1'
+assert s1.reply() == [b'message', b'ps_a', b'hello']
+assert c.call('publish', 'ps_nobody', 'x') == b':0'
+assert not s1.pending()
+
+# patterns, counted once per matching pattern
+s2 = Conn()
+s2.send('psubscribe', 'ps_*', 'ps_[ab]', 'ps_\\*')
+assert s2.reply() == [b'psubscribe', b'ps_*', b':1']
+assert s2.reply() == [b'psubscribe', b'ps_[ab]', b':2']
+assert s2.reply() == [b'psubscribe', b'ps_\\*', b':3']
+assert c.call('publish', 'ps_b', 'm') == b':3'
+assert s1.reply() == [b'message', b'ps_b', b'm']
+got = sorted([s2.reply(), s2.reply()])
+assert got == [[b'pmessage', b'ps_*', b'ps_b', b'm'], [b'pmessage', b'ps_[ab]', b'ps_b', b'm']]
+assert c.call('publish', 'ps_*', 'star') == b':2'
+got = sorted([s2.reply(), s2.reply()])
+assert got == [[b'pmessage', b'ps_*', b'ps_*', b'star'], [b'pmessage', b'ps_\\*', b'ps_*', b'star']]
+assert c.call('publish', 'ps_c', '') == b':1'
+assert s2.reply() == [b'pmessage', b'ps_*', b'ps_c', b'']
+assert c.call('publish', 'xps_a', 'x') == b':0'
+assert not s2.pending()
+info = c.info('stats')
+assert info['pubsub_channels'] == base['pubsub_channels'] + 2
+assert info['pubsub_patterns'] == base['pubsub_patterns'] + 3
+
+# only these commands while subscribed
+assert s1.call('get', 'ps_k') == b'-ERR only (P)SUBSCRIBE / (P)UNSUBSCRIBE / PING are allowed in this context.'
+assert s1.call('ping') == [b'pong', b'']
+assert s1.call('ping', 'hi') == [b'pong', b'hi']
+
+# unsubscribing from nothing in particular drops everything, then it's a normal client again
+assert s1.call('unsubscribe', 'ps_b') == [b'unsubscribe', b'ps_b', b':1']
+assert s1.call('unsubscribe', 'ps_nope') == [b'unsubscribe', b'ps_nope', b':1']
+assert s1.call('unsubscribe') == [b'unsubscribe', b'ps_a', b':0']
+assert s1.call('unsubscribe') == [b'unsubscribe', b'$-1', b':0']
+assert s1.call('ping') == b'PONG'
+assert c.call('publish', 'ps_a', 'x') == b':2'
+assert sorted([s2.reply()[1], s2.reply()[1]]) == [b'ps_*', b'ps_[ab]']
+s2.send('punsubscribe')
+got = sorted([s2.reply(), s2.reply(), s2.reply()])
+assert [g[1] for g in got] == [b'ps_*', b'ps_[ab]', b'ps_\\*'] and sorted(g[2] for g in got) == [b':0', b':1', b':2']
+assert c.call('publish', 'ps_a', 'x') == b':0'
+info = c.info('stats')
+assert info['pubsub_channels'] == base['pubsub_channels']
+assert info['pubsub_patterns'] == base['pubsub_patterns']
+
+# not in a transaction
+assert c.call('multi') == b'+OK'
+c.call('subscribe', 'ps_a')
+assert c.call('exec') == [b'-ERR (P)SUBSCRIBE is not allowed inside MULTI.']
+assert c.call('publish', 'ps_a', 'x') == b':0'
+
+# RESP3: pushes, and other commands keep working
+s3 = Conn()
+s3.call('hello', '3')
+assert s3.call('subscribe', 'ps_r') == ('>', [b'subscribe', b'ps_r', b':1'])
+assert s3.call('set', 'ps_k', 'v') == b'+OK'
+assert c.call('publish', 'ps_r', 'r3') == b':1'
+assert s3.reply() == ('>', [b'message', b'ps_r', b'r3'])
+assert s3.call('get', 'ps_k') == b'v'
+assert s3.call('ping') == b'PONG'
+c.call('del', 'ps_k')
+
+# a disconnected subscriber is gone
+s3.sock.close()
+time.sleep(0.1)
+assert c.call('publish', 'ps_r', 'x') == b':0'
+assert c.info('stats')['pubsub_channels'] == base['pubsub_channels']
+
+# one message to many
+subs = [Conn() for _ in range(200)]
+for i, s in enumerate(subs):
+    if i % 2:
+        s.send('subscribe', 'ps_many')
+    else:
+        s.send('psubscribe', 'ps_m*')
+for s in subs:
+    s.reply()
+payload = b'p' * 10000
+assert c.call('publish', 'ps_many', payload) == b':200'
+for i, s in enumerate(subs):
+    want = [b'message', b'ps_many', payload] if i % 2 else [b'pmessage', b'ps_m*', b'ps_many', payload]
+    assert s.reply() == want
+for s in subs:
+    s.sock.close()
+time.sleep(0.1)
+info = c.info('stats')
+assert info['pubsub_channels'] == base['pubsub_channels']
+assert info['pubsub_patterns'] == base['pubsub_patterns']
+assert info['pubsub_messages'] >= base['pubsub_messages'] + 210
+
+print('pubsub OK')
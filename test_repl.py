@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+# Replication, against a server on port 1234 as the primary. Starts its own
+# replica, ./server on port 1235.
+
+import os
+import signal
+import subprocess
+import time
+
+from resp_client import Conn
+
+
+OK = b'+OK'
+NIL = b'$-1'
+
+
+def start_replica():
+    proc = subprocess.Popen(['./server', '--port', '1235'], stderr=subprocess.DEVNULL)
+    deadline = time.time() + 5
+    while True:
+        try:
+            return proc, Conn(1235)
+        except ConnectionRefusedError:
+            assert time.time() < deadline, 'the replica did not start'
+            time.sleep(0.02)
+
+
+def wait_synced(p, r):
+    deadline = time.time() + 10
+    while True:
+        want = p.info('replication')['repl_offset']
+        got = r.info('replication')
+        if got['primary_link_up'] and got['repl_offset'] == want:
+            return
+        assert time.time() < deadline, (want, got)
+        time.sleep(0.02)
+
+
+def dump(c, keys):
+    # strings, zsets, hashes, lists, sets and whether the key has a TTL
+    out = []
+    for k in keys:
+        v = c.call('get', k)
+        if v.startswith(b'-WRONGTYPE'):
+            v = c.call('zquery', k, '-inf', '', '0', '1000')
+        if isinstance(v, bytes) and v.startswith(b'-WRONGTYPE'):
+            v = sorted(c.call('hgetall', k))
+        if isinstance(v, bytes) and v.startswith(b'-WRONGTYPE'):
+            v = c.call('lrange', k, '0', '-1')
+        if isinstance(v, bytes) and v.startswith(b'-WRONGTYPE'):
+            v = sorted(c.call('smembers', k))
+        out.append((k, v, c.call('pttl', k) != b':-1'))
+    return out
+
+
+def same(p, r, keys):
+    wait_synced(p, r)
+    a, b = dump(p, keys), dump(r, keys)
+    assert a == b, [(x, y) for x, y in zip(a, b) if x != y][:5]
+
+
+p = Conn(1234)
+keys = ['rp_s%d' % i for i in range(200)] + ['rp_z%d' % i for i in range(20)] + ['rp_t', 'rp_m1', 'rp_m2', 'rp_h', 'rp_l', 'rp_set', 'rp_big', 'rp_x']
+p.pipeline([('del', k) for k in keys])
+
+# data from before the replica attaches comes with the snapshot
+p.pipeline([('set', 'rp_s%d' % i, 'v%d' % i) for i in range(100)])
+p.pipeline([('zadd', 'rp_z%d' % (i % 20), str(i * 0.1), 'm%d' % i) for i in range(500)])
+p.call('pexpire', 'rp_s0', '100000')
+p.call('hset', 'rp_h', 'a', '1', 'b', '2')
+p.call('rpush', 'rp_l', *['e%d' % i for i in range(1000)])
+p.call('sadd', 'rp_set', '1', '2', 'three')
+# the snapshot packs the stream into other blocks than the primary's
+p.pipeline([('xadd', 'rp_x', '%d-1' % i, 'f', 'v%d' % i) for i in range(1, 151)])
+p.call('xtrim', 'rp_x', 'maxlen', '120')
+proc, r = start_replica()
+try:
+    full = p.info('replication')['sync_full']
+    assert r.call('replicaof', '127.0.0.1', '1234') == OK
+    same(p, r, keys)
+    assert p.info('replication')['sync_full'] == full + 1
+    assert p.info('replication')['connected_replicas'] == 1
+    assert r.info('replication')['is_replica'] == 1
+
+    # then every write is streamed
+    p.pipeline([('set', 'rp_s%d' % i, 'w%d' % i) for i in range(50, 200)])
+    p.call('del', 'rp_s1', 'rp_s2')
+    p.call('zadd', 'rp_z0', '99', 'new')
+    p.call('zrem', 'rp_z1', 'm1')
+    p.call('mset', 'rp_m1', 'a', 'rp_m2', 'b')
+    p.call('pexpire', 'rp_s3', '100000')
+    p.call('hincrby', 'rp_h', 'a', '10')
+    p.call('hdel', 'rp_h', 'b')
+    p.call('srem', 'rp_set', '2')
+    p.call('lpush', 'rp_l', 'head')
+    p.call('rpop', 'rp_l')
+    p.call('ltrim', 'rp_l', '0', '500')
+    assert p.call('blpop', 'rp_l', '0') == [b'rp_l', b'head']   # goes to the replica as LPOP
+    assert p.call('multi') == OK
+    p.call('set', 'rp_t', 'x')
+    p.call('zadd', 'rp_z2', '5', 'y')
+    assert len(p.call('exec')) == 2
+    same(p, r, keys)
+
+    # so ~ trims, which drop whole blocks, go out as exact ones
+    assert p.call('xtrim', 'rp_x', 'maxlen', '~', '50') == b':70'
+    p.call('xadd', 'rp_x', 'MAXLEN', '~', '20', '151-1', 'f', 'v')
+    p.call('xtrim', 'rp_x', 'MINID', '~', '140')
+    p.call('xadd', 'rp_x', 'minid', '~', '145', '152-1', 'f', 'v')
+    wait_synced(p, r)
+    assert p.call('xlen', 'rp_x') == r.call('xlen', 'rp_x')
+    assert p.call('xrange', 'rp_x', '-', '+') == r.call('xrange', 'rp_x', '-', '+')
+
+    # replicas don't take writes from clients
+    assert r.call('set', 'rp_t', 'y').startswith(b'-READONLY')
+    assert r.call('get', 'rp_t') == b'x'
+
+    # a key expiring on the primary goes away on the replica too
+    p.call('pexpire', 'rp_t', '50')
+    time.sleep(0.2)
+    wait_synced(p, r)
+    assert r.call('get', 'rp_t') == NIL
+
+    # a replica that went away for a while resumes from the backlog
+    assert p.call('config', 'set', 'repl-timeout-ms', '500') == OK
+    partial = p.info('replication')['sync_partial_ok']
+    os.kill(proc.pid, signal.SIGSTOP)
+    time.sleep(0.3)
+    p.pipeline([('set', 'rp_s%d' % i, 'x%d' % i) for i in range(100)])
+    deadline = time.time() + 5
+    while p.info('replication')['connected_replicas'] and time.time() < deadline:
+        time.sleep(0.05)
+    assert p.info('replication')['connected_replicas'] == 0
+    p.pipeline([('set', 'rp_s%d' % i, 'y%d' % i) for i in range(100, 150)])
+    os.kill(proc.pid, signal.SIGCONT)
+    assert p.call('config', 'set', 'repl-timeout-ms', '60000') == OK
+    same(p, r, keys)
+    assert p.info('replication')['sync_partial_ok'] == partial + 1
+    assert p.info('replication')['sync_full'] == full + 1
+
+    # one that stops reading is dropped at the output hard limit, long before the timeout
+    dropped = p.info('clients')['output_limit_disconnects']
+    assert p.call('config', 'set', 'client-output-hard-limit', str(1 << 20)) == OK
+    os.kill(proc.pid, signal.SIGSTOP)
+    time.sleep(0.1)
+    for i in range(200):
+        p.call('set', 'rp_big', 'b%d' % i * 20000)
+        if not p.info('replication')['connected_replicas']:
+            break
+    assert p.info('replication')['connected_replicas'] == 0
+    assert p.info('clients')['output_limit_disconnects'] == dropped + 1
+    assert p.info('clients')['client_output_bytes'] < 8 << 20
+    assert p.call('config', 'set', 'client-output-hard-limit', str(256 << 20)) == OK
+    os.kill(proc.pid, signal.SIGCONT)
+    same(p, r, keys)
+
+    # promoted, it takes writes and no longer follows
+    assert r.call('replicaof', 'no', 'one') == OK
+    assert r.call('set', 'rp_t', 'local') == OK
+    p.call('set', 'rp_t', 'remote')
+    time.sleep(0.1)
+    assert r.call('get', 'rp_t') == b'local'
+    assert r.info('replication')['is_replica'] == 0
+finally:
+    proc.kill()
+    proc.wait()
+
+p.pipeline([('del', k) for k in keys])
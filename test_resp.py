@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+# RESP clients on the TLV server, run against a server on port 1234.
+
+from resp_client import Conn, enc
+
+
+c = Conn()
+c.send('PING')
+c.expect(b'$4\r\nPONG\r\n')
+c.send('DEL', 'resp_k')
+c.expect(b':0\r\n')
+c.send('SET', 'resp_k', 'v1')
+c.expect(b'+OK\r\n')
+c.send('get', 'resp_k')
+c.expect(b'$2\r\nv1\r\n')
+c.send('NOSUCHCMD')
+c.expect(b'-ERR unknown command.\r\n')
+c.send('ZADD', 'resp_z', '1.5', 'a')
+c.expect(b':1\r\n')
+c.send('ZSCORE', 'resp_z', 'a')
+c.expect(b'$3\r\n1.5\r\n')
+c.send('GET', 'resp_z')
+c.expect(b'-WRONGTYPE not a string value\r\n')
+# array counts are patched after the fact
+c.send('ZQUERY', 'resp_z', '0', '', '0', '10')
+c.expect(b'*2\r\n$1\r\na\r\n$3\r\n1.5\r\n')
+c.send('ZQUERY', 'resp_z', '9', '', '0', '10')
+c.expect(b'*0\r\n')
+
+# pipelined, and a request split across writes
+c.send_raw(enc('GET', 'resp_k') * 3 + b'*2\r\n$3\r\nGE')
+c.expect(b'$2\r\nv1\r\n' * 3)
+c.send_raw(b'T\r\n$6\r\nresp_k\r\n')
+c.expect(b'$2\r\nv1\r\n')
+
+# big values are sent by reference
+big = b'x' * 100000
+c.send_raw(enc('SET', 'resp_big', big) + enc('GET', 'resp_big'))
+c.expect(b'+OK\r\n$100000\r\n' + big + b'\r\n')
+
+# RESP3 after HELLO 3
+c.send('HELLO', '3')
+c.expect(b'%2\r\n$6\r\nserver\r\n$10\r\nredis-lite\r\n$5\r\nproto\r\n:3\r\n')
+c.send_raw(enc('GET', 'nokey') + enc('ZSCORE', 'resp_z', 'a'))
+c.expect(b'_\r\n,1.5\r\n')
+c.send('HELLO', '4')
+c.expect(b'-ERR unsupported protocol version.\r\n')
+
+# malformed requests close the connection
+bad = Conn()
+bad.send_raw(b'*1\r\n$x\r\n')
+assert bad.sock.recv(100) == b''
+
+c.send_raw(enc('DEL', 'resp_k') + enc('DEL', 'resp_z') + enc('DEL', 'resp_big'))
+c.expect(b':1\r\n' * 3)
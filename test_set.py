@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+# Sets, run against a server on port 1234. Also compares the memory of tag
+# memberships stored as sets with the zset-with-dummy-scores workaround.
+
+import random
+
+from resp_client import Conn
+
+
+c = Conn()
+c.call('del', 's_a', 's_b', 's_c', 's_str')
+
+# the basics, as an intset
+assert c.call('sadd', 's_a', '3', '1', '2', '1') == b':3'
+assert c.call('smembers', 's_a') == [b'1', b'2', b'3']
+assert c.call('sismember', 's_a', '2') == b':1'
+assert c.call('sismember', 's_a', '02') == b':0'
+assert c.call('sismember', 's_nokey', '2') == b':0'
+assert c.call('scard', 's_a') == b':3'
+assert c.call('srem', 's_a', '2', '5') == b':1'
+assert c.call('smembers', 's_nokey') == []
+
+# integers that don't print back the same stay strings
+assert c.call('sadd', 's_b', '-5', str(-2**63), str(2**63 - 1)) == b':3'
+assert c.call('sadd', 's_b', '007', '-0', '+1', str(2**63), '') == b':5'
+assert sorted(c.call('smembers', 's_b')) == sorted(
+    [b'-5', str(-2**63).encode(), str(2**63 - 1).encode(), b'007', b'-0', b'+1', str(2**63).encode(), b''])
+assert c.call('sismember', 's_b', '007') == b':1'
+assert c.call('sismember', 's_b', '7') == b':0'
+
+# type checks both ways
+c.call('set', 's_str', 'x')
+assert c.call('sadd', 's_str', '1') == b'-WRONGTYPE expect set'
+assert c.call('sinter', 's_a', 's_str') == b'-WRONGTYPE expect set'
+assert c.call('get', 's_a') == b'-WRONGTYPE not a string value'
+
+# the last member takes the key with it
+assert c.call('srem', 's_a', '1', '3') == b':2'
+assert c.call('pttl', 's_a') == b':-2'
+
+# intersections and unions against a model, intsets and tables mixed
+random.seed(3)
+model = {}
+for name, size, universe in [('s_a', 400, 1000), ('s_b', 300, 1000), ('s_c', 5000, 20000)]:
+    c.call('del', name)
+    vals = set(str(random.randrange(universe)) for _ in range(size))
+    c.pipeline([('sadd', name, *list(vals)[i:i + 100]) for i in range(0, len(vals), 100)])
+    model[name] = vals
+assert set(c.call('smembers', 's_c')) == set(v.encode() for v in model['s_c'])
+
+
+def check(*names):
+    inter = set.intersection(*(model[n] for n in names))
+    union = set.union(*(model[n] for n in names))
+    assert sorted(c.call('sinter', *names)) == sorted(v.encode() for v in inter), names
+    assert sorted(c.call('sunion', *names)) == sorted(v.encode() for v in union), names
+
+
+check('s_a', 's_b')             # intsets, the SIMD merge
+check('s_a', 's_b', 's_c')      # a table (over set-max-intset-entries) in the mix
+check('s_c', 's_a')
+assert c.call('sinter', 's_a', 's_nokey') == []
+assert sorted(c.call('sunion', 's_a', 's_nokey')) == sorted(v.encode() for v in model['s_a'])
+c.call('sadd', 's_a', 'tag')    # no longer all integers
+model['s_a'].add('tag')
+check('s_a', 's_b')
+c.call('del', 's_a', 's_b', 's_c', 's_str')
+
+# memory per tag: 100 member ids as a set vs as a zset with dummy scores, and the
+# same with string members
+N = 1000
+
+
+def measure(store):
+    base = c.info('memory')['used_memory']
+    for i in range(0, N, 20):
+        c.pipeline([cmd for j in range(i, i + 20) for cmd in store(j)])
+    return (c.info('memory')['used_memory'] - base) / N
+
+
+def members(j, fmt):
+    return [fmt % ((j * 37 + k * 101) % 100000) for k in range(100)]
+
+
+def forget():
+    c.pipeline([('del', 's_t:%d' % j) for j in range(N)])
+
+
+ids_set = measure(lambda j: [('sadd', 's_t:%d' % j, *members(j, '%d'))])
+forget()
+ids_zset = measure(lambda j: [('zadd', 's_t:%d' % j, '0', m) for m in members(j, '%d')])
+forget()
+tags_set = measure(lambda j: [('sadd', 's_t:%d' % j, *members(j, 'user:%d'))])
+forget()
+tags_zset = measure(lambda j: [('zadd', 's_t:%d' % j, '0', m) for m in members(j, 'user:%d')])
+forget()
+assert ids_set * 5 < ids_zset, (ids_set, ids_zset)
+assert tags_set * 1.5 < tags_zset, (tags_set, tags_zset)
@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+# SLOWLOG, WATCHDOG and CONFIG GET/SET, run against a server on port 1234.
+
+from resp_client import Conn
+
+OK = b'+OK'
+
+c = Conn()
+threshold = c.call('config', 'get', 'slowlog-threshold-us')
+max_len = c.call('config', 'get', 'slowlog-max-len')
+budget = c.call('config', 'get', 'loop-budget-us')
+
+# settings round trip, names ignore case
+assert c.call('config', 'set', 'SLOWLOG-Threshold-US', '0') == OK
+assert c.call('config', 'get', 'slowlog-threshold-us') == b':0'
+assert c.call('config', 'set', 'slowlog-max-len', '1000') == OK
+assert c.call('config', 'get', 'SLOWLOG-MAX-LEN') == b':1000'
+# and bad values leave them as they were
+for name, val in (('slowlog-threshold-us', 'abc'), ('slowlog-threshold-us', '-2'),
+                  ('slowlog-max-len', '-1'), ('slowlog-max-len', str((1 << 20) + 1)),
+                  ('slowlog-max-len', '12x')):
+    assert c.call('config', 'set', name, val) == b'-ERR bad config value.'
+assert c.call('config', 'get', 'slowlog-threshold-us') == b':0'
+assert c.call('config', 'get', 'slowlog-max-len') == b':1000'
+assert c.call('config', 'get', 'no-such-config') == b'-ERR unknown config.'
+assert c.call('config', 'set', 'port', '4321') == b'-ERR can only be set at startup.'
+assert c.call('config', 'get', 'port') == b':1234'
+
+# with a threshold of 0 every command is logged, after it ran
+assert c.call('slowlog', 'reset') == OK
+assert c.call('slowlog', 'len') == b':1'     # the RESET
+c.call('set', 'sl_k', 'x' * 300)
+c.call('get', 'sl_k')
+got = c.call('slowlog', 'get', '2')
+assert len(got) == 2
+(get_id, get_ms, _, _, get_args), (set_id, set_ms, _, _, set_args) = got
+assert int(get_id[1:]) == int(set_id[1:]) + 1
+assert int(get_ms[1:]) >= int(set_ms[1:]) > 0
+assert get_args == [b'get', b'sl_k']
+assert set_args == [b'set', b'sl_k', b'x' * 128]    # long args are cut
+assert c.call('slowlog', 'len') == b':5'            # RESET, LEN, SET, GET, GET 2
+assert len(c.call('slowlog', 'get')) == 6           # up to 10 by default
+assert c.call('slowlog', 'get', '-1') == b'-ERR expect SLOWLOG GET [n]|LEN|RESET.'
+
+# the ring keeps the newest entries
+c.call('config', 'set', 'slowlog-max-len', '3')
+for i in range(10):
+    c.call('ping', str(i))
+got = c.call('slowlog', 'get', '100')
+assert len(got) == 3
+assert [e[4] for e in got] == [[b'ping', b'9'], [b'ping', b'8'], [b'ping', b'7']]
+
+# a threshold of -1 turns it off
+c.call('config', 'set', 'slowlog-threshold-us', '-1')
+assert c.call('slowlog', 'reset') == OK
+c.call('ping')
+assert c.call('slowlog', 'len') == b':0'
+
+# a budget of 0 records every phase that took 1us or more
+c.call('config', 'set', 'loop-budget-us', '0')
+assert c.call('watchdog', 'reset') == OK
+c.pipeline([('set', 'sl_k%d' % i, 'v') for i in range(2000)])
+c.call('config', 'set', 'loop-budget-us', '-1')
+got = c.call('watchdog', 'get', '1000')
+assert got and all(e[3] in (b'poll', b'read', b'write', b'timers') for e in got)
+assert any(e[3] == b'read' for e in got)
+ids = [int(e[0][1:]) for e in got]
+assert ids == sorted(ids, reverse=True)             # newest first
+assert c.call('watchdog', 'reset') == OK
+assert c.call('watchdog', 'get') == []
+assert c.call('watchdog', 'len') == b'-ERR expect WATCHDOG GET [n]|RESET.'
+
+c.call('config', 'set', 'slowlog-threshold-us', threshold[1:])
+c.call('config', 'set', 'slowlog-max-len', max_len[1:])
+c.call('config', 'set', 'loop-budget-us', budget[1:])
+c.call('slowlog', 'reset')
+c.pipeline([('del', 'sl_k%d' % i) for i in range(2000)] + [('del', 'sl_k')])
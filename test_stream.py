@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+# Streams and blocking XREAD, run against a server on port 1234.
+
+import random
+import time
+
+from resp_client import Conn
+
+
+c = Conn()
+NIL = b'$-1'
+BAD_ID = b'-ERR Invalid stream ID specified as stream command argument'
+SMALLER = b'-ERR The ID specified in XADD is equal or smaller than the target stream top item'
+c.call('del', 'x_a', 'x_b', 'x_big', 'x_str', 'x_mem', 'x_z')
+
+# IDs only grow: explicit, "ms-*" and "ms" number within the ms, "*" takes the clock
+assert c.call('xadd', 'x_a', '5-1', 'f', 'v') == b'5-1'
+assert c.call('xadd', 'x_a', '5-1', 'f', 'v') == SMALLER
+assert c.call('xadd', 'x_a', '4-9', 'f', 'v') == SMALLER
+assert c.call('xadd', 'x_a', '5-*', 'f', 'v') == b'5-2'
+assert c.call('xadd', 'x_a', '5', 'f', 'v') == b'5-3'
+assert c.call('xadd', 'x_a', '6', 'f', 'v') == b'6-0'
+assert c.call('xadd', 'x_b', '0-0', 'f', 'v') == b'-ERR The ID specified in XADD must be greater than 0-0'
+assert c.call('xadd', 'x_b', '0-*', 'f', 'v') == b'0-1'
+assert c.call('xadd', 'x_b', '1-x', 'f', 'v') == BAD_ID
+assert c.call('xadd', 'x_b', '*', 'f') == b'-ERR wrong number of arguments.'
+now_ms = int(time.time() * 1000)
+ms, seq = c.call('xadd', 'x_b', '*', 'f', 'v').split(b'-')
+assert abs(int(ms) - now_ms) < 5000 and seq == b'0'
+assert c.call('xadd', 'x_b', str(int(ms) + 10 ** 9) + '-5', 'f', 'v').endswith(b'-5')
+ms2, seq2 = c.call('xadd', 'x_b', '*', 'f', 'v').split(b'-')
+assert int(ms2) == int(ms) + 10 ** 9 and seq2 == b'6'   # the clock is behind the last ID
+assert c.call('xadd', 'x_nope', 'nomkstream', '*', 'f', 'v') == NIL
+assert c.call('xlen', 'x_nope') == b':0'
+assert c.call('xlen', 'x_a') == b':4'
+c.call('set', 'x_str', 'v')
+assert c.call('xadd', 'x_str', '*', 'f', 'v') == b'-WRONGTYPE expect stream'
+assert c.call('xlen', 'x_str') == b'-WRONGTYPE expect stream'
+
+# ranges: - and +, a missing seq covers the whole ms, ( excludes
+assert c.call('xrange', 'x_a', '-', '+') == [
+    [b'5-1', [b'f', b'v']], [b'5-2', [b'f', b'v']], [b'5-3', [b'f', b'v']], [b'6-0', [b'f', b'v']]]
+assert [e[0] for e in c.call('xrange', 'x_a', '5', '5')] == [b'5-1', b'5-2', b'5-3']
+assert [e[0] for e in c.call('xrange', 'x_a', '(5-1', '(6-0')] == [b'5-2', b'5-3']
+assert [e[0] for e in c.call('xrange', 'x_a', '-', '+', 'count', '2')] == [b'5-1', b'5-2']
+assert [e[0] for e in c.call('xrevrange', 'x_a', '+', '-', 'count', '3')] == [b'6-0', b'5-3', b'5-2']
+assert [e[0] for e in c.call('xrevrange', 'x_a', '5-2', '-')] == [b'5-2', b'5-1']
+assert c.call('xrange', 'x_a', '6', '5') == []
+assert c.call('xrange', 'x_nope', '-', '+') == []
+assert c.call('xrange', 'x_a', 'abc', '+') == BAD_ID
+
+# many small blocks: ranges from anywhere in both directions, then trims
+c.call('config', 'set', 'stream-node-max-entries', '7')
+model = []
+for i in range(500):
+    fields = ['k%d' % j for j in range(random.randint(1, 3)) for _ in range(2)]
+    id = c.call('xadd', 'x_big', '%d-%d' % (i // 3 + 1, i % 3), *fields)
+    model.append((id, [f.encode() for f in fields]))
+c.call('config', 'set', 'stream-node-max-entries', '100')
+assert c.call('xrange', 'x_big', '-', '+') == [[id, f] for id, f in model]
+for _ in range(50):
+    lo, hi = sorted(random.sample(range(len(model)), 2))
+    want = [m[0] for m in model[lo:hi + 1]]
+    assert [e[0] for e in c.call('xrange', 'x_big', model[lo][0], model[hi][0])] == want
+    assert [e[0] for e in c.call('xrevrange', 'x_big', model[hi][0], model[lo][0])] == want[::-1]
+assert c.call('xtrim', 'x_big', 'maxlen', '=', '490') == b':10'
+model = model[10:]
+assert c.call('xrange', 'x_big', '-', '+', 'count', '1')[0][0] == model[0][0]
+# whole blocks only: the 4 left in the first one, then 12 of 7
+assert c.call('xtrim', 'x_big', 'maxlen', '~', '400') == b':88'
+model = model[88:]
+assert c.call('xlen', 'x_big') == b':%d' % len(model)
+assert c.call('xtrim', 'x_big', 'minid', model[5][0]) == b':5'
+model = model[5:]
+assert c.call('xrange', 'x_big', '-', '+') == [[id, f] for id, f in model]
+assert c.call('xadd', 'x_big', 'maxlen', '3', '999-0', 'f', 'v') == b'999-0'
+assert [e[0] for e in c.call('xrange', 'x_big', '-', '+')] == [model[-2][0], model[-1][0], b'999-0']
+assert c.call('xtrim', 'x_big', 'maxlen', '0') == b':3'
+assert c.call('xlen', 'x_big') == b':0'
+assert c.call('xadd', 'x_big', '999-0', 'f', 'v') == SMALLER   # an empty stream keeps its last ID
+assert c.call('xtrim', 'x_big', 'size', '0') == b'-ERR syntax error.'
+
+# packed entries cost far less than a sorted set member
+before = c.info('memory')['used_memory']
+for i in range(2000):
+    c.send('xadd', 'x_mem', '*', 'f', 'v')
+for i in range(2000):
+    c.reply()
+stream_mem = c.info('memory')['used_memory'] - before
+for i in range(2000):
+    c.send('zadd', 'x_z', str(i), 'm%d' % i)
+for i in range(2000):
+    c.reply()
+zset_mem = c.info('memory')['used_memory'] - before - stream_mem
+assert stream_mem * 4 < zset_mem, (stream_mem, zset_mem)
+c.call('del', 'x_mem', 'x_z')
+
+# XREAD: what comes after each ID, for the streams that have something
+assert c.call('xread', 'streams', 'x_a', 'x_nope', '5-2', '0') == [
+    [b'x_a', [[b'5-3', [b'f', b'v']], [b'6-0', [b'f', b'v']]]]]
+assert c.call('xread', 'count', '1', 'streams', 'x_a', '0') == [[b'x_a', [[b'5-1', [b'f', b'v']]]]]
+assert c.call('xread', 'streams', 'x_a', '$') == NIL
+assert c.call('xread', 'streams', 'x_a', 'x_b', '0') == \
+    b"-ERR Unbalanced 'xread' list of streams: for each stream key an ID or '$' must be specified."
+assert c.call('xread', 'streams', 'x_str', '0') == b'-WRONGTYPE expect stream'
+
+# BLOCK waits for an XADD, `$` is the last ID when it started waiting
+r1, r2, r3 = Conn(), Conn(), Conn()
+r1.send('xread', 'block', '0', 'streams', 'x_a', '$')
+r2.send('xread', 'block', '0', 'streams', 'x_nope', 'x_a', '0', '6-0')
+r3.send('xread', 'block', '0', 'streams', 'x_nope', '$')
+r1.send('ping')     # pipelined behind the blocked request
+time.sleep(0.1)
+assert not r1.pending() and not r2.pending()
+assert c.info('clients')['blocked_clients'] == 3
+assert c.call('xadd', 'x_a', '7-0', 'g', 'w') == b'7-0'
+assert r1.reply() == [[b'x_a', [[b'7-0', [b'g', b'w']]]]]
+assert r1.reply() == b'PONG'
+assert r2.reply() == [[b'x_a', [[b'7-0', [b'g', b'w']]]]]
+assert not r3.pending()
+assert c.call('xadd', 'x_nope', '1-1', 'h', 'x') == b'1-1'
+assert r3.reply() == [[b'x_nope', [[b'1-1', [b'h', b'x']]]]]
+c.call('del', 'x_nope')
+
+# it gives up after the timeout, and never waits inside EXEC
+assert r1.call('xread', 'block', '100', 'streams', 'x_a', '$') == NIL
+assert c.call('multi') == b'+OK'
+c.call('xread', 'block', '0', 'streams', 'x_a', '$')
+assert c.call('exec') == [NIL]
+assert c.info('clients')['blocked_clients'] == 0
+
+# a reader woken by an ID it's already past waits again
+r1.send('xread', 'block', '0', 'streams', 'x_a', '8-0')
+time.sleep(0.1)
+assert c.call('xadd', 'x_a', '7-1', 'f', 'v') == b'7-1'
+assert not r1.pending()
+assert c.call('xadd', 'x_a', '8-1', 'f', 'v') == b'8-1'
+assert r1.reply() == [[b'x_a', [[b'8-1', [b'f', b'v']]]]]
+
+c.call('del', 'x_a', 'x_b', 'x_big', 'x_str')
+print('stream OK')
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+# MULTI/EXEC/DISCARD/WATCH, run against a server on port 1234. Speaks RESP
+# because ./client sends a single command per connection.
+
+from resp_client import Conn
+
+
+OK = b'+OK\r\n'
+NIL = b'$-1\r\n'
+QUEUED = b'$6\r\nQUEUED\r\n'
+
+a = Conn()
+b = Conn()
+a.check(['del', 'tx_k', 'tx_z'], b':0\r\n')
+
+# the batch runs at once, the replies come back as one array
+a.check(['multi'], OK)
+a.check(['set', 'tx_k', 'v1'], QUEUED)
+a.check(['get', 'tx_k'], QUEUED)
+a.check(['zadd', 'tx_k', '1', 'm'], QUEUED)
+b.check(['get', 'tx_k'], NIL)
+a.check(['exec'], b'*3\r\n' + OK + b'$2\r\nv1\r\n-WRONGTYPE expect zset\r\n')
+
+a.check(['exec'], b'-ERR EXEC without MULTI.\r\n')
+a.check(['discard'], b'-ERR DISCARD without MULTI.\r\n')
+a.check(['multi'], OK)
+a.check(['multi'], b'-ERR MULTI calls can not be nested.\r\n')
+a.check(['set', 'tx_k', 'v2'], QUEUED)
+a.check(['discard'], OK)
+a.check(['get', 'tx_k'], b'$2\r\nv1\r\n')
+
+# a command that fails to queue discards the whole batch
+a.check(['multi'], OK)
+a.check(['set', 'tx_k', 'v3'], QUEUED)
+a.check(['nosuchcmd'], b'-ERR unknown command.\r\n')
+a.check(['get'], b'-ERR wrong number of arguments.\r\n')
+a.check(['exec'], b'-ERR transaction discarded because of previous errors.\r\n')
+a.check(['get', 'tx_k'], b'$2\r\nv1\r\n')
+
+# WATCH: a write by another client makes EXEC fail
+a.check(['watch', 'tx_k', 'tx_z'], OK)
+b.check(['set', 'tx_k', 'v4'], OK)
+a.check(['multi'], OK)
+a.check(['set', 'tx_k', 'v5'], QUEUED)
+a.check(['exec'], NIL)
+a.check(['get', 'tx_k'], b'$2\r\nv4\r\n')
+
+# EXEC clears the watches, so the next one goes through
+a.check(['multi'], OK)
+a.check(['set', 'tx_k', 'v5'], QUEUED)
+a.check(['exec'], b'*1\r\n' + OK)
+
+# deleting, creating and expiring count as writes, reading doesn't
+for other in (['del', 'tx_k'], ['zadd', 'tx_z', '1', 'm'], ['pexpire', 'tx_z', '100000']):
+    a.check(['watch', 'tx_k', 'tx_z'], OK)
+    b.check(['get', 'tx_k'], b'$2\r\nv5\r\n' if other[0] == 'del' else NIL)
+    b.call(*other)
+    a.check(['multi'], OK)
+    a.check(['get', 'tx_k'], QUEUED)
+    a.check(['exec'], NIL)
+
+a.check(['watch', 'tx_z'], OK)
+a.check(['unwatch'], OK)
+b.check(['zrem', 'tx_z', 'm'], b':1\r\n')
+a.check(['multi'], OK)
+a.check(['watch', 'tx_z'], b'-ERR WATCH inside MULTI is not allowed.\r\n')
+a.check(['zscore', 'tx_z', 'm'], QUEUED)
+a.check(['exec'], b'*1\r\n' + NIL)
+
+# a missing key that is created and deleted again has changed too
+a.check(['watch', 'tx_m'], OK)
+b.check(['set', 'tx_m', 'v'], OK)
+b.check(['del', 'tx_m'], b':1\r\n')
+a.check(['multi'], OK)
+a.check(['set', 'tx_m', 'v2'], QUEUED)
+a.check(['exec'], NIL)
+a.check(['get', 'tx_m'], NIL)
+
+a.check(['del', 'tx_k', 'tx_z'], b':1\r\n')
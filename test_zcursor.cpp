@@ -0,0 +1,81 @@
+#include <assert.h>
+#include <stdio.h>
+#include <set>
+#include <string>
+#include "zset.h"
+
+
+static std::string name_of(uint32_t i) {
+    return "n" + std::to_string(i);
+}
+
+static void add(ZSet &z, uint32_t i) {
+    std::string name = name_of(i);
+    zset_insert(&z, name.data(), name.size(), (double)i);
+}
+
+static void del(ZSet &z, uint32_t i) {
+    std::string name = name_of(i);
+    ZNode *node = zset_lookup(&z, name.data(), name.size());
+    if (node) {
+        zset_delete(&z, node);
+    }
+}
+
+// iterate while deleting the node under the cursor and inserting behind it
+static void test_mutations(uint32_t sz) {
+    ZSet z;
+    for (uint32_t i = 0; i < sz; i += 2) {
+        add(z, i);
+    }
+    ZCursor cur;
+    zcursor_open(&cur, &z, zset_seekge(&z, 0, "", 0));
+
+    std::set<uint32_t> stable;     // never touched, must all be visited
+    for (uint32_t i = 0; i < sz; i += 2) {
+        if (i % 6 != 2) {
+            stable.insert(i);
+        }
+    }
+    double last = -1;
+    uint32_t step = 0;
+    while (ZNode *node = zcursor_next(&cur)) {
+        assert(node->score > last);
+        last = node->score;
+        stable.erase((uint32_t)node->score);
+        // free the node the cursor points at next
+        if (cur.node && (uint32_t)cur.node->score % 6 == 2) {
+            del(z, (uint32_t)cur.node->score);
+            assert(cur.node == NULL && cur.reseek);
+        }
+        // insert odd scores, some behind and some ahead of the cursor
+        add(z, (step * 7919) % sz | 1);
+        step++;
+    }
+    assert(stable.empty());
+    zcursor_close(&cur);
+    zset_clear(&z);
+}
+
+// destroying the zset leaves the cursor exhausted
+static void test_clear() {
+    ZSet z;
+    for (uint32_t i = 0; i < 100; ++i) {
+        add(z, i);
+    }
+    ZCursor cur;
+    zcursor_open(&cur, &z, zset_seekge(&z, 0, "", 0));
+    assert(zcursor_next(&cur));
+    zset_clear(&z);
+    assert(cur.zset == NULL);
+    assert(zcursor_next(&cur) == NULL);
+    zcursor_close(&cur);
+}
+
+int main() {
+    for (uint32_t sz = 2; sz < 2000; sz += sz / 2 + 1) {
+        test_mutations(sz);
+    }
+    test_clear();
+    return 0;
+}
@@ -0,0 +1,211 @@
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.h"
+
+
+static int sys_setup(unsigned entries, io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete,
+    unsigned flags, void *arg, size_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+static int sys_register(int fd, unsigned op, void *arg, unsigned nr) {
+    return (int)syscall(__NR_io_uring_register, fd, op, arg, nr);
+}
+
+// the rings are shared with the kernel
+static unsigned load_acquire(unsigned *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+static void store_release(unsigned *p, unsigned v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+int uring_init(URing *ring, unsigned entries) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = entries * 4;     // multishot ops produce many CQEs per SQE
+    int fd = sys_setup(entries, &p);
+    if (fd < 0) {
+        return -errno;
+    }
+    ring->fd = fd;
+    // EXT_ARG is needed for the wait timeout, it implies everything else we rely on
+    if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        uring_destroy(ring);
+        return -ENOSYS;
+    }
+
+    // with SINGLE_MMAP, the SQ and CQ rings share one mapping
+    ring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (cq_size > ring->sq_size) {
+        ring->sq_size = cq_size;
+    }
+    ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        ring->sq_ptr = NULL;
+        int err = -errno;
+        uring_destroy(ring);
+        return err;
+    }
+    ring->cq_ptr = ring->sq_ptr;
+    ring->sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+    ring->sqes = (io_uring_sqe *)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        int err = -errno;
+        uring_destroy(ring);
+        return err;
+    }
+
+    uint8_t *sq = (uint8_t *)ring->sq_ptr;
+    ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    uint8_t *cq = (uint8_t *)ring->cq_ptr;
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (io_uring_cqe *)(cq + p.cq_off.cqes);
+    // a fixed 1:1 mapping between SQ array slots and SQEs
+    for (unsigned i = 0; i <= ring->sq_mask; i++) {
+        ring->sq_array[i] = i;
+    }
+    return 0;
+}
+
+bool uring_has_op(URing *ring, uint8_t op) {
+    const size_t nops = 256;
+    size_t size = sizeof(io_uring_probe) + nops * sizeof(io_uring_probe_op);
+    io_uring_probe *probe = (io_uring_probe *)calloc(1, size);
+    bool ok = false;
+    if (sys_register(ring->fd, IORING_REGISTER_PROBE, probe, nops) == 0) {
+        ok = op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+}
+
+int uring_setup_bufs(URing *ring, uint16_t bgid, uint32_t nbufs, uint32_t buf_size) {
+    // the ring size must be a power of 2
+    if (nbufs == 0 || (nbufs & (nbufs - 1)) || nbufs > 32768) {
+        return -EINVAL;
+    }
+    size_t br_size = nbufs * sizeof(io_uring_buf);
+    void *br = mmap(NULL, br_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (br == MAP_FAILED) {
+        return -errno;
+    }
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)br;
+    reg.ring_entries = nbufs;
+    reg.bgid = bgid;
+    if (sys_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        int err = -errno;
+        munmap(br, br_size);
+        return err;
+    }
+    uint8_t *bufs = (uint8_t *)malloc((size_t)nbufs * buf_size);
+    if (!bufs) {
+        sys_register(ring->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        munmap(br, br_size);
+        return -ENOMEM;
+    }
+    ring->br = (io_uring_buf_ring *)br;
+    ring->bufs = bufs;
+    ring->nbufs = nbufs;
+    ring->buf_size = buf_size;
+    ring->bgid = bgid;
+    // hand all buffers to the kernel
+    ring->br->tail = 0;
+    for (uint32_t i = 0; i < nbufs; i++) {
+        uring_buf_recycle(ring, (uint16_t)i);
+    }
+    return 0;
+}
+
+void uring_buf_recycle(URing *ring, uint16_t bid) {
+    uint16_t tail = ring->br->tail;
+    // not `br->bufs[]`: in C++ the header's flex array member sits after an empty
+    // struct and lands at offset 8, but the kernel expects bufs[0] to overlap the header
+    io_uring_buf *buf = (io_uring_buf *)ring->br + (tail & (ring->nbufs - 1));
+    buf->addr = (uint64_t)(uintptr_t)uring_buf(ring, bid);
+    buf->len = ring->buf_size;
+    buf->bid = bid;
+    __atomic_store_n(&ring->br->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+}
+
+void uring_destroy(URing *ring) {
+    if (ring->br) {
+        munmap(ring->br, ring->nbufs * sizeof(io_uring_buf));
+    }
+    free(ring->bufs);
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->sq_ptr) {
+        munmap(ring->sq_ptr, ring->sq_size);
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+    *ring = URing{};
+}
+
+io_uring_sqe *uring_get_sqe(URing *ring) {
+    unsigned head = load_acquire(ring->sq_head);
+    unsigned tail = *ring->sq_tail + ring->sq_pending;
+    if (tail - head > ring->sq_mask) {
+        return NULL;    // full
+    }
+    io_uring_sqe *sqe = &ring->sqes[tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_pending++;
+    return sqe;
+}
+
+int uring_submit_and_wait(URing *ring, unsigned wait_nr, int32_t timeout_ms) {
+    unsigned to_submit = ring->sq_pending;
+    store_release(ring->sq_tail, *ring->sq_tail + to_submit);
+    ring->sq_pending = 0;
+
+    unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    memset(&arg, 0, sizeof(arg));
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000 * 1000;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+    flags |= IORING_ENTER_EXT_ARG;
+    int rv = sys_enter(ring->fd, to_submit, wait_nr, flags, &arg, sizeof(arg));
+    if (rv < 0 && errno != ETIME && errno != EINTR) {
+        return -errno;
+    }
+    return 0;
+}
+
+io_uring_cqe *uring_peek_cqe(URing *ring) {
+    unsigned head = *ring->cq_head;
+    if (head == load_acquire(ring->cq_tail)) {
+        return NULL;
+    }
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+void uring_cqe_seen(URing *ring) {
+    store_release(ring->cq_head, *ring->cq_head + 1);
+}
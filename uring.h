@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+
+/*A minimal io_uring wrapper on top of the raw syscalls, so the server has no liburing dependency.
+It maps the submission/completion rings and one ring of provided receive buffers. The kernel
+picks a free buffer for each multishot recv completion, and we hand it back with uring_buf_recycle().*/
+struct URing {
+    int fd = -1;
+    // submission queue
+    unsigned *sq_head = NULL;
+    unsigned *sq_tail = NULL;
+    unsigned sq_mask = 0;
+    unsigned *sq_array = NULL;
+    io_uring_sqe *sqes = NULL;
+    unsigned sq_pending = 0;    // queued but not yet submitted
+    // completion queue
+    unsigned *cq_head = NULL;
+    unsigned *cq_tail = NULL;
+    unsigned cq_mask = 0;
+    io_uring_cqe *cqes = NULL;
+    // the mmap'ed regions
+    void *sq_ptr = NULL;
+    size_t sq_size = 0;
+    void *cq_ptr = NULL;
+    size_t cq_size = 0;
+    size_t sqes_size = 0;
+    // provided buffer ring for receives
+    io_uring_buf_ring *br = NULL;
+    uint8_t *bufs = NULL;
+    uint32_t nbufs = 0;
+    uint32_t buf_size = 0;
+    uint16_t bgid = 0;
+};
+
+// all of these return 0 or -errno
+int  uring_init(URing *ring, unsigned entries);
+int  uring_setup_bufs(URing *ring, uint16_t bgid, uint32_t nbufs, uint32_t buf_size);
+void uring_destroy(URing *ring);
+// check that the kernel supports an opcode
+bool uring_has_op(URing *ring, uint8_t op);
+
+// a zeroed SQE, NULL when the queue is full (submit first)
+io_uring_sqe *uring_get_sqe(URing *ring);
+// submit the queued SQEs and wait for at least `wait_nr` CQEs, or `timeout_ms` (< 0: forever)
+int  uring_submit_and_wait(URing *ring, unsigned wait_nr, int32_t timeout_ms);
+// the next completion, NULL when there is none; call uring_cqe_seen() when done with it
+io_uring_cqe *uring_peek_cqe(URing *ring);
+void uring_cqe_seen(URing *ring);
+
+// provided buffers
+inline uint8_t *uring_buf(URing *ring, uint16_t bid) {
+    return ring->bufs + (size_t)bid * ring->buf_size;
+}
+void uring_buf_recycle(URing *ring, uint16_t bid);
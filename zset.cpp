@@ -59,11 +59,29 @@ static void tree_insert(ZSet *zset, ZNode *node) {
     zset->root = avl_fix(&node->tree);
 }
 
+// a node that cursors point at is about to move or be freed:
+// save its position so the cursors can re-seek from it later.
+static void cursors_invalidate(ZSet *zset, ZNode *node) {
+    if (!zset->cursors.next) {
+        return;     // no cursor was ever opened
+    }
+    for (DList *it = zset->cursors.next; it != &zset->cursors; it = it->next) {
+        ZCursor *cur = container_of(it, ZCursor, link);
+        if (cur->node == node) {
+            cur->node = NULL;
+            cur->reseek = true;
+            cur->score = node->score;
+            cur->name.assign(node->name, node->len);
+        }
+    }
+}
+
 // update the score of an existing node
 static void zset_update(ZSet *zset, ZNode *node, double score) {
     if (node->score == score) {
         return;
     }
+    cursors_invalidate(zset, node);
     // detach the tree node
     zset->root = avl_del(&node->tree);
     avl_init(&node->tree);
@@ -80,6 +98,7 @@ bool zset_insert(ZSet *zset, const char *name, size_t len, double score) {
         return false;
     } else {
         node = znode_new(name, len, score);
+        zset->node_mem += sizeof(ZNode) + len;
         hm_insert(&zset->hmap, &node->hmap);
         tree_insert(zset, node);
         return true;
@@ -125,9 +144,11 @@ void zset_delete(ZSet *zset, ZNode *node) {
     key.len = node->len;
     HNode *found = hm_delete(&zset->hmap, &key.node, &hcmp);
     assert(found);
+    cursors_invalidate(zset, node);
     // remove from the tree
     zset->root = avl_del(&node->tree);
     // deallocate the node
+    zset->node_mem -= sizeof(ZNode) + node->len;
     znode_del(node);
 }
 
@@ -162,7 +183,58 @@ static void tree_dispose(AVLNode *node) {
 
 // destroy the zset
 void zset_clear(ZSet *zset) {
+    // open cursors outlive the zset, they just become exhausted
+    while (zset->cursors.next && !dlist_empty(&zset->cursors)) {
+        ZCursor *cur = container_of(zset->cursors.next, ZCursor, link);
+        zcursor_close(cur);
+    }
     hm_clear(&zset->hmap);
     tree_dispose(zset->root);
     zset->root = NULL;
-}
\ No newline at end of file
+    zset->node_mem = 0;
+}
+
+size_t zset_mem(ZSet *zset) {
+    return zset->node_mem + hm_mem(&zset->hmap);
+}
+
+void zcursor_open(ZCursor *cur, ZSet *zset, ZNode *start) {
+    cur->node = start;
+    cur->reseek = false;
+    if (!start) {
+        return;     // nothing to iterate, don't attach
+    }
+    if (!zset->cursors.next) {
+        dlist_init(&zset->cursors);
+    }
+    cur->zset = zset;
+    dlist_insert_before(&zset->cursors, &cur->link);
+}
+
+ZNode *zcursor_next(ZCursor *cur) {
+    if (!cur->zset) {
+        return NULL;
+    }
+    if (cur->reseek) {
+        // the saved node is gone, continue from the first tuple >= it
+        cur->node = zset_seekge(cur->zset, cur->score, cur->name.data(), cur->name.size());
+        cur->reseek = false;
+        cur->name.clear();
+    }
+    ZNode *node = cur->node;
+    if (!node) {
+        zcursor_close(cur);
+        return NULL;
+    }
+    cur->node = znode_offset(node, +1);
+    return node;
+}
+
+void zcursor_close(ZCursor *cur) {
+    if (cur->zset) {
+        dlist_detach(&cur->link);
+        cur->zset = NULL;
+    }
+    cur->node = NULL;
+    cur->reseek = false;
+}